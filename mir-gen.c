@@ -145,6 +145,7 @@ struct gen_ctx {
   MIR_context_t ctx;
   unsigned optimize_level; /* 0:fast gen; 1:RA+combiner; 2: +GVN/CCP (default); >=3: everything  */
   MIR_item_t curr_func_item;
+  int keep_mir_p; /* the optimized func is kept as MIR (MIR_gen_optimize) */
 #if !MIR_NO_GEN_DEBUG
   FILE *debug_file;
   int debug_level;
@@ -172,6 +173,7 @@ struct gen_ctx {
 
 #define optimize_level gen_ctx->optimize_level
 #define curr_func_item gen_ctx->curr_func_item
+#define keep_mir_p gen_ctx->keep_mir_p
 #define debug_file gen_ctx->debug_file
 #define debug_level gen_ctx->debug_level
 #define insn_to_consider gen_ctx->insn_to_consider
@@ -1796,7 +1798,9 @@ static MIR_reg_t get_new_reg (gen_ctx_t gen_ctx, MIR_reg_t reg, size_t index) {
 
   VARR_TRUNC (char, reg_name, 0);
   VARR_PUSH_ARR (char, reg_name, name, strlen (name));
-  VARR_PUSH (char, reg_name, '@');
+  /* '@' can not be in MIR names, so it guarantees uniqueness.  Use '$' when the result
+     should be still valid MIR text: */
+  VARR_PUSH (char, reg_name, keep_mir_p ? '$' : '@');
   sprintf (ind_str, "%lu", (unsigned long) index); /* ??? should be enough to unique */
   VARR_PUSH_ARR (char, reg_name, ind_str, strlen (ind_str) + 1);
   new_reg = MIR_new_func_reg (ctx, func, type, VARR_ADDR (char, reg_name));
@@ -2101,7 +2105,8 @@ static void copy_prop (gen_ctx_t gen_ctx) {
         def_insn = se->def->insn;
         w2 = get_ext_params (def_insn->code, &sign2_p);
         if (w2 != 0 && sign_p == sign2_p && w2 <= w
-            && !bitmap_bit_p (temp_bitmap, def_insn->ops[1].u.reg)) {
+            && (def_insn->ops[1].mode != MIR_OP_REG
+                || !bitmap_bit_p (temp_bitmap, def_insn->ops[1].u.reg))) {
           DEBUG (2, {
             fprintf (debug_file, "    Change code of insn %lu: before",
                      (unsigned long) bb_insn->index);
@@ -2274,10 +2279,14 @@ static int gvn_insn_p (MIR_insn_t insn) {
           && insn->code != MIR_BSTART && insn->code != MIR_BEND && insn->code != MIR_VA_START
           && insn->code != MIR_VA_ARG && insn->code != MIR_VA_END
           && insn->code != MIR_PHI
-          /* After simplification we have only mem insn in form: mem = reg or reg = mem. */
-          && (!move_code_p (insn->code)
-              || (insn->ops[0].mode != MIR_OP_MEM && insn->ops[0].mode != MIR_OP_HARD_REG_MEM
-                  && insn->ops[1].mode != MIR_OP_MEM && insn->ops[1].mode != MIR_OP_HARD_REG_MEM)));
+          /* After simplification we have only mem insn in form: mem = reg or reg = mem.  Other
+             insns can still have mem operands for MIR_gen_optimize: */
+          && (insn->nops < 1
+              || (insn->ops[0].mode != MIR_OP_MEM && insn->ops[0].mode != MIR_OP_HARD_REG_MEM))
+          && (insn->nops < 2
+              || (insn->ops[1].mode != MIR_OP_MEM && insn->ops[1].mode != MIR_OP_HARD_REG_MEM))
+          && (insn->nops < 3
+              || (insn->ops[2].mode != MIR_OP_MEM && insn->ops[2].mode != MIR_OP_HARD_REG_MEM)));
 }
 
 #if !MIR_NO_GEN_DEBUG
@@ -5343,44 +5352,9 @@ static void parallel_error (MIR_context_t ctx, const char *err_message) {
   MIR_get_error_func (ctx) (MIR_parallel_error, err_message);
 }
 
-void *MIR_gen (MIR_context_t ctx, int gen_num, MIR_item_t func_item) {
-  struct all_gen_ctx *all_gen_ctx = *all_gen_ctx_loc (ctx);
-  gen_ctx_t gen_ctx;
-  uint8_t *code;
-  void *machine_code;
-  size_t code_len;
-  double start_time = real_usec_time ();
-
-#if !MIR_PARALLEL_GEN
-  gen_num = 0;
-#endif
-  gen_assert (gen_num >= 0 && gen_num < all_gen_ctx->gens_num);
-  gen_ctx = &all_gen_ctx->gen_ctx[gen_num];
-  gen_assert (func_item->item_type == MIR_func_item && func_item->data == NULL);
-  if (func_item->u.func->machine_code != NULL) {
-    gen_assert (func_item->u.func->call_addr != NULL);
-    _MIR_redirect_thunk (ctx, func_item->addr, func_item->u.func->call_addr);
-    DEBUG (2, {
-      fprintf (debug_file, "+++++++++++++The code for %s has been already generated\n",
-               MIR_item_name (ctx, func_item));
-    });
-    return func_item->addr;
-  }
-  DEBUG (0, {
-    fprintf (debug_file, "Code generation of function %s:\n", MIR_item_name (ctx, func_item));
-  });
-  DEBUG (2, {
-    fprintf (debug_file, "+++++++++++++MIR before generator:\n");
-    MIR_output_item (ctx, debug_file, func_item);
-  });
-  curr_func_item = func_item;
-  _MIR_duplicate_func_insns (ctx, func_item);
-  curr_cfg = func_item->data = gen_malloc (gen_ctx, sizeof (struct func_cfg));
-  build_func_cfg (gen_ctx);
-  DEBUG (2, {
-    fprintf (debug_file, "+++++++++++++MIR after building CFG:\n");
-    print_CFG (gen_ctx, TRUE, FALSE, TRUE, FALSE, NULL);
-  });
+/* Machine-independent optimizations: build SSA, do copy propagation, GVN, CCP, and dead code
+   elimination, and go out of SSA.  */
+static void ssa_optimize (gen_ctx_t gen_ctx) {
   if (optimize_level >= 2) {
     build_ssa (gen_ctx);
     DEBUG (2, {
@@ -5438,6 +5412,47 @@ void *MIR_gen (MIR_context_t ctx, int gen_num, MIR_item_t func_item) {
   }
 #endif /* #ifndef NO_CCP */
   if (optimize_level >= 2) undo_build_ssa (gen_ctx);
+}
+
+void *MIR_gen (MIR_context_t ctx, int gen_num, MIR_item_t func_item) {
+  struct all_gen_ctx *all_gen_ctx = *all_gen_ctx_loc (ctx);
+  gen_ctx_t gen_ctx;
+  uint8_t *code;
+  void *machine_code;
+  size_t code_len;
+  double start_time = real_usec_time ();
+
+#if !MIR_PARALLEL_GEN
+  gen_num = 0;
+#endif
+  gen_assert (gen_num >= 0 && gen_num < all_gen_ctx->gens_num);
+  gen_ctx = &all_gen_ctx->gen_ctx[gen_num];
+  gen_assert (func_item->item_type == MIR_func_item && func_item->data == NULL);
+  if (func_item->u.func->machine_code != NULL) {
+    gen_assert (func_item->u.func->call_addr != NULL);
+    _MIR_redirect_thunk (ctx, func_item->addr, func_item->u.func->call_addr);
+    DEBUG (2, {
+      fprintf (debug_file, "+++++++++++++The code for %s has been already generated\n",
+               MIR_item_name (ctx, func_item));
+    });
+    return func_item->addr;
+  }
+  DEBUG (0, {
+    fprintf (debug_file, "Code generation of function %s:\n", MIR_item_name (ctx, func_item));
+  });
+  DEBUG (2, {
+    fprintf (debug_file, "+++++++++++++MIR before generator:\n");
+    MIR_output_item (ctx, debug_file, func_item);
+  });
+  curr_func_item = func_item;
+  _MIR_duplicate_func_insns (ctx, func_item);
+  curr_cfg = func_item->data = gen_malloc (gen_ctx, sizeof (struct func_cfg));
+  build_func_cfg (gen_ctx);
+  DEBUG (2, {
+    fprintf (debug_file, "+++++++++++++MIR after building CFG:\n");
+    print_CFG (gen_ctx, TRUE, FALSE, TRUE, FALSE, NULL);
+  });
+  ssa_optimize (gen_ctx);
   make_io_dup_op_insns (gen_ctx);
   target_machinize (gen_ctx);
   DEBUG (2, {
@@ -5519,6 +5534,105 @@ void *MIR_gen (MIR_context_t ctx, int gen_num, MIR_item_t func_item) {
   return func_item->addr;
 }
 
+/* SSA keeps one def-use edge per operand, so a memory operand can have only one reg.  Compute
+   the addresses with two regs into temporaries: */
+static void split_mem_addrs (gen_ctx_t gen_ctx) {
+  MIR_context_t ctx = gen_ctx->ctx;
+  MIR_func_t func = curr_func_item->u.func;
+  MIR_insn_t insn;
+  MIR_op_t *op, ind_op, temp_op;
+  size_t i, nops;
+
+  for (insn = DLIST_HEAD (MIR_insn_t, func->insns); insn != NULL;
+       insn = DLIST_NEXT (MIR_insn_t, insn)) {
+    nops = MIR_insn_nops (ctx, insn);
+    for (i = 0; i < nops; i++) {
+      op = &insn->ops[i];
+      if (op->mode != MIR_OP_MEM || op->u.mem.base == 0 || op->u.mem.index == 0) continue;
+      if (op->u.mem.scale != 0) {
+        ind_op = MIR_new_reg_op (ctx, op->u.mem.index);
+        if (op->u.mem.scale != 1) {
+          temp_op = MIR_new_reg_op (ctx, _MIR_new_temp_reg (ctx, MIR_T_I64, func));
+          MIR_insert_insn_before (ctx, curr_func_item, insn,
+                                  MIR_new_insn (ctx, MIR_MUL, temp_op, ind_op,
+                                                MIR_new_int_op (ctx, op->u.mem.scale)));
+          ind_op = temp_op;
+        }
+        temp_op = MIR_new_reg_op (ctx, _MIR_new_temp_reg (ctx, MIR_T_I64, func));
+        MIR_insert_insn_before (ctx, curr_func_item, insn,
+                                MIR_new_insn (ctx, MIR_ADD, temp_op,
+                                              MIR_new_reg_op (ctx, op->u.mem.base), ind_op));
+        op->u.mem.base = temp_op.u.reg;
+      }
+      op->u.mem.index = 0;
+      op->u.mem.scale = 1;
+    }
+  }
+}
+
+/* The optimizations create operands without value modes; set them as MIR_finish_func does
+   because the interpreter uses them for variadic call args: */
+static void restore_value_modes (gen_ctx_t gen_ctx) {
+  MIR_context_t ctx = gen_ctx->ctx;
+  MIR_func_t func = curr_func_item->u.func;
+  MIR_insn_t insn;
+  MIR_op_t *op;
+  MIR_type_t type;
+  size_t i, nops;
+
+  for (insn = DLIST_HEAD (MIR_insn_t, func->insns); insn != NULL;
+       insn = DLIST_NEXT (MIR_insn_t, insn)) {
+    nops = MIR_insn_nops (ctx, insn);
+    for (i = 0; i < nops; i++) {
+      op = &insn->ops[i];
+      if (op->mode == MIR_OP_REG) {
+        type = MIR_reg_type (ctx, op->u.reg, func);
+        op->value_mode = (type == MIR_T_F    ? MIR_OP_FLOAT
+                          : type == MIR_T_D  ? MIR_OP_DOUBLE
+                          : type == MIR_T_LD ? MIR_OP_LDOUBLE
+                                             : MIR_OP_INT);
+      } else if (op->mode == MIR_OP_INT || op->mode == MIR_OP_UINT || op->mode == MIR_OP_FLOAT
+                 || op->mode == MIR_OP_DOUBLE || op->mode == MIR_OP_LDOUBLE) {
+        op->value_mode = op->mode;
+      }
+    }
+  }
+}
+
+void MIR_gen_optimize (MIR_context_t ctx, int gen_num, MIR_item_t func_item) {
+  struct all_gen_ctx *all_gen_ctx = *all_gen_ctx_loc (ctx);
+  gen_ctx_t gen_ctx;
+  double start_time = real_usec_time ();
+
+#if !MIR_PARALLEL_GEN
+  gen_num = 0;
+#endif
+  gen_assert (gen_num >= 0 && gen_num < all_gen_ctx->gens_num);
+  gen_ctx = &all_gen_ctx->gen_ctx[gen_num];
+  gen_assert (func_item->item_type == MIR_func_item && func_item->data == NULL);
+  if (optimize_level < 2) return;
+  DEBUG (2, {
+    fprintf (debug_file, "+++++++++++++MIR before optimization:\n");
+    MIR_output_item (ctx, debug_file, func_item);
+  });
+  /* Unlike MIR_gen, work on the original insns to keep the result: */
+  curr_func_item = func_item;
+  keep_mir_p = TRUE;
+  split_mem_addrs (gen_ctx);
+  curr_cfg = func_item->data = gen_malloc (gen_ctx, sizeof (struct func_cfg));
+  build_func_cfg (gen_ctx);
+  ssa_optimize (gen_ctx);
+  destroy_func_cfg (gen_ctx);
+  restore_value_modes (gen_ctx);
+  keep_mir_p = FALSE;
+  DEBUG (0, {
+    fprintf (debug_file, "  Optimization of %s: %lu MIR insns -- time %.2f ms\n",
+             MIR_item_name (ctx, func_item),
+             (long unsigned) DLIST_LENGTH (MIR_insn_t, func_item->u.func->insns),
+             (real_usec_time () - start_time) / 1000.0);
+  });
+}
+
 void MIR_gen_set_debug_file (MIR_context_t ctx, int gen_num, FILE *f) {
 #if !MIR_NO_GEN_DEBUG
   struct all_gen_ctx *all_gen_ctx = *all_gen_ctx_loc (ctx);
@@ -5665,6 +5779,7 @@ void MIR_gen_init (MIR_context_t ctx, int gens_num) {
 #endif
     gen_ctx->ctx = ctx;
     optimize_level = 2;
+    keep_mir_p = FALSE;
     gen_ctx->target_ctx = NULL;
     gen_ctx->data_flow_ctx = NULL;
     gen_ctx->gvn_ctx = NULL;
@@ -11,7 +11,23 @@ extern errno_t __errno;
 #define EDOM 33 /* Numerical argument out of domain */
 #define EILSEQ 84 /* Invalid or incomplete multibyte or wide character */
 #define ERANGE 34 /* Numerical result out of range*/
+#define EIO 5 /* Input/output error */
+#define EBADF 9 /* Bad file descriptor */
+#define EAGAIN 11 /* Resource temporarily unavailable */
+#define EWOULDBLOCK EAGAIN
 #define	ENOMEM 12 /* Not enough core */
+#define EPIPE 32 /* Broken pipe */
+#define ENOTSOCK 88 /* Socket operation on non-socket */
+#define ENOPROTOOPT 92 /* Protocol not available */
+#define EPROTONOSUPPORT 93 /* Protocol not supported */
+#define EAFNOSUPPORT 97 /* Address family not supported by protocol */
+#define EADDRINUSE 98 /* Address already in use */
+#define ECONNRESET 104 /* Connection reset by peer */
+#define EISCONN 106 /* Transport endpoint is already connected */
+#define ENOTCONN 107 /* Transport endpoint is not connected */
+#define ECONNREFUSED 111 /* Connection refused */
+#define EALREADY 114 /* Operation already in progress */
+#define EINPROGRESS 115 /* Operation now in progress */
 
 // Needed to build with libraries from Linux and Windows.
 #if defined(__unix__)
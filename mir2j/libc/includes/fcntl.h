@@ -0,0 +1,20 @@
+#ifndef fcntl_h
+#define fcntl_h
+
+#define O_RDONLY 0
+#define O_WRONLY 1
+#define O_RDWR 2
+#define O_NONBLOCK 04000
+
+#define F_GETFD 1
+#define F_SETFD 2
+#define F_GETFL 3
+#define F_SETFL 4
+
+/**
+ * Only F_GETFL and F_SETFL with O_NONBLOCK change anything, for sockets and
+ * pipes.
+ */
+int fcntl(int fd, int cmd, ...);
+
+#endif
@@ -1,10 +1,30 @@
 #ifndef	_NETINET_IN_H
 #define	_NETINET_IN_H
 
+#include "../stdint.h"
+#include "../sys/socket.h"
+
 typedef uint32_t in_addr_t;
+typedef uint16_t in_port_t;
+#define INADDR_ANY        ((in_addr_t) 0x00000000)
+#define INADDR_LOOPBACK   ((in_addr_t) 0x7F000001)
 #define INADDR_NONE       ((in_addr_t) 0xFFFFFFFF)
 
+#define IPPROTO_IP 0
+#define IPPROTO_TCP 6
+
 struct in_addr { in_addr_t s_addr; };
 
-#endif
+struct sockaddr_in {
+    sa_family_t sin_family;
+    in_port_t sin_port;         // In network byte order
+    struct in_addr sin_addr;    // In network byte order
+    unsigned char sin_zero[8];
+};
 
+uint32_t htonl(uint32_t hostlong);
+uint16_t htons(uint16_t hostshort);
+uint32_t ntohl(uint32_t netlong);
+uint16_t ntohs(uint16_t netshort);
+
+#endif
@@ -0,0 +1,6 @@
+#ifndef	_NETINET_TCP_H
+#define	_NETINET_TCP_H
+
+#define TCP_NODELAY 1
+
+#endif
@@ -0,0 +1,27 @@
+#ifndef poll_h
+#define poll_h
+
+struct pollfd {
+    int fd;
+    short events;
+    short revents;
+};
+
+typedef unsigned long nfds_t;
+
+#define POLLIN 0x001
+#define POLLPRI 0x002
+#define POLLOUT 0x004
+#define POLLERR 0x008
+#define POLLHUP 0x010
+#define POLLNVAL 0x020
+
+/**
+ * Wait until one of the nfds file descriptors is ready for the requested
+ * events, at most timeout milliseconds (forever if negative). Sockets and pipes
+ * are waited for with a NIO Selector, files are always ready, stdin is ready
+ * when it has input available.
+ */
+int poll(struct pollfd *fds, nfds_t nfds, int timeout);
+
+#endif
@@ -11,10 +11,8 @@ typedef struct _jmp_buf {
 } jmp_buf[1];
 
 #else
-// This is processor specific.
-typedef struct {
-	int dummy;
-} jmp_buf;
+// The token and the stack position stored by the setjmp of the mir2j runtime
+typedef long long jmp_buf[2];
 #endif
 
 int setjmp(jmp_buf env);
@@ -1,86 +1,132 @@
 #ifndef stdatomic_h
 #define stdatomic_h
 
-// TODO: stdatomic
-#if 0
-ATOMIC_BOOL_LOCK_FREE
-ATOMIC_CHAR_LOCK_FREE
-ATOMIC_CHAR16_T_LOCK_FREE
-ATOMIC_CHAR32_T_LOCK_FREE
-ATOMIC_WCHAR_T_LOCK_FREE
-ATOMIC_SHORT_LOCK_FREE
-ATOMIC_INT_LOCK_FREE
-ATOMIC_LONG_LOCK_FREE
-ATOMIC_LLONG_LOCK_FREE
-ATOMIC_POINTER_LOCK_FREE
-ATOMIC_FLAG_INIT
-memory_order
-atomic_flag
-memory_order_relaxed ∗
-memory_order_consume
-memory_order_acquire
-memory_order_release
-memory_order_acq_rel
-memory_order_seq_cst
-atomic_bool
-atomic_char
-atomic_schar
-atomic_uchar
-atomic_short
-atomic_ushort
-atomic_int
-atomic_uint
-atomic_long
-atomic_ulong
-atomic_llong
-atomic_ullong
-atomic_char16_t
-atomic_char32_t
-atomic_wchar_t
-atomic_int_least8_t
-atomic_uint_least8_t
-atomic_int_least16_t
-atomic_uint_least16_t
-atomic_int_least32_t
-atomic_uint_least32_t
-atomic_int_least64_t
-atomic_uint_least64_t
-atomic_int_fast8_t
-atomic_uint_fast8_t
-atomic_int_fast16_t
-atomic_uint_fast16_t
-atomic_int_fast32_t
-atomic_uint_fast32_t
-atomic_int_fast64_t
-atomic_uint_fast64_t
-atomic_intptr_t
-atomic_uintptr_t
-atomic_size_t
-atomic_ptrdiff_t
-atomic_intmax_t
-atomic_uintmax_t
-#define ATOMIC_VAR_INIT(C value)
-void atomic_init(volatile A *obj, C value);
-type kill_dependency(type y);
+#include "stddef.h"
+#include "stdint.h"
+
+// The atomic_* operations call the mir_atomic_* functions of the mir2j runtime,
+// which use VarHandle atomic accesses of the memory.  Operators on _Atomic
+// objects (x++, x = v...) are plain accesses: use the functions instead.
+// Only integer and pointer objects of 1, 2, 4 or 8 bytes are supported: the
+// value of an atomic pointer is a void *, and atomic_fetch_* on pointers do not
+// scale the operand.
+
+#define ATOMIC_BOOL_LOCK_FREE 2
+#define ATOMIC_CHAR_LOCK_FREE 2
+#define ATOMIC_CHAR16_T_LOCK_FREE 2
+#define ATOMIC_CHAR32_T_LOCK_FREE 2
+#define ATOMIC_WCHAR_T_LOCK_FREE 2
+#define ATOMIC_SHORT_LOCK_FREE 2
+#define ATOMIC_INT_LOCK_FREE 2
+#define ATOMIC_LONG_LOCK_FREE 2
+#define ATOMIC_LLONG_LOCK_FREE 2
+#define ATOMIC_POINTER_LOCK_FREE 2
+
+typedef enum {
+  memory_order_relaxed,
+  memory_order_consume,
+  memory_order_acquire,
+  memory_order_release,
+  memory_order_acq_rel,
+  memory_order_seq_cst
+} memory_order;
+
+typedef struct { int __v; } atomic_flag;
+#define ATOMIC_FLAG_INIT {0}
+
+typedef _Atomic _Bool atomic_bool;
+typedef _Atomic char atomic_char;
+typedef _Atomic signed char atomic_schar;
+typedef _Atomic unsigned char atomic_uchar;
+typedef _Atomic short atomic_short;
+typedef _Atomic unsigned short atomic_ushort;
+typedef _Atomic int atomic_int;
+typedef _Atomic unsigned int atomic_uint;
+typedef _Atomic long atomic_long;
+typedef _Atomic unsigned long atomic_ulong;
+typedef _Atomic long long atomic_llong;
+typedef _Atomic unsigned long long atomic_ullong;
+typedef _Atomic int_least8_t atomic_int_least8_t;
+typedef _Atomic uint_least8_t atomic_uint_least8_t;
+typedef _Atomic int_least16_t atomic_int_least16_t;
+typedef _Atomic uint_least16_t atomic_uint_least16_t;
+typedef _Atomic int_least32_t atomic_int_least32_t;
+typedef _Atomic uint_least32_t atomic_uint_least32_t;
+typedef _Atomic int_least64_t atomic_int_least64_t;
+typedef _Atomic uint_least64_t atomic_uint_least64_t;
+typedef _Atomic int_fast8_t atomic_int_fast8_t;
+typedef _Atomic uint_fast8_t atomic_uint_fast8_t;
+typedef _Atomic int_fast16_t atomic_int_fast16_t;
+typedef _Atomic uint_fast16_t atomic_uint_fast16_t;
+typedef _Atomic int_fast32_t atomic_int_fast32_t;
+typedef _Atomic uint_fast32_t atomic_uint_fast32_t;
+typedef _Atomic int_fast64_t atomic_int_fast64_t;
+typedef _Atomic uint_fast64_t atomic_uint_fast64_t;
+typedef _Atomic intptr_t atomic_intptr_t;
+typedef _Atomic uintptr_t atomic_uintptr_t;
+typedef _Atomic size_t atomic_size_t;
+typedef _Atomic ptrdiff_t atomic_ptrdiff_t;
+typedef _Atomic intmax_t atomic_intmax_t;
+typedef _Atomic uintmax_t atomic_uintmax_t;
+
+// Runtime primitives: size is the object size, op of mir_atomic_fetch_op is
+// 0 add, 1 sub, 2 or, 3 xor, 4 and
+long long mir_atomic_load(volatile void *obj, int size, int order);
+void mir_atomic_store(volatile void *obj, long long v, int size, int order);
+long long mir_atomic_exchange(volatile void *obj, long long v, int size, int order);
+_Bool mir_atomic_compare_exchange(volatile void *obj, void *expected, long long desired, int size, int success,
+                                  int failure);
+long long mir_atomic_fetch_op(volatile void *obj, long long v, int size, int op, int order);
 void atomic_thread_fence(memory_order order);
 void atomic_signal_fence(memory_order order);
-_Bool atomic_is_lock_free(const volatile A *obj);
-void atomic_store(volatile A *object, C desired);
-void atomic_store_explicit(volatile A *object, C desired, memory_order order);
-C atomic_load(volatile A *object);
-C atomic_load_explicit(volatile A *object, memory_order order);
-C atomic_exchange(volatile A *object, C desired);
-C atomic_exchange_explicit(volatile A *object, C desired, memory_order order);
-_Bool atomic_compare_exchange_strong(volatile A *object, C *expected, C desired);
-_Bool atomic_compare_exchange_strong_explicit(volatile A *object, C *expected, C desired, memory_order success, memory_order failure);
-_Bool atomic_compare_exchange_weak(volatile A *object, C *expected, C desired);
-_Bool atomic_compare_exchange_weak_explicit(volatile A *object, C *expected, C desired, memory_order success, memory_order failure);
-C atomic_fetch_key(volatile A *object, M operand);
-C atomic_fetch_key_explicit(volatile A *object,M operand, memory_order order);
-_Bool atomic_flag_test_and_set(volatile atomic_flag *object);
-_Bool atomic_flag_test_and_set_explicit(volatile atomic_flag *object, memory_order order);
-void atomic_flag_clear(volatile atomic_flag *object);
-void atomic_flag_clear_explicit(volatile atomic_flag *object, memory_order order);
-#endif
+
+#define ATOMIC_VAR_INIT(value) (value)
+#define atomic_init(obj, value) ((void) (*(obj) = (value)))
+#define kill_dependency(y) (y)
+#define atomic_is_lock_free(obj) ((void) (obj), 1)
+
+// The runtime returns the raw bits: convert them to the type of *obj
+#define __mir_atomic_value(obj, v)                                                                  \
+  _Generic ((obj), _Bool *: (_Bool) (v), char *: (char) (v), signed char *: (signed char) (v),      \
+            unsigned char *: (unsigned char) (v), short *: (short) (v),                             \
+            unsigned short *: (unsigned short) (v), int *: (int) (v), unsigned int *: (unsigned) (v), \
+            long *: (long) (v), unsigned long *: (unsigned long) (v), long long *: (long long) (v),  \
+            unsigned long long *: (unsigned long long) (v), default: (void *) (v))
+
+#define __mir_atomic_fetch(obj, v, op, order) \
+  __mir_atomic_value (obj, mir_atomic_fetch_op ((void *) (obj), (long long) (v), sizeof (*(obj)), op, order))
+
+#define atomic_store_explicit(obj, desired, order) \
+  mir_atomic_store ((void *) (obj), (long long) (desired), sizeof (*(obj)), order)
+#define atomic_store(obj, desired) atomic_store_explicit (obj, desired, memory_order_seq_cst)
+#define atomic_load_explicit(obj, order) \
+  __mir_atomic_value (obj, mir_atomic_load ((void *) (obj), sizeof (*(obj)), order))
+#define atomic_load(obj) atomic_load_explicit (obj, memory_order_seq_cst)
+#define atomic_exchange_explicit(obj, desired, order) \
+  __mir_atomic_value (obj, mir_atomic_exchange ((void *) (obj), (long long) (desired), sizeof (*(obj)), order))
+#define atomic_exchange(obj, desired) atomic_exchange_explicit (obj, desired, memory_order_seq_cst)
+#define atomic_compare_exchange_strong_explicit(obj, expected, desired, success, failure)         \
+  mir_atomic_compare_exchange ((void *) (obj), (void *) (expected), (long long) (desired), \
+                               sizeof (*(obj)), success, failure)
+#define atomic_compare_exchange_strong(obj, expected, desired) \
+  atomic_compare_exchange_strong_explicit (obj, expected, desired, memory_order_seq_cst, memory_order_seq_cst)
+#define atomic_compare_exchange_weak_explicit atomic_compare_exchange_strong_explicit
+#define atomic_compare_exchange_weak atomic_compare_exchange_strong
+#define atomic_fetch_add_explicit(obj, v, order) __mir_atomic_fetch (obj, v, 0, order)
+#define atomic_fetch_add(obj, v) __mir_atomic_fetch (obj, v, 0, memory_order_seq_cst)
+#define atomic_fetch_sub_explicit(obj, v, order) __mir_atomic_fetch (obj, v, 1, order)
+#define atomic_fetch_sub(obj, v) __mir_atomic_fetch (obj, v, 1, memory_order_seq_cst)
+#define atomic_fetch_or_explicit(obj, v, order) __mir_atomic_fetch (obj, v, 2, order)
+#define atomic_fetch_or(obj, v) __mir_atomic_fetch (obj, v, 2, memory_order_seq_cst)
+#define atomic_fetch_xor_explicit(obj, v, order) __mir_atomic_fetch (obj, v, 3, order)
+#define atomic_fetch_xor(obj, v) __mir_atomic_fetch (obj, v, 3, memory_order_seq_cst)
+#define atomic_fetch_and_explicit(obj, v, order) __mir_atomic_fetch (obj, v, 4, order)
+#define atomic_fetch_and(obj, v) __mir_atomic_fetch (obj, v, 4, memory_order_seq_cst)
+
+#define atomic_flag_test_and_set_explicit(obj, order) \
+  ((_Bool) mir_atomic_exchange (&(obj)->__v, 1, sizeof (int), order))
+#define atomic_flag_test_and_set(obj) atomic_flag_test_and_set_explicit (obj, memory_order_seq_cst)
+#define atomic_flag_clear_explicit(obj, order) mir_atomic_store (&(obj)->__v, 0, sizeof (int), order)
+#define atomic_flag_clear(obj) atomic_flag_clear_explicit (obj, memory_order_seq_cst)
 
 #endif
@@ -30,12 +30,14 @@ typedef int64_t fpos_t;
 #define TMP_MAX 32
 #define FOPEN_MAX 32
 #define FILENAME_MAX 256
-#define BUFSIZ 256
+#define BUFSIZ 4096
+
+/* Buffering modes, see setvbuf */
+#define _IOFBF 0
+#define _IOLBF 1
+#define _IONBF 2
 
 /*
-_IOFBF
-_IOLBF
-_IONBF
 L_tmpnam
 */
 
@@ -133,6 +135,12 @@ void clearerr(FILE *stream);
 int feof(FILE *stream);
 
 int ferror(FILE *stream);
+
+/**
+ * Return the file descriptor of the given stream, for mmap.
+ */
+int fileno(FILE *stream);
+
 void setbuf(FILE * restrict stream, char * restrict buf);
 int setvbuf(FILE * restrict stream, char * restrict buf, int mode, size_t size);
 
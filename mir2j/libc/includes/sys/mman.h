@@ -0,0 +1,42 @@
+#ifndef _SYS_MMAN_H
+#define	_SYS_MMAN_H
+
+#include "../stddef.h"
+
+typedef long off_t;
+
+#define PROT_NONE 0
+#define PROT_READ 1
+#define PROT_WRITE 2
+#define PROT_EXEC 4
+
+#define MAP_SHARED 0x01
+#define MAP_PRIVATE 0x02
+#define MAP_FIXED 0x10
+#define MAP_ANONYMOUS 0x20
+#define MAP_ANON MAP_ANONYMOUS
+
+#define MAP_FAILED ((void *) -1)
+
+#define MS_ASYNC 1
+#define MS_INVALIDATE 2
+#define MS_SYNC 4
+
+/**
+ * Map length bytes of the file fd from offset (or zeroed memory with
+ * MAP_ANONYMOUS). The runtime copies the file region into memory it chooses,
+ * so addr is only a hint and MAP_FIXED is not supported. Changes to a
+ * MAP_SHARED and PROT_WRITE mapping are written to the file by msync and
+ * munmap. The whole region is copied into the heap (16 MB by default, see
+ * the mir2j.heapSize property), so mapping a large file fails with ENOMEM.
+ */
+void *mmap(void *addr, size_t length, int prot, int flags, int fd, off_t offset);
+
+/**
+ * Unmap a whole mapping, addr must be an address returned by mmap.
+ */
+int munmap(void *addr, size_t length);
+
+int msync(void *addr, size_t length, int flags);
+
+#endif
@@ -0,0 +1,63 @@
+#ifndef _SYS_SOCKET_H
+#define	_SYS_SOCKET_H
+
+#include "../stddef.h"
+
+#ifndef _SSIZE_T_DEFINED
+#define _SSIZE_T_DEFINED
+typedef long ssize_t;
+#endif
+
+typedef unsigned int socklen_t;
+typedef unsigned short sa_family_t;
+
+struct sockaddr {
+    sa_family_t sa_family;
+    char sa_data[14];
+};
+
+#define AF_UNSPEC 0
+#define AF_INET 2
+#define PF_INET AF_INET
+
+#define SOCK_STREAM 1
+#define SOCK_NONBLOCK 04000
+
+#define SOL_SOCKET 1
+#define SO_REUSEADDR 2
+#define SO_TYPE 3
+#define SO_ERROR 4
+#define SO_KEEPALIVE 9
+
+#define SOMAXCONN 128
+
+#define MSG_NOSIGNAL 0x4000
+
+#define SHUT_RD 0
+#define SHUT_WR 1
+#define SHUT_RDWR 2
+
+/**
+ * Create a TCP/IPv4 socket (AF_INET and SOCK_STREAM, optionally with
+ * SOCK_NONBLOCK). The runtime backs it with NIO channels, poll() multiplexes
+ * them.
+ */
+int socket(int domain, int type, int protocol);
+int bind(int sockfd, const struct sockaddr *addr, socklen_t addrlen);
+int listen(int sockfd, int backlog);
+int accept(int sockfd, struct sockaddr * restrict addr, socklen_t * restrict addrlen);
+int connect(int sockfd, const struct sockaddr *addr, socklen_t addrlen);
+int getsockname(int sockfd, struct sockaddr * restrict addr, socklen_t * restrict addrlen);
+int getpeername(int sockfd, struct sockaddr * restrict addr, socklen_t * restrict addrlen);
+int setsockopt(int sockfd, int level, int optname, const void *optval, socklen_t optlen);
+int getsockopt(int sockfd, int level, int optname, void * restrict optval, socklen_t * restrict optlen);
+int shutdown(int sockfd, int how);
+
+/**
+ * Like read() and write(), flags must be 0 or MSG_NOSIGNAL (there are no
+ * signals).
+ */
+ssize_t send(int sockfd, const void *buf, size_t len, int flags);
+ssize_t recv(int sockfd, void *buf, size_t len, int flags);
+
+#endif
@@ -1,24 +1,27 @@
 #ifndef threads_h
 #define threads_h
 
-thread_local
-ONCE_FLAG_INIT
-TSS_DTOR_ITERATIONS
-cnd_t
-thrd_t
-tss_t
-mtx_t
-tss_dtor_t
-thrd_start_t
-once_flag
-mtx_plain ∗
-mtx_recursive
-mtx_timed
-thrd_timedout
-thrd_success
-thrd_busy
-thrd_error
-thrd_nomem
+#include "time.h"
+
+// C11 threads of the mir2j runtime: each thread is a Java thread with its own
+// stack in the shared memory.  thread_local is not defined as _Thread_local
+// objects would be shared by all threads: use tss_* instead.
+
+#define ONCE_FLAG_INIT {0}
+#define TSS_DTOR_ITERATIONS 4
+
+// Threads, mutexes, condition variables and tss keys are handles of Java objects
+typedef unsigned long thrd_t;
+typedef struct { int __handle; } mtx_t;
+typedef struct { int __handle; } cnd_t;
+typedef unsigned int tss_t;
+typedef struct { int __done; } once_flag;
+typedef int (*thrd_start_t)(void *);
+typedef void (*tss_dtor_t)(void *);
+
+enum { mtx_plain = 0, mtx_recursive = 1, mtx_timed = 2 };
+enum { thrd_success = 0, thrd_busy = 1, thrd_error = 2, thrd_nomem = 3, thrd_timedout = 4 };
+
 void call_once(once_flag *flag, void (*func)(void));
 int cnd_broadcast(cnd_t *cond);
 void cnd_destroy(cnd_t *cond);
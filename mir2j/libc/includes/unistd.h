@@ -0,0 +1,29 @@
+#ifndef unistd_h
+#define unistd_h
+
+#include "stddef.h"
+
+#ifndef _SSIZE_T_DEFINED
+#define _SSIZE_T_DEFINED
+typedef long ssize_t;
+#endif
+
+#define STDIN_FILENO 0
+#define STDOUT_FILENO 1
+#define STDERR_FILENO 2
+
+/**
+ * Read at most count bytes from a file, stdin, a socket or a pipe. Returns the
+ * number of bytes read, 0 at end of file, or -1 and sets errno (EAGAIN when a
+ * non-blocking socket or pipe has no data).
+ */
+ssize_t read(int fd, void *buf, size_t count);
+ssize_t write(int fd, const void *buf, size_t count);
+int close(int fd);
+
+/**
+ * Create a pipe, fds[0] is its read end and fds[1] its write end.
+ */
+int pipe(int fds[2]);
+
+#endif
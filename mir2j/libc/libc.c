@@ -40,8 +40,16 @@ SOFTWARE.
 #include <time.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
 #include <stdnoreturn.h> /* for _Noreturn */
 
+/// Marks this module as the bundled libc: m2j replaces its string and memory
+/// functions with the Runtime intrinsics.
+const char __mir2j_libc = 1;
 
 //********************************************************************************
 // System call interface for C library
@@ -56,6 +64,21 @@ noreturn void mir_sys_exit(int status);
 struct __sysio_FILE {
     int fd;
     int error;
+    int eof;
+
+    // Stream buffer, see setvbuf. It holds either the output not written yet,
+    // buffer[0, writeLength), or the input not read yet,
+    // buffer[readPosition, readLength).
+    int bufferMode;
+    char *buffer;
+    size_t bufferSize;
+    size_t writeLength;
+    size_t readPosition;
+    size_t readLength;
+    bool ownsBuffer;
+
+    // Next open stream, see fflush(NULL).
+    struct __sysio_FILE *next;
 
     // Used when outputting to a string.
     char *stringBuffer;
@@ -64,9 +87,11 @@ struct __sysio_FILE {
     int charCount;
 };
 
-static struct __sysio_FILE __stdin  = { .fd = 0, .error = 0, .stringBuffer = NULL, .stringBufferLength = 0, .stringBufferCapacity = 0, .charCount = 0 };
-static struct __sysio_FILE __stdout = { .fd = 1, .error = 0, .stringBuffer = NULL, .stringBufferLength = 0, .stringBufferCapacity = 0, .charCount = 0 };
-static struct __sysio_FILE __stderr = { .fd = 2, .error = 0, .stringBuffer = NULL, .stringBufferLength = 0, .stringBufferCapacity = 0, .charCount = 0 };
+static struct __sysio_FILE __stderr = { .fd = 2, .bufferMode = _IONBF, .next = NULL };
+static struct __sysio_FILE __stdout = { .fd = 1, .bufferMode = _IOLBF, .next = &__stderr };
+static struct __sysio_FILE __stdin  = { .fd = 0, .bufferMode = _IOFBF, .next = &__stdout };
+
+static FILE *openStreams = &__stdin;
 
 FILE* const stdin  = &__stdin;
 FILE* const stdout = &__stdout;
@@ -96,6 +121,34 @@ int   mir_sysio_feof(int fd);
  */
 int mir_sysclock_gettime(clockid_t clk, struct timespec *ts);
 
+/**
+ * @param length the byte count
+ * @param prot the PROT_ flags
+ * @param flags the MAP_ flags
+ * @param fd the mapped file, ignored with MAP_ANONYMOUS
+ * @param offset the offset in the file
+ * @return the address of the mapping, or `-errno`
+ */
+long mir_sysio_mmap(unsigned long length, int prot, int flags, int fd, long offset);
+int  mir_sysio_munmap(void *addr, unsigned long length);
+int  mir_sysio_msync(void *addr, unsigned long length, int flags);
+
+/**
+ * The socket, pipe and poll functions below return their result, or `-errno`.
+ */
+int mir_sysio_socket(int domain, int type, int protocol);
+int mir_sysio_bind(int fd, const struct sockaddr *addr, socklen_t addrlen);
+int mir_sysio_listen(int fd, int backlog);
+int mir_sysio_accept(int fd, struct sockaddr *addr, socklen_t *addrlen);
+int mir_sysio_connect(int fd, const struct sockaddr *addr, socklen_t addrlen);
+int mir_sysio_getsockname(int fd, struct sockaddr *addr, socklen_t *addrlen, int peer);
+int mir_sysio_setsockopt(int fd, int level, int name, const void *value, socklen_t length);
+int mir_sysio_getsockopt(int fd, int level, int name, void *value, socklen_t *length);
+int mir_sysio_shutdown(int fd, int how);
+int mir_sysio_pipe(int *fds);
+int mir_sysio_fcntl(int fd, int cmd, int arg);
+int mir_sysio_poll(struct pollfd *fds, unsigned long nfds, int timeout);
+
 
 //********************************************************************************
 // assert.h
@@ -339,27 +392,7 @@ intmax_t imaxabs(intmax_t j) {
 	// return data;
 // }
 
-void* memchr(const void *s, int c, size_t n) {
-	const unsigned char *p = (const unsigned char *)s;
-	while (n--) {
-		if (*p == (unsigned char)c)
-			return (void *)p;
-		++p;
-	}
-	return NULL;
-}
-
-int memcmp(const void *s1, const void *s2, size_t n) {
-	const unsigned char *p1 = (const unsigned char *)s1;
-	const unsigned char *p2 = (const unsigned char *)s2;
-	while (n--) {
-		if (*p1 != *p2)
-			return *p1 - *p2;
-		++p1;
-		++p2;
-	}
-	return 0;
-}
+// memchr, memcmp, memmove, strcat, strchr, strcmp and strncmp are Runtime intrinsics.
 
 /*
 void* memcpy(void * restrict s1, const void * restrict s2, size_t n) {
@@ -371,21 +404,6 @@ void* memcpy(void * restrict s1, const void * restrict s2, size_t n) {
 }
 */
 
-void* memmove(void *s1, const void *s2, size_t n) {
-	char *dest = (char *)s1;
-	const char *src = (const char *)s2;
-	if (dest <= src) {
-		while (n--)
-			*dest++ = *src++;
-	} else {
-		src += n;
-		dest += n;
-		while (n--)
-			*--dest = *--src;
-	}
-	return s1;
-}
-
 // void* memset(void *s, int c, size_t n) {
 	// unsigned char *p = (unsigned char *)s;
 	// while (n--)
@@ -393,30 +411,6 @@ void* memmove(void *s1, const void *s2, size_t n) {
 	// return s;
 // }
 
-char* strcat(char * restrict s1, const char * restrict s2) {
-	char *rc = s1;
-	if (*s1) {
-		while (*++s1) ;
-	}
-	while ((*s1++ = *s2++)) ;
-	return rc;
-}
-
-char* strchr(const char *s, const int c) {
-	while (*s != '\0' && *s != (char)c)
-		s++;
-	return (*s != '\0' || c == '\0') ? (char *)s : NULL;
-}
-
-int strcmp(const char * const s1, const char * const s2) {
-	const unsigned char *p1 = (unsigned char *)s1;
-	const unsigned char *p2 = (unsigned char *)s2;
-	while (*p1 != '\0' && *p1 == *p2) {
-		p1++, p2++;
-	}
-	return *p1 - *p2;
-}
-
 int strcoll(const char * const s1, const char * const s2) {
 	return strcmp(s1, s2);
 }
@@ -475,18 +469,6 @@ char* strncat(char * restrict s1, const char * restrict s2, size_t n) {
 	return rc;
 }
 
-int strncmp(const char *s1, const char *s2, size_t n) {
-	while (*s1 && n && (*s1 == *s2)) {
-		++s1;
-		++s2;
-		--n;
-	}
-	if (n == 0)
-		return 0;
-	else
-		return (*(unsigned char *)s1 - *(unsigned char *)s2);
-}
-
 char* strncpy(char * restrict s1, const char * restrict s2, size_t n) {
 	char *rc = s1;
 	while ((n > 0) && (*s1++ = *s2++)) {
@@ -630,6 +612,130 @@ size_t strxfrm(char * restrict s1, const char * restrict s2, size_t n) {
 //********************************************************************************
 // stdio.h
 //********************************************************************************
+/* Gives stream its buffer on first use, or makes it unbuffered if that fails */
+static bool hasBuffer(FILE *stream) {
+    if (stream->bufferMode == _IONBF)
+        return false;
+    if (stream->buffer == NULL) {
+        size_t size = stream->bufferSize > 0 ? stream->bufferSize : BUFSIZ;
+        stream->buffer = malloc(size);
+        if (stream->buffer == NULL) {
+            stream->bufferMode = _IONBF;
+            return false;
+        }
+        stream->bufferSize = size;
+        stream->ownsBuffer = true;
+    }
+    return true;
+}
+
+/* Writes the count bytes at s to the file of stream, whatever its buffering */
+static int writeFully(FILE *stream, const char *s, size_t count) {
+    while (count > 0) {
+        long rc = mir_sysio_write(stream->fd, s, count);
+        if (rc <= 0) {
+            errno = rc < 0 ? -(int)rc : EIO;
+            stream->error = 1;
+            return EOF;
+        }
+        s += rc;
+        count -= rc;
+    }
+    return 0;
+}
+
+/* Writes the buffered output of stream */
+static int flushOutput(FILE *stream) {
+    size_t length = stream->writeLength;
+    stream->writeLength = 0;
+    return length > 0 ? writeFully(stream, stream->buffer, length) : 0;
+}
+
+/* Drops the buffered input of stream, moving its file position back to the first byte not read */
+static void dropInput(FILE *stream) {
+    size_t unread = stream->readLength - stream->readPosition;
+    stream->readPosition = stream->readLength = 0;
+    if (unread > 0)
+        mir_sysio_seek(stream->fd, -(long)unread, SEEK_CUR);
+}
+
+/*
+ * Outputs count bytes to stream: they are buffered until the buffer is full,
+ * until a newline for a line buffered stream, or until fflush. Writes larger
+ * than the buffer go directly to the file.
+ */
+static int outputBytes(FILE *stream, const char *s, size_t count) {
+    if (stream->readLength > 0)
+        dropInput(stream);
+    if (!hasBuffer(stream))
+        return writeFully(stream, s, count);
+    if (count > stream->bufferSize - stream->writeLength) {
+        if (flushOutput(stream) == EOF)
+            return EOF;
+        if (count >= stream->bufferSize)
+            return writeFully(stream, s, count);
+    }
+    memcpy(stream->buffer + stream->writeLength, s, count);
+    stream->writeLength += count;
+    if (stream->bufferMode == _IOLBF && memchr(s, '\n', count) != NULL)
+        return flushOutput(stream);
+    return 0;
+}
+
+/* Reads at most count bytes from the file of stream, updating its indicators */
+static long readBytes(FILE *stream, void *ptr, size_t count) {
+    long rc = mir_sysio_read(stream->fd, ptr, count);
+    if (rc < 0) {
+        errno = -(int)rc;
+        stream->error = 1;
+        return EOF;
+    }
+    if (rc == 0)
+        stream->eof = 1;
+    return rc;
+}
+
+/*
+ * Inputs count bytes from stream, less at end of file or on error. The buffer
+ * is refilled with as many bytes as the file gives, reads larger than the
+ * buffer go directly to ptr.
+ */
+static size_t inputBytes(FILE *stream, char *ptr, size_t count) {
+    if (stream == stdin && __stdout.writeLength > 0)
+        flushOutput(stdout); // Show the prompt before waiting for input
+    if (flushOutput(stream) == EOF)
+        return 0;
+    size_t done = 0;
+    while (done < count) {
+        size_t available = stream->readLength - stream->readPosition;
+        if (available > 0) {
+            size_t n = available < count - done ? available : count - done;
+            memcpy(ptr + done, stream->buffer + stream->readPosition, n);
+            stream->readPosition += n;
+            done += n;
+        } else if (!hasBuffer(stream) || count - done >= stream->bufferSize) {
+            long rc = readBytes(stream, ptr + done, count - done);
+            if (rc <= 0)
+                break;
+            done += rc;
+        } else {
+            long rc = readBytes(stream, stream->buffer, stream->bufferSize);
+            if (rc <= 0)
+                break;
+            stream->readPosition = 0;
+            stream->readLength = rc;
+        }
+    }
+    return done;
+}
+
+static int inputChar(FILE *stream) {
+    if (stream->readPosition < stream->readLength)
+        return (unsigned char) stream->buffer[stream->readPosition++];
+    unsigned char c;
+    return inputBytes(stream, (char *) &c, 1) == 1 ? c : EOF;
+}
+
 static int outputBuffer(FILE * restrict stream, const char *s, int length) {
     if (stream->fd < 0) {
         while (length != 0) {
@@ -647,11 +753,7 @@ static int outputBuffer(FILE * restrict stream, const char *s, int length) {
     } else {
         if (length < 0)
             length = strlen(s);
-        long rc = mir_sysio_write(stream->fd, s, length);
-        if (rc < 0) {
-            errno = -((int)rc);
-            return EOF;
-        }
+        return outputBytes(stream, s, length);
     }
     return 0;
 }
@@ -680,61 +782,95 @@ FILE* fopen(const char *filename, const char *mode) {
     FILE *stream = (FILE*)calloc(1, sizeof(FILE));
     if (!stream) { mir_sysio_close_fd(fd); errno = ENOMEM; return NULL; }
     stream->fd = fd;
+    stream->bufferMode = _IOFBF;
+    stream->next = openStreams;
+    openStreams = stream;
     return stream;
 }
 
 FILE* freopen(const char *restrict filename, const char *restrict mode, FILE *restrict stream) {
     if (!stream) return fopen(filename, mode);
+    flushOutput(stream);
     int fd = mir_sysio_open(filename, mode);
     if (fd < 0) { errno = -fd; return NULL; }
     if (stream->fd >= 0) mir_sysio_close_fd(stream->fd);
     stream->fd = fd;
     stream->error = 0;
+    stream->eof = 0;
+    stream->readPosition = stream->readLength = 0;
     return stream;
 }
 
 int fclose(FILE *stream) {
     if (!stream) { errno = EINVAL; return EOF; }
+    int flushed = flushOutput(stream);
     int rc = mir_sysio_close_fd(stream->fd);
-    free(stream);
+    FILE **link = &openStreams;
+    while (*link != NULL && *link != stream)
+        link = &(*link)->next;
+    if (*link != NULL)
+        *link = stream->next;
+    if (stream->ownsBuffer) {
+        free(stream->buffer);
+        stream->buffer = NULL;
+        stream->ownsBuffer = false;
+    }
+    if (stream != stdin && stream != stdout && stream != stderr)
+        free(stream);
     if (rc < 0) { errno = -rc; return EOF; }
-    return 0;
+    return flushed;
 }
 
 size_t fread(void *ptr, size_t size, size_t nmemb, FILE *stream) {
     if (!stream || !ptr) { errno = EINVAL; return 0; }
-    unsigned long want = size * nmemb;
-    long rc = mir_sysio_read(stream->fd, ptr, want);
-    if (rc < 0) { errno = -rc; return 0; }
-    return (size_t)(rc / (long)size);
+    if (size == 0) return 0;
+    return inputBytes(stream, ptr, size * nmemb) / size;
 }
 
 size_t fwrite(const void *ptr, size_t size, size_t nmemb, FILE *stream) {
     if (!stream || !ptr) { errno = EINVAL; return 0; }
-    unsigned long want = size * nmemb;
-    long rc = mir_sysio_write(stream->fd, ptr, want);
-    if (rc < 0) { errno = -rc; return 0; }
-    return (size_t)(rc / (long)size);
+    if (size == 0) return 0;
+    if (outputBytes(stream, ptr, size * nmemb) == EOF) return 0;
+    return nmemb;
 }
 
 int feof(FILE *stream) {
     if (!stream) { errno = EINVAL; return 0; }
-    int rc = mir_sysio_feof(stream->fd);
-    if (rc < 0) { errno = -rc; return 0; }
-    return rc;
+    return stream->eof;
+}
+
+int ferror(FILE *stream) {
+    if (!stream) { errno = EINVAL; return 0; }
+    return stream->error;
+}
+
+int fileno(FILE *stream) {
+    if (!stream || stream->fd < 0) { errno = EINVAL; return -1; }
+    return stream->fd;
+}
+
+void clearerr(FILE *stream) {
+    if (!stream) { errno = EINVAL; return; }
+    stream->eof = 0;
+    stream->error = 0;
 }
 
 long int ftell(FILE *stream) {
     if (!stream) { errno = EINVAL; return -1L; }
     long rc = mir_sysio_tell(stream->fd);
     if (rc < 0) { errno = -rc; return -1L; }
-    return rc;
+    return rc - (long)(stream->readLength - stream->readPosition) + (long)stream->writeLength;
 }
 
 int fseek(FILE *stream, long int offset, int whence) {
     if (!stream) { errno = EINVAL; return -1; }
+    if (flushOutput(stream) == EOF) return -1;
+    if (whence == SEEK_CUR)
+        offset -= (long)(stream->readLength - stream->readPosition);
+    stream->readPosition = stream->readLength = 0;
     long rc = mir_sysio_seek(stream->fd, offset, whence);
     if (rc < 0) { errno = -rc; return -1; }
+    stream->eof = 0;
     return 0;
 }
 
@@ -742,10 +878,8 @@ char *fgets(char *restrict s, int n, FILE *restrict stream) {
     if (!stream || !s || n <= 1) { errno = EINVAL; return NULL; }
     int i = 0;
     while (i < n - 1) {
-        char ch;
-        long rc = mir_sysio_read(stream->fd, &ch, 1);
-        if (rc < 0) { errno = -rc; return (i > 0) ? s : NULL; }
-        if (rc == 0) break; /* EOF */
+        int ch = inputChar(stream);
+        if (ch == EOF) break;
         s[i++] = ch;
         if (ch == '\n') break;
     }
@@ -756,36 +890,50 @@ char *fgets(char *restrict s, int n, FILE *restrict stream) {
 
 int fputs(const char *s, FILE *stream) {
     if (!stream || !s) { errno = EINVAL; return EOF; }
-    long rc = mir_sysio_write(stream->fd, s, strlen(s));
-    if (rc < 0) { errno = -rc; return EOF; }
-    return (int)rc;
+    size_t length = strlen(s);
+    if (outputBytes(stream, s, length) == EOF) return EOF;
+    return (int)length;
 }
 
 int fputc(int ch, FILE *stream) {
     unsigned char c = (unsigned char)ch;
-    long rc = mir_sysio_write(stream->fd, &c, 1);
-    if (rc < 0) { errno = -rc; return EOF; }
+    if (outputBytes(stream, (const char *) &c, 1) == EOF) return EOF;
     return c;
 }
 
 int fgetc(FILE *stream) {
     if (!stream) { errno = EINVAL; return EOF; }
-    unsigned char ch = 0;
-    long rc = mir_sysio_read(stream->fd, &ch, 1);
-    if (rc < 0) { errno = (int)-rc; return EOF; }  // backend error
-    if (rc == 0) return EOF;                       // EOF
-    return (int)ch;
+    return inputChar(stream);
 }
 
 int fflush(FILE *stream) {
-    /* No stdio buffering layer is implemented:
-       - outputBuffer() writes directly via mir_sysio_write()
-       - Java backend flushes stdout/stderr itself
-       Therefore there is nothing to flush here. */
-    (void)stream;
+    if (stream != NULL)
+        return flushOutput(stream);
+    int rc = 0;
+    for (FILE *s = openStreams; s != NULL; s = s->next)
+        if (flushOutput(s) == EOF)
+            rc = EOF;
+    return rc;
+}
+
+int setvbuf(FILE * restrict stream, char * restrict buf, int mode, size_t size) {
+    if (!stream || (mode != _IOFBF && mode != _IOLBF && mode != _IONBF)) { errno = EINVAL; return EOF; }
+    if (flushOutput(stream) == EOF) return EOF;
+    if (stream->ownsBuffer)
+        free(stream->buffer);
+    // Without buf, a buffer of size bytes is allocated on first use
+    stream->buffer = mode != _IONBF && size > 0 ? buf : NULL;
+    stream->bufferSize = mode != _IONBF ? size : 0;
+    stream->ownsBuffer = false;
+    stream->readPosition = stream->readLength = 0;
+    stream->bufferMode = mode;
     return 0;
 }
 
+void setbuf(FILE * restrict stream, char * restrict buf) {
+    setvbuf(stream, buf, buf != NULL ? _IOFBF : _IONBF, BUFSIZ);
+}
+
 int sscanf(const char * restrict s, const char * restrict format, ...) {
     return EOF;
 }
@@ -1450,16 +1598,17 @@ int fprintf(FILE *stream, const char *format, ...) {
 // stdlib.h
 //********************************************************************************
 
+void exit(int status) {
+	fflush(NULL);
+	mir_sys_exit(status);
+}
+
 /*
 _Noreturn void _Exit(int status) {
 	mir_sys_exit(status);
     //while (1) ;
 }
 
-void exit(int status) {
-	_Exit(status);
-}
-
 void quick_exit(int status) {
 	_Exit(status);
 }
@@ -1877,12 +2026,156 @@ int nanosleep (const struct timespec *req, struct timespec *rem) {
 //--------------------------------------------------------------------------------
 // Net
 //--------------------------------------------------------------------------------
+uint32_t htonl(uint32_t hostlong) {
+    return (hostlong >> 24) | ((hostlong >> 8) & 0xFF00) | ((hostlong << 8) & 0xFF0000) | (hostlong << 24);
+}
+
+uint16_t htons(uint16_t hostshort) {
+    return (uint16_t) ((hostshort >> 8) | (hostshort << 8));
+}
+
+uint32_t ntohl(uint32_t netlong) {
+    return htonl(netlong);
+}
+
+uint16_t ntohs(uint16_t netshort) {
+    return htons(netshort);
+}
+
 char* inet_ntoa(struct in_addr in) {
-    return "127.0.0.1";
+    static char buffer[16];
+    uint32_t addr = ntohl(in.s_addr);
+    snprintf(buffer, sizeof(buffer), "%u.%u.%u.%u", addr >> 24, (addr >> 16) & 0xFF, (addr >> 8) & 0xFF, addr & 0xFF);
+    return buffer;
 }
 
 in_addr_t inet_addr(const char* cp) {
-    return INADDR_NONE;
+    uint32_t addr = 0;
+    for (int i = 0; i < 4; i++) {
+        if (!isdigit((unsigned char) *cp))
+            return INADDR_NONE;
+        uint32_t part = 0;
+        while (isdigit((unsigned char) *cp)) {
+            part = part * 10 + (*cp++ - '0');
+            if (part > 255)
+                return INADDR_NONE;
+        }
+        addr = (addr << 8) | part;
+        if (i < 3 && *cp++ != '.')
+            return INADDR_NONE;
+    }
+    return *cp == '\0' ? htonl(addr) : INADDR_NONE;
+}
+
+/* Returns the result of a mir_sysio function, or sets errno and returns -1 */
+static long sysResult(long rc) {
+    if (rc < 0) { errno = (int)-rc; return -1; }
+    return rc;
+}
+
+int socket(int domain, int type, int protocol) {
+    return sysResult(mir_sysio_socket(domain, type, protocol));
+}
+
+int bind(int sockfd, const struct sockaddr *addr, socklen_t addrlen) {
+    return sysResult(mir_sysio_bind(sockfd, addr, addrlen));
+}
+
+int listen(int sockfd, int backlog) {
+    return sysResult(mir_sysio_listen(sockfd, backlog));
+}
+
+int accept(int sockfd, struct sockaddr * restrict addr, socklen_t * restrict addrlen) {
+    return sysResult(mir_sysio_accept(sockfd, addr, addrlen));
 }
 
+int connect(int sockfd, const struct sockaddr *addr, socklen_t addrlen) {
+    return sysResult(mir_sysio_connect(sockfd, addr, addrlen));
+}
+
+int getsockname(int sockfd, struct sockaddr * restrict addr, socklen_t * restrict addrlen) {
+    return sysResult(mir_sysio_getsockname(sockfd, addr, addrlen, 0));
+}
+
+int getpeername(int sockfd, struct sockaddr * restrict addr, socklen_t * restrict addrlen) {
+    return sysResult(mir_sysio_getsockname(sockfd, addr, addrlen, 1));
+}
+
+int setsockopt(int sockfd, int level, int optname, const void *optval, socklen_t optlen) {
+    return sysResult(mir_sysio_setsockopt(sockfd, level, optname, optval, optlen));
+}
+
+int getsockopt(int sockfd, int level, int optname, void * restrict optval, socklen_t * restrict optlen) {
+    return sysResult(mir_sysio_getsockopt(sockfd, level, optname, optval, optlen));
+}
+
+int shutdown(int sockfd, int how) {
+    return sysResult(mir_sysio_shutdown(sockfd, how));
+}
+
+ssize_t send(int sockfd, const void *buf, size_t len, int flags) {
+    if (flags & ~MSG_NOSIGNAL) { errno = EINVAL; return -1; }
+    return write(sockfd, buf, len);
+}
+
+ssize_t recv(int sockfd, void *buf, size_t len, int flags) {
+    if (flags & ~MSG_NOSIGNAL) { errno = EINVAL; return -1; }
+    return read(sockfd, buf, len);
+}
+
+int poll(struct pollfd *fds, nfds_t nfds, int timeout) {
+    return sysResult(mir_sysio_poll(fds, nfds, timeout));
+}
+
+//--------------------------------------------------------------------------------
+// File descriptors
+//--------------------------------------------------------------------------------
+ssize_t read(int fd, void *buf, size_t count) {
+    return sysResult(mir_sysio_read(fd, buf, count));
+}
 
+ssize_t write(int fd, const void *buf, size_t count) {
+    return sysResult(mir_sysio_write(fd, buf, count));
+}
+
+int close(int fd) {
+    return sysResult(mir_sysio_close_fd(fd));
+}
+
+int pipe(int fds[2]) {
+    return sysResult(mir_sysio_pipe(fds));
+}
+
+int fcntl(int fd, int cmd, ...) {
+    int arg = 0;
+    if (cmd == F_SETFL || cmd == F_SETFD) {
+        va_list ap;
+        va_start(ap, cmd);
+        arg = va_arg(ap, int);
+        va_end(ap);
+    }
+    return sysResult(mir_sysio_fcntl(fd, cmd, arg));
+}
+
+//--------------------------------------------------------------------------------
+// Memory mapping
+//--------------------------------------------------------------------------------
+void *mmap(void *addr, size_t length, int prot, int flags, int fd, off_t offset) {
+    (void) addr; // Only a hint
+    if (length == 0 || (flags & MAP_FIXED)) { errno = EINVAL; return MAP_FAILED; }
+    long rc = mir_sysio_mmap(length, prot, flags, fd, offset);
+    if (rc < 0) { errno = (int)-rc; return MAP_FAILED; }
+    return (void *)rc;
+}
+
+int munmap(void *addr, size_t length) {
+    int rc = mir_sysio_munmap(addr, length);
+    if (rc < 0) { errno = -rc; return -1; }
+    return 0;
+}
+
+int msync(void *addr, size_t length, int flags) {
+    int rc = mir_sysio_msync(addr, length, flags);
+    if (rc < 0) { errno = -rc; return -1; }
+    return 0;
+}
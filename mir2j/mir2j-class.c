@@ -0,0 +1,1555 @@
+/*
+MIT License
+
+Copyright (c) 2025 Guillaume Legris
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/* JVM class file output of m2j -bytecode, included by mir2j.c.
+
+   The part classes MainPart<n> holding the functions are written as class
+   files instead of Java source, so the bulk of a program does not go through
+   javac.  MainBase, Main, MainFunctions and MainData stay Java source.
+
+   A function is translated insn by insn: MIR labels are branch targets and
+   each referenced MIR var gets its own local slot, typed as the var of the
+   Java emission (int for the vars found by find_int_vars).  Every value is
+   converted with the Java casts the Java emission writes, so both outputs
+   compute the same results.  All locals are initialized by the prologue and
+   never change type, so one frame, written once in full, holds at every
+   label of the StackMapTable.
+
+   Calls of the runtime methods (libc, SDL...) go through small bridge
+   methods appended to MainBase: javac resolves their overloads there as it
+   does for the Java emission.  A function the writer does not handle (setjmp
+   calls, code above 64 KB, a branch beyond 32 KB...) is emitted as Java
+   source into its own part class.  */
+
+#define CLASS_FILE_VERSION 52 /* Java 8, the first version requiring StackMapTable */
+#define CLASS_MAX_CONSTANTS 60000 /* start a new class above, the limit is 65535 */
+
+/* Java types of the values of the operand stack and the locals */
+enum { JT_V, JT_I, JT_J, JT_F, JT_D };
+
+enum {
+  JVM_NOP = 0x00, JVM_ICONST_0 = 0x03, JVM_LCONST_0 = 0x09, JVM_FCONST_0 = 0x0b, JVM_DCONST_0 = 0x0e,
+  JVM_BIPUSH = 0x10, JVM_SIPUSH = 0x11, JVM_LDC = 0x12, JVM_LDC_W = 0x13, JVM_LDC2_W = 0x14,
+  JVM_ILOAD = 0x15, JVM_LLOAD = 0x16, JVM_FLOAD = 0x17, JVM_DLOAD = 0x18, JVM_ALOAD = 0x19,
+  JVM_ILOAD_0 = 0x1a, JVM_LLOAD_0 = 0x1e, JVM_FLOAD_0 = 0x22, JVM_DLOAD_0 = 0x26, JVM_ALOAD_0 = 0x2a,
+  JVM_ISTORE = 0x36, JVM_LSTORE = 0x37, JVM_FSTORE = 0x38, JVM_DSTORE = 0x39, JVM_ASTORE = 0x3a,
+  JVM_ISTORE_0 = 0x3b, JVM_LSTORE_0 = 0x3f, JVM_FSTORE_0 = 0x43, JVM_DSTORE_0 = 0x47,
+  JVM_ASTORE_0 = 0x4b, JVM_POP = 0x57, JVM_POP2 = 0x58, JVM_DUP = 0x59,
+  JVM_IADD = 0x60, JVM_LADD = 0x61, JVM_FADD = 0x62, JVM_DADD = 0x63, JVM_ISUB = 0x64,
+  JVM_LSUB = 0x65, JVM_FSUB = 0x66, JVM_DSUB = 0x67, JVM_IMUL = 0x68, JVM_LMUL = 0x69,
+  JVM_FMUL = 0x6a, JVM_DMUL = 0x6b, JVM_IDIV = 0x6c, JVM_LDIV = 0x6d, JVM_FDIV = 0x6e,
+  JVM_DDIV = 0x6f, JVM_IREM = 0x70, JVM_LREM = 0x71, JVM_INEG = 0x74, JVM_LNEG = 0x75,
+  JVM_FNEG = 0x76, JVM_DNEG = 0x77, JVM_ISHL = 0x78, JVM_LSHL = 0x79, JVM_ISHR = 0x7a,
+  JVM_LSHR = 0x7b, JVM_IUSHR = 0x7c, JVM_LUSHR = 0x7d, JVM_IAND = 0x7e, JVM_LAND = 0x7f,
+  JVM_IOR = 0x80, JVM_LOR = 0x81, JVM_IXOR = 0x82, JVM_LXOR = 0x83, JVM_I2L = 0x85,
+  JVM_I2F = 0x86, JVM_I2D = 0x87, JVM_L2I = 0x88, JVM_L2F = 0x89, JVM_L2D = 0x8a,
+  JVM_F2I = 0x8b, JVM_F2L = 0x8c, JVM_F2D = 0x8d, JVM_D2I = 0x8e, JVM_D2L = 0x8f,
+  JVM_D2F = 0x90, JVM_I2B = 0x91, JVM_I2S = 0x93, JVM_LCMP = 0x94, JVM_FCMPL = 0x95,
+  JVM_FCMPG = 0x96, JVM_DCMPL = 0x97, JVM_DCMPG = 0x98, JVM_IFEQ = 0x99, JVM_IFNE = 0x9a,
+  JVM_IF_ICMPEQ = 0x9f, JVM_GOTO = 0xa7, JVM_TABLESWITCH = 0xaa, JVM_IRETURN = 0xac,
+  JVM_LRETURN = 0xad, JVM_FRETURN = 0xae, JVM_DRETURN = 0xaf, JVM_RETURN = 0xb1,
+  JVM_GETFIELD = 0xb4, JVM_INVOKEVIRTUAL = 0xb6, JVM_INVOKESPECIAL = 0xb7,
+  JVM_INVOKESTATIC = 0xb8, JVM_CHECKCAST = 0xc0, JVM_WIDE = 0xc4,
+};
+
+/* Conditions in the order of ifeq...ifle and if_icmpeq...if_icmple */
+enum { CMP_EQ, CMP_NE, CMP_LT, CMP_GE, CMP_GT, CMP_LE };
+
+/* How the operands of a comparison are compared */
+enum { CMP_LONG, CMP_INT, CMP_ULONG, CMP_UINT, CMP_FLOAT, CMP_DOUBLE };
+
+static int bytecode_p = FALSE; /* -bytecode */
+
+static int jtype (MIR_type_t t) {
+  switch (t) {
+  case MIR_T_I8:
+  case MIR_T_U8:
+  case MIR_T_I16:
+  case MIR_T_U16:
+  case MIR_T_I32: return JT_I;
+  case MIR_T_F: return JT_F;
+  case MIR_T_D:
+  case MIR_T_LD: return JT_D;
+  default: return JT_J;
+  }
+}
+
+static int jtype_size (int jt) { return jt == JT_V ? 0 : jt == JT_J || jt == JT_D ? 2 : 1; }
+
+static char jtype_letter (int jt) { return "VIJFD"[jt]; }
+
+static int letter_jtype (char letter) {
+  switch (letter) {
+  case 'V': return JT_V;
+  case 'J': return JT_J;
+  case 'F': return JT_F;
+  case 'D': return JT_D;
+  default: return JT_I;
+  }
+}
+
+/* Descriptor of out_type (t) */
+static char type_desc_letter (MIR_type_t t) {
+  switch (t) {
+  case MIR_T_I8: return 'B';
+  case MIR_T_U8:
+  case MIR_T_I16: return 'S';
+  case MIR_T_U16:
+  case MIR_T_I32: return 'I';
+  default: return jtype_letter (jtype (t));
+  }
+}
+
+static const char *desc_java_type (char letter) {
+  switch (letter) {
+  case 'V': return "void";
+  case 'B': return "byte";
+  case 'S': return "short";
+  case 'I': return "int";
+  case 'F': return "float";
+  case 'D': return "double";
+  default: return "long";
+  }
+}
+
+/* ------------------------------ Class buffer --------------------------- */
+
+typedef struct cp_entry {
+  size_t start, len; /* bytes of the constant in cp_bytes */
+  int index;
+} cp_entry_t;
+
+DEF_HTAB (cp_entry_t);
+
+static HTAB (cp_entry_t) * cp_tab;
+static VARR (uint8_t) * cp_bytes, *class_methods;
+static int cp_count, class_nmethods;
+static int class_part; /* number of the part class in the buffer, 0 if none */
+static char class_name[32], class_super_name[32];
+static VARR (char_ptr_t) * bridge_names; /* MainBase bridge methods already emitted */
+
+static void put_u1 (VARR (uint8_t) * v, int b) { VARR_PUSH (uint8_t, v, (uint8_t) b); }
+
+static void put_u2 (VARR (uint8_t) * v, int b) {
+  put_u1 (v, b >> 8);
+  put_u1 (v, b);
+}
+
+static void put_u4 (VARR (uint8_t) * v, uint32_t b) {
+  put_u2 (v, (int) (b >> 16));
+  put_u2 (v, (int) (b & 0xffff));
+}
+
+static void put_bytes (VARR (uint8_t) * v, const void *bytes, size_t len) {
+  for (size_t i = 0; i < len; i++) put_u1 (v, ((const uint8_t *) bytes)[i]);
+}
+
+static int cp_entry_eq (cp_entry_t a, cp_entry_t b, void *arg) {
+  uint8_t *bytes = VARR_ADDR (uint8_t, cp_bytes);
+
+  return a.len == b.len && memcmp (bytes + a.start, bytes + b.start, a.len) == 0;
+}
+
+static htab_hash_t cp_entry_hash (cp_entry_t a, void *arg) {
+  return (htab_hash_t) mir_hash (VARR_ADDR (uint8_t, cp_bytes) + a.start, a.len, 0);
+}
+
+/* Return the index of the constant appended to cp_bytes from start, which
+   is dropped if the pool already has it.  Long and double constants take
+   two indexes.  */
+static int cp_add (size_t start, int nindexes) {
+  cp_entry_t el, tab_el;
+
+  el.start = start;
+  el.len = VARR_LENGTH (uint8_t, cp_bytes) - start;
+  if (HTAB_DO (cp_entry_t, cp_tab, el, HTAB_FIND, tab_el)) {
+    VARR_TRUNC (uint8_t, cp_bytes, start);
+    return tab_el.index;
+  }
+  el.index = cp_count;
+  cp_count += nindexes;
+  HTAB_DO (cp_entry_t, cp_tab, el, HTAB_INSERT, tab_el);
+  return el.index;
+}
+
+static int cp_utf8 (const char *str) {
+  size_t start = VARR_LENGTH (uint8_t, cp_bytes), len = strlen (str);
+
+  put_u1 (cp_bytes, 1);
+  put_u2 (cp_bytes, (int) len);
+  put_bytes (cp_bytes, str, len);
+  return cp_add (start, 1);
+}
+
+static int cp_refs (int tag, int index1, int index2) {
+  size_t start = VARR_LENGTH (uint8_t, cp_bytes);
+
+  put_u1 (cp_bytes, tag);
+  put_u2 (cp_bytes, index1);
+  if (index2 >= 0) put_u2 (cp_bytes, index2);
+  return cp_add (start, 1);
+}
+
+static int cp_class (const char *name) { return cp_refs (7, cp_utf8 (name), -1); }
+
+static int cp_name_and_type (const char *name, const char *desc) {
+  int name_index = cp_utf8 (name);
+
+  return cp_refs (12, name_index, cp_utf8 (desc));
+}
+
+/* Fieldref (tag 9) or Methodref (tag 10) */
+static int cp_member (int tag, const char *cls, const char *name, const char *desc) {
+  int class_index = cp_class (cls);
+
+  return cp_refs (tag, class_index, cp_name_and_type (name, desc));
+}
+
+/* Integer (tag 3), Float (4), Long (5) or Double (6) */
+static int cp_number (int tag, uint64_t bits) {
+  size_t start = VARR_LENGTH (uint8_t, cp_bytes);
+
+  put_u1 (cp_bytes, tag);
+  if (tag >= 5) put_u4 (cp_bytes, (uint32_t) (bits >> 32));
+  put_u4 (cp_bytes, (uint32_t) bits);
+  return cp_add (start, tag >= 5 ? 2 : 1);
+}
+
+/* Start part class MainPart<part> in the buffer */
+static void class_start (int part) {
+  class_part = part;
+  sprintf (class_name, "MainPart%d", part);
+  if (part == 1)
+    strcpy (class_super_name, "MainBase");
+  else
+    sprintf (class_super_name, "MainPart%d", part - 1);
+  VARR_TRUNC (uint8_t, cp_bytes, 0);
+  VARR_TRUNC (uint8_t, class_methods, 0);
+  HTAB_CLEAR (cp_entry_t, cp_tab);
+  cp_count = 1;
+  class_nmethods = 1;
+  /* The default constructor */
+  put_u2 (class_methods, 0);
+  put_u2 (class_methods, cp_utf8 ("<init>"));
+  put_u2 (class_methods, cp_utf8 ("()V"));
+  put_u2 (class_methods, 1);
+  put_u2 (class_methods, cp_utf8 ("Code"));
+  put_u4 (class_methods, 17);
+  put_u2 (class_methods, 1); /* max_stack */
+  put_u2 (class_methods, 1); /* max_locals */
+  put_u4 (class_methods, 5);
+  put_u1 (class_methods, JVM_ALOAD_0);
+  put_u1 (class_methods, JVM_INVOKESPECIAL);
+  put_u2 (class_methods, cp_member (10, class_super_name, "<init>", "()V"));
+  put_u1 (class_methods, JVM_RETURN);
+  put_u2 (class_methods, 0); /* exception_table_length */
+  put_u2 (class_methods, 0); /* attributes_count */
+}
+
+static int class_full_p (void) { return class_part != 0 && cp_count > CLASS_MAX_CONSTANTS; }
+
+/* Write the class in the buffer to output_dir/<class_name>.class */
+static void class_finish (void) {
+  char *path = malloc (strlen (output_dir) + strlen (class_name) + 8);
+  int this_index = cp_class (class_name), super_index = cp_class (class_super_name);
+  VARR (uint8_t) * header;
+  FILE *f;
+
+  sprintf (path, "%s/%s.class", output_dir, class_name);
+  if ((f = fopen (path, "wb")) == NULL) {
+    fprintf (stderr, "m2j: cannot open file %s\n", path);
+    exit (1);
+  }
+  free (path);
+  VARR_CREATE (uint8_t, header, 16);
+  put_u4 (header, 0xCAFEBABE);
+  put_u2 (header, 0);
+  put_u2 (header, CLASS_FILE_VERSION);
+  put_u2 (header, cp_count);
+  fwrite (VARR_ADDR (uint8_t, header), 1, VARR_LENGTH (uint8_t, header), f);
+  fwrite (VARR_ADDR (uint8_t, cp_bytes), 1, VARR_LENGTH (uint8_t, cp_bytes), f);
+  VARR_TRUNC (uint8_t, header, 0);
+  put_u2 (header, 0x0420); /* ACC_SUPER | ACC_ABSTRACT */
+  put_u2 (header, this_index);
+  put_u2 (header, super_index);
+  put_u2 (header, 0); /* interfaces */
+  put_u2 (header, 0); /* fields */
+  put_u2 (header, class_nmethods);
+  fwrite (VARR_ADDR (uint8_t, header), 1, VARR_LENGTH (uint8_t, header), f);
+  fwrite (VARR_ADDR (uint8_t, class_methods), 1, VARR_LENGTH (uint8_t, class_methods), f);
+  VARR_TRUNC (uint8_t, header, 0);
+  put_u2 (header, 0); /* attributes */
+  fwrite (VARR_ADDR (uint8_t, header), 1, VARR_LENGTH (uint8_t, header), f);
+  VARR_DESTROY (uint8_t, header);
+  if (ferror (f) || fclose (f) != 0) {
+    fprintf (stderr, "m2j: error in writing class %s\n", class_name);
+    exit (1);
+  }
+  class_part = 0;
+}
+
+/* Emit into MainBase the method bridge calling runtime method target with
+   params of the given descriptor letters and returning ret, or returning
+   the runtime field target if params is NULL.  javac picks the overload of
+   target there.  */
+static void out_bridge (const char *bridge, const char *target, char ret, const char *params) {
+  size_t i;
+
+  for (i = 0; i < VARR_LENGTH (char_ptr_t, bridge_names); i++)
+    if (strcmp (VARR_GET (char_ptr_t, bridge_names, i), bridge) == 0) return;
+  VARR_PUSH (char_ptr_t, bridge_names, strcpy (malloc (strlen (bridge) + 1), bridge));
+  if (params == NULL) {
+    fprintf (base_f, "final %s %s () { return %s; }\n", desc_java_type (ret), bridge, target);
+    return;
+  }
+  fprintf (base_f, "final %s %s (", desc_java_type (ret), bridge);
+  for (i = 0; params[i] != '\0'; i++)
+    fprintf (base_f, i == 0 ? "%s a%d" : ", %s a%d", desc_java_type (params[i]), (int) i);
+  fprintf (base_f, ret == 'V' ? ") { %s(" : ") { return %s(", target);
+  for (i = 0; params[i] != '\0'; i++) fprintf (base_f, i == 0 ? "a%d" : ", a%d", (int) i);
+  fprintf (base_f, "); }\n");
+}
+
+/* ------------------------------ Method code ---------------------------- */
+
+typedef struct bc_fixup {
+  size_t pc, pos; /* the branch insn and its offset */
+  MIR_insn_t label;
+  int wide_p; /* 4-byte offset of a tableswitch */
+} bc_fixup_t;
+
+DEF_VARR (bc_fixup_t);
+
+static VARR (uint8_t) * bc_code, *bc_locals; /* bc_locals: the frame letter of each local */
+static VARR (bc_fixup_t) * bc_fixups;
+static VARR (int) * bc_frame_pcs, *bc_var_slots, *bc_var_jtypes;
+static int bc_stack_depth, bc_max_stack, bc_nslots, bc_failed_p, bc_reachable_p;
+static int bc_mem_slot, bc_saved_slot, bc_va_area_slot, bc_va_saved_slot, bc_va_args_slot,
+  bc_va_next_slot;
+
+static void bc_u1 (int b) { put_u1 (bc_code, b); }
+
+static void bc_u2 (int b) { put_u2 (bc_code, b); }
+
+static void bc_adjust_stack (int delta) {
+  bc_stack_depth += delta;
+  mir_assert (bc_stack_depth >= 0);
+  if (bc_stack_depth > bc_max_stack) bc_max_stack = bc_stack_depth;
+}
+
+static void bc_op (int opcode, int delta) {
+  bc_u1 (opcode);
+  bc_adjust_stack (delta);
+}
+
+/* Return a new local of frame letter letter ('I', 'J', 'F', 'D', or 'M'
+   for the memory array) */
+static int bc_new_local (char letter) {
+  int slot = bc_nslots;
+
+  VARR_PUSH (uint8_t, bc_locals, letter);
+  bc_nslots += letter == 'J' || letter == 'D' ? 2 : 1;
+  return slot;
+}
+
+static void bc_local_op (int opcode, int opcode_0, int slot) {
+  if (slot <= 3) {
+    bc_u1 (opcode_0 + slot);
+  } else if (slot <= 255) {
+    bc_u1 (opcode);
+    bc_u1 (slot);
+  } else {
+    bc_u1 (JVM_WIDE);
+    bc_u1 (opcode);
+    bc_u2 (slot);
+  }
+}
+
+static void bc_load (int jt, int slot) {
+  static const int ops[] = {0, JVM_ILOAD, JVM_LLOAD, JVM_FLOAD, JVM_DLOAD};
+  static const int ops_0[] = {0, JVM_ILOAD_0, JVM_LLOAD_0, JVM_FLOAD_0, JVM_DLOAD_0};
+
+  bc_local_op (ops[jt], ops_0[jt], slot);
+  bc_adjust_stack (jtype_size (jt));
+}
+
+static void bc_store (int jt, int slot) {
+  static const int ops[] = {0, JVM_ISTORE, JVM_LSTORE, JVM_FSTORE, JVM_DSTORE};
+  static const int ops_0[] = {0, JVM_ISTORE_0, JVM_LSTORE_0, JVM_FSTORE_0, JVM_DSTORE_0};
+
+  bc_local_op (ops[jt], ops_0[jt], slot);
+  bc_adjust_stack (-jtype_size (jt));
+}
+
+static void bc_aload (int slot) {
+  bc_local_op (JVM_ALOAD, JVM_ALOAD_0, slot);
+  bc_adjust_stack (1);
+}
+
+static void bc_astore (int slot) {
+  bc_local_op (JVM_ASTORE, JVM_ASTORE_0, slot);
+  bc_adjust_stack (-1);
+}
+
+static void bc_pop (int jt) {
+  if (jt != JT_V) bc_op (jtype_size (jt) == 2 ? JVM_POP2 : JVM_POP, -jtype_size (jt));
+}
+
+static void bc_ldc (int index, int size) {
+  if (size == 2) {
+    bc_u1 (JVM_LDC2_W);
+    bc_u2 (index);
+  } else if (index <= 255) {
+    bc_u1 (JVM_LDC);
+    bc_u1 (index);
+  } else {
+    bc_u1 (JVM_LDC_W);
+    bc_u2 (index);
+  }
+  bc_adjust_stack (size);
+}
+
+static void bc_iconst (int32_t v) {
+  if (v >= -1 && v <= 5) {
+    bc_op (JVM_ICONST_0 + v, 1);
+  } else if (v >= -128 && v <= 127) {
+    bc_op (JVM_BIPUSH, 1);
+    bc_u1 (v & 0xff);
+  } else if (v >= -32768 && v <= 32767) {
+    bc_op (JVM_SIPUSH, 1);
+    bc_u2 (v & 0xffff);
+  } else {
+    bc_ldc (cp_number (3, (uint32_t) v), 1);
+  }
+}
+
+static void bc_lconst (int64_t v) {
+  if (v == 0 || v == 1)
+    bc_op (JVM_LCONST_0 + (int) v, 2);
+  else
+    bc_ldc (cp_number (5, (uint64_t) v), 2);
+}
+
+static void bc_fconst (float v) {
+  uint32_t bits;
+
+  memcpy (&bits, &v, sizeof (bits));
+  if (bits == 0 || v == 1.0f || v == 2.0f)
+    bc_op (JVM_FCONST_0 + (int) v, 1);
+  else
+    bc_ldc (cp_number (4, bits), 1);
+}
+
+static void bc_dconst (double v) {
+  uint64_t bits;
+
+  memcpy (&bits, &v, sizeof (bits));
+  if (bits == 0 || v == 1.0)
+    bc_op (JVM_DCONST_0 + (int) v, 2);
+  else
+    bc_ldc (cp_number (6, bits), 2);
+}
+
+/* Push the zero of type jt */
+static void bc_zero (int jt) {
+  switch (jt) {
+  case JT_I: bc_iconst (0); break;
+  case JT_J: bc_lconst (0); break;
+  case JT_F: bc_fconst (0.0f); break;
+  case JT_D: bc_dconst (0.0); break;
+  default: break;
+  }
+}
+
+/* Convert the value on the top of the stack as a Java cast does */
+static void bc_conv (int from, int to) {
+  static const int ops[5][5] = {
+    {0, 0, 0, 0, 0},
+    {0, 0, JVM_I2L, JVM_I2F, JVM_I2D},
+    {0, JVM_L2I, 0, JVM_L2F, JVM_L2D},
+    {0, JVM_F2I, JVM_F2L, 0, JVM_F2D},
+    {0, JVM_D2I, JVM_D2L, JVM_D2F, 0},
+  };
+
+  if (from == to) return;
+  if (from == JT_V || to == JT_V) {
+    bc_failed_p = TRUE;
+    return;
+  }
+  bc_op (ops[from][to], jtype_size (to) - jtype_size (from));
+}
+
+/* Emit the cast "(out_type (t)) value" of a value of type jt */
+static int bc_cast (int jt, MIR_type_t t) {
+  int to = jtype (t);
+
+  bc_conv (jt, to);
+  if (t == MIR_T_I8)
+    bc_op (JVM_I2B, 0);
+  else if (t == MIR_T_U8 || t == MIR_T_I16)
+    bc_op (JVM_I2S, 0);
+  return to;
+}
+
+/* Return the size of the args of method descriptor desc and set *res_size
+   to the size of its result */
+static int desc_sizes (const char *desc, int *res_size) {
+  int size = 0;
+
+  for (desc++; *desc != ')'; desc++) {
+    size += *desc == 'J' || *desc == 'D' ? 2 : 1;
+    while (*desc == '[') desc++;
+    if (*desc == 'L') desc = strchr (desc, ';');
+  }
+  *res_size = jtype_size (letter_jtype (desc[1]));
+  return size;
+}
+
+static void bc_invoke (int opcode, const char *cls, const char *name, const char *desc) {
+  int res_size, args_size = desc_sizes (desc, &res_size);
+
+  bc_u1 (opcode);
+  bc_u2 (cp_member (10, cls, name, desc));
+  bc_adjust_stack (res_size - args_size - (opcode == JVM_INVOKESTATIC ? 0 : 1));
+}
+
+/* Call method name of the runtime on this */
+static void bc_invoke_runtime (const char *name, const char *desc) {
+  bc_invoke (JVM_INVOKEVIRTUAL, "mir2j/Runtime", name, desc);
+}
+
+static void bc_branch (int opcode, MIR_op_t label_op, int delta) {
+  bc_fixup_t fixup;
+
+  mir_assert (label_op.mode == MIR_OP_LABEL);
+  fixup.pc = VARR_LENGTH (uint8_t, bc_code);
+  fixup.pos = fixup.pc + 1;
+  fixup.label = label_op.u.label;
+  fixup.wide_p = FALSE;
+  VARR_PUSH (bc_fixup_t, bc_fixups, fixup);
+  bc_op (opcode, delta);
+  bc_u2 (0);
+}
+
+/* Reload the memory local from the field, see out_memory_reload */
+static void bc_memory_reload (void) {
+  if (legacy_memory_p) return;
+  bc_aload (0);
+  bc_u1 (JVM_GETFIELD);
+  bc_u2 (paged_memory_p ? cp_member (9, "mir2j/Runtime", "pages", "[[B")
+                        : cp_member (9, "mir2j/Runtime", "memory", "[B"));
+  bc_astore (bc_mem_slot);
+}
+
+/* Push the first arg of the memory accessors */
+static void bc_push_memory (void) { bc_aload (legacy_memory_p ? 0 : bc_mem_slot); }
+
+/* Call the memory read or write accessor of type t, see out_mem_access.
+   Return the type of the value read.  */
+static int bc_mem_access (int write_p, MIR_type_t t) {
+  char name[32], desc[16];
+  const char *mangled = mangled_type_name (t);
+  char letter;
+
+  if (write_p)
+    letter = t == MIR_T_F ? 'F' : t == MIR_T_D || t == MIR_T_LD ? 'D' : 'J';
+  else
+    letter = t == MIR_T_I8 ? 'B' : t == MIR_T_I16 ? 'S' : t == MIR_T_U8 || t == MIR_T_U16 ? 'I'
+                                                                                            : type_desc_letter (t);
+  sprintf (name, legacy_memory_p ? "mir_%s_%s" : "%s_%s", write_p ? "write" : "read", mangled);
+  sprintf (desc, write_p ? "(%sJ%c)V" : "(%sJ)%c",
+           legacy_memory_p ? "" : paged_memory_p ? "[[B" : "[B", letter);
+  if (legacy_memory_p)
+    bc_invoke_runtime (name, desc);
+  else
+    bc_invoke (JVM_INVOKESTATIC, paged_memory_p ? "mir2j/PagedMemory" : "mir2j/Memory", name, desc);
+  return write_p ? JT_V : letter_jtype (letter);
+}
+
+static int bc_load_var (MIR_reg_t reg) {
+  int slot = VARR_GET (int, bc_var_slots, reg - 1), jt = VARR_GET (int, bc_var_jtypes, reg - 1);
+
+  mir_assert (slot >= 0);
+  bc_load (jt, slot);
+  return jt;
+}
+
+/* Add reg * scale to the address part of type jt (JT_V if none) on the
+   stack and return the new type, with the Java typing of the expression of
+   out_op_mem_address */
+static int bc_add_address_term (int jt, MIR_reg_t reg, int scale) {
+  int reg_jt = VARR_GET (int, bc_var_jtypes, reg - 1);
+
+  if (jt == JT_I && reg_jt == JT_J) bc_conv (JT_I, JT_J);
+  bc_load_var (reg);
+  if (scale != 1) {
+    if (reg_jt == JT_I) {
+      bc_iconst (scale);
+      bc_op (JVM_IMUL, -1);
+    } else {
+      bc_lconst (scale);
+      bc_op (JVM_LMUL, -2);
+    }
+  }
+  if (jt == JT_V) return reg_jt;
+  if (jt == JT_J && reg_jt == JT_I) bc_conv (JT_I, JT_J);
+  if (jt == JT_I && reg_jt == JT_I) {
+    bc_op (JVM_IADD, -1);
+    return JT_I;
+  }
+  bc_op (JVM_LADD, -2);
+  return JT_J;
+}
+
+static void bc_push_mem_address (MIR_op_t op) {
+  int jt = JT_V;
+
+  if (op.u.mem.disp != 0 || (op.u.mem.base == 0 && op.u.mem.index == 0)) {
+    bc_lconst (op.u.mem.disp);
+    jt = JT_J;
+  }
+  if (op.u.mem.base != 0) jt = bc_add_address_term (jt, op.u.mem.base, 1);
+  if (op.u.mem.index != 0) jt = bc_add_address_term (jt, op.u.mem.index, op.u.mem.scale);
+  bc_conv (jt, JT_J);
+}
+
+/* Push the value of a ref operand, see out_op and out_fn_address */
+static int bc_push_ref (MIR_context_t ctx, MIR_op_t op) {
+  MIR_item_t item = resolve_ref_item (op.u.ref);
+  char *name, *bridge;
+
+  if (item->item_type == MIR_func_item) {
+    mir_assert (fn_addr_index (item) >= 0);
+    bc_lconst (FUNCTION_ADDRESS_BASE + fn_addr_index (item));
+  } else if (data_item_p (item)) {
+    bc_lconst ((int64_t) data_addr (item));
+  } else {
+    /* A runtime field */
+    name = get_mangled_symbol_name (MIR_item_name (ctx, op.u.ref));
+    bridge = malloc (strlen (name) + 9);
+    sprintf (bridge, "mir_ref_%s", name);
+    out_bridge (bridge, name, 'J', NULL);
+    bc_aload (0);
+    bc_invoke (JVM_INVOKEVIRTUAL, class_name, bridge, "()J");
+    free (bridge);
+  }
+  return JT_J;
+}
+
+/* Push the value of op and return its Java type */
+static int bc_push_op (MIR_context_t ctx, MIR_op_t op) {
+  switch (op.mode) {
+  case MIR_OP_REG: return bc_load_var (op.u.reg);
+  case MIR_OP_INT: bc_lconst (op.u.i); return JT_J;
+  case MIR_OP_UINT: bc_lconst ((int64_t) op.u.u); return JT_J;
+  case MIR_OP_FLOAT: bc_fconst (op.u.f); return JT_F;
+  case MIR_OP_DOUBLE: bc_dconst (op.u.d); return JT_D;
+  case MIR_OP_LDOUBLE: bc_dconst ((double) op.u.ld); return JT_D;
+  case MIR_OP_REF: return bc_push_ref (ctx, op);
+  case MIR_OP_STR: bc_lconst ((int64_t) str_addr (op.u.str)); return JT_J;
+  case MIR_OP_MEM:
+    if (MIR_all_blk_type_p (op.u.mem.type)) return bc_load_var (op.u.mem.base);
+    bc_push_memory ();
+    bc_push_mem_address (op);
+    return bc_mem_access (FALSE, op.u.mem.type);
+  default: bc_failed_p = TRUE; return JT_V;
+  }
+}
+
+/* Push op converted to type jt */
+static void bc_push_op_as (MIR_context_t ctx, MIR_op_t op, int jt) {
+  bc_conv (bc_push_op (ctx, op), jt);
+}
+
+/* Start the store of a value into op: a memory write gets its first args */
+static void bc_dst_start (MIR_op_t op) {
+  if (op.mode == MIR_OP_MEM && !MIR_all_blk_type_p (op.u.mem.type)) {
+    bc_push_memory ();
+    bc_push_mem_address (op);
+  } else if (op.mode != MIR_OP_REG) {
+    bc_failed_p = TRUE;
+  }
+}
+
+/* Store the value of type jt on the stack into op */
+static void bc_dst_end (MIR_op_t op, int jt) {
+  if (op.mode == MIR_OP_REG) {
+    int var_jt = VARR_GET (int, bc_var_jtypes, op.u.reg - 1);
+
+    bc_conv (jt, var_jt);
+    bc_store (var_jt, VARR_GET (int, bc_var_slots, op.u.reg - 1));
+  } else if (op.mode == MIR_OP_MEM && !MIR_all_blk_type_p (op.u.mem.type)) {
+    MIR_type_t t = op.u.mem.type;
+
+    bc_conv (jt, t == MIR_T_F ? JT_F : t == MIR_T_D || t == MIR_T_LD ? JT_D : JT_J);
+    bc_mem_access (TRUE, t);
+  } else {
+    bc_pop (jt);
+  }
+}
+
+/* dst = (jt) src followed by opcode if any */
+static void bc_unary (MIR_context_t ctx, MIR_op_t *ops, int jt, int opcode) {
+  bc_dst_start (ops[0]);
+  bc_push_op_as (ctx, ops[1], jt);
+  if (opcode != JVM_NOP) bc_op (opcode, 0);
+  bc_dst_end (ops[0], jt);
+}
+
+/* dst = src & mask, computed in type jt */
+static void bc_mask (MIR_context_t ctx, MIR_op_t *ops, int jt, int64_t mask) {
+  bc_dst_start (ops[0]);
+  bc_push_op_as (ctx, ops[1], jt);
+  if (jt == JT_I) {
+    bc_iconst ((int32_t) mask);
+    bc_op (JVM_IAND, -1);
+  } else {
+    bc_lconst (mask);
+    bc_op (JVM_LAND, -2);
+  }
+  bc_dst_end (ops[0], jt);
+}
+
+/* dst = (jt) src1 op (jt) src2 */
+static void bc_binary (MIR_context_t ctx, MIR_op_t *ops, int jt, int opcode) {
+  bc_dst_start (ops[0]);
+  bc_push_op_as (ctx, ops[1], jt);
+  bc_push_op_as (ctx, ops[2], jt);
+  bc_op (opcode, -jtype_size (jt));
+  bc_dst_end (ops[0], jt);
+}
+
+/* dst = (jt) src1 shift (jt) src2 */
+static void bc_shift (MIR_context_t ctx, MIR_op_t *ops, int jt, int opcode) {
+  bc_dst_start (ops[0]);
+  bc_push_op_as (ctx, ops[1], jt);
+  bc_push_op_as (ctx, ops[2], jt);
+  bc_conv (jt, JT_I);
+  bc_op (opcode, -1);
+  bc_dst_end (ops[0], jt);
+}
+
+/* dst = cls.name ((jt) src1, (jt) src2) */
+static void bc_binary_call (MIR_context_t ctx, MIR_op_t *ops, int jt, const char *cls,
+                            const char *name) {
+  bc_dst_start (ops[0]);
+  bc_push_op_as (ctx, ops[1], jt);
+  bc_push_op_as (ctx, ops[2], jt);
+  bc_invoke (JVM_INVOKESTATIC, cls, name, jt == JT_I ? "(II)I" : "(JJ)J");
+  bc_dst_end (ops[0], jt);
+}
+
+/* Push the operands of a comparison insn and leave an int of the sign of
+   their comparison */
+static void bc_compare (MIR_context_t ctx, MIR_op_t *ops, int kind, int cond) {
+  static const int jtypes[] = {JT_J, JT_I, JT_J, JT_I, JT_F, JT_D};
+  int jt = jtypes[kind];
+
+  for (int i = 1; i <= 2; i++) {
+    bc_push_op_as (ctx, ops[i], jt);
+    if (kind == CMP_INT) bc_conv (JT_I, JT_J);
+  }
+  switch (kind) {
+  case CMP_LONG:
+  case CMP_INT: bc_op (JVM_LCMP, -3); break;
+  case CMP_ULONG: bc_invoke (JVM_INVOKESTATIC, "java/lang/Long", "compareUnsigned", "(JJ)I"); break;
+  case CMP_UINT: bc_invoke (JVM_INVOKESTATIC, "java/lang/Integer", "compareUnsigned", "(II)I"); break;
+  /* NaN makes < and <= false with the g variant and the others with the l one */
+  case CMP_FLOAT: bc_op (cond == CMP_LT || cond == CMP_LE ? JVM_FCMPG : JVM_FCMPL, -1); break;
+  case CMP_DOUBLE: bc_op (cond == CMP_LT || cond == CMP_LE ? JVM_DCMPG : JVM_DCMPL, -3); break;
+  default: mir_assert (FALSE);
+  }
+}
+
+/* dst = (src1 cond src2) ? 1 : 0, without branches: the comparison gives
+   -1, 0 or 1 whose sign bit is extracted */
+static void bc_compare_value (MIR_context_t ctx, MIR_op_t *ops, int kind, int cond) {
+  bc_dst_start (ops[0]);
+  bc_compare (ctx, ops, kind, cond);
+  switch (cond) {
+  case CMP_EQ:
+  case CMP_NE:
+    bc_op (JVM_DUP, 1);
+    bc_op (JVM_INEG, 0);
+    bc_op (JVM_IOR, -1);
+    break;
+  case CMP_GT:
+  case CMP_LE: bc_op (JVM_INEG, 0); break;
+  default: break;
+  }
+  bc_iconst (31);
+  bc_op (JVM_IUSHR, -1);
+  if (cond == CMP_EQ || cond == CMP_GE || cond == CMP_LE) {
+    bc_iconst (1);
+    bc_op (JVM_IXOR, -1);
+  }
+  bc_dst_end (ops[0], JT_I);
+}
+
+static void bc_compare_branch (MIR_context_t ctx, MIR_op_t *ops, int kind, int cond) {
+  if (kind == CMP_INT) {
+    bc_push_op_as (ctx, ops[1], JT_I);
+    bc_push_op_as (ctx, ops[2], JT_I);
+    bc_branch (JVM_IF_ICMPEQ + cond, ops[0], -2);
+  } else {
+    bc_compare (ctx, ops, kind, cond);
+    bc_branch (JVM_IFEQ + cond, ops[0], -1);
+  }
+}
+
+/* Branch if op, as an int for int_p, compares with 0 as cond (CMP_EQ or
+   CMP_NE) */
+static void bc_test_branch (MIR_context_t ctx, MIR_op_t *ops, int int_p, int cond) {
+  int jt = bc_push_op (ctx, ops[1]);
+
+  if (int_p || jt == JT_I) {
+    bc_conv (jt, JT_I);
+  } else {
+    bc_conv (jt, JT_J);
+    bc_lconst (0);
+    bc_op (JVM_LCMP, -3);
+  }
+  bc_branch (JVM_IFEQ + cond, ops[0], -1);
+}
+
+static void bc_set_stack_position (int slot) {
+  bc_aload (0);
+  bc_load (JT_I, slot);
+  bc_invoke_runtime ("mir_set_stack_position", "(I)V");
+}
+
+static void bc_va_list_address (MIR_context_t ctx, MIR_op_t op) {
+  if (op.mode == MIR_OP_MEM && op.u.mem.type == MIR_T_UNDEF)
+    bc_push_mem_address (op);
+  else
+    bc_push_op_as (ctx, op, JT_J);
+}
+
+/* Spill the variadic args of call insn from first_va, see out_va_args_start */
+static void bc_va_args_start (MIR_context_t ctx, MIR_insn_t insn, size_t first_va) {
+  size_t i, size = 0, disp = 0;
+
+  for (i = first_va; i < insn->nops; i++) size += va_arg_size (insn->ops[i]);
+  bc_aload (0);
+  bc_invoke_runtime ("mir_get_stack_position", "()I");
+  bc_store (JT_I, bc_va_saved_slot);
+  bc_aload (0);
+  bc_lconst ((int64_t) size);
+  bc_invoke_runtime ("mir_allocate", "(J)J");
+  bc_store (JT_J, bc_va_args_slot);
+  for (i = first_va; i < insn->nops; disp += va_arg_size (insn->ops[i]), i++) {
+    MIR_op_t op = insn->ops[i];
+
+    if (op.mode == MIR_OP_MEM && MIR_all_blk_type_p (op.u.mem.type)) {
+      bc_aload (0);
+      bc_conv (bc_load_var (op.u.mem.base), JT_J);
+    } else {
+      bc_push_memory ();
+    }
+    bc_load (JT_J, bc_va_args_slot);
+    if (disp != 0) {
+      bc_lconst ((int64_t) disp);
+      bc_op (JVM_LADD, -2);
+    }
+    if (op.mode == MIR_OP_MEM && MIR_all_blk_type_p (op.u.mem.type)) {
+      bc_lconst (op.u.mem.disp);
+      bc_invoke_runtime ("mir_copy_memory", "(JJJ)V");
+    } else {
+      MIR_type_t t = va_slot_type (ctx, op);
+
+      bc_push_op_as (ctx, op, jtype (t));
+      bc_mem_access (TRUE, t);
+    }
+  }
+}
+
+/* Append letter to the descriptor being built in desc */
+static void desc_add (char *desc, char letter) {
+  size_t len = strlen (desc);
+
+  desc[len] = letter;
+  desc[len + 1] = '\0';
+}
+
+static void bc_call (MIR_context_t ctx, MIR_insn_t insn) {
+  MIR_op_t *ops = insn->ops;
+  MIR_proto_t proto = ops[0].u.ref->u.proto;
+  size_t i, start, nargs = VARR_LENGTH (MIR_var_t, proto->args), first_va;
+  MIR_item_t callee = ops[1].mode == MIR_OP_REF ? op_func_item (ops[1]) : NULL;
+  MIR_func_t func = callee != NULL && !runtime_intrinsic_p (callee) ? callee->u.func : NULL;
+  int vararg_p = proto->vararg_p, va_p, jt, res_jt;
+  char *desc = malloc (insn->nops + 16), *name, *bridge;
+
+  if (setjmp_call_p (ctx, insn) || proto->nres > 1
+      || (proto->nres == 1 && (insn->nops < 3 || ops[2].mode != MIR_OP_REG))) {
+    bc_failed_p = TRUE;
+    free (desc);
+    return;
+  }
+  start = 2 + proto->nres;
+  if (func != NULL) { /* as in out_insn, a direct call follows the callee signature */
+    nargs = func->nargs;
+    vararg_p = func->vararg_p;
+  }
+  first_va = start + nargs;
+  va_p = vararg_p && first_va < insn->nops;
+  if (va_p) bc_va_args_start (ctx, insn, first_va);
+  if (insn->nops < first_va && func == NULL) bc_failed_p = TRUE;
+  if (ops[1].mode != MIR_OP_REF) {
+    /* Through the dispatcher of the call signature, see out_function_dispatchers */
+    const char *sig = handle_sig (proto);
+
+    bc_aload (0);
+    bc_u1 (JVM_CHECKCAST);
+    bc_u2 (cp_class ("Main"));
+    bc_push_op_as (ctx, ops[1], JT_J);
+    strcpy (desc, "(LMain;J");
+    for (i = start; i < insn->nops && i < first_va; i++) {
+      bc_push_op_as (ctx, ops[i], letter_jtype (sig[i - start + 2]));
+      desc_add (desc, sig[i - start + 2]);
+    }
+    if (proto->vararg_p) desc_add (desc, 'J');
+    desc_add (desc, ')');
+    desc_add (desc, sig[0]);
+    if (va_p)
+      bc_load (JT_J, bc_va_args_slot);
+    else if (proto->vararg_p)
+      bc_lconst (0);
+    name = malloc (strlen (sig) + 6);
+    sprintf (name, "call_%s", sig);
+    bc_invoke (JVM_INVOKESTATIC, "MainFunctions", name, desc);
+    free (name);
+    res_jt = letter_jtype (sig[0]);
+  } else if (func != NULL) {
+    bc_aload (0);
+    strcpy (desc, "(");
+    for (i = start; i < first_va; i++) {
+      MIR_type_t param_type = VARR_GET (MIR_var_t, func->vars, i - start).type;
+
+      if (i >= insn->nops) { /* an arg missing in a K&R call */
+        bc_lconst (0);
+        bc_cast (JT_J, param_type);
+      } else if (i - start < VARR_LENGTH (MIR_var_t, proto->args)) {
+        MIR_type_t arg_type = VARR_GET (MIR_var_t, proto->args, i - start).type;
+
+        jt = bc_cast (bc_push_op (ctx, ops[i]), arg_type);
+        if (type_desc_letter (arg_type) != type_desc_letter (param_type)) bc_cast (jt, param_type);
+      } else { /* a variadic arg of a K&R call */
+        bc_cast (bc_push_op (ctx, ops[i]), param_type);
+      }
+      desc_add (desc, type_desc_letter (param_type));
+    }
+    if (vararg_p) {
+      desc_add (desc, 'J');
+      if (va_p)
+        bc_load (JT_J, bc_va_args_slot);
+      else
+        bc_lconst (0);
+    }
+    desc_add (desc, ')');
+    desc_add (desc, func->nres == 0 ? 'V' : type_desc_letter (func->res_types[0]));
+    bc_invoke (JVM_INVOKEVIRTUAL, class_name,
+               get_mangled_symbol_name (MIR_item_name (ctx, ops[1].u.ref)), desc);
+    res_jt = func->nres == 0 ? JT_V : jtype (func->res_types[0]);
+  } else {
+    /* A runtime method, through a bridge taking the arg types of the Java emission */
+    char ret = proto->nres == 0 ? 'V' : handle_type_letter (proto->res_types[0]);
+    char *params = malloc (insn->nops + 2);
+
+    params[0] = '\0';
+    bc_aload (0);
+    for (i = start; i < insn->nops; i++) {
+      if (i >= first_va) break;
+      jt = bc_push_op (ctx, ops[i]);
+      if (i - start < nargs) {
+        MIR_type_t arg_type = VARR_GET (MIR_var_t, proto->args, i - start).type;
+
+        bc_cast (jt, arg_type);
+        desc_add (params, type_desc_letter (arg_type));
+      } else {
+        desc_add (params, jtype_letter (jt));
+      }
+    }
+    if (proto->vararg_p) {
+      desc_add (params, 'J');
+      if (va_p)
+        bc_load (JT_J, bc_va_args_slot);
+      else
+        bc_lconst (0);
+    }
+    name = get_mangled_symbol_name (MIR_item_name (ctx, ops[1].u.ref));
+    bridge = malloc (strlen (name) + strlen (params) + 16);
+    sprintf (bridge, "mir_ext_%s_%c_%s", name, ret, params);
+    out_bridge (bridge, name, ret, params);
+    sprintf (desc, "(%s)%c", params, ret);
+    bc_invoke (JVM_INVOKEVIRTUAL, class_name, bridge, desc);
+    free (bridge);
+    free (params);
+    res_jt = letter_jtype (ret);
+  }
+  free (desc);
+  if (proto->nres == 0)
+    bc_pop (res_jt);
+  else if (res_jt == JT_V)
+    bc_failed_p = TRUE;
+  else
+    bc_dst_end (ops[2], res_jt);
+  if (va_p) bc_set_stack_position (bc_va_saved_slot);
+}
+
+static void bc_gen_insn (MIR_context_t ctx, MIR_insn_t insn) {
+  MIR_op_t *ops = insn->ops;
+
+  switch (insn->code) {
+  case MIR_MOV:
+  case MIR_FMOV:
+  case MIR_DMOV:
+  case MIR_LDMOV:
+    bc_dst_start (ops[0]);
+    bc_dst_end (ops[0], bc_push_op (ctx, ops[1]));
+    break;
+  case MIR_EXT8: bc_unary (ctx, ops, JT_I, JVM_I2B); break;
+  case MIR_EXT16: bc_unary (ctx, ops, JT_I, JVM_I2S); break;
+  case MIR_EXT32: bc_unary (ctx, ops, JT_I, JVM_NOP); break;
+  case MIR_UEXT8: bc_mask (ctx, ops, JT_I, 0xFF); break;
+  case MIR_UEXT16: bc_mask (ctx, ops, JT_I, 0xFFFF); break;
+  case MIR_UEXT32: bc_mask (ctx, ops, JT_J, 0xFFFFFFFFLL); break;
+  case MIR_F2I:
+  case MIR_D2I:
+  case MIR_LD2I: bc_unary (ctx, ops, JT_J, JVM_NOP); break;
+  case MIR_I2D:
+  case MIR_F2D:
+  case MIR_LD2D:
+  case MIR_I2LD:
+  case MIR_D2LD:
+  case MIR_F2LD: bc_unary (ctx, ops, JT_D, JVM_NOP); break;
+  case MIR_I2F:
+  case MIR_D2F:
+  case MIR_LD2F: bc_unary (ctx, ops, JT_F, JVM_NOP); break;
+  case MIR_UI2D:
+  case MIR_UI2LD:
+  case MIR_UI2F: {
+    int jt = insn->code == MIR_UI2F ? JT_F : JT_D;
+
+    /* As the Java emission, "(double) (long) x" */
+    bc_dst_start (ops[0]);
+    bc_push_op_as (ctx, ops[1], JT_J);
+    bc_conv (JT_J, jt);
+    bc_dst_end (ops[0], jt);
+    break;
+  }
+  case MIR_NEG: bc_unary (ctx, ops, JT_J, JVM_LNEG); break;
+  case MIR_NEGS: bc_unary (ctx, ops, JT_I, JVM_INEG); break;
+  case MIR_FNEG: bc_unary (ctx, ops, JT_F, JVM_FNEG); break;
+  case MIR_DNEG:
+  case MIR_LDNEG: bc_unary (ctx, ops, JT_D, JVM_DNEG); break;
+  case MIR_ADD: bc_binary (ctx, ops, JT_J, JVM_LADD); break;
+  case MIR_SUB: bc_binary (ctx, ops, JT_J, JVM_LSUB); break;
+  case MIR_MUL: bc_binary (ctx, ops, JT_J, JVM_LMUL); break;
+  case MIR_DIV: bc_binary (ctx, ops, JT_J, JVM_LDIV); break;
+  case MIR_MOD: bc_binary (ctx, ops, JT_J, JVM_LREM); break;
+  case MIR_UDIV: bc_binary_call (ctx, ops, JT_J, "java/lang/Long", "divideUnsigned"); break;
+  case MIR_UMOD: bc_binary_call (ctx, ops, JT_J, "java/lang/Long", "remainderUnsigned"); break;
+  case MIR_AND: bc_binary (ctx, ops, JT_J, JVM_LAND); break;
+  case MIR_OR: bc_binary (ctx, ops, JT_J, JVM_LOR); break;
+  case MIR_XOR: bc_binary (ctx, ops, JT_J, JVM_LXOR); break;
+  case MIR_LSH: bc_shift (ctx, ops, JT_J, JVM_LSHL); break;
+  case MIR_RSH: bc_shift (ctx, ops, JT_J, JVM_LSHR); break;
+  case MIR_URSH: bc_shift (ctx, ops, JT_J, JVM_LUSHR); break;
+  case MIR_ADDS: bc_binary (ctx, ops, JT_I, JVM_IADD); break;
+  case MIR_SUBS: bc_binary (ctx, ops, JT_I, JVM_ISUB); break;
+  case MIR_MULS: bc_binary (ctx, ops, JT_I, JVM_IMUL); break;
+  case MIR_DIVS: bc_binary (ctx, ops, JT_I, JVM_IDIV); break;
+  case MIR_MODS: bc_binary (ctx, ops, JT_I, JVM_IREM); break;
+  case MIR_UDIVS: bc_binary_call (ctx, ops, JT_I, "java/lang/Integer", "divideUnsigned"); break;
+  case MIR_UMODS: bc_binary_call (ctx, ops, JT_I, "java/lang/Integer", "remainderUnsigned"); break;
+  case MIR_ANDS: bc_binary (ctx, ops, JT_I, JVM_IAND); break;
+  case MIR_ORS: bc_binary (ctx, ops, JT_I, JVM_IOR); break;
+  case MIR_XORS: bc_binary (ctx, ops, JT_I, JVM_IXOR); break;
+  case MIR_LSHS: bc_shift (ctx, ops, JT_I, JVM_ISHL); break;
+  case MIR_RSHS: bc_shift (ctx, ops, JT_I, JVM_ISHR); break;
+  case MIR_URSHS: bc_shift (ctx, ops, JT_I, JVM_IUSHR); break;
+  case MIR_FADD: bc_binary (ctx, ops, JT_F, JVM_FADD); break;
+  case MIR_FSUB: bc_binary (ctx, ops, JT_F, JVM_FSUB); break;
+  case MIR_FMUL: bc_binary (ctx, ops, JT_F, JVM_FMUL); break;
+  case MIR_FDIV: bc_binary (ctx, ops, JT_F, JVM_FDIV); break;
+  case MIR_DADD:
+  case MIR_LDADD: bc_binary (ctx, ops, JT_D, JVM_DADD); break;
+  case MIR_DSUB:
+  case MIR_LDSUB: bc_binary (ctx, ops, JT_D, JVM_DSUB); break;
+  case MIR_DMUL:
+  case MIR_LDMUL: bc_binary (ctx, ops, JT_D, JVM_DMUL); break;
+  case MIR_DDIV:
+  case MIR_LDDIV: bc_binary (ctx, ops, JT_D, JVM_DDIV); break;
+  case MIR_EQ: bc_compare_value (ctx, ops, CMP_LONG, CMP_EQ); break;
+  case MIR_NE: bc_compare_value (ctx, ops, CMP_LONG, CMP_NE); break;
+  case MIR_LT: bc_compare_value (ctx, ops, CMP_LONG, CMP_LT); break;
+  case MIR_LE: bc_compare_value (ctx, ops, CMP_LONG, CMP_LE); break;
+  case MIR_GT: bc_compare_value (ctx, ops, CMP_LONG, CMP_GT); break;
+  case MIR_GE: bc_compare_value (ctx, ops, CMP_LONG, CMP_GE); break;
+  case MIR_EQS: bc_compare_value (ctx, ops, CMP_INT, CMP_EQ); break;
+  case MIR_NES: bc_compare_value (ctx, ops, CMP_INT, CMP_NE); break;
+  case MIR_LTS: bc_compare_value (ctx, ops, CMP_INT, CMP_LT); break;
+  case MIR_LES: bc_compare_value (ctx, ops, CMP_INT, CMP_LE); break;
+  case MIR_GTS: bc_compare_value (ctx, ops, CMP_INT, CMP_GT); break;
+  case MIR_GES: bc_compare_value (ctx, ops, CMP_INT, CMP_GE); break;
+  case MIR_ULT: bc_compare_value (ctx, ops, CMP_ULONG, CMP_LT); break;
+  case MIR_ULE: bc_compare_value (ctx, ops, CMP_ULONG, CMP_LE); break;
+  case MIR_UGT: bc_compare_value (ctx, ops, CMP_ULONG, CMP_GT); break;
+  case MIR_UGE: bc_compare_value (ctx, ops, CMP_ULONG, CMP_GE); break;
+  case MIR_ULTS: bc_compare_value (ctx, ops, CMP_UINT, CMP_LT); break;
+  case MIR_ULES: bc_compare_value (ctx, ops, CMP_UINT, CMP_LE); break;
+  case MIR_UGTS: bc_compare_value (ctx, ops, CMP_UINT, CMP_GT); break;
+  case MIR_UGES: bc_compare_value (ctx, ops, CMP_UINT, CMP_GE); break;
+  case MIR_FEQ: bc_compare_value (ctx, ops, CMP_FLOAT, CMP_EQ); break;
+  case MIR_FNE: bc_compare_value (ctx, ops, CMP_FLOAT, CMP_NE); break;
+  case MIR_FLT: bc_compare_value (ctx, ops, CMP_FLOAT, CMP_LT); break;
+  case MIR_FLE: bc_compare_value (ctx, ops, CMP_FLOAT, CMP_LE); break;
+  case MIR_FGT: bc_compare_value (ctx, ops, CMP_FLOAT, CMP_GT); break;
+  case MIR_FGE: bc_compare_value (ctx, ops, CMP_FLOAT, CMP_GE); break;
+  case MIR_DEQ:
+  case MIR_LDEQ: bc_compare_value (ctx, ops, CMP_DOUBLE, CMP_EQ); break;
+  case MIR_DNE:
+  case MIR_LDNE: bc_compare_value (ctx, ops, CMP_DOUBLE, CMP_NE); break;
+  case MIR_DLT:
+  case MIR_LDLT: bc_compare_value (ctx, ops, CMP_DOUBLE, CMP_LT); break;
+  case MIR_DLE:
+  case MIR_LDLE: bc_compare_value (ctx, ops, CMP_DOUBLE, CMP_LE); break;
+  case MIR_DGT:
+  case MIR_LDGT: bc_compare_value (ctx, ops, CMP_DOUBLE, CMP_GT); break;
+  case MIR_DGE:
+  case MIR_LDGE: bc_compare_value (ctx, ops, CMP_DOUBLE, CMP_GE); break;
+  case MIR_JMP:
+    bc_branch (JVM_GOTO, ops[0], 0);
+    bc_reachable_p = FALSE;
+    break;
+  case MIR_SWITCH: {
+    bc_fixup_t fixup;
+
+    bc_push_op_as (ctx, ops[0], JT_I);
+    fixup.pc = VARR_LENGTH (uint8_t, bc_code);
+    fixup.wide_p = TRUE;
+    bc_op (JVM_TABLESWITCH, -1);
+    while (VARR_LENGTH (uint8_t, bc_code) % 4 != 0) bc_u1 (0);
+    /* An index out of range is undefined in MIR: go to the first case */
+    for (size_t i = 0; i < insn->nops; i++) {
+      if (i == 1) {
+        bc_u2 (0); /* low */
+        bc_u2 (0);
+        put_u4 (bc_code, (uint32_t) (insn->nops - 2)); /* high */
+      }
+      fixup.pos = VARR_LENGTH (uint8_t, bc_code);
+      fixup.label = ops[i == 0 ? 1 : i].u.label;
+      VARR_PUSH (bc_fixup_t, bc_fixups, fixup);
+      put_u4 (bc_code, 0);
+    }
+    bc_reachable_p = FALSE;
+    break;
+  }
+  case MIR_BT: bc_test_branch (ctx, ops, FALSE, CMP_NE); break;
+  case MIR_BF: bc_test_branch (ctx, ops, FALSE, CMP_EQ); break;
+  case MIR_BTS: bc_test_branch (ctx, ops, TRUE, CMP_NE); break;
+  case MIR_BFS: bc_test_branch (ctx, ops, TRUE, CMP_EQ); break;
+  case MIR_BEQ: bc_compare_branch (ctx, ops, CMP_LONG, CMP_EQ); break;
+  case MIR_BNE: bc_compare_branch (ctx, ops, CMP_LONG, CMP_NE); break;
+  case MIR_BLT: bc_compare_branch (ctx, ops, CMP_LONG, CMP_LT); break;
+  case MIR_BLE: bc_compare_branch (ctx, ops, CMP_LONG, CMP_LE); break;
+  case MIR_BGT: bc_compare_branch (ctx, ops, CMP_LONG, CMP_GT); break;
+  case MIR_BGE: bc_compare_branch (ctx, ops, CMP_LONG, CMP_GE); break;
+  case MIR_BEQS: bc_compare_branch (ctx, ops, CMP_INT, CMP_EQ); break;
+  case MIR_BNES: bc_compare_branch (ctx, ops, CMP_INT, CMP_NE); break;
+  case MIR_BLTS: bc_compare_branch (ctx, ops, CMP_INT, CMP_LT); break;
+  case MIR_BLES: bc_compare_branch (ctx, ops, CMP_INT, CMP_LE); break;
+  case MIR_BGTS: bc_compare_branch (ctx, ops, CMP_INT, CMP_GT); break;
+  case MIR_BGES: bc_compare_branch (ctx, ops, CMP_INT, CMP_GE); break;
+  case MIR_UBLT: bc_compare_branch (ctx, ops, CMP_ULONG, CMP_LT); break;
+  case MIR_UBLE: bc_compare_branch (ctx, ops, CMP_ULONG, CMP_LE); break;
+  case MIR_UBGT: bc_compare_branch (ctx, ops, CMP_ULONG, CMP_GT); break;
+  case MIR_UBGE: bc_compare_branch (ctx, ops, CMP_ULONG, CMP_GE); break;
+  case MIR_UBLTS: bc_compare_branch (ctx, ops, CMP_UINT, CMP_LT); break;
+  case MIR_UBLES: bc_compare_branch (ctx, ops, CMP_UINT, CMP_LE); break;
+  case MIR_UBGTS: bc_compare_branch (ctx, ops, CMP_UINT, CMP_GT); break;
+  case MIR_UBGES: bc_compare_branch (ctx, ops, CMP_UINT, CMP_GE); break;
+  case MIR_FBEQ: bc_compare_branch (ctx, ops, CMP_FLOAT, CMP_EQ); break;
+  case MIR_FBNE: bc_compare_branch (ctx, ops, CMP_FLOAT, CMP_NE); break;
+  case MIR_FBLT: bc_compare_branch (ctx, ops, CMP_FLOAT, CMP_LT); break;
+  case MIR_FBLE: bc_compare_branch (ctx, ops, CMP_FLOAT, CMP_LE); break;
+  case MIR_FBGT: bc_compare_branch (ctx, ops, CMP_FLOAT, CMP_GT); break;
+  case MIR_FBGE: bc_compare_branch (ctx, ops, CMP_FLOAT, CMP_GE); break;
+  case MIR_DBEQ:
+  case MIR_LDBEQ: bc_compare_branch (ctx, ops, CMP_DOUBLE, CMP_EQ); break;
+  case MIR_DBNE:
+  case MIR_LDBNE: bc_compare_branch (ctx, ops, CMP_DOUBLE, CMP_NE); break;
+  case MIR_DBLT:
+  case MIR_LDBLT: bc_compare_branch (ctx, ops, CMP_DOUBLE, CMP_LT); break;
+  case MIR_DBLE:
+  case MIR_LDBLE: bc_compare_branch (ctx, ops, CMP_DOUBLE, CMP_LE); break;
+  case MIR_DBGT:
+  case MIR_LDBGT: bc_compare_branch (ctx, ops, CMP_DOUBLE, CMP_GT); break;
+  case MIR_DBGE:
+  case MIR_LDBGE: bc_compare_branch (ctx, ops, CMP_DOUBLE, CMP_GE); break;
+  case MIR_ALLOCA:
+    bc_dst_start (ops[0]);
+    bc_aload (0);
+    bc_push_op_as (ctx, ops[1], JT_J);
+    bc_invoke_runtime ("mir_allocate", "(J)J");
+    bc_dst_end (ops[0], JT_J);
+    break;
+  case MIR_BSTART:
+    bc_dst_start (ops[0]);
+    bc_aload (0);
+    bc_invoke_runtime ("mir_get_stack_position", "()I");
+    bc_dst_end (ops[0], JT_I);
+    break;
+  case MIR_BEND:
+    bc_aload (0);
+    bc_push_op_as (ctx, ops[0], JT_I);
+    bc_invoke_runtime ("mir_set_stack_position", "(I)V");
+    break;
+  case MIR_CALL:
+  case MIR_INLINE: bc_call (ctx, insn); break;
+  case MIR_RET: {
+    static const int ops_ret[] = {JVM_RETURN, JVM_IRETURN, JVM_LRETURN, JVM_FRETURN, JVM_DRETURN};
+    int jt = JT_V;
+
+    if (insn->nops > 1 || (insn->nops == 1) != (curr_func->nres == 1)) {
+      bc_failed_p = TRUE;
+      break;
+    }
+    if (curr_func_has_stack_allocation) bc_set_stack_position (bc_saved_slot);
+    if (insn->nops != 0) jt = bc_cast (bc_push_op (ctx, ops[0]), curr_func->res_types[0]);
+    bc_op (ops_ret[jt], -jtype_size (jt));
+    bc_reachable_p = FALSE;
+    break;
+  }
+  case MIR_VA_START:
+    if (!curr_func->vararg_p) {
+      bc_failed_p = TRUE;
+      break;
+    }
+    bc_push_memory ();
+    bc_va_list_address (ctx, ops[0]);
+    bc_load (JT_J, bc_va_area_slot);
+    bc_mem_access (TRUE, MIR_T_I64);
+    break;
+  case MIR_VA_ARG:
+  case MIR_VA_BLOCK_ARG:
+    /* The result of va_arg is the address of the arg slot, see out_insn */
+    bc_push_memory ();
+    bc_va_list_address (ctx, ops[1]);
+    bc_mem_access (FALSE, MIR_T_I64);
+    bc_store (JT_J, bc_va_next_slot);
+    bc_push_memory ();
+    bc_va_list_address (ctx, ops[1]);
+    bc_load (JT_J, bc_va_next_slot);
+    if (insn->code == MIR_VA_ARG) {
+      bc_lconst (VA_SLOT_SIZE);
+    } else if (ops[2].mode == MIR_OP_INT || ops[2].mode == MIR_OP_UINT) {
+      bc_lconst ((int64_t) va_block_size (ops[2].u.u));
+    } else {
+      bc_push_op_as (ctx, ops[2], JT_J);
+      bc_lconst (VA_SLOT_SIZE - 1);
+      bc_op (JVM_LADD, -2);
+      bc_lconst (-VA_SLOT_SIZE);
+      bc_op (JVM_LAND, -2);
+    }
+    bc_op (JVM_LADD, -2);
+    bc_mem_access (TRUE, MIR_T_I64);
+    if (insn->code == MIR_VA_ARG) {
+      bc_dst_start (ops[0]);
+      bc_load (JT_J, bc_va_next_slot);
+      bc_dst_end (ops[0], JT_J);
+    } else {
+      bc_aload (0);
+      bc_load (JT_J, bc_va_next_slot);
+      bc_push_op_as (ctx, ops[0], JT_J);
+      bc_push_op_as (ctx, ops[2], JT_J);
+      bc_invoke_runtime ("mir_copy_memory", "(JJJ)V");
+    }
+    break;
+  case MIR_VA_END: break;
+  default: bc_failed_p = TRUE; break;
+  }
+}
+
+/* Does the current function need the temporaries of variadic calls? */
+static int bc_va_temps_p (void) {
+  for (MIR_insn_t insn = DLIST_HEAD (MIR_insn_t, curr_func->insns); insn != NULL;
+       insn = DLIST_NEXT (MIR_insn_t, insn))
+    if (insn->code == MIR_VA_ARG || insn->code == MIR_VA_BLOCK_ARG
+        || (MIR_call_code_p (insn->code) && insn->ops[0].mode == MIR_OP_REF
+            && insn->ops[0].u.ref->item_type == MIR_proto_item
+            && insn->ops[0].u.ref->u.proto->vararg_p))
+      return TRUE;
+  return FALSE;
+}
+
+/* Allocate the locals of the current function and emit its prologue.
+   Return the descriptor of the method.  */
+static char *bc_prologue (void) {
+  size_t i, nvars = VARR_LENGTH (MIR_var_t, curr_func->vars);
+  char *desc = malloc (curr_func->nargs + 5);
+  VARR (int) * arg_slots;
+
+  VARR_CREATE (int, arg_slots, 0);
+  VARR_PUSH (uint8_t, bc_locals, 'A'); /* this */
+  bc_nslots = 1;
+  strcpy (desc, "(");
+  for (i = 0; i < curr_func->nargs; i++) {
+    char letter = type_desc_letter (VARR_GET (MIR_var_t, curr_func->vars, i).type);
+
+    VARR_PUSH (int, arg_slots, bc_new_local (jtype_letter (letter_jtype (letter))));
+    desc_add (desc, letter);
+  }
+  if (curr_func->vararg_p) {
+    bc_va_area_slot = bc_new_local ('J');
+    desc_add (desc, 'J');
+  }
+  desc_add (desc, ')');
+  desc_add (desc, curr_func->nres == 0 ? 'V' : type_desc_letter (curr_func->res_types[0]));
+  VARR_TRUNC (int, bc_var_slots, 0);
+  VARR_TRUNC (int, bc_var_jtypes, 0);
+  for (i = 0; i < nvars; i++) {
+    MIR_type_t t = VARR_GET (MIR_var_t, curr_func->vars, i).type;
+    int jt = bitmap_bit_p (int_vars, i) ? JT_I : t == MIR_T_F ? JT_F : t == MIR_T_D || t == MIR_T_LD ? JT_D : JT_J;
+    int slot = -1;
+
+    if (i < curr_func->nargs) {
+      /* A param is converted as by the Java emission, which names it _<name> */
+      int arg_jt = jtype (t), arg_slot = VARR_GET (int, arg_slots, i);
+
+      if (jt == arg_jt && t != MIR_T_U8 && t != MIR_T_U16 && t != MIR_T_U32) {
+        slot = arg_slot;
+      } else {
+        slot = bc_new_local (jtype_letter (jt));
+        bc_load (arg_jt, arg_slot);
+        bc_conv (arg_jt, jt);
+        if (t == MIR_T_U8 || t == MIR_T_U16 || (t == MIR_T_U32 && jt == JT_J)) {
+          int64_t mask = t == MIR_T_U8 ? 0xFF : t == MIR_T_U16 ? 0xFFFF : 0xFFFFFFFFLL;
+
+          if (jt == JT_I) {
+            bc_iconst ((int32_t) mask);
+            bc_op (JVM_IAND, -1);
+          } else {
+            bc_lconst (mask);
+            bc_op (JVM_LAND, -2);
+          }
+        }
+        bc_store (jt, slot);
+      }
+    } else if (var_referenced_p (i)) {
+      slot = bc_new_local (jtype_letter (jt));
+      bc_zero (jt);
+      bc_store (jt, slot);
+    }
+    VARR_PUSH (int, bc_var_slots, slot);
+    VARR_PUSH (int, bc_var_jtypes, jt);
+  }
+  VARR_DESTROY (int, arg_slots);
+  if (!legacy_memory_p) {
+    bc_mem_slot = bc_new_local ('M');
+    bc_memory_reload ();
+  }
+  if (curr_func_has_stack_allocation) {
+    bc_saved_slot = bc_new_local ('I');
+    bc_aload (0);
+    bc_invoke_runtime ("mir_get_stack_position", "()I");
+    bc_store (JT_I, bc_saved_slot);
+  }
+  if (bc_va_temps_p ()) {
+    bc_va_saved_slot = bc_new_local ('I');
+    bc_va_args_slot = bc_new_local ('J');
+    bc_va_next_slot = bc_new_local ('J');
+    bc_iconst (0);
+    bc_store (JT_I, bc_va_saved_slot);
+    bc_lconst (0);
+    bc_store (JT_J, bc_va_args_slot);
+    bc_lconst (0);
+    bc_store (JT_J, bc_va_next_slot);
+  }
+  return desc;
+}
+
+/* Append the StackMapTable attribute of the method code to v: the locals
+   are the same at all labels */
+static void out_stack_map_table (VARR (uint8_t) * v) {
+  size_t nframes = VARR_LENGTH (int, bc_frame_pcs), start;
+  int prev_pc = -1;
+
+  put_u2 (v, cp_utf8 ("StackMapTable"));
+  start = VARR_LENGTH (uint8_t, v);
+  put_u4 (v, 0);
+  put_u2 (v, (int) nframes);
+  for (size_t i = 0; i < nframes; i++) {
+    int pc = VARR_GET (int, bc_frame_pcs, i), delta = prev_pc < 0 ? pc : pc - prev_pc - 1;
+
+    prev_pc = pc;
+    if (i != 0 && delta <= 63) {
+      put_u1 (v, delta); /* same_frame */
+      continue;
+    }
+    if (i != 0) {
+      put_u1 (v, 251); /* same_frame_extended */
+      put_u2 (v, delta);
+      continue;
+    }
+    put_u1 (v, 255); /* full_frame */
+    put_u2 (v, delta);
+    put_u2 (v, (int) VARR_LENGTH (uint8_t, bc_locals));
+    for (size_t j = 0; j < VARR_LENGTH (uint8_t, bc_locals); j++) {
+      switch (VARR_GET (uint8_t, bc_locals, j)) {
+      case 'I': put_u1 (v, 1); break;
+      case 'F': put_u1 (v, 2); break;
+      case 'D': put_u1 (v, 3); break;
+      case 'J': put_u1 (v, 4); break;
+      case 'A':
+        put_u1 (v, 7);
+        put_u2 (v, cp_class (class_name));
+        break;
+      case 'M':
+        put_u1 (v, 7);
+        put_u2 (v, cp_class (paged_memory_p ? "[[B" : "[B"));
+        break;
+      default: mir_assert (FALSE);
+      }
+    }
+    put_u2 (v, 0); /* stack */
+  }
+  /* The attribute length */
+  for (int i = 0; i < 4; i++)
+    VARR_SET (uint8_t, v, start + i,
+              (uint8_t) ((VARR_LENGTH (uint8_t, v) - start - 4) >> (8 * (3 - i))));
+}
+
+/* Resolve the branch offsets.  Return FALSE if one does not fit.  */
+static int bc_resolve_fixups (void) {
+  for (size_t i = 0; i < VARR_LENGTH (bc_fixup_t, bc_fixups); i++) {
+    bc_fixup_t fixup = VARR_GET (bc_fixup_t, bc_fixups, i);
+    int64_t offset = (int64_t) (intptr_t) fixup.label->data - (int64_t) fixup.pc;
+    int size = fixup.wide_p ? 4 : 2;
+
+    if (!fixup.wide_p && (offset < -32768 || offset > 32767)) return FALSE;
+    for (int k = 0; k < size; k++)
+      VARR_SET (uint8_t, bc_code, fixup.pos + k, (uint8_t) (offset >> (8 * (size - 1 - k))));
+  }
+  return TRUE;
+}
+
+/* Add the current function, prepared by prepare_func, as method name of the
+   class in the buffer.  Return FALSE if it must be emitted as Java.  */
+static int gen_class_method (MIR_context_t ctx, MIR_item_t item, const char *name) {
+  size_t code_len, start;
+  char *desc;
+
+  if (curr_func_setjmp_calls > 0 || curr_func->nres > 1) return FALSE;
+  VARR_TRUNC (uint8_t, bc_code, 0);
+  VARR_TRUNC (uint8_t, bc_locals, 0);
+  VARR_TRUNC (bc_fixup_t, bc_fixups, 0);
+  VARR_TRUNC (int, bc_frame_pcs, 0);
+  bc_stack_depth = bc_max_stack = 0;
+  bc_failed_p = FALSE;
+  bc_reachable_p = TRUE;
+  desc = bc_prologue ();
+  for (MIR_insn_t insn = DLIST_HEAD (MIR_insn_t, curr_func->insns); insn != NULL && !bc_failed_p;
+       insn = DLIST_NEXT (MIR_insn_t, insn)) {
+    if (insn->code == MIR_LABEL) {
+      int pc = (int) VARR_LENGTH (uint8_t, bc_code);
+
+      if (pc == 0) { /* keep the first frame after the implicit one */
+        bc_u1 (JVM_NOP);
+        pc++;
+      }
+      insn->data = (void *) (intptr_t) pc;
+      if (VARR_LENGTH (int, bc_frame_pcs) == 0 || VARR_LAST (int, bc_frame_pcs) != pc)
+        VARR_PUSH (int, bc_frame_pcs, pc);
+      bc_reachable_p = TRUE;
+      continue;
+    }
+    if (!bc_reachable_p) continue; /* after a jump or a return */
+    bc_gen_insn (ctx, insn);
+    if (may_grow_memory_p (insn)) bc_memory_reload ();
+    mir_assert (bc_failed_p || bc_stack_depth == 0);
+  }
+  if (bc_reachable_p && !bc_failed_p) { /* falling off the end */
+    int jt = curr_func->nres == 0 ? JT_V : jtype (curr_func->res_types[0]);
+    static const int ops_ret[] = {JVM_RETURN, JVM_IRETURN, JVM_LRETURN, JVM_FRETURN, JVM_DRETURN};
+
+    bc_zero (jt);
+    bc_op (ops_ret[jt], -jtype_size (jt));
+  }
+  code_len = VARR_LENGTH (uint8_t, bc_code);
+  if (bc_failed_p || code_len > 65535 || bc_nslots > 65535 || !bc_resolve_fixups ()) {
+    free (desc);
+    return FALSE;
+  }
+  put_u2 (class_methods, item->export_p ? 0x0001 : 0x0004); /* ACC_PUBLIC or ACC_PROTECTED */
+  put_u2 (class_methods, cp_utf8 (name));
+  put_u2 (class_methods, cp_utf8 (desc));
+  free (desc);
+  put_u2 (class_methods, 1);
+  put_u2 (class_methods, cp_utf8 ("Code"));
+  start = VARR_LENGTH (uint8_t, class_methods);
+  put_u4 (class_methods, 0);
+  put_u2 (class_methods, bc_max_stack);
+  put_u2 (class_methods, bc_nslots);
+  put_u4 (class_methods, (uint32_t) code_len);
+  put_bytes (class_methods, VARR_ADDR (uint8_t, bc_code), code_len);
+  put_u2 (class_methods, 0); /* exception_table_length */
+  put_u2 (class_methods, VARR_LENGTH (int, bc_frame_pcs) == 0 ? 0 : 1);
+  if (VARR_LENGTH (int, bc_frame_pcs) != 0) out_stack_map_table (class_methods);
+  for (int i = 0; i < 4; i++)
+    VARR_SET (uint8_t, class_methods, start + i,
+              (uint8_t) ((VARR_LENGTH (uint8_t, class_methods) - start - 4) >> (8 * (3 - i))));
+  class_nmethods++;
+  return TRUE;
+}
+
+static void create_class_data (void) {
+  HTAB_CREATE (cp_entry_t, cp_tab, 1024, cp_entry_hash, cp_entry_eq, NULL);
+  VARR_CREATE (uint8_t, cp_bytes, 0);
+  VARR_CREATE (uint8_t, class_methods, 0);
+  VARR_CREATE (char_ptr_t, bridge_names, 0);
+  VARR_CREATE (uint8_t, bc_code, 0);
+  VARR_CREATE (uint8_t, bc_locals, 0);
+  VARR_CREATE (bc_fixup_t, bc_fixups, 0);
+  VARR_CREATE (int, bc_frame_pcs, 0);
+  VARR_CREATE (int, bc_var_slots, 0);
+  VARR_CREATE (int, bc_var_jtypes, 0);
+  class_part = 0;
+}
+
+static void destroy_class_data (void) {
+  for (size_t i = 0; i < VARR_LENGTH (char_ptr_t, bridge_names); i++)
+    free (VARR_GET (char_ptr_t, bridge_names, i));
+  HTAB_DESTROY (cp_entry_t, cp_tab);
+  VARR_DESTROY (uint8_t, cp_bytes);
+  VARR_DESTROY (uint8_t, class_methods);
+  VARR_DESTROY (char_ptr_t, bridge_names);
+  VARR_DESTROY (uint8_t, bc_code);
+  VARR_DESTROY (uint8_t, bc_locals);
+  VARR_DESTROY (bc_fixup_t, bc_fixups);
+  VARR_DESTROY (int, bc_frame_pcs);
+  VARR_DESTROY (int, bc_var_slots);
+  VARR_DESTROY (int, bc_var_jtypes);
+}
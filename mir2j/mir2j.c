@@ -27,13 +27,40 @@ SOFTWARE.
 #include <inttypes.h>
 #include <string.h>
 #include <mir-hash.h>
+#include <mir-bitmap.h>
 
 static MIR_func_t curr_func;
-static int unused_data_addr_count = 0;
 // This flag prevents jump after a return statement (bug ?) 
 static int is_in_dead_code = FALSE;
 static char curr_func_has_stack_allocation = FALSE;
+static int curr_func_number_of_labels;
+/* Number of setjmp calls in the current function and of those already emitted */
+static int curr_func_setjmp_calls, setjmp_call_num;
+static bitmap_t int_vars; /* vars of the current function declared as Java int */
+typedef char *char_ptr_t;
+DEF_VARR (char_ptr_t);
+/* Signatures (e.g. "J_JD") of the MethodType fields used by indirect calls */
+static VARR (char_ptr_t) * handle_types;
 static int module_serial = 0;  /* 1, 2, 3, ... */
+/* Use the byte-wise Runtime accessors (pure Java 1.2, e.g. for TeaVM/GWT)
+   instead of the VarHandle based Memory class */
+static int legacy_memory_p = FALSE;
+/* Memory is paged (Runtime.pages) instead of one byte[], so it can go
+   beyond 2 GB.  Accessors are then in class PagedMemory.  */
+static int paged_memory_p = FALSE;
+/* Skip the peephole pass over MIR (-O0) */
+static int no_opt_p = FALSE;
+/* Run the generator SSA optimizations before the peephole pass (-O2) */
+static int gen_opt_p = FALSE;
+/* Multi-class output: with -d, the functions of each module go to their own
+   classes MainPart<n> in output_dir, with at most class_func_limit functions
+   per class if it is not zero.  The part classes form an inheritance chain
+   from MainBase, which declares all functions and data addresses, to Main,
+   so the generated code still reaches the runtime and other functions through
+   this.  */
+static const char *output_dir = NULL;
+static int class_func_limit = 0;
+static FILE *base_f; /* MainBase members, NULL for single class output */
 
 /* Symbol table */
 typedef struct mir2j_symbol {
@@ -157,6 +184,184 @@ static inline void fprintf_long_double (FILE *f, long double x) {
   fprintf(f, "%.17g", (double) x);
 }
 
+/* Exported definitions of all modules, to resolve imports between them */
+typedef struct export_def {
+  const char *name;
+  MIR_item_t def;
+} export_def_t;
+
+DEF_HTAB (export_def_t);
+
+static HTAB (export_def_t) * export_tab;
+
+static int export_def_eq (export_def_t a, export_def_t b, void *arg) {
+  return strcmp (a.name, b.name) == 0;
+}
+
+static htab_hash_t export_def_hash (export_def_t a, void *arg) {
+  return (htab_hash_t) mir_hash (a.name, strlen (a.name), 0);
+}
+
+/* Return the definition of an export or forward item or of an item
+   imported from another module, or item itself */
+static MIR_item_t resolve_ref_item (MIR_item_t item) {
+  export_def_t el;
+
+  if ((item->item_type == MIR_export_item || item->item_type == MIR_forward_item)
+      && item->ref_def != NULL)
+    return item->ref_def;
+  if (item->item_type != MIR_import_item) return item;
+  el.name = item->u.import_id;
+  return HTAB_DO (export_def_t, export_tab, el, HTAB_FIND, el) ? el.def : item;
+}
+
+static void build_export_tab (MIR_context_t ctx) {
+  export_def_t el;
+
+  HTAB_CREATE (export_def_t, export_tab, 1024, export_def_hash, export_def_eq, NULL);
+  for (MIR_module_t m = DLIST_HEAD (MIR_module_t, *MIR_get_module_list (ctx)); m != NULL;
+       m = DLIST_NEXT (MIR_module_t, m))
+    for (MIR_item_t it = DLIST_HEAD (MIR_item_t, m->items); it != NULL;
+         it = DLIST_NEXT (MIR_item_t, it))
+      if (it->item_type == MIR_export_item && it->ref_def != NULL) {
+        el.name = it->u.export_id;
+        el.def = it->ref_def;
+        HTAB_DO (export_def_t, export_tab, el, HTAB_REPLACE, el);
+      }
+}
+
+/* Return the function an operand refers to, or NULL */
+static MIR_item_t op_func_item (MIR_op_t op) {
+  MIR_item_t item;
+
+  if (op.mode != MIR_OP_REF) return NULL;
+  item = resolve_ref_item (op.u.ref);
+  return item->item_type == MIR_func_item ? item : NULL;
+}
+
+/* String and memory functions implemented by Runtime with bulk array
+   operations.  Their definitions in the bundled libc.c, whose module exports
+   LIBC_MARKER_NAME, are dropped: calls go to the Runtime method of the same
+   name.  A definition in any other module is translated as usual, as it may
+   not have the standard semantics.  */
+#define LIBC_MARKER_NAME "__mir2j_libc"
+
+static MIR_module_t libc_module; /* module of the bundled libc or NULL */
+
+static const struct {
+  const char *name;
+  size_t nargs;
+} runtime_intrinsics[] = {
+  {"memchr", 3}, {"memcmp", 3}, {"memcpy", 3}, {"memmove", 3}, {"memset", 3}, {"strcat", 2},
+  {"strchr", 2}, {"strcmp", 2}, {"strcpy", 2}, {"strlen", 1},  {"strncmp", 3},
+};
+
+static int runtime_intrinsic_p (MIR_item_t item) {
+  MIR_func_t func;
+
+  if (item->item_type != MIR_func_item || !item->export_p || item->module != libc_module)
+    return FALSE;
+  func = item->u.func;
+  if (func->nres != 1 || func->vararg_p) return FALSE;
+  for (size_t i = 0; i < sizeof (runtime_intrinsics) / sizeof (runtime_intrinsics[0]); i++)
+    if (strcmp (func->name, runtime_intrinsics[i].name) == 0)
+      return func->nargs == runtime_intrinsics[i].nargs;
+  return FALSE;
+}
+
+static void find_libc_module (MIR_context_t ctx) {
+  libc_module = NULL;
+  for (MIR_module_t m = DLIST_HEAD (MIR_module_t, *MIR_get_module_list (ctx)); m != NULL;
+       m = DLIST_NEXT (MIR_module_t, m))
+    for (MIR_item_t it = DLIST_HEAD (MIR_item_t, m->items); it != NULL;
+         it = DLIST_NEXT (MIR_item_t, it)) {
+      const char *name = MIR_item_name (ctx, it);
+
+      if (it->export_p && name != NULL && strcmp (name, LIBC_MARKER_NAME) == 0) libc_module = m;
+    }
+}
+
+/* Function address table.  Every function whose address is taken gets a
+   dense index at translation time: its address is the constant
+   Runtime.FUNCTION_ADDRESS_BASE + index, and indirect calls go through the
+   switch dispatchers of the generated MainFunctions class.  */
+#define FUNCTION_ADDRESS_BASE 0x1000000000000LL
+
+typedef struct fn_addr {
+  MIR_item_t func;
+  int index;
+} fn_addr_t;
+
+DEF_HTAB (fn_addr_t);
+DEF_VARR (MIR_item_t);
+
+static HTAB (fn_addr_t) * fn_addr_tab;
+static VARR (MIR_item_t) * fn_table;     /* address-taken funcs in index order */
+static VARR (char_ptr_t) * fn_table_names; /* their Java names, set when emitted */
+
+static int fn_addr_eq (fn_addr_t a, fn_addr_t b, void *arg) { return a.func == b.func; }
+
+static htab_hash_t fn_addr_hash (fn_addr_t a, void *arg) {
+  return (htab_hash_t) mir_hash_finish (mir_hash_step (mir_hash_init (0), (uint64_t) a.func));
+}
+
+static void add_fn_addr (MIR_item_t func) {
+  fn_addr_t el = {func, (int) VARR_LENGTH (MIR_item_t, fn_table)};
+
+  if (HTAB_DO (fn_addr_t, fn_addr_tab, el, HTAB_FIND, el)) return;
+  HTAB_DO (fn_addr_t, fn_addr_tab, el, HTAB_INSERT, el);
+  VARR_PUSH (MIR_item_t, fn_table, func);
+  VARR_PUSH (char_ptr_t, fn_table_names, NULL);
+}
+
+/* Return index of func in the address table or -1 */
+static int fn_addr_index (MIR_item_t func) {
+  fn_addr_t el;
+
+  el.func = func;
+  return HTAB_DO (fn_addr_t, fn_addr_tab, el, HTAB_FIND, el) ? el.index : -1;
+}
+
+/* Collect the funcs whose address is taken in all modules */
+static void build_fn_table (MIR_context_t ctx) {
+  HTAB_CREATE (fn_addr_t, fn_addr_tab, 64, fn_addr_hash, fn_addr_eq, NULL);
+  VARR_CREATE (MIR_item_t, fn_table, 0);
+  VARR_CREATE (char_ptr_t, fn_table_names, 0);
+  for (MIR_module_t m = DLIST_HEAD (MIR_module_t, *MIR_get_module_list (ctx)); m != NULL;
+       m = DLIST_NEXT (MIR_module_t, m))
+    for (MIR_item_t it = DLIST_HEAD (MIR_item_t, m->items); it != NULL;
+         it = DLIST_NEXT (MIR_item_t, it)) {
+      if (it->item_type == MIR_ref_data_item) {
+        MIR_item_t ref_item = resolve_ref_item (it->u.ref_data->ref_item);
+
+        if (ref_item->item_type == MIR_func_item) add_fn_addr (ref_item);
+        continue;
+      }
+      if (it->item_type != MIR_func_item) continue;
+      for (MIR_insn_t insn = DLIST_HEAD (MIR_insn_t, it->u.func->insns); insn != NULL;
+           insn = DLIST_NEXT (MIR_insn_t, insn))
+        for (size_t i = MIR_call_code_p (insn->code) ? 2 : 0; i < insn->nops; i++)
+          if (op_func_item (insn->ops[i]) != NULL) add_fn_addr (op_func_item (insn->ops[i]));
+    }
+}
+
+static void destroy_export_tab (void) { HTAB_DESTROY (export_def_t, export_tab); }
+
+static void destroy_fn_table (void) {
+  HTAB_DESTROY (fn_addr_t, fn_addr_tab);
+  VARR_DESTROY (MIR_item_t, fn_table);
+  VARR_DESTROY (char_ptr_t, fn_table_names);
+}
+
+/* Emit the constant address of func */
+static void out_fn_address (MIR_context_t ctx, FILE *f, MIR_item_t func) {
+  int index = fn_addr_index (func);
+
+  mir_assert (index >= 0);
+  fprintf_long_hex (f, FUNCTION_ADDRESS_BASE + index);
+  fprintf (f, " /* &%s */", MIR_item_name (ctx, func));
+}
+
 static size_t get_MIR_type_size (MIR_type_t type) {
   switch (type) {
   case MIR_T_I8: return sizeof (int8_t);
@@ -175,30 +380,320 @@ static size_t get_MIR_type_size (MIR_type_t type) {
   }
 }
 
-static void out_mangled_type (FILE *f, MIR_type_t t) {
+/* Data image.  All data, bss and ref data items are laid out at translation
+   time into one little-endian image loaded at Runtime.DATA_ADDRESS, so data
+   addresses are constants.  Like the MIR loader, a section is an item
+   followed by the unnamed data items after it.  The string literals of the
+   functions follow the non-zero sections, each distinct literal once.
+   Sections holding only zeros go after them and are not stored in the
+   image.  */
+#define DATA_ADDRESS 8
+#define DATA_SECTION_ALIGN 16
+#define DATA_CHUNK_SIZE 32767 /* bytes per Java string constant */
+
+typedef struct data_addr {
+  MIR_item_t item;
+  uint64_t addr;
+} data_addr_t;
+
+DEF_HTAB (data_addr_t);
+DEF_VARR (uint8_t);
+
+static HTAB (data_addr_t) * data_addr_tab;
+static VARR (uint8_t) * data_image;
+static VARR (MIR_item_t) * data_relocs; /* ref data resolved at run time */
+static size_t data_size;                /* image and trailing zero sections */
+
+typedef struct str_addr {
+  MIR_str_t str;
+  uint64_t addr;
+} str_addr_t;
+
+DEF_HTAB (str_addr_t);
+
+static HTAB (str_addr_t) * str_addr_tab;
+
+static int data_addr_eq (data_addr_t a, data_addr_t b, void *arg) { return a.item == b.item; }
+
+static htab_hash_t data_addr_hash (data_addr_t a, void *arg) {
+  return (htab_hash_t) mir_hash_finish (mir_hash_step (mir_hash_init (0), (uint64_t) a.item));
+}
+
+static int data_item_p (MIR_item_t item) {
+  return (item->item_type == MIR_data_item || item->item_type == MIR_bss_item
+          || item->item_type == MIR_ref_data_item || item->item_type == MIR_expr_data_item);
+}
+
+/* Size of a data item in the image.  long double is a Java double stored in
+   the first 8 bytes of a MIR long double.  */
+static size_t data_item_size (MIR_item_t item) {
+  switch (item->item_type) {
+  case MIR_data_item: return item->u.data->nel * get_MIR_type_size (item->u.data->el_type);
+  case MIR_bss_item: return item->u.bss->len;
+  case MIR_ref_data_item: return get_MIR_type_size (MIR_T_P);
+  default: mir_assert (FALSE); return 0;
+  }
+}
+
+static MIR_item_t data_section_end (MIR_context_t ctx, MIR_item_t head, int *zero_p, size_t *size) {
+  MIR_item_t item = head;
+
+  *zero_p = TRUE;
+  *size = 0;
+  do {
+    if (item->item_type == MIR_expr_data_item)
+      (*MIR_get_error_func (ctx)) (MIR_func_error, "Expr data items are not supported yet");
+    if (item->item_type == MIR_ref_data_item) *zero_p = FALSE;
+    if (item->item_type == MIR_data_item)
+      for (size_t i = 0; *zero_p && i < data_item_size (item); i++)
+        if (item->u.data->u.els[i] != 0) *zero_p = FALSE;
+    *size += data_item_size (item);
+    item = DLIST_NEXT (MIR_item_t, item);
+  } while (item != NULL && data_item_p (item) && MIR_item_name (ctx, item) == NULL);
+  return item;
+}
+
+static void set_data_addrs (MIR_context_t ctx, int zero_sections_p) {
+  data_addr_t el;
+  MIR_item_t end;
+  size_t size;
+  int zero_p;
+
+  for (MIR_module_t m = DLIST_HEAD (MIR_module_t, *MIR_get_module_list (ctx)); m != NULL;
+       m = DLIST_NEXT (MIR_module_t, m))
+    for (MIR_item_t it = DLIST_HEAD (MIR_item_t, m->items); it != NULL; it = end) {
+      if (!data_item_p (it)) {
+        end = DLIST_NEXT (MIR_item_t, it);
+        continue;
+      }
+      end = data_section_end (ctx, it, &zero_p, &size);
+      if (zero_p != zero_sections_p) continue;
+      data_size = (data_size + DATA_SECTION_ALIGN - 1) / DATA_SECTION_ALIGN * DATA_SECTION_ALIGN;
+      for (MIR_item_t item = it; item != end; item = DLIST_NEXT (MIR_item_t, item)) {
+        el.item = item;
+        el.addr = DATA_ADDRESS + data_size;
+        HTAB_DO (data_addr_t, data_addr_tab, el, HTAB_INSERT, el);
+        data_size += data_item_size (item);
+      }
+    }
+}
+
+static int str_addr_eq (str_addr_t a, str_addr_t b, void *arg) {
+  return a.str.len == b.str.len && memcmp (a.str.s, b.str.s, a.str.len) == 0;
+}
+
+static htab_hash_t str_addr_hash (str_addr_t a, void *arg) {
+  return (htab_hash_t) mir_hash (a.str.s, a.str.len, 0);
+}
+
+/* Size of a string literal in the image, terminating zero included */
+static size_t str_size (MIR_str_t str) {
+  return str.len != 0 && str.s[str.len - 1] == '\0' ? str.len : str.len + 1;
+}
+
+/* Give addresses to the string literals of the functions or, if fill_p,
+   copy them into the image */
+static void set_str_addrs (MIR_context_t ctx, int fill_p) {
+  str_addr_t el;
+
+  for (MIR_module_t m = DLIST_HEAD (MIR_module_t, *MIR_get_module_list (ctx)); m != NULL;
+       m = DLIST_NEXT (MIR_module_t, m))
+    for (MIR_item_t it = DLIST_HEAD (MIR_item_t, m->items); it != NULL;
+         it = DLIST_NEXT (MIR_item_t, it)) {
+      if (it->item_type != MIR_func_item) continue;
+      for (MIR_insn_t insn = DLIST_HEAD (MIR_insn_t, it->u.func->insns); insn != NULL;
+           insn = DLIST_NEXT (MIR_insn_t, insn))
+        for (size_t i = 0; i < insn->nops; i++) {
+          if (insn->ops[i].mode != MIR_OP_STR) continue;
+          el.str = insn->ops[i].u.str;
+          if (fill_p) {
+            HTAB_DO (str_addr_t, str_addr_tab, el, HTAB_FIND, el);
+            memcpy (VARR_ADDR (uint8_t, data_image) + el.addr - DATA_ADDRESS, el.str.s, el.str.len);
+          } else if (!HTAB_DO (str_addr_t, str_addr_tab, el, HTAB_FIND, el)) {
+            el.addr = DATA_ADDRESS + data_size;
+            HTAB_DO (str_addr_t, str_addr_tab, el, HTAB_INSERT, el);
+            data_size += str_size (el.str);
+          }
+        }
+    }
+}
+
+/* Return address of a string literal */
+static uint64_t str_addr (MIR_str_t str) {
+  str_addr_t el;
+
+  el.str = str;
+  if (!HTAB_DO (str_addr_t, str_addr_tab, el, HTAB_FIND, el)) {
+    fprintf (stderr, "m2j: no address for a string literal of %lu bytes in the data image\n",
+             (unsigned long) str.len);
+    exit (1);
+  }
+  return el.addr;
+}
+
+static const char *data_item_name (MIR_item_t item) {
+  const char *name = NULL;
+
+  switch (item->item_type) {
+  case MIR_data_item: name = item->u.data->name; break;
+  case MIR_bss_item: name = item->u.bss->name; break;
+  case MIR_ref_data_item: name = item->u.ref_data->name; break;
+  case MIR_expr_data_item: name = item->u.expr_data->name; break;
+  default: break;
+  }
+  return name != NULL ? name : "<anonymous>";
+}
+
+/* Return address of a data item */
+static uint64_t data_addr (MIR_item_t item) {
+  data_addr_t el;
+
+  el.item = item;
+  if (!HTAB_DO (data_addr_t, data_addr_tab, el, HTAB_FIND, el)) {
+    fprintf (stderr, "m2j: no address for data item %s in the data image\n", data_item_name (item));
+    exit (1);
+  }
+  return el.addr;
+}
+
+static void put_data_value (uint64_t addr, uint64_t v) {
+  for (int i = 0; i < 8; i++) VARR_SET (uint8_t, data_image, addr - DATA_ADDRESS + i, (uint8_t) (v >> (8 * i)));
+}
+
+/* Fill the image of a data or ref data item */
+static void fill_data_item (MIR_context_t ctx, MIR_item_t item) {
+  uint64_t addr = data_addr (item);
+
+  if (item->item_type == MIR_data_item) {
+    MIR_data_t data = item->u.data;
+
+    if (data->el_type == MIR_T_LD) {
+      for (size_t i = 0; i < data->nel; i++) {
+        double d = (double) ((long double *) data->u.els)[i];
+        uint64_t v;
+
+        memcpy (&v, &d, sizeof (v));
+        put_data_value (addr + i * get_MIR_type_size (MIR_T_LD), v);
+      }
+    } else {
+      memcpy (VARR_ADDR (uint8_t, data_image) + addr - DATA_ADDRESS, data->u.els, data_item_size (item));
+    }
+  } else if (item->item_type == MIR_ref_data_item) {
+    MIR_item_t ref_item = resolve_ref_item (item->u.ref_data->ref_item);
+    int64_t disp = item->u.ref_data->disp;
+
+    if (ref_item->item_type == MIR_func_item)
+      put_data_value (addr, FUNCTION_ADDRESS_BASE + fn_addr_index (ref_item) + disp);
+    else if (data_item_p (ref_item))
+      put_data_value (addr, data_addr (ref_item) + disp);
+    else
+      VARR_PUSH (MIR_item_t, data_relocs, item);
+  }
+}
+
+static void build_data_image (MIR_context_t ctx) {
+  size_t image_size;
+
+  HTAB_CREATE (data_addr_t, data_addr_tab, 1024, data_addr_hash, data_addr_eq, NULL);
+  HTAB_CREATE (str_addr_t, str_addr_tab, 1024, str_addr_hash, str_addr_eq, NULL);
+  VARR_CREATE (uint8_t, data_image, 0);
+  VARR_CREATE (MIR_item_t, data_relocs, 0);
+  data_size = 0;
+  set_data_addrs (ctx, FALSE);
+  set_str_addrs (ctx, FALSE);
+  image_size = data_size;
+  set_data_addrs (ctx, TRUE);
+  while (VARR_LENGTH (uint8_t, data_image) < image_size) VARR_PUSH (uint8_t, data_image, 0);
+  for (MIR_module_t m = DLIST_HEAD (MIR_module_t, *MIR_get_module_list (ctx)); m != NULL;
+       m = DLIST_NEXT (MIR_module_t, m))
+    for (MIR_item_t it = DLIST_HEAD (MIR_item_t, m->items); it != NULL;
+         it = DLIST_NEXT (MIR_item_t, it))
+      if (data_item_p (it) && data_addr (it) < DATA_ADDRESS + image_size) fill_data_item (ctx, it);
+  set_str_addrs (ctx, TRUE);
+}
+
+static void destroy_data_image (void) {
+  HTAB_DESTROY (data_addr_t, data_addr_tab);
+  HTAB_DESTROY (str_addr_t, str_addr_tab);
+  VARR_DESTROY (uint8_t, data_image);
+  VARR_DESTROY (MIR_item_t, data_relocs);
+}
+
+/* Load the image when Main is constructed and apply the relocations to
+   symbols the translated modules do not define */
+static void out_data_init (MIR_context_t ctx, FILE *f) {
+  fprintf (f, "{\n");
+  fprintf (f, "  mir_load_data(MainData.CHUNKS, %lu);\n", (unsigned long) data_size);
+  for (size_t i = 0; i < VARR_LENGTH (MIR_item_t, data_relocs); i++) {
+    MIR_item_t item = VARR_GET (MIR_item_t, data_relocs, i);
+
+    fprintf (f, "  mir_write_long(");
+    fprintf_long_hex (f, data_addr (item));
+    fprintf (f, ", %s + %ldL);\n", get_mangled_symbol_name (MIR_item_name (ctx, item->u.ref_data->ref_item)),
+             (long) item->u.ref_data->disp);
+  }
+  fprintf (f, "}\n\n");
+}
+
+/* Emit class MainData holding the image as Latin-1 string constants, each
+   copied into memory with one String.getBytes */
+static void out_data_image (FILE *f) {
+  size_t len = VARR_LENGTH (uint8_t, data_image);
+  uint8_t *image = VARR_ADDR (uint8_t, data_image);
+
+  while (len > 0 && image[len - 1] == 0) len--; /* memory is zeroed */
+  fprintf (f, "\nfinal class MainData {\n\n");
+  fprintf (f, "static final String[] CHUNKS = {");
+  for (size_t start = 0; start < len; start += DATA_CHUNK_SIZE) {
+    size_t end = start + DATA_CHUNK_SIZE < len ? start + DATA_CHUNK_SIZE : len;
+
+    fprintf (f, "\n\"");
+    for (size_t i = start; i < end; i++) {
+      uint8_t c = image[i];
+
+      if (c == '"' || c == '\\')
+        fprintf (f, "\\%c", c);
+      else if (c >= ' ' && c < 127)
+        fputc (c, f);
+      else if (i + 1 < end && image[i + 1] >= '0' && image[i + 1] <= '7')
+        fprintf (f, "\\%03o", c); /* a short octal escape would absorb the next digit */
+      else
+        fprintf (f, "\\%o", c);
+      if ((i - start) % 128 == 127 && i + 1 < end) fprintf (f, "\"\n+ \"");
+    }
+    fprintf (f, "\",");
+  }
+  fprintf (f, "\n};\n\n");
+  fprintf (f, "} // End of class MainData\n");
+}
+
+/* Name of type t in the memory accessors */
+static const char *mangled_type_name (MIR_type_t t) {
   switch (t) {
-  case MIR_T_I8: fprintf (f, "byte"); break; // int8_t
-  case MIR_T_U8: fprintf (f, "ubyte"); break; // uint8_t
-  case MIR_T_I16: fprintf (f, "short"); break; // int16_t
-  case MIR_T_U16: fprintf (f, "ushort"); break; // uint16_t
-  case MIR_T_I32: fprintf (f, "int"); break; // int32_t
-  case MIR_T_U32: fprintf (f, "uint"); break; // uint32_t
-  case MIR_T_I64: fprintf (f, "long"); break; // int64_t
-  case MIR_T_U64: fprintf (f, "ulong"); break; // uint64_t
-  case MIR_T_F: fprintf (f, "float"); break;
-  case MIR_T_D: fprintf (f, "double"); break;
-  case MIR_T_LD: fprintf (f, "long_double"); break; // long double
-  case MIR_T_P: fprintf (f, "pointer"); break;
+  case MIR_T_I8: return "byte"; // int8_t
+  case MIR_T_U8: return "ubyte"; // uint8_t
+  case MIR_T_I16: return "short"; // int16_t
+  case MIR_T_U16: return "ushort"; // uint16_t
+  case MIR_T_I32: return "int"; // int32_t
+  case MIR_T_U32: return "uint"; // uint32_t
+  case MIR_T_I64: return "long"; // int64_t
+  case MIR_T_U64: return "ulong"; // uint64_t
+  case MIR_T_F: return "float";
+  case MIR_T_D: return "double";
+  case MIR_T_LD: return "long_double"; // long double
+  case MIR_T_P: return "pointer";
   case MIR_T_BLK:
   case MIR_T_BLK + 1:
   case MIR_T_BLK + 2:
   case MIR_T_BLK + 3:
   case MIR_T_BLK + 4:
-  case MIR_T_RBLK: fprintf (f, "long"); break;
-  default: mir_assert (FALSE);
+  case MIR_T_RBLK: return "long";
+  default: mir_assert (FALSE); return NULL;
   }
 }
 
+static void out_mangled_type (FILE *f, MIR_type_t t) { fprintf (f, "%s", mangled_type_name (t)); }
+
 
 static void out_type (FILE *f, MIR_type_t t) {
   switch (t) {
@@ -224,22 +719,127 @@ static void out_type (FILE *f, MIR_type_t t) {
   }
 }
 
-static void out_type_value (FILE *f, MIR_type_t t, uint8_t* v) {
-  switch (t) {
-  case MIR_T_I8: fprintf (f, "%" PRIi8, ((int8_t *)v)[0]); break; // int8_t
-  case MIR_T_U8: fprintf (f, "%" PRIu8, ((uint8_t *)v)[0]); break; // uint8_t
-  case MIR_T_I16: fprintf (f, "%" PRIi16, ((int16_t *)v)[0]); break; // int16_t
-  case MIR_T_U16: fprintf (f, "%" PRIu16, ((uint16_t *)v)[0]); break; // uint16_t
-  case MIR_T_I32: fprintf (f, "%" PRIi32, ((int32_t *)v)[0]); break; // int32_t
-  case MIR_T_U32: fprintf (f, "%" PRIu32 "L", ((uint32_t *)v)[0]); break; // uint32_t
-  case MIR_T_I64: fprintf (f, "%" PRIi64 "L", ((int64_t *)v)[0]); break; // int64_t
-  case MIR_T_U64: fprintf_long_hex(f, ((uint64_t*)v)[0]); break; // uint64_t
-  case MIR_T_F: fprintf_float (f, ((float *)v)[0]);; break;
-  case MIR_T_D: fprintf_double(f, ((double*)v)[0]); break;
-  case MIR_T_LD: fprintf_long_double(f, ((long double*)v)[0]); break; // long double
-  case MIR_T_P: fprintf_long_hex(f, ((uint64_t*)v)[0]); break;
-  default: mir_assert (FALSE);
+/* Java type of a value passed to or returned from a function handle.
+   Runtime.mir_get_function_handle adapts the functions to these types.  */
+static void out_handle_type (FILE *f, MIR_type_t t) {
+  out_type (f, t == MIR_T_F || t == MIR_T_D || t == MIR_T_LD ? t : MIR_T_I64);
+}
+
+static char handle_type_letter (MIR_type_t t) {
+  return t == MIR_T_F ? 'F' : t == MIR_T_D || t == MIR_T_LD ? 'D' : 'J';
+}
+
+/* Return the canonical signature of calls through proto (result letter,
+   '_', arg letters, 'J' for the variadic args area), recording it for
+   out_function_dispatchers */
+static const char *handle_sig (MIR_proto_t proto) {
+  size_t i, nargs = VARR_LENGTH (MIR_var_t, proto->args);
+  char *sig = malloc (nargs + 4);
+
+  sig[0] = proto->nres == 0 ? 'V' : handle_type_letter (proto->res_types[0]);
+  sig[1] = '_';
+  for (i = 0; i < nargs; i++) sig[i + 2] = handle_type_letter (VARR_GET (MIR_var_t, proto->args, i).type);
+  if (proto->vararg_p) sig[nargs++ + 2] = 'J';
+  sig[nargs + 2] = '\0';
+  for (i = 0; i < VARR_LENGTH (char_ptr_t, handle_types); i++)
+    if (strcmp (VARR_GET (char_ptr_t, handle_types, i), sig) == 0) {
+      free (sig);
+      return VARR_GET (char_ptr_t, handle_types, i);
+    }
+  VARR_PUSH (char_ptr_t, handle_types, sig);
+  return sig;
+}
+
+static const char *handle_java_class (char letter) {
+  return letter == 'V' ? "void.class" : letter == 'F' ? "float.class" : letter == 'D' ? "double.class" : "long.class";
+}
+
+static const char *handle_java_type (char letter) {
+  return letter == 'V' ? "void" : letter == 'F' ? "float" : letter == 'D' ? "double" : "long";
+}
+
+/* Can a call of signature sig be a direct call of func? */
+static int func_matches_sig_p (MIR_func_t func, const char *sig) {
+  if (func->nargs + (func->vararg_p ? 1 : 0) != strlen (sig + 2)) return FALSE;
+  for (size_t i = 0; i < func->nargs; i++)
+    if (handle_type_letter (VARR_GET (MIR_var_t, func->vars, i).type) != sig[i + 2]) return FALSE;
+  if (func->vararg_p && sig[func->nargs + 2] != 'J') return FALSE;
+  return sig[0] == 'V' || func->nres == 0 || handle_type_letter (func->res_types[0]) == sig[0];
+}
+
+/* Emit class MainFunctions: the names of the address table and, for each
+   signature recorded by handle_sig, a static method calling the function at
+   an address through a switch on its table index.  Functions registered at
+   run time fall back to a MethodHandle.  */
+static void out_function_dispatchers (MIR_context_t ctx, FILE *f) {
+  size_t i, n, nfuncs = VARR_LENGTH (MIR_item_t, fn_table);
+
+  fprintf (f, "\nfinal class MainFunctions {\n\n");
+  fprintf (f, "static final String[] NAMES = {");
+  for (i = 0; i < nfuncs; i++) {
+    char *name = VARR_GET (char_ptr_t, fn_table_names, i);
+
+    mir_assert (name != NULL);
+    fprintf (f, i % 8 == 0 ? "\n  \"%s\"," : " \"%s\",", name);
+  }
+  fprintf (f, "\n};\n\n");
+  fprintf (f, "private static int index(long addr) {\n");
+  fprintf (f, "  long i = addr - Runtime.FUNCTION_ADDRESS_BASE;\n");
+  fprintf (f, "  return i >= 0 && i < NAMES.length ? (int) i : -1;\n");
+  fprintf (f, "}\n");
+  for (size_t k = 0; k < VARR_LENGTH (char_ptr_t, handle_types); k++) {
+    char *sig = VARR_GET (char_ptr_t, handle_types, k);
+    size_t nargs = strlen (sig + 2);
+
+    fprintf (f, "\nprivate static final java.lang.invoke.MethodType mir_handle_type_%s = ", sig);
+    fprintf (f, "java.lang.invoke.MethodType.methodType(%s", handle_java_class (sig[0]));
+    for (n = 0; n < nargs; n++) fprintf (f, ", %s", handle_java_class (sig[n + 2]));
+    fprintf (f, ");\n\n");
+    fprintf (f, "static %s call_%s(Main m, long addr", handle_java_type (sig[0]), sig);
+    for (n = 0; n < nargs; n++) fprintf (f, ", %s a%d", handle_java_type (sig[n + 2]), (int) n);
+    fprintf (f, ") {\n");
+    fprintf (f, "  switch (index(addr)) {\n");
+    for (i = 0; i < nfuncs; i++) {
+      MIR_func_t func = VARR_GET (MIR_item_t, fn_table, i)->u.func;
+
+      if (!func_matches_sig_p (func, sig)) continue;
+      fprintf (f, "  case %d: ", (int) i);
+      if (sig[0] != 'V' && func->nres != 0) fprintf (f, "return (%s) ", handle_java_type (sig[0]));
+      fprintf (f, "m.%s(", VARR_GET (char_ptr_t, fn_table_names, i));
+      for (n = 0; n < nargs; n++) {
+        if (n != 0) fprintf (f, ", ");
+        if (n < func->nargs) {
+          fprintf (f, "(");
+          out_type (f, VARR_GET (MIR_var_t, func->vars, n).type);
+          fprintf (f, ") ");
+        }
+        fprintf (f, "a%d", (int) n);
+      }
+      fprintf (f, sig[0] == 'V' ? "); return;\n" : func->nres == 0 ? "); return 0;\n" : ");\n");
+    }
+    fprintf (f, "  default:\n");
+    fprintf (f, "    try {\n      ");
+    if (sig[0] != 'V') fprintf (f, "return (%s) ", handle_java_type (sig[0]));
+    fprintf (f, "m.mir_get_function_handle(addr, mir_handle_type_%s).invokeExact(", sig);
+    for (n = 0; n < nargs; n++) fprintf (f, n == 0 ? "a%d" : ", a%d", (int) n);
+    fprintf (f, ");\n");
+    if (sig[0] == 'V') fprintf (f, "      return;\n");
+    fprintf (f, "    } catch (Throwable mir_e) {\n");
+    fprintf (f, "      throw Runtime.mir_rethrow(mir_e);\n");
+    fprintf (f, "    }\n");
+    fprintf (f, "  }\n");
+    fprintf (f, "}\n");
+    free (sig);
   }
+  VARR_TRUNC (char_ptr_t, handle_types, 0);
+  fprintf (f, "\n} // End of class MainFunctions\n");
+}
+
+/* Emit the start of a memory read or write call up to its address arg */
+static void out_mem_access (FILE *f, const char *access, MIR_type_t type) {
+  fprintf (f, legacy_memory_p ? "mir_%s_" : paged_memory_p ? "PagedMemory.%s_" : "Memory.%s_", access);
+  out_mangled_type (f, type);
+  fprintf (f, legacy_memory_p ? "(" : paged_memory_p ? "(pages, " : "(memory, ");
 }
 
 static void out_op_mem_address(MIR_context_t ctx, FILE *f, MIR_op_t op) {
@@ -273,31 +873,7 @@ static void out_op (MIR_context_t ctx, FILE *f, MIR_op_t op) {
     char* mangled_name = get_mangled_symbol_name(name);
     fprintf (f, "%s", mangled_name); break;
   }
-  case MIR_OP_STR: {
-    fprintf (f, "mir_get_string_ptr(\"");
-    for (int i = 0; i < op.u.str.len - 1; i++) {
-      unsigned char c = (unsigned char) op.u.str.s[i];
-      switch (c) {
-      case '\n': fputs("\\n", f); break;
-      case '\r': fputs("\\r", f); break;
-      case '\t': fputs("\\t", f); break;
-      case '\b': fputs("\\b", f); break;
-      case '\f': fputs("\\f", f); break;
-      case '\"': fputs("\\\"", f); break;
-      case '\\': fputs("\\\\", f); break;
-      case 0:    fputs("\\0",  f); break;
-      default:
-        if (c < 0x20 || c == 0x7F || c >= 0x80) {
-          // Encode non-printable ASCII to \u00XX for Java
-          fprintf(f, "\\u%04X", (unsigned)c);
-        } else {
-          fputc((char)c, f);
-        }
-      }
-    }
-    fputs("\")", f);
-    break;
-  }
+  case MIR_OP_STR: fprintf_long_hex (f, str_addr (op.u.str)); break;
   case MIR_OP_MEM: {
     //MIR_reg_t no_reg = 0;
     //int disp_p = FALSE;
@@ -307,9 +883,7 @@ static void out_op (MIR_context_t ctx, FILE *f, MIR_op_t op) {
       //out_op_mem_address(ctx, f, op);	
       fprintf (f, "%s", MIR_reg_name (ctx, op.u.mem.base, curr_func));
     } else {
-      fprintf (f, "mir_read_");
-      out_mangled_type (f, op.u.mem.type);
-      fprintf (f, "(");
+      out_mem_access (f, "read", op.u.mem.type);
       out_op_mem_address (ctx, f, op);
       fprintf (f, ")");
     }
@@ -385,38 +959,53 @@ static void out_op (MIR_context_t ctx, FILE *f, MIR_op_t op) {
   }
 }
 
+static int int_var_op_p (MIR_op_t op) {
+  return op.mode == MIR_OP_REG && bitmap_bit_p (int_vars, op.u.reg - 1);
+}
+
+/* Emit `dst = '.  A long expression stored into an int var gets a narrowing
+   cast.  Return TRUE if the cast must be closed by out_assign_end.  */
+static int out_assign (MIR_context_t ctx, FILE *f, MIR_op_t dst, int int_expr_p) {
+  int cast_p = !int_expr_p && int_var_op_p (dst);
+
+  out_op (ctx, f, dst);
+  fprintf (f, cast_p ? " = (int) (" : " = ");
+  return cast_p;
+}
+
+static void out_assign_end (FILE *f, int cast_p) {
+  fprintf (f, cast_p ? ");\n" : ";\n");
+}
+
 static void out_op2 (MIR_context_t ctx, FILE *f, MIR_op_t *ops, const char *str) {
   //printf("out_op2: mode=%d\n", ops[1].mode);
   if (ops[0].mode == MIR_OP_MEM) {
-    fprintf (f, "mir_write_");
-    out_mangled_type (f, ops[0].u.mem.type);
-    fprintf (f, "(");
+    out_mem_access (f, "write", ops[0].u.mem.type);
     out_op_mem_address(ctx, f, ops[0]);
     fprintf (f, ", ");
     out_op (ctx, f, ops[1]);
     fprintf (f, ");\n");
   } else { 
-    out_op (ctx, f, ops[0]);
-    fprintf (f, " = ");
+    int cast_p = out_assign (ctx, f, ops[0], str == NULL && int_var_op_p (ops[1]));
+
     if (str != NULL) fprintf (f, "%s ", str);
-    if (ops[1].mode == MIR_OP_REF && ops[1].u.ref->item_type == MIR_func_item) {
-      fprintf (f, "mir_get_function_ptr(\"");
-      out_op (ctx, f, ops[1]);
-      fprintf (f, "\")");
+    if (op_func_item (ops[1]) != NULL) {
+      out_fn_address (ctx, f, op_func_item (ops[1]));
     } else {
       out_op (ctx, f, ops[1]);
     }
-    fprintf (f, ";\n");
+    out_assign_end (f, cast_p);
   }
 }
 
 static void out_op3 (MIR_context_t ctx, FILE *f, MIR_op_t *ops, const char *str) {
-  out_op (ctx, f, ops[0]);
-  fprintf (f, " = (long) "); // int64_t
+  int cast_p = out_assign (ctx, f, ops[0], FALSE);
+
+  fprintf (f, "(long) "); // int64_t
   out_op (ctx, f, ops[1]);
   fprintf (f, " %s (long) ", str); // int64_t
   out_op (ctx, f, ops[2]);
-  fprintf (f, ";\n");
+  out_assign_end (f, cast_p);
 }
 
 static void out_op3_logic (MIR_context_t ctx, FILE *f, MIR_op_t *ops, const char *str) {
@@ -430,12 +1019,13 @@ static void out_op3_logic (MIR_context_t ctx, FILE *f, MIR_op_t *ops, const char
 
 
 static void out_uop3 (MIR_context_t ctx, FILE *f, MIR_op_t *ops, const char *str) {
-  out_op (ctx, f, ops[0]);
-  fprintf (f, " = (long) ");  // uint64_t. FIXME: how to handle unsigned long ?
+  int cast_p = out_assign (ctx, f, ops[0], FALSE);
+
+  fprintf (f, "(long) ");  // uint64_t. FIXME: how to handle unsigned long ?
   out_op (ctx, f, ops[1]);
   fprintf (f, " %s (long) ", str);
   out_op (ctx, f, ops[2]);
-  fprintf (f, ";\n");
+  out_assign_end (f, cast_p);
 }
 
 static void out_sop3 (MIR_context_t ctx, FILE *f, MIR_op_t *ops, const char *str) {
@@ -502,37 +1092,33 @@ static void out_jmp (MIR_context_t ctx, FILE *f, MIR_op_t label_op) {
 }
 
 static void out_bcmp (MIR_context_t ctx, FILE *f, MIR_op_t *ops, const char *str) {
-  fprintf (f, "if ((long) "); // int64_t 
+  fprintf (f, "((long) "); // int64_t 
   out_op (ctx, f, ops[1]);
   fprintf (f, " %s (long) ", str); // int64_t
   out_op (ctx, f, ops[2]);
-  fprintf (f, ") { ");
-  out_jmp (ctx, f, ops[0]);
-  fprintf (f, " }\n");
+  fprintf (f, ")");
 }
 
 static void out_bscmp (MIR_context_t ctx, FILE *f, MIR_op_t *ops, const char *str) {
-  fprintf (f, "if ((int) "); // int32_t
+  fprintf (f, "((int) "); // int32_t
   out_op (ctx, f, ops[1]);
   fprintf (f, " %s (int) ", str); // int32_t
   out_op (ctx, f, ops[2]);
-  fprintf (f, ") { ");
-  out_jmp (ctx, f, ops[0]);
-  fprintf (f, " }\n");
+  fprintf (f, ")");
 }
 
-/* 64-bit unsigned branch: if (cmpUnsigned(a,b) op 0) goto L; */
+/* 64-bit unsigned branch condition: (cmpUnsigned(a,b) op 0) */
 static void out_bucmp64 (MIR_context_t ctx, FILE *f, MIR_op_t *ops, const char *op) {
-  fprintf(f,"if (Long.compareUnsigned((long) "); out_op(ctx,f,ops[1]);
+  fprintf(f,"(Long.compareUnsigned((long) "); out_op(ctx,f,ops[1]);
   fprintf(f,", (long) "); out_op(ctx,f,ops[2]);
-  fprintf(f,") %s 0) { ", op); out_jmp(ctx,f,ops[0]); fprintf(f," }\n");
+  fprintf(f,") %s 0)", op);
 }
 
-/* 32-bit unsigned branch */
+/* 32-bit unsigned branch condition */
 static void out_buscmp32 (MIR_context_t ctx, FILE *f, MIR_op_t *ops, const char *op) {
-  fprintf(f,"if (Integer.compareUnsigned((int) "); out_op(ctx,f,ops[1]);
+  fprintf(f,"(Integer.compareUnsigned((int) "); out_op(ctx,f,ops[1]);
   fprintf(f,", (int) "); out_op(ctx,f,ops[2]);
-  fprintf(f,") %s 0) { ", op); out_jmp(ctx,f,ops[0]); fprintf(f," }\n");
+  fprintf(f,") %s 0)", op);
 }
 
 static void out_fop3 (MIR_context_t ctx, FILE *f, MIR_op_t *ops, const char *str) {
@@ -545,82 +1131,152 @@ static void out_fop3 (MIR_context_t ctx, FILE *f, MIR_op_t *ops, const char *str
 }
 
 static void out_bfcmp (MIR_context_t ctx, FILE *f, MIR_op_t *ops, const char *str) {
-  fprintf (f, "if (");
+  fprintf (f, "(");
   out_op (ctx, f, ops[1]);
   fprintf (f, " %s ", str);
   out_op (ctx, f, ops[2]);
-  fprintf (f, ") { ");
-  out_jmp (ctx, f, ops[0]);
-  fprintf (f, " }\n");
+  fprintf (f, ")");
 }
 
 /* Emit: dst = (long) Long.divideUnsigned((long)a, (long)b); */
 static void out_udiv64 (MIR_context_t ctx, FILE *f, MIR_op_t *ops) {
   /* ops[0] = dst, ops[1] = lhs, ops[2] = rhs */
-  out_op(ctx, f, ops[0]); fprintf(f, " = (long) Long.divideUnsigned((long) ");
+  int cast_p = out_assign(ctx, f, ops[0], FALSE); fprintf(f, "(long) Long.divideUnsigned((long) ");
   out_op(ctx, f, ops[1]); fprintf(f, ", (long) "); out_op(ctx, f, ops[2]);
-  fprintf(f, ");\n");
+  fprintf(f, ")"); out_assign_end(f, cast_p);
 }
 
 /* Emit: dst = (long) Long.remainderUnsigned((long)a, (long)b); */
 static void out_umod64 (MIR_context_t ctx, FILE *f, MIR_op_t *ops) {
-  out_op(ctx, f, ops[0]); fprintf(f, " = (long) Long.remainderUnsigned((long) ");
+  int cast_p = out_assign(ctx, f, ops[0], FALSE); fprintf(f, "(long) Long.remainderUnsigned((long) ");
   out_op(ctx, f, ops[1]); fprintf(f, ", (long) "); out_op(ctx, f, ops[2]);
-  fprintf(f, ");\n");
+  fprintf(f, ")"); out_assign_end(f, cast_p);
 }
 
-/* Emit: dst = (long) Integer.divideUnsigned((int)a, (int)b); */
+/* Emit: dst = Integer.divideUnsigned((int)a, (int)b); */
 static void out_udiv32 (MIR_context_t ctx, FILE *f, MIR_op_t *ops) {
-  out_op(ctx, f, ops[0]); fprintf(f, " = (long) Integer.divideUnsigned((int) ");
+  out_op(ctx, f, ops[0]); fprintf(f, " = Integer.divideUnsigned((int) ");
   out_op(ctx, f, ops[1]); fprintf(f, ", (int) "); out_op(ctx, f, ops[2]);
   fprintf(f, ");\n");
 }
 
-/* Emit: dst = (long) Integer.remainderUnsigned((int)a, (int)b); */
+/* Emit: dst = Integer.remainderUnsigned((int)a, (int)b); */
 static void out_umod32 (MIR_context_t ctx, FILE *f, MIR_op_t *ops) {
-  out_op(ctx, f, ops[0]); fprintf(f, " = (long) Integer.remainderUnsigned((int) ");
+  out_op(ctx, f, ops[0]); fprintf(f, " = Integer.remainderUnsigned((int) ");
   out_op(ctx, f, ops[1]); fprintf(f, ", (int) "); out_op(ctx, f, ops[2]);
   fprintf(f, ");\n");
 }
 
-/* Zero-extend 8-bit to 64-bit */
+/* Zero-extend 8-bit to 64-bit (to 32-bit for an int dst) */
 static void out_uext8 (MIR_context_t ctx, FILE *f, MIR_op_t *ops) {
+  if (int_var_op_p(ops[0])) {
+    out_op(ctx,f,ops[0]); fprintf(f," = ((int) ");
+    out_op(ctx,f,ops[1]); fprintf(f," & 0xFF);\n");
+    return;
+  }
   out_op(ctx,f,ops[0]); fprintf(f," = (((long) (int) ");
   out_op(ctx,f,ops[1]); fprintf(f,") & 0xFFL);\n");
 }
 
-/* Zero-extend 16-bit to 64-bit */
+/* Zero-extend 16-bit to 64-bit (to 32-bit for an int dst) */
 static void out_uext16 (MIR_context_t ctx, FILE *f, MIR_op_t *ops) {
+  if (int_var_op_p(ops[0])) {
+    out_op(ctx,f,ops[0]); fprintf(f," = ((int) ");
+    out_op(ctx,f,ops[1]); fprintf(f," & 0xFFFF);\n");
+    return;
+  }
   out_op(ctx,f,ops[0]); fprintf(f," = (((long) (int) ");
   out_op(ctx,f,ops[1]); fprintf(f,") & 0xFFFFL);\n");
 }
 
-/* Zero-extend 32-bit to 64-bit */
+/* Zero-extend 32-bit to 64-bit (a plain move for an int dst) */
 static void out_uext32 (MIR_context_t ctx, FILE *f, MIR_op_t *ops) {
+  if (int_var_op_p(ops[0])) {
+    out_op(ctx,f,ops[0]); fprintf(f," = (int) ");
+    out_op(ctx,f,ops[1]); fprintf(f,";\n");
+    return;
+  }
   out_op(ctx,f,ops[0]); 
   fprintf(f," = (((long) "); 
   out_op(ctx,f,ops[1]);
   fprintf(f, ") & 0xFFFFFFFFL);\n"); 
 }
 
-/* 32-bit logical right shift: dst = (long)(((int)lhs) >>> (int)rhs) */
+/* 32-bit logical right shift: dst = ((int)lhs) >>> (int)rhs */
 static void out_urshs32 (MIR_context_t ctx, FILE *f, MIR_op_t *ops) {
-  out_op(ctx,f,ops[0]); fprintf(f," = (long)(((int) ");
+  out_op(ctx,f,ops[0]); fprintf(f," = ((int) ");
   out_op(ctx,f,ops[1]); fprintf(f,") >>> (int) ");
-  out_op(ctx,f,ops[2]); fprintf(f," );\n");
+  out_op(ctx,f,ops[2]); fprintf(f,";\n");
 }
 
-/* Emit: if (((int) v) != 0) { goto L; } */
+/* Emit: (((int) v) != 0) */
 static void out_bts (MIR_context_t ctx, FILE *f, MIR_op_t *ops) {
   /* ops[0] = label, ops[1] = value */
-  fprintf(f, "if (((int) "); out_op(ctx, f, ops[1]); fprintf(f, " != 0)) { ");
-  out_jmp(ctx, f, ops[0]); fprintf(f, " }\n");
+  fprintf(f, "(((int) "); out_op(ctx, f, ops[1]); fprintf(f, " != 0))");
 }
 
-/* Emit: if (((int) v) == 0) { goto L; } */
+/* Emit: (((int) v) == 0) */
 static void out_bfs (MIR_context_t ctx, FILE *f, MIR_op_t *ops) {
-  fprintf(f, "if (((int) "); out_op(ctx, f, ops[1]); fprintf(f, " == 0)) { ");
-  out_jmp(ctx, f, ops[0]); fprintf(f, " }\n");
+  fprintf(f, "(((int) "); out_op(ctx, f, ops[1]); fprintf(f, " == 0))");
+}
+
+/* Emit the condition of a conditional branch insn */
+static void out_branch_cond (MIR_context_t ctx, FILE *f, MIR_insn_t insn) {
+  MIR_op_t *ops = insn->ops;
+
+  switch (insn->code) {
+  case MIR_BT:
+    fprintf (f, "(((long) "); // int64_t
+    out_op (ctx, f, ops[1]);
+    fprintf (f, " != 0))");
+    break;
+  case MIR_BF:
+    fprintf (f, "(((long) "); // int64_t
+    out_op (ctx, f, ops[1]);
+    fprintf (f, " == 0))");
+    break;
+  case MIR_BTS: out_bts (ctx, f, ops); break;
+  case MIR_BFS: out_bfs (ctx, f, ops); break;
+  case MIR_BEQ: out_bcmp (ctx, f, ops, "=="); break;
+  case MIR_BNE: out_bcmp (ctx, f, ops, "!="); break;
+  case MIR_BLT: out_bcmp (ctx, f, ops, "<"); break;
+  case MIR_BLE: out_bcmp (ctx, f, ops, "<="); break;
+  case MIR_BGT: out_bcmp (ctx, f, ops, ">"); break;
+  case MIR_BGE: out_bcmp (ctx, f, ops, ">="); break;
+  case MIR_BEQS: out_bscmp (ctx, f, ops, "=="); break;
+  case MIR_BNES: out_bscmp (ctx, f, ops, "!="); break;
+  case MIR_BLTS: out_bscmp (ctx, f, ops, "<"); break;
+  case MIR_BLES: out_bscmp (ctx, f, ops, "<="); break;
+  case MIR_BGTS: out_bscmp (ctx, f, ops, ">"); break;
+  case MIR_BGES: out_bscmp (ctx, f, ops, ">="); break;
+  case MIR_UBLT:  out_bucmp64 (ctx, f, ops, "<");  break;
+  case MIR_UBLE:  out_bucmp64 (ctx, f, ops,"<="); break;
+  case MIR_UBGT:  out_bucmp64 (ctx, f, ops, ">");  break;
+  case MIR_UBGE:  out_bucmp64 (ctx, f, ops, ">="); break;
+  case MIR_UBLTS: out_buscmp32(ctx, f, ops, "<");  break;
+  case MIR_UBLES: out_buscmp32(ctx, f, ops, "<="); break;
+  case MIR_UBGTS: out_buscmp32(ctx, f, ops, ">");  break;
+  case MIR_UBGES: out_buscmp32(ctx, f, ops, ">="); break;
+  case MIR_FBEQ:
+  case MIR_DBEQ:
+  case MIR_LDBEQ: out_bfcmp (ctx, f, ops, "=="); break;
+  case MIR_FBNE:
+  case MIR_DBNE:
+  case MIR_LDBNE: out_bfcmp (ctx, f, ops, "!="); break;
+  case MIR_FBLT:
+  case MIR_DBLT:
+  case MIR_LDBLT: out_bfcmp (ctx, f, ops, "<"); break;
+  case MIR_FBLE:
+  case MIR_DBLE:
+  case MIR_LDBLE: out_bfcmp (ctx, f, ops, "<="); break;
+  case MIR_FBGT:
+  case MIR_DBGT:
+  case MIR_LDBGT: out_bfcmp (ctx, f, ops, ">"); break;
+  case MIR_FBGE:
+  case MIR_DBGE:
+  case MIR_LDBGE: out_bfcmp (ctx, f, ops, ">="); break;
+  default: mir_assert (FALSE);
+  }
 }
 
 /* Emit: saved = mir_get_stack_position(); */
@@ -633,23 +1289,207 @@ static void out_bend (MIR_context_t ctx, FILE *f, MIR_op_t *ops) {
   fprintf(f, "mir_set_stack_position("); out_op(ctx, f, ops[0]); fprintf(f, ");\n");
 }
 
-static void out_insn (MIR_context_t ctx, FILE *f, MIR_insn_t insn) {
-  MIR_op_t *ops = insn->ops;
+/* Can insn replace the memory array (see Runtime.growMemory) whose local copy
+   the generated functions use?  Only calls may, as they may reach malloc.  */
+static int may_grow_memory_p (MIR_insn_t insn) { return MIR_call_code_p (insn->code); }
 
-  if (insn->code != MIR_LABEL) fprintf (f, "  ");
-  switch (insn->code) {
-  case MIR_MOV:
-  case MIR_FMOV:
-  case MIR_DMOV: 
-  case MIR_LDMOV: out_op2 (ctx, f, ops, NULL); break;
-  case MIR_EXT8: out_op2 (ctx, f, ops, "(long) (byte)"); break; // (int64_t) (int8_t) 
-  case MIR_EXT16: out_op2 (ctx, f, ops, "(long) (short)"); break; // (int64_t) (int16_t) 
-  case MIR_EXT32: out_op2 (ctx, f, ops, "(long) (int)"); break; // (int64_t) (int32_t)
-  case MIR_UEXT8: out_uext8 (ctx,f,ops); break; // (int64_t) (uint8_t)
-  case MIR_UEXT16: out_uext16(ctx,f,ops); break; // (int64_t) (uint16_t)
-  case MIR_UEXT32: out_uext32 (ctx, f, ops); break; // (int64_t) (uint32_t)
-  case MIR_F2I:
-  case MIR_D2I:
+static void out_indent (FILE *f, int level);
+
+/* Refresh the local copy of the memory array after insn if needed */
+static void out_memory_reload (FILE *f, MIR_insn_t insn, int level) {
+  if (legacy_memory_p || !may_grow_memory_p (insn)) return;
+  out_indent (f, level);
+  fprintf (f, paged_memory_p ? "  pages = this.pages;\n" : "  memory = this.memory;\n");
+}
+
+/* Variadic args are spilled to an area of the stack, one slot per arg and
+   blocks by value rounded up to slots.  The callee gets the area address as
+   its last param, and its va_list holds the address of the next arg.  */
+#define VA_SLOT_SIZE 8
+
+static size_t va_block_size (size_t size) {
+  return (size + VA_SLOT_SIZE - 1) / VA_SLOT_SIZE * VA_SLOT_SIZE;
+}
+
+static size_t va_arg_size (MIR_op_t op) {
+  if (op.mode == MIR_OP_MEM && MIR_all_blk_type_p (op.u.mem.type)) return va_block_size (op.u.mem.disp);
+  return VA_SLOT_SIZE;
+}
+
+/* Type of the slot write of variadic arg op */
+static MIR_type_t va_slot_type (MIR_context_t ctx, MIR_op_t op) {
+  MIR_type_t t;
+
+  switch (op.mode) {
+  case MIR_OP_REG: t = MIR_reg_type (ctx, op.u.reg, curr_func); break;
+  case MIR_OP_FLOAT: t = MIR_T_F; break;
+  case MIR_OP_DOUBLE:
+  case MIR_OP_LDOUBLE: t = MIR_T_D; break;
+  case MIR_OP_MEM: t = op.u.mem.type; break;
+  default: t = MIR_T_I64;
+  }
+  return t == MIR_T_F ? MIR_T_F : t == MIR_T_D || t == MIR_T_LD ? MIR_T_D : MIR_T_I64;
+}
+
+/* Emit the spill of the args of call insn from first_va: opens a block
+   closed by out_va_args_end */
+static void out_va_args_start (MIR_context_t ctx, FILE *f, MIR_insn_t insn, size_t first_va) {
+  size_t i, size = 0, disp = 0;
+
+  for (i = first_va; i < insn->nops; i++) size += va_arg_size (insn->ops[i]);
+  fprintf (f, "{ int mir_va_saved = mir_get_stack_position();\n");
+  fprintf (f, "  long mir_va_args = mir_allocate(%d);\n", (int) size);
+  for (i = first_va; i < insn->nops; disp += va_arg_size (insn->ops[i]), i++) {
+    MIR_op_t op = insn->ops[i];
+
+    if (op.mode == MIR_OP_MEM && MIR_all_blk_type_p (op.u.mem.type)) {
+      fprintf (f, "  mir_copy_memory(%s, ", MIR_reg_name (ctx, op.u.mem.base, curr_func));
+      fprintf (f, disp == 0 ? "mir_va_args, " : "mir_va_args + %d, ", (int) disp);
+      fprintf (f, "%d);\n", (int) op.u.mem.disp);
+      continue;
+    }
+    fprintf (f, "  ");
+    out_mem_access (f, "write", va_slot_type (ctx, op));
+    fprintf (f, disp == 0 ? "mir_va_args, " : "mir_va_args + %d, ", (int) disp);
+    if (op_func_item (op) != NULL)
+      out_fn_address (ctx, f, op_func_item (op));
+    else
+      out_op (ctx, f, op);
+    fprintf (f, ");\n");
+  }
+  fprintf (f, "  ");
+}
+
+static void out_va_args_end (FILE *f) {
+  fprintf (f, "  mir_set_stack_position(mir_va_saved); }\n");
+}
+
+/* va_list operand: memory of undefined type stands for its address */
+static void out_va_list (MIR_context_t ctx, FILE *f, MIR_op_t op) {
+  if (op.mode == MIR_OP_MEM && op.u.mem.type == MIR_T_UNDEF)
+    out_op_mem_address (ctx, f, op);
+  else
+    out_op (ctx, f, op);
+}
+
+/* setjmp returns twice, which Java can not do: a function calling it always
+   uses the mir_label dispatcher wrapped in a try/catch.  The call stores a
+   new token in the jmp_buf and keeps it in mir_jmp_token<N>, and the code
+   after the call gets its own case label.  longjmp throws the preallocated
+   JmpException with the token of the jmp_buf, and the catch clause of the
+   frame owning the token sets mir_label to that case and loops back.  The
+   values at the setjmp call of the locals live after it are stored in the
+   mir_jmp_iregs<N> and mir_jmp_fregs<N> arrays, allocated once when the
+   function starts, and restored by the catch clause, as C compilers keeping
+   them in the jmp_buf registers do.  */
+static int setjmp_call_p (MIR_context_t ctx, MIR_insn_t insn) {
+  const char *name;
+
+  if (insn->code != MIR_CALL || insn->nops != 4 || insn->ops[1].mode != MIR_OP_REF
+      || insn->ops[0].u.ref->u.proto->nres != 1)
+    return FALSE;
+  name = MIR_item_name (ctx, insn->ops[1].u.ref);
+  return strcmp (name, "setjmp") == 0 || strcmp (name, "_setjmp") == 0;
+}
+
+static int setjmp_case (int num) { return -2 - num; }
+
+DEF_VARR (bitmap_t);
+
+static VARR (bitmap_t) * jmp_live_vars; /* vars saved by each setjmp call, see find_jmp_live_vars */
+
+static int jmp_saved_var_p (int num, size_t nvar) {
+  return bitmap_bit_p (VARR_GET (bitmap_t, jmp_live_vars, num), nvar);
+}
+
+static int fp_type_p (MIR_type_t type) {
+  return type == MIR_T_F || type == MIR_T_D || type == MIR_T_LD;
+}
+
+/* Return the number of fp or other locals saved by setjmp num */
+static int jmp_saved_vars_num (int num, int fp_p) {
+  int n = 0;
+
+  for (size_t i = 0; i < VARR_LENGTH (MIR_var_t, curr_func->vars); i++)
+    if (jmp_saved_var_p (num, i) && fp_type_p (VARR_GET (MIR_var_t, curr_func->vars, i).type) == fp_p)
+      n++;
+  return n;
+}
+
+/* Store the locals of the current function into the arrays of setjmp num */
+static void out_jmp_save (FILE *f, int num) {
+  int islot = 0, fslot = 0;
+
+  for (size_t i = 0; i < VARR_LENGTH (MIR_var_t, curr_func->vars); i++) {
+    MIR_var_t var = VARR_GET (MIR_var_t, curr_func->vars, i);
+
+    if (!jmp_saved_var_p (num, i)) continue;
+    if (fp_type_p (var.type))
+      fprintf (f, "mir_jmp_fregs%d[%d] = %s;\n  ", num, fslot++, var.name);
+    else
+      fprintf (f, "mir_jmp_iregs%d[%d] = %s;\n  ", num, islot++, var.name);
+  }
+}
+
+/* Restore the locals of the current function from the arrays of setjmp num */
+static void out_jmp_restore (FILE *f, int num) {
+  int islot = 0, fslot = 0;
+
+  for (size_t i = 0; i < VARR_LENGTH (MIR_var_t, curr_func->vars); i++) {
+    MIR_var_t var = VARR_GET (MIR_var_t, curr_func->vars, i);
+
+    if (!jmp_saved_var_p (num, i)) continue;
+    if (fp_type_p (var.type))
+      fprintf (f, "    %s = %smir_jmp_fregs%d[%d];\n", var.name, var.type == MIR_T_F ? "(float) " : "", num,
+               fslot++);
+    else
+      fprintf (f, "    %s = %smir_jmp_iregs%d[%d];\n", var.name, bitmap_bit_p (int_vars, i) ? "(int) " : "",
+               num, islot++);
+  }
+}
+
+static void out_setjmp (MIR_context_t ctx, FILE *f, MIR_insn_t insn) {
+  int num = setjmp_call_num++;
+
+  out_jmp_save (f, num);
+  fprintf (f, "mir_jmp_token%d = mir_setjmp(", num);
+  out_op (ctx, f, insn->ops[3]);
+  fprintf (f, ");\n  mir_jmp_value = 0;\ncase %d:\n  ", setjmp_case (num));
+  out_op (ctx, f, insn->ops[2]);
+  fprintf (f, " = mir_jmp_value;\n");
+}
+
+static void out_setjmp_catch (FILE *f) {
+  fprintf (f, "} catch (JmpException mir_jmp) {\n");
+  for (int i = 0; i < curr_func_setjmp_calls; i++) {
+    fprintf (f, "  %sif (mir_jmp.token == mir_jmp_token%d) {\n", i == 0 ? "" : "else ", i);
+    out_jmp_restore (f, i);
+    fprintf (f, "    mir_label = %d;\n  }\n", setjmp_case (i));
+  }
+  fprintf (f, "  else throw mir_jmp;\n");
+  fprintf (f, "  mir_jmp_value = mir_jmp.value;\n");
+  if (!legacy_memory_p)
+    fprintf (f, paged_memory_p ? "  pages = this.pages;\n" : "  memory = this.memory;\n");
+  fprintf (f, "}\n");
+}
+
+static void out_insn (MIR_context_t ctx, FILE *f, MIR_insn_t insn) {
+  MIR_op_t *ops = insn->ops;
+
+  if (insn->code != MIR_LABEL) fprintf (f, "  ");
+  switch (insn->code) {
+  case MIR_MOV:
+  case MIR_FMOV:
+  case MIR_DMOV: 
+  case MIR_LDMOV: out_op2 (ctx, f, ops, NULL); break;
+  case MIR_EXT8: out_op2 (ctx, f, ops, int_var_op_p (ops[0]) ? "(byte)" : "(long) (byte)"); break; // (int64_t) (int8_t) 
+  case MIR_EXT16: out_op2 (ctx, f, ops, int_var_op_p (ops[0]) ? "(short)" : "(long) (short)"); break; // (int64_t) (int16_t) 
+  case MIR_EXT32: out_op2 (ctx, f, ops, int_var_op_p (ops[0]) ? "(int)" : "(long) (int)"); break; // (int64_t) (int32_t)
+  case MIR_UEXT8: out_uext8 (ctx,f,ops); break; // (int64_t) (uint8_t)
+  case MIR_UEXT16: out_uext16(ctx,f,ops); break; // (int64_t) (uint16_t)
+  case MIR_UEXT32: out_uext32 (ctx, f, ops); break; // (int64_t) (uint32_t)
+  case MIR_F2I:
+  case MIR_D2I:
   case MIR_LD2I: out_op2 (ctx, f, ops, "(long)"); break; // int64_t 
   case MIR_I2D:
   case MIR_F2D:
@@ -769,59 +1609,53 @@ static void out_insn (MIR_context_t ctx, FILE *f, MIR_insn_t insn) {
     fprintf (f, ")\n");
     break; 
   case MIR_BT:
-    fprintf (f, "if (((long) "); // int64_t
-    out_op (ctx, f, ops[1]);
-    fprintf (f, " != 0)) { ");
-    out_jmp (ctx, f, ops[0]);
-    fprintf (f, " }\n");
-    break;
   case MIR_BF:
-    fprintf (f, "if (((long) "); // int64_t
-    out_op (ctx, f, ops[1]);
-    fprintf (f, " == 0)) { ");
-    out_jmp (ctx, f, ops[0]);
-    fprintf (f, " }\n");
-    break;
-  case MIR_BTS: out_bts (ctx, f, ops); break;
-  case MIR_BFS: out_bfs (ctx, f, ops); break;
-  case MIR_BEQ: out_bcmp (ctx, f, ops, "=="); break;
-  case MIR_BNE: out_bcmp (ctx, f, ops, "!="); break;
-  case MIR_BLT: out_bcmp (ctx, f, ops, "<"); break;
-  case MIR_BLE: out_bcmp (ctx, f, ops, "<="); break;
-  case MIR_BGT: out_bcmp (ctx, f, ops, ">"); break;
-  case MIR_BGE: out_bcmp (ctx, f, ops, ">="); break;
-  case MIR_BEQS: out_bscmp (ctx, f, ops, "=="); break;
-  case MIR_BNES: out_bscmp (ctx, f, ops, "!="); break;
-  case MIR_BLTS: out_bscmp (ctx, f, ops, "<"); break;
-  case MIR_BLES: out_bscmp (ctx, f, ops, "<="); break;
-  case MIR_BGTS: out_bscmp (ctx, f, ops, ">"); break;
-  case MIR_BGES: out_bscmp (ctx, f, ops, ">="); break;
-  case MIR_UBLT:  out_bucmp64 (ctx, f, ops, "<");  break;
-  case MIR_UBLE:  out_bucmp64 (ctx, f, ops,"<="); break;
-  case MIR_UBGT:  out_bucmp64 (ctx, f, ops, ">");  break;
-  case MIR_UBGE:  out_bucmp64 (ctx, f, ops, ">="); break;
-  case MIR_UBLTS: out_buscmp32(ctx, f, ops, "<");  break;
-  case MIR_UBLES: out_buscmp32(ctx, f, ops, "<="); break;
-  case MIR_UBGTS: out_buscmp32(ctx, f, ops, ">");  break;
-  case MIR_UBGES: out_buscmp32(ctx, f, ops, ">="); break;
+  case MIR_BTS:
+  case MIR_BFS:
+  case MIR_BEQ:
+  case MIR_BNE:
+  case MIR_BLT:
+  case MIR_BLE:
+  case MIR_BGT:
+  case MIR_BGE:
+  case MIR_BEQS:
+  case MIR_BNES:
+  case MIR_BLTS:
+  case MIR_BLES:
+  case MIR_BGTS:
+  case MIR_BGES:
+  case MIR_UBLT:
+  case MIR_UBLE:
+  case MIR_UBGT:
+  case MIR_UBGE:
+  case MIR_UBLTS:
+  case MIR_UBLES:
+  case MIR_UBGTS:
+  case MIR_UBGES:
   case MIR_FBEQ:
   case MIR_DBEQ:
-  case MIR_LDBEQ: out_bfcmp (ctx, f, ops, "=="); break;
+  case MIR_LDBEQ:
   case MIR_FBNE:
   case MIR_DBNE:
-  case MIR_LDBNE: out_bfcmp (ctx, f, ops, "!="); break;
+  case MIR_LDBNE:
   case MIR_FBLT:
   case MIR_DBLT:
-  case MIR_LDBLT: out_bfcmp (ctx, f, ops, "<"); break;
+  case MIR_LDBLT:
   case MIR_FBLE:
   case MIR_DBLE:
-  case MIR_LDBLE: out_bfcmp (ctx, f, ops, "<="); break;
+  case MIR_LDBLE:
   case MIR_FBGT:
   case MIR_DBGT:
-  case MIR_LDBGT: out_bfcmp (ctx, f, ops, ">"); break;
+  case MIR_LDBGT:
   case MIR_FBGE:
   case MIR_DBGE:
-  case MIR_LDBGE: out_bfcmp (ctx, f, ops, ">="); break;
+  case MIR_LDBGE:
+    fprintf (f, "if ");
+    out_branch_cond (ctx, f, insn);
+    fprintf (f, " { ");
+    out_jmp (ctx, f, ops[0]);
+    fprintf (f, " }\n");
+    break;
   case MIR_ALLOCA:
     out_op (ctx, f, ops[0]);
     fprintf (f, " = mir_allocate(");
@@ -831,65 +1665,82 @@ static void out_insn (MIR_context_t ctx, FILE *f, MIR_insn_t insn) {
   case MIR_CALL:
   case MIR_INLINE: {
     MIR_proto_t proto;
-    size_t start = 2;
-    int has_result = 0;
-    MIR_type_t rt = MIR_T_I64; // default
+    MIR_item_t callee;
+    VARR (MIR_var_t) * args;
+    size_t start = 2, nargs;
+    int typed_handle_p, vararg_p, va_p;
+    size_t first_va;
 
     mir_assert (insn->nops >= 2 && ops[0].mode == MIR_OP_REF
                 && ops[0].u.ref->item_type == MIR_proto_item);
+    if (setjmp_call_p (ctx, insn)) {
+      out_setjmp (ctx, f, insn);
+      break;
+    }
     proto = ops[0].u.ref->u.proto;
+    typed_handle_p = ops[1].mode != MIR_OP_REF;
+    /* A direct call follows the callee signature: an unprototyped (K&R) call
+       has a variadic proto even if the callee is not variadic */
+    callee = typed_handle_p ? NULL : op_func_item (ops[1]);
+    if (callee != NULL) {
+      args = callee->u.func->vars;
+      nargs = callee->u.func->nargs;
+      vararg_p = callee->u.func->vararg_p;
+    } else {
+      args = proto->args;
+      nargs = VARR_LENGTH (MIR_var_t, proto->args);
+      vararg_p = proto->vararg_p;
+    }
+    first_va = start + (proto->nres == 1 ? 1 : 0) + nargs;
+    va_p = vararg_p && first_va < insn->nops;
+    if (va_p) out_va_args_start (ctx, f, insn, first_va);
     if (proto->nres > 1) {
       (*MIR_get_error_func (ctx)) (MIR_call_op_error,
                                    " can not translate multiple results functions into C");
     } else if (proto->nres == 1) {
       out_op (ctx, f, ops[2]);
-      fprintf (f, " = ");
+      fprintf (f, int_var_op_p (ops[2]) ? " = (int) " : " = ");
       start = 3;
-      rt = proto->res_types[0];
-      has_result = 1;
     }
     //fprintf (f, "((%s) ", proto->name);
     //printf(" (CALL: mode=%d) ", ops[1].mode);
     //int number_of_args = insn->nops - start;
-    if ((ops[1].mode == MIR_OP_REG)) { // && (number_of_args > 0)) {
-        // Indirect call through function pointer
-        if (!has_result) {
-            fprintf (f, "mir_call_function_ret_void(");
-        } else if (rt == MIR_T_F) {
-            fprintf (f, "mir_call_function_ret_float(");
-        } else if (rt == MIR_T_D) {
-            fprintf (f, "mir_call_function_ret_double(");
-        } else {
-            fprintf (f, "mir_call_function_ret_long(");
-        }
+    if (typed_handle_p) {
+        // Indirect call through the dispatcher of the call signature: no boxing nor reflection.
+        // With -d, this is a part class of which Main is a subclass.
+        fprintf (f, "MainFunctions.call_%s(%s, ", handle_sig (proto), output_dir != NULL ? "(Main) this" : "this");
         out_op (ctx, f, ops[1]);
-        fprintf (f, ", ");
     } else {
       // Direct call path
       out_op (ctx, f, ops[1]);
       fprintf (f, "(");	
     }
 
-    // Emit arguments
-    int arg_number = VARR_LENGTH (MIR_var_t, proto->args);
-    for (size_t i = start; i < insn->nops; i++) {
-      if (i != start) fprintf (f, ", ");
-	  int arg_index = (int) (i - start);
-	  if (arg_index < arg_number) {
-	    MIR_var_t var = VARR_GET (MIR_var_t, proto->args, arg_index);
-	    fprintf (f, "(");
+    // Emit arguments, 0 for the args missing in a K&R call
+    for (size_t i = start; i < first_va; i++) {
+      // The args of an indirect call follow the function address
+      if (i != start || typed_handle_p) fprintf (f, ", ");
+	  MIR_var_t var = VARR_GET (MIR_var_t, args, i - start);
+	  fprintf (f, "(");
+      if (typed_handle_p)
+        out_handle_type (f, var.type);
+      else
         out_type (f, var.type);
-	    fprintf (f, ") ");
-	  }      
-      if (ops[i].mode == MIR_OP_REF && ops[i].u.ref->item_type == MIR_func_item) {
-        fprintf (f, "mir_get_function_ptr(\"");
-        out_op (ctx, f, ops[i]);
-        fprintf (f, "\")");
+	  fprintf (f, ") ");
+      if (i >= insn->nops) {
+        fprintf (f, "0");
+      } else if (op_func_item (ops[i]) != NULL) {
+        out_fn_address (ctx, f, op_func_item (ops[i]));
       } else {
         out_op (ctx, f, ops[i]);
       }
     }
+    if (vararg_p) {
+      if (start != first_va || typed_handle_p) fprintf (f, ", ");
+      fprintf (f, va_p ? "mir_va_args" : "0L");
+    }
     fprintf (f, ");\n");
+    if (va_p) out_va_args_end (f);
 
     /*
     for (i = 0; i < VARR_LENGTH (MIR_var_t, proto->args); i++) {
@@ -957,54 +1808,39 @@ static void out_insn (MIR_context_t ctx, FILE *f, MIR_insn_t insn) {
     is_in_dead_code = FALSE;
     break;
   case MIR_VA_START:
-    fprintf (f, "mir_va_start(");
-    out_op (ctx, f, insn->ops[0]);
-    fprintf (f, ", mir_var_args);\n");
+    out_mem_access (f, "write", MIR_T_I64);
+    out_va_list (ctx, f, ops[0]);
+    fprintf (f, ", mir_va_area);\n");
     break;
-  case MIR_VA_ARG: 
-    {
-    int var_type = insn->ops[2].u.mem.type;
-    fprintf (f, "{ // va_arg(");
-    out_type(f, var_type);
-    fprintf (f, ")\n");
-    fprintf (f, "  VarArgs varArgs = mir_va_get_wrapper(");
-    out_op (ctx, f, insn->ops[1]);
+  case MIR_VA_ARG:
+  case MIR_VA_BLOCK_ARG:
+    /* The result of va_arg is the address of the arg slot */
+    fprintf (f, "{ long mir_va_next = ");
+    out_mem_access (f, "read", MIR_T_I64);
+    out_va_list (ctx, f, ops[1]);
     fprintf (f, ");\n  ");
-    out_op (ctx, f, insn->ops[0]);
-    fprintf (f, " = varArgs.getArgDataAddr();\n");
-    if (var_type == MIR_T_F || var_type == MIR_T_D || var_type == MIR_T_LD) {
-      fprintf (f, "  double arg_value = varArgs.nextDouble");	
+    out_mem_access (f, "write", MIR_T_I64);
+    out_va_list (ctx, f, ops[1]);
+    if (insn->code == MIR_VA_ARG) {
+      fprintf (f, ", mir_va_next + %d);\n  ", VA_SLOT_SIZE);
+      out_op (ctx, f, ops[0]);
+      fprintf (f, " = mir_va_next; }\n");
+    } else if (ops[2].mode == MIR_OP_INT || ops[2].mode == MIR_OP_UINT) {
+      fprintf (f, ", mir_va_next + %d);\n  ", (int) va_block_size (ops[2].u.u));
     } else {
-      fprintf (f, "  long arg_value = varArgs.nextLong");	
-    } 
-    fprintf (f, "();\n");	  
-    fprintf (f, "  mir_write_");
-    out_mangled_type(f, var_type);
-    fprintf (f, "(");
-    out_op (ctx, f, insn->ops[0]);
-    fprintf (f, ", (");
-    out_type(f, var_type);
-    fprintf (f, ") arg_value);\n");
-    fprintf (f, "  } // end of va_arg\n");    
+      fprintf (f, ", mir_va_next + ((");
+      out_op (ctx, f, ops[2]);
+      fprintf (f, " + %d) & -%d));\n  ", VA_SLOT_SIZE - 1, VA_SLOT_SIZE);
+    }
+    if (insn->code == MIR_VA_BLOCK_ARG) {
+      fprintf (f, "mir_copy_memory(mir_va_next, ");
+      out_op (ctx, f, ops[0]);
+      fprintf (f, ", ");
+      out_op (ctx, f, ops[2]);
+      fprintf (f, "); }\n");
     }
     break;
-  case MIR_VA_END:
-    // FIXME c2mir doesn't emit va_end currently
-    fprintf (f, "mir_va_end(");
-    out_op (ctx, f, insn->ops[0]);
-    fprintf (f, ");\n");
-    break;
-  case MIR_VA_BLOCK_ARG:
-   fprintf (f, "// Instruction MIR_VA_BLOCK_ARG is not supported yet\n");
-   exit(1);
-   /* result addr := buffer; copy next block argument of given size there */
-   // fprintf(f, "{ // va_block_arg\n  ");
-   // out_op(ctx,f,ops[0]); fprintf(f," = "); /* result receives a writable buffer addr */
-   // fprintf(f, "mir_va_get_wrapper("); out_op(ctx,f,ops[1]); fprintf(f, ").getArgDataAddr();\n  ");
-   // fprintf(f, "long __src = mir_va_get_wrapper("); out_op(ctx,f,ops[1]); fprintf(f, ").nextLong();\n  ");
-   // fprintf(f, "memcpy("); out_op(ctx,f,ops[0]); fprintf(f, ", __src, ");
-   // out_op(ctx,f,ops[2]); fprintf(f, ");\n}\n"); 
-   break;
+  case MIR_VA_END: fprintf (f, "// va_end\n"); break;
   default: 
     fprintf (f, "// Unknown instruction code=%d\n", insn->code);
     mir_assert (FALSE);
@@ -1012,172 +1848,1690 @@ static void out_insn (MIR_context_t ctx, FILE *f, MIR_insn_t insn) {
   }
 }
 
-void out_item (MIR_context_t ctx, FILE *f, MIR_item_t item) {
-  MIR_var_t var;
-  size_t i, nlocals;
+/* --------------------------- Register typing ---------------------------
+   MIR has only 64-bit integer registers, and c2mir keeps C ints in them
+   with *S insns.  A var whose value is only ever read by insns looking at
+   the low 32 bits (the *S insns, extensions, narrow stores, args and
+   results) is declared as a Java int: it then needs a conversion only where
+   a long value is stored into it.  */
 
-  if (item->item_type == MIR_export_item) {
-	/*
-    MIR_item_t exported_item = item->ref_def;
-    if (exported_item->item_type == MIR_data_item) {
-      out_type(f, exported_item->u.data->el_type);
-      fprintf(f, " %s = %d;\n", exported_item->u.data->name, exported_item->u.data->u.els[0]);
-    }
-    */
-    MIR_item_t exported_item = item->ref_def;
-    add_symbol(MIR_item_name(ctx, exported_item), TRUE);
-    return;
+static int narrow_int_type_p (MIR_type_t type) {
+  return type == MIR_T_I8 || type == MIR_T_U8 || type == MIR_T_I16 || type == MIR_T_U16
+         || type == MIR_T_I32;
+}
+
+static int int_var_type_p (MIR_type_t type) {
+  return type != MIR_T_F && type != MIR_T_D && type != MIR_T_LD && !MIR_all_blk_type_p (type);
+}
+
+/* Return TRUE if input operand nop of insn is emitted so that only its low
+   32 bits matter.  Reg moves are handled by the caller.  */
+static int narrow_input_p (MIR_insn_t insn, size_t nop) {
+  switch (insn->code) {
+  case MIR_MOV: /* narrow store */
+    return insn->ops[0].mode == MIR_OP_MEM
+           && (narrow_int_type_p (insn->ops[0].u.mem.type) || insn->ops[0].u.mem.type == MIR_T_U32);
+  case MIR_EXT8:
+  case MIR_EXT16:
+  case MIR_EXT32:
+  case MIR_UEXT8:
+  case MIR_UEXT16:
+  case MIR_UEXT32:
+  case MIR_NEGS:
+  case MIR_ADDS:
+  case MIR_SUBS:
+  case MIR_MULS:
+  case MIR_DIVS:
+  case MIR_MODS:
+  case MIR_UDIVS:
+  case MIR_UMODS:
+  case MIR_ANDS:
+  case MIR_ORS:
+  case MIR_XORS:
+  case MIR_LSHS:
+  case MIR_RSHS:
+  case MIR_URSHS:
+  case MIR_EQS:
+  case MIR_NES:
+  case MIR_LTS:
+  case MIR_LES:
+  case MIR_GTS:
+  case MIR_GES:
+  case MIR_ULTS:
+  case MIR_ULES:
+  case MIR_UGTS:
+  case MIR_UGES:
+  case MIR_BTS:
+  case MIR_BFS:
+  case MIR_BEQS:
+  case MIR_BNES:
+  case MIR_BLTS:
+  case MIR_BLES:
+  case MIR_BGTS:
+  case MIR_BGES:
+  case MIR_UBLTS:
+  case MIR_UBLES:
+  case MIR_UBGTS:
+  case MIR_UBGES: return TRUE;
+  case MIR_CALL:
+  case MIR_INLINE: {
+    MIR_proto_t proto = insn->ops[0].u.ref->u.proto;
+    size_t arg = nop - 2 - proto->nres;
+
+    return nop >= 2 + proto->nres && arg < VARR_LENGTH (MIR_var_t, proto->args)
+           && narrow_int_type_p (VARR_GET (MIR_var_t, proto->args, arg).type);
   }
-  if (item->item_type == MIR_import_item) {
-    //fprintf (f, "extern char %s[];\n", item->u.import_id);
-    MIR_item_t imported_item = item->ref_def;
-    add_symbol(item->u.import_id, TRUE);
-    return;
+  case MIR_RET: return curr_func->nres == 1 && narrow_int_type_p (curr_func->res_types[0]);
+  default: return FALSE;
   }
-  if (item->item_type == MIR_forward_item) {  // ???
-    MIR_item_t forwarded_item = item->ref_def;
-    add_symbol(MIR_item_name(ctx, forwarded_item), FALSE);
-    return;
+}
+
+static int clear_int_var (MIR_reg_t reg) {
+  return reg != 0 && bitmap_clear_bit_p (int_vars, reg - 1);
+}
+
+/* Find the vars of curr_func which can be declared as Java int */
+static void find_int_vars (MIR_context_t ctx) {
+  size_t i, nvars = VARR_LENGTH (MIR_var_t, curr_func->vars);
+  int out_p, changed_p = TRUE;
+
+  bitmap_clear (int_vars);
+  for (i = 0; i < nvars; i++)
+    if (int_var_type_p (VARR_GET (MIR_var_t, curr_func->vars, i).type))
+      bitmap_set_bit_p (int_vars, i);
+  while (changed_p) { /* a reg move makes the source wide if the destination is */
+    changed_p = FALSE;
+    for (MIR_insn_t insn = DLIST_HEAD (MIR_insn_t, curr_func->insns); insn != NULL;
+         insn = DLIST_NEXT (MIR_insn_t, insn)) {
+      int special_p = insn->code == MIR_ALLOCA || insn->code == MIR_BSTART
+                      || insn->code == MIR_BEND || insn->code == MIR_VA_START
+                      || insn->code == MIR_VA_ARG || insn->code == MIR_VA_BLOCK_ARG
+                      || insn->code == MIR_VA_END;
+
+      for (i = 0; i < insn->nops; i++) {
+        MIR_op_t op = insn->ops[i];
+
+        if (op.mode == MIR_OP_MEM) {
+          changed_p |= clear_int_var (op.u.mem.base);
+          changed_p |= clear_int_var (op.u.mem.index);
+          continue;
+        }
+        if (op.mode != MIR_OP_REG || insn->code == MIR_LABEL) continue;
+        MIR_insn_op_mode (ctx, insn, i, &out_p);
+        if (special_p) {
+          changed_p |= clear_int_var (op.u.reg);
+        } else if (out_p) {
+          continue;
+        } else if (insn->code == MIR_MOV && insn->ops[0].mode == MIR_OP_REG) {
+          if (!int_var_op_p (insn->ops[0])) changed_p |= clear_int_var (op.u.reg);
+        } else if (!narrow_input_p (insn, i)) {
+          changed_p |= clear_int_var (op.u.reg);
+        }
+      }
+    }
   }
-  if (item->item_type == MIR_proto_item) {
-    /*
-    MIR_proto_t proto = item->u.proto;
+}
 
-    fprintf (f, "typedef ");
-    if (proto->nres == 0)
-      fprintf (f, "void");
-    else if (proto->nres == 1)
-      out_type (f, proto->res_types[0]);
-    else
-      (*MIR_get_error_func (ctx)) (MIR_func_error,
-                                   "Multiple result functions can not be called in C");
-    fprintf (f, " (*%s) (", proto->name);
-    for (i = 0; i < VARR_LENGTH (MIR_var_t, proto->args); i++) {
-      var = VARR_GET (MIR_var_t, proto->args, i);
-      if (i != 0) fprintf (f, ", ");
-      out_type (f, var.type);
-      if (var.name != NULL) fprintf (f, " %s", var.name);
+/* ----------------------- Structured control flow -----------------------
+   Java has no goto, so by default a function with labels becomes a
+   while/switch dispatcher over mir_label.  HotSpot sees such a function as
+   one irreducible loop and can't optimize the real loops inside it.
+
+   For reducible CFGs (c2mir output without gotos into loops) we rebuild
+   structured code instead, following N. Ramsey's "Beyond Relooper":
+     - a back edge to loop header H becomes `continue mir_loopH;'
+       (H's code is wrapped in `mir_loopH: while (true) { ... }'),
+     - a forward edge to a block B with several forward predecessors becomes
+       `break mir_blockB;' out of a labeled block followed by B's code,
+     - a forward edge to a block with only one predecessor inlines its code.
+   Irreducible functions still use the dispatcher.  */
+
+typedef struct bb {
+  MIR_insn_t first, last;      /* first and last insns of the block */
+  size_t succ_start, succ_num; /* successors in bb_succs */
+  size_t pred_start, pred_num; /* predecessors in bb_preds */
+  size_t merge_start, merge_num; /* merge children in bb_merges */
+  int rpo;                     /* reverse postorder number, -1 if unreachable */
+  int idom;                    /* immediate dominator */
+  int fwd_preds_num;           /* number of in-edges from blocks earlier in RPO */
+  char loop_header_p;          /* target of a back edge */
+  /* Method splitting data: */
+  char outlined_p;             /* the dominator subtree is emitted as a separate method */
+  char ret_exit_p;             /* the outlined subtree contains a return */
+  int size;                    /* estimated bytecode size of the block insns */
+  int residual_size;           /* estimated bytecode size of the subtree minus outlined parts */
+  int dom_pre, dom_last;       /* preorder numbers of the block and its last dominator subtree block */
+  size_t child_start, child_num; /* dominator tree children in bb_children */
+  size_t exit_start, exit_num; /* outlined subtree exit targets in bb_exits */
+  bitmap_t use, def;           /* vars used before any definition and defined in the block */
+  bitmap_t live_in, live_out;  /* vars live at the block start and end */
+  bitmap_t regs, defs;         /* vars used and defined in the dominator subtree */
+  bitmap_t in_regs, out_regs;  /* vars passed to and returned from the outlined subtree */
+  bitmap_t own_regs;           /* vars declared in the method of the outlined subtree or function */
+} bb_t;
+
+DEF_VARR (bb_t);
+DEF_VARR (int);
+
+static VARR (bb_t) * bbs;
+static VARR (int) * bb_succs, *bb_preds, *bb_merges, *bb_order, *bb_stack;
+static VARR (int) * bb_children, *bb_dom_order, *bb_exits, *var_slots;
+
+static void create_bb_data (void) {
+  VARR_CREATE (bb_t, bbs, 0);
+  VARR_CREATE (int, bb_succs, 0);
+  VARR_CREATE (int, bb_preds, 0);
+  VARR_CREATE (int, bb_merges, 0);
+  VARR_CREATE (int, bb_order, 0);
+  VARR_CREATE (int, bb_stack, 0);
+  VARR_CREATE (int, bb_children, 0);
+  VARR_CREATE (int, bb_dom_order, 0);
+  VARR_CREATE (int, bb_exits, 0);
+  VARR_CREATE (int, var_slots, 0);
+}
+
+static void destroy_bb_data (void) {
+  VARR_DESTROY (bb_t, bbs);
+  VARR_DESTROY (int, bb_succs);
+  VARR_DESTROY (int, bb_preds);
+  VARR_DESTROY (int, bb_merges);
+  VARR_DESTROY (int, bb_order);
+  VARR_DESTROY (int, bb_stack);
+  VARR_DESTROY (int, bb_children);
+  VARR_DESTROY (int, bb_dom_order);
+  VARR_DESTROY (int, bb_exits);
+  VARR_DESTROY (int, var_slots);
+}
+
+static int bb_terminator_p (MIR_insn_t insn) {
+  return MIR_branch_code_p (insn->code) || insn->code == MIR_SWITCH || insn->code == MIR_RET;
+}
+
+static int label_bb (MIR_op_t op) {
+  mir_assert (op.mode == MIR_OP_LABEL);
+  return (int) (intptr_t) op.u.label->data;
+}
+
+/* Split curr_func into basic blocks and set up successor/predecessor lists */
+static void build_bbs (void) {
+  bb_t bb, *bb_addr;
+  MIR_insn_t insn, prev = NULL;
+  size_t i, j, nbbs;
+
+  VARR_TRUNC (bb_t, bbs, 0);
+  VARR_TRUNC (int, bb_succs, 0);
+  VARR_TRUNC (int, bb_preds, 0);
+  memset (&bb, 0, sizeof (bb));
+  for (insn = DLIST_HEAD (MIR_insn_t, curr_func->insns); insn != NULL;
+       prev = insn, insn = DLIST_NEXT (MIR_insn_t, insn)) {
+    if (prev == NULL || bb_terminator_p (prev)
+        || (insn->code == MIR_LABEL && prev->code != MIR_LABEL)) {
+      bb.first = insn;
+      VARR_PUSH (bb_t, bbs, bb);
     }
-    if (i == 0) fprintf (f, "void");
-    fprintf (f, ");\n");
-    */
-    return;
+    VARR_ADDR (bb_t, bbs)[VARR_LENGTH (bb_t, bbs) - 1].last = insn;
+    if (insn->code == MIR_LABEL) insn->data = (void *) (intptr_t) (VARR_LENGTH (bb_t, bbs) - 1);
   }
-  if (item->item_type == MIR_data_item) {
-    fprintf(f, "long ");
-    if (item->u.data->name != NULL) {
-    	//const char* var_name = mangle_name(item->u.data->name);
-        char *var_name = get_mangled_symbol_name(item->u.data->name);
-    	fprintf(f, "%s", var_name);
-    } else {
-        fprintf(f, "unused_data_addr_%d", unused_data_addr_count++);
+  nbbs = VARR_LENGTH (bb_t, bbs);
+  bb_addr = VARR_ADDR (bb_t, bbs);
+  for (i = 0; i < nbbs; i++) {
+    MIR_insn_t last = bb_addr[i].last;
+
+    bb_addr[i].succ_start = VARR_LENGTH (int, bb_succs);
+    if (last->code == MIR_JMP) {
+      VARR_PUSH (int, bb_succs, label_bb (last->ops[0]));
+    } else if (last->code == MIR_SWITCH) {
+      for (j = 1; j < last->nops; j++) VARR_PUSH (int, bb_succs, label_bb (last->ops[j]));
+    } else if (last->code != MIR_RET) {
+      if (MIR_branch_code_p (last->code)) VARR_PUSH (int, bb_succs, label_bb (last->ops[0]));
+      if (i + 1 < nbbs) VARR_PUSH (int, bb_succs, (int) i + 1);
     }
-    fprintf(f, " = mir_set_data_");
-    out_mangled_type(f, item->u.data->el_type);
-    /*
-    if (item->u.data->el_type == MIR_T_U8) {
-      fprintf(f, "ubyte");
-    } else if (item->u.data->el_type == MIR_T_U16) {
-      fprintf(f, "ushort");
-    } else if (item->u.data->el_type == MIR_T_U32) {
-      fprintf(f, "uint");
-    } else if (item->u.data->el_type == MIR_T_U64) {
-      fprintf(f, "ulong");  
-    } else {
-      out_type(f, item->u.data->el_type);
+    bb_addr[i].succ_num = VARR_LENGTH (int, bb_succs) - bb_addr[i].succ_start;
+    bb_addr[i].pred_num = 0;
+  }
+  for (i = 0; i < VARR_LENGTH (int, bb_succs); i++)
+    bb_addr[VARR_GET (int, bb_succs, i)].pred_num++;
+  for (i = j = 0; i < nbbs; i++) {
+    bb_addr[i].pred_start = j;
+    j += bb_addr[i].pred_num;
+    bb_addr[i].pred_num = 0;
+  }
+  while (VARR_LENGTH (int, bb_preds) < j) VARR_PUSH (int, bb_preds, 0);
+  for (i = 0; i < nbbs; i++)
+    for (j = 0; j < bb_addr[i].succ_num; j++) {
+      bb_t *succ = &bb_addr[VARR_GET (int, bb_succs, bb_addr[i].succ_start + j)];
+      VARR_SET (int, bb_preds, succ->pred_start + succ->pred_num++, (int) i);
     }
-    */
-    if (item->u.data->nel == 1) {
-      //fprintf(f, "(alignement = %f)", item->u.data->u.d);
-      fprintf(f, "(");
-      out_type_value(f, item->u.data->el_type, item->u.data->u.els);
-      fprintf(f, ");\n");
-    } else {
-      fprintf(f, "s(new ");
-      if (item->u.data->el_type == MIR_T_U8) {
-        fprintf(f, "short");
-      } else if (item->u.data->el_type == MIR_T_U16) {
-        fprintf(f, "int");
-      } else if (item->u.data->el_type == MIR_T_U32) {
-        fprintf(f, "long");
-      } else {
-        out_type(f, item->u.data->el_type);
+}
+
+/* Number reachable blocks in reverse postorder into bb_order */
+static void order_bbs (void) {
+  bb_t *bb_addr = VARR_ADDR (bb_t, bbs);
+  size_t i, nbbs = VARR_LENGTH (bb_t, bbs);
+  int b, s, n;
+
+  VARR_TRUNC (int, bb_order, 0);
+  VARR_TRUNC (int, bb_stack, 0);
+  for (i = 0; i < nbbs; i++) bb_addr[i].rpo = -1;
+  /* DFS where rpo temporarily keeps the number of visited successors */
+  bb_addr[0].rpo = 0;
+  VARR_PUSH (int, bb_stack, 0);
+  while (VARR_LENGTH (int, bb_stack) != 0) {
+    b = VARR_LAST (int, bb_stack);
+    if ((size_t) bb_addr[b].rpo < bb_addr[b].succ_num) {
+      s = VARR_GET (int, bb_succs, bb_addr[b].succ_start + bb_addr[b].rpo++);
+      if (bb_addr[s].rpo < 0) {
+        bb_addr[s].rpo = 0;
+        VARR_PUSH (int, bb_stack, s);
       }
-      fprintf(f, "[] { ");
-      for (int i = 0; i < item->u.data->nel; i++) {
-        if (i != 0) fprintf (f, ", ");
-        fprintf(f, "%d", item->u.data->u.els[i]);	
-      } 
-      fprintf(f, " });\n");
-    }
-    return;
-  }
-  if (item->item_type == MIR_ref_data_item) {
-    fprintf(f, "long ");
-    if (item->u.ref_data->name != NULL) {
-        char* out_var_name = get_mangled_symbol_name(item->u.ref_data->name);
-    	fprintf(f, "%s", out_var_name);
     } else {
-        fprintf(f, "unused_data_addr_%d", unused_data_addr_count++);
+      VARR_POP (int, bb_stack);
+      VARR_PUSH (int, bb_order, b);
     }
-    char* in_var_name = get_mangled_symbol_name(item->u.ref_data->ref_item->u.ref_data->name);
-    fprintf(f, " = mir_set_data_ref(%s + %d);\n", in_var_name, item->u.ref_data->disp);
-    return;
   }
-  if (item->item_type == MIR_expr_data_item) {
-      fprintf(stderr, "\nError in function %s\n", curr_func->name);
-      (*MIR_get_error_func (ctx)) (MIR_func_error, "Expr data items are not supported yet");
-      return;
+  n = (int) VARR_LENGTH (int, bb_order);
+  for (i = 0; i < (size_t) n / 2; i++) { /* postorder -> reverse postorder */
+    b = VARR_GET (int, bb_order, i);
+    VARR_SET (int, bb_order, i, VARR_GET (int, bb_order, n - 1 - i));
+    VARR_SET (int, bb_order, n - 1 - i, b);
   }
-  if (item->item_type == MIR_bss_item) {
-    fprintf(f, "long ");
-    if (item->u.bss->name != NULL) {
-      char* bss_name = get_mangled_symbol_name(item->u.bss->name);
-      fprintf(f, "%s", bss_name);
-    } else {
-      fprintf(f, "unused_data_addr_%d", unused_data_addr_count++);
+  for (i = 0; i < (size_t) n; i++) bb_addr[VARR_GET (int, bb_order, i)].rpo = (int) i;
+}
+
+static int intersect_doms (bb_t *bb_addr, int b1, int b2) {
+  while (b1 != b2) {
+    while (bb_addr[b1].rpo > bb_addr[b2].rpo) b1 = bb_addr[b1].idom;
+    while (bb_addr[b2].rpo > bb_addr[b1].rpo) b2 = bb_addr[b2].idom;
+  }
+  return b1;
+}
+
+/* Cooper, Harvey and Kennedy's iterative dominator algorithm */
+static void calculate_dominators (void) {
+  bb_t *bb_addr = VARR_ADDR (bb_t, bbs);
+  size_t i, j, n = VARR_LENGTH (int, bb_order);
+  int b, p, new_idom, changed_p = TRUE;
+
+  for (i = 0; i < VARR_LENGTH (bb_t, bbs); i++) bb_addr[i].idom = -1;
+  bb_addr[0].idom = 0;
+  while (changed_p) {
+    changed_p = FALSE;
+    for (i = 1; i < n; i++) {
+      b = VARR_GET (int, bb_order, i);
+      new_idom = -1;
+      for (j = 0; j < bb_addr[b].pred_num; j++) {
+        p = VARR_GET (int, bb_preds, bb_addr[b].pred_start + j);
+        if (bb_addr[p].idom < 0) continue; /* unreachable or not processed yet */
+        new_idom = new_idom < 0 ? p : intersect_doms (bb_addr, p, new_idom);
+      }
+      if (bb_addr[b].idom != new_idom) {
+        bb_addr[b].idom = new_idom;
+        changed_p = TRUE;
+      }
     }
-    fprintf(f, " = mir_allocate(%d);\n", item->u.bss->len);
-    return;
   }
+}
+
+static int dominates_p (bb_t *bb_addr, int dom, int b) {
+  for (;;) {
+    if (b == dom) return TRUE;
+    if (b == 0) return FALSE;
+    b = bb_addr[b].idom;
+  }
+}
 
-  curr_func = item->u.func;
-  char* func_name = (char*) curr_func->name;
-  //printf("[MIR2J_DEBUG] function name:%s\n", func_name);
+static int merge_cmp (const void *a1, const void *a2) {
+  bb_t *bb_addr = VARR_ADDR (bb_t, bbs);
+  const bb_t *bb1 = &bb_addr[*(const int *) a1], *bb2 = &bb_addr[*(const int *) a2];
 
-  /*------------------------------------
-    First pass to analyze the function
-  ------------------------------------- */
-  int curr_func_number_of_labels = 0;
-  curr_func_has_stack_allocation = FALSE;
-  for (MIR_insn_t insn = DLIST_HEAD (MIR_insn_t, curr_func->insns); insn != NULL;
-       insn = DLIST_NEXT (MIR_insn_t, insn)) {
-    if (insn->code == MIR_LABEL) {
-      curr_func_number_of_labels++; 
-    } else if (insn->code == MIR_ALLOCA) {
-      curr_func_has_stack_allocation = TRUE;	
+  if (bb1->idom != bb2->idom) return bb1->idom < bb2->idom ? -1 : 1;
+  return bb2->rpo - bb1->rpo; /* the latest block in RPO is the outermost one */
+}
+
+/* Classify edges and collect merge children of each block.  Return FALSE if
+   the CFG is irreducible, i.e. there is a retreating edge to a block that
+   does not dominate the edge source.  */
+static int analyze_structure (void) {
+  bb_t *bb_addr;
+  size_t i, j, nbbs;
+  int b, s;
+
+  build_bbs ();
+  order_bbs ();
+  calculate_dominators ();
+  bb_addr = VARR_ADDR (bb_t, bbs);
+  nbbs = VARR_LENGTH (bb_t, bbs);
+  for (i = 0; i < nbbs; i++) {
+    bb_addr[i].fwd_preds_num = 0;
+    bb_addr[i].loop_header_p = FALSE;
+  }
+  for (i = 0; i < VARR_LENGTH (int, bb_order); i++) {
+    b = VARR_GET (int, bb_order, i);
+    for (j = 0; j < bb_addr[b].succ_num; j++) {
+      s = VARR_GET (int, bb_succs, bb_addr[b].succ_start + j);
+      if (bb_addr[s].rpo > bb_addr[b].rpo) {
+        bb_addr[s].fwd_preds_num++;
+      } else if (dominates_p (bb_addr, s, b)) {
+        bb_addr[s].loop_header_p = TRUE;
+      } else {
+        return FALSE;
+      }
     }
   }
-  if (curr_func->vararg_p) {
-    // The current implementation of varargs uses stack allocation
-    curr_func_has_stack_allocation = TRUE;	
+  VARR_TRUNC (int, bb_merges, 0);
+  for (i = 1; i < VARR_LENGTH (int, bb_order); i++) {
+    b = VARR_GET (int, bb_order, i);
+    if (bb_addr[b].fwd_preds_num > 1) VARR_PUSH (int, bb_merges, b);
   }
-  //printf("n of labels=%d\n", curr_func_number_of_labels);
-
-  /*-----------------------------------------------
-    Second pass where the code is actually emitted
-  ------------------------------------------------ */
-  symbol_t func_symbol;
-  if (!item->export_p) {
-    fprintf (f, "protected "); // static
-    func_symbol = add_symbol(curr_func->name, FALSE);
-  } else {
-  	fprintf (f, "public ");
-  	func_symbol = add_symbol(curr_func->name, TRUE);
+  qsort (VARR_ADDR (int, bb_merges), VARR_LENGTH (int, bb_merges), sizeof (int), merge_cmp);
+  for (i = 0; i < nbbs; i++) bb_addr[i].merge_start = bb_addr[i].merge_num = 0;
+  for (i = 0; i < VARR_LENGTH (int, bb_merges); i++) {
+    bb_t *dom = &bb_addr[bb_addr[VARR_GET (int, bb_merges, i)].idom];
+    if (dom->merge_num++ == 0) dom->merge_start = i;
   }
-  if (curr_func->nres == 0)
-    fprintf (f, "void");
-  else if (curr_func->nres == 1)
+  return TRUE;
+}
+
+static void out_indent (FILE *f, int level) {
+  for (int i = 0; i < level; i++) fputs ("  ", f);
+}
+
+/* Return TRUE if the edge from -> to is translated by inlining the code of to */
+static int bb_inline_edge_p (int from, int to) {
+  bb_t *bb_addr = VARR_ADDR (bb_t, bbs);
+  return bb_addr[to].rpo > bb_addr[from].rpo && bb_addr[to].fwd_preds_num == 1;
+}
+
+static int curr_region = -1; /* root of the outlined subtree being emitted or -1 */
+
+static int bb_in_subtree_p (int root, int b) {
+  bb_t *bb_addr = VARR_ADDR (bb_t, bbs);
+  return bb_addr[root].dom_pre <= bb_addr[b].dom_pre && bb_addr[b].dom_pre <= bb_addr[root].dom_last;
+}
+
+static void out_bb_jump (FILE *f, int from, int to) {
+  bb_t *bb_addr = VARR_ADDR (bb_t, bbs);
+
+  if (curr_region >= 0 && !bb_in_subtree_p (curr_region, to)) {
+    bb_t *region = &bb_addr[curr_region];
+    size_t i;
+
+    for (i = 0; VARR_GET (int, bb_exits, region->exit_start + i) != to; i++)
+      mir_assert (i < region->exit_num);
+    fprintf (f, "{ mir_exit = %d; break mir_region; }", (int) i + 1);
+  } else if (bb_addr[to].rpo <= bb_addr[from].rpo)
+    fprintf (f, "continue mir_loop%d;", to);
+  else
+    fprintf (f, "break mir_block%d;", to);
+}
+
+static void out_bb_code (MIR_context_t ctx, FILE *f, int b, int level);
+
+static void out_bb_branch (MIR_context_t ctx, FILE *f, int from, int to, int level) {
+  if (bb_inline_edge_p (from, to)) {
+    out_bb_code (ctx, f, to, level);
+  } else {
+    out_indent (f, level);
+    out_bb_jump (f, from, to);
+    fprintf (f, "\n");
+  }
+}
+
+static void out_regs_array (FILE *f, int var_index) {
+  MIR_var_t var = VARR_GET (MIR_var_t, curr_func->vars, var_index);
+  int fp_p = var.type == MIR_T_F || var.type == MIR_T_D || var.type == MIR_T_LD;
+
+  fprintf (f, "%s[%d]", fp_p ? "mir_fregs" : "mir_iregs", VARR_GET (int, var_slots, var_index));
+}
+
+/* Result slot of the function in the register arrays */
+static void out_result_slot (FILE *f) {
+  MIR_type_t type = curr_func->res_types[0];
+  int fp_p = type == MIR_T_F || type == MIR_T_D || type == MIR_T_LD;
+
+  fprintf (f, "%s[%d]", fp_p ? "mir_fregs" : "mir_iregs",
+           VARR_GET (int, var_slots, VARR_LENGTH (MIR_var_t, curr_func->vars) + fp_p));
+}
+
+/* Return from an outlined subtree: keep the result and exit with code 0 */
+static void out_region_ret (MIR_context_t ctx, FILE *f, MIR_insn_t insn, int level) {
+  out_indent (f, level);
+  if (insn != NULL && insn->nops != 0) {
+    out_result_slot (f);
+    fprintf (f, " = (");
+    out_type (f, curr_func->res_types[0]);
+    fprintf (f, ") ");
+    out_op (ctx, f, insn->ops[0]);
+    fprintf (f, "; ");
+  }
+  fprintf (f, "mir_exit = 0; break mir_region;\n");
+}
+
+/* Code for the end of a function without ret */
+static void out_fall_off_ret (FILE *f, int level) {
+  if (curr_region >= 0) {
+    out_region_ret (NULL, f, NULL, level);
+    return;
+  }
+  out_indent (f, level);
+  if (curr_func_has_stack_allocation)
+    fprintf (f, "mir_set_stack_position(mir_saved_stack_position); ");
+  if (curr_func->nres == 0) {
+    fprintf (f, "return;\n");
+  } else {
+    fprintf (f, "return (");
+    out_type (f, curr_func->res_types[0]);
+    fprintf (f, ") 0;\n");
+  }
+}
+
+/* c2mir lowers small or sparse C switches into chains of BEQS of the same
+   register against constants.  Such a chain of at least MIR2J_MIN_BEQ_CHAIN
+   blocks becomes one Java switch, compiled by javac into a tableswitch or a
+   lookupswitch.  Chain blocks after the first must be only the BEQS reached
+   by the fall-through of the previous one.  Their merge blocks are wrapped
+   around the switch.  */
+#ifndef MIR2J_MIN_BEQ_CHAIN
+#define MIR2J_MIN_BEQ_CHAIN 3
+#endif
+
+static int beq_chain_insn_p (MIR_insn_t insn, MIR_reg_t reg) {
+  return (insn->code == MIR_BEQS && insn->ops[1].mode == MIR_OP_REG
+          && (insn->ops[2].mode == MIR_OP_INT || insn->ops[2].mode == MIR_OP_UINT)
+          && (reg == 0 || insn->ops[1].u.reg == reg));
+}
+
+/* Return the number of blocks of the BEQS chain ending block b or 0 if
+   there is no chain long enough */
+static int beq_chain_length (int b) {
+  bb_t *bb_addr = VARR_ADDR (bb_t, bbs);
+  MIR_insn_t insn = bb_addr[b].last;
+  MIR_reg_t reg;
+  int n, start = b;
+
+  if (!beq_chain_insn_p (insn, 0)) return 0;
+  reg = insn->ops[1].u.reg;
+  for (n = 1;; n++) {
+    bb_t *bb = &bb_addr[b];
+    int next;
+
+    if (bb->succ_num != 2) break;
+    next = VARR_GET (int, bb_succs, bb->succ_start + 1);
+    bb = &bb_addr[next];
+    if (bb->first != bb->last || !beq_chain_insn_p (bb->last, reg) || bb->pred_num != 1
+        || bb->outlined_p || bb->loop_header_p)
+      break;
+    for (int c = start, i = 0; i < n; i++, c = VARR_GET (int, bb_succs, bb_addr[c].succ_start + 1))
+      if ((int32_t) bb_addr[c].last->ops[2].u.i == (int32_t) bb->last->ops[2].u.i) goto done;
+    b = next;
+  }
+done:
+  return n < MIR2J_MIN_BEQ_CHAIN ? 0 : n;
+}
+
+/* Code of the branch to s in a switch case */
+static void out_case_branch (MIR_context_t ctx, FILE *f, int from, int s, int level) {
+  if (bb_inline_edge_p (from, s)) {
+    fprintf (f, " {\n");
+    out_bb_code (ctx, f, s, level + 1);
+    out_indent (f, level);
+    fprintf (f, "}\n");
+  } else {
+    fprintf (f, " ");
+    out_bb_jump (f, from, s);
+    fprintf (f, "\n");
+  }
+}
+
+/* Switch for the BEQS chain of n blocks ending block b */
+static void out_beq_switch (MIR_context_t ctx, FILE *f, int b, int n, int level) {
+  bb_t *bb_addr = VARR_ADDR (bb_t, bbs);
+  MIR_op_t reg_op = bb_addr[b].last->ops[1];
+
+  out_indent (f, level);
+  fprintf (f, "switch ((int) ");
+  out_op (ctx, f, reg_op);
+  fprintf (f, ") {\n");
+  for (int i = 0;; i++) {
+    bb_t *bb = &bb_addr[b];
+
+    out_indent (f, level);
+    fprintf (f, "case %d:", (int) (int32_t) bb->last->ops[2].u.i);
+    out_case_branch (ctx, f, b, VARR_GET (int, bb_succs, bb->succ_start), level);
+    if (i + 1 == n) break;
+    b = VARR_GET (int, bb_succs, bb->succ_start + 1);
+  }
+  out_indent (f, level);
+  fprintf (f, "default: {\n");
+  if (bb_addr[b].succ_num > 1)
+    out_bb_branch (ctx, f, b, VARR_GET (int, bb_succs, bb_addr[b].succ_start + 1), level + 1);
+  else
+    out_fall_off_ret (f, level + 1);
+  out_indent (f, level);
+  fprintf (f, "}\n");
+  out_indent (f, level);
+  fprintf (f, "} // End of switch(");
+  out_op (ctx, f, reg_op);
+  fprintf (f, ")\n");
+}
+
+static int rpo_desc_cmp (const void *a1, const void *a2) {
+  bb_t *bb_addr = VARR_ADDR (bb_t, bbs);
+  return bb_addr[*(const int *) a2].rpo - bb_addr[*(const int *) a1].rpo;
+}
+
+static void out_bb_within (MIR_context_t ctx, FILE *f, int b, const int *merges, size_t n,
+                           int chain_n, int level);
+
+/* Switch for the BEQS chain of n blocks ending block b within labeled blocks
+   for the merge children of the other chain blocks */
+static void out_beq_chain (MIR_context_t ctx, FILE *f, int b, int n, int level) {
+  bb_t *bb_addr = VARR_ADDR (bb_t, bbs);
+  size_t nmerges = 0;
+  int *merges, c = b;
+
+  for (int i = 1; i < n; i++) {
+    c = VARR_GET (int, bb_succs, bb_addr[c].succ_start + 1);
+    nmerges += bb_addr[c].merge_num;
+  }
+  merges = malloc (sizeof (int) * (nmerges + 1));
+  nmerges = 0;
+  c = b;
+  for (int i = 1; i < n; i++) {
+    c = VARR_GET (int, bb_succs, bb_addr[c].succ_start + 1);
+    for (size_t j = 0; j < bb_addr[c].merge_num; j++)
+      merges[nmerges++] = VARR_GET (int, bb_merges, bb_addr[c].merge_start + j);
+  }
+  qsort (merges, nmerges, sizeof (int), rpo_desc_cmp);
+  out_bb_within (ctx, f, b, merges, nmerges, n, level);
+  free (merges);
+}
+
+static void out_bb_insns (MIR_context_t ctx, FILE *f, int b, int level) {
+  bb_t *bb = &VARR_ADDR (bb_t, bbs)[b];
+  MIR_insn_t insn, last = bb->last;
+  int s, n;
+
+  for (insn = bb->first;; insn = DLIST_NEXT (MIR_insn_t, insn)) {
+    if (insn->code == MIR_RET && curr_region >= 0) {
+      out_region_ret (ctx, f, insn, level);
+    } else if (insn->code != MIR_LABEL && (insn != last || !bb_terminator_p (insn) || insn->code == MIR_RET)) {
+      out_indent (f, level - 1);
+      out_insn (ctx, f, insn);
+      out_memory_reload (f, insn, level - 1);
+    }
+    if (insn == last) break;
+  }
+  if ((n = beq_chain_length (b)) != 0) {
+    out_beq_chain (ctx, f, b, n, level);
+  } else if (last->code == MIR_SWITCH) {
+    out_indent (f, level);
+    fprintf (f, "switch ((int) ");
+    out_op (ctx, f, last->ops[0]);
+    fprintf (f, ") {\n");
+    for (size_t i = 0; i < bb->succ_num; i++) {
+      s = VARR_GET (int, bb_succs, bb->succ_start + i);
+      out_indent (f, level);
+      /* out of range index is undefined behaviour in MIR */
+      fprintf (f, i + 1 < bb->succ_num ? "case %d:" : "case %d: default:", (int) i);
+      out_case_branch (ctx, f, b, s, level);
+    }
+    out_indent (f, level);
+    fprintf (f, "} // End of switch(");
+    out_op (ctx, f, last->ops[0]);
+    fprintf (f, ")\n");
+  } else if (last->code == MIR_JMP) {
+    out_bb_branch (ctx, f, b, VARR_GET (int, bb_succs, bb->succ_start), level);
+  } else if (MIR_branch_code_p (last->code)) {
+    s = VARR_GET (int, bb_succs, bb->succ_start);
+    out_indent (f, level);
+    fprintf (f, "if ");
+    out_branch_cond (ctx, f, last);
+    if (bb_inline_edge_p (b, s)) {
+      fprintf (f, " {\n");
+      out_bb_code (ctx, f, s, level + 1);
+      out_indent (f, level);
+      fprintf (f, "}\n");
+    } else {
+      fprintf (f, " { ");
+      out_bb_jump (f, b, s);
+      fprintf (f, " }\n");
+    }
+    if (bb->succ_num > 1)
+      out_bb_branch (ctx, f, b, VARR_GET (int, bb_succs, bb->succ_start + 1), level);
+    else
+      out_fall_off_ret (f, level);
+  } else if (last->code != MIR_RET) {
+    if (bb->succ_num != 0)
+      out_bb_branch (ctx, f, b, VARR_GET (int, bb_succs, bb->succ_start), level);
+    else
+      out_fall_off_ret (f, level);
+  }
+}
+
+/* Code of block b, or the switch of the BEQS chain of chain_n blocks ending
+   it if chain_n is not zero, wrapped into labeled blocks for merge children
+   merges[0..n-1], the outermost first */
+static void out_bb_within (MIR_context_t ctx, FILE *f, int b, const int *merges, size_t n,
+                           int chain_n, int level) {
+  if (n == 0) {
+    if (chain_n != 0)
+      out_beq_switch (ctx, f, b, chain_n, level);
+    else
+      out_bb_insns (ctx, f, b, level);
+    return;
+  }
+  out_indent (f, level);
+  fprintf (f, "mir_block%d: {\n", merges[0]);
+  out_bb_within (ctx, f, b, merges + 1, n - 1, chain_n, level + 1);
+  out_indent (f, level);
+  fprintf (f, "} // End of mir_block%d\n", merges[0]);
+  out_bb_code (ctx, f, merges[0], level);
+}
+
+static void out_region_call (MIR_context_t ctx, FILE *f, int b, int level);
+
+/* Code of block b and of all blocks it dominates */
+static void out_bb_code (MIR_context_t ctx, FILE *f, int b, int level) {
+  bb_t *bb = &VARR_ADDR (bb_t, bbs)[b];
+  const int *merges = VARR_ADDR (int, bb_merges) + bb->merge_start;
+
+  if (bb->outlined_p && b != curr_region) {
+    out_region_call (ctx, f, b, level);
+    return;
+  }
+  if (!bb->loop_header_p) {
+    out_bb_within (ctx, f, b, merges, bb->merge_num, 0, level);
+    return;
+  }
+  out_indent (f, level);
+  fprintf (f, "mir_loop%d: while (true) {\n", b);
+  out_bb_within (ctx, f, b, merges, bb->merge_num, 0, level + 1);
+  out_indent (f, level);
+  fprintf (f, "} // End of mir_loop%d\n", b);
+}
+
+/* --------------------------- Method splitting ---------------------------
+   The JVM rejects methods with more than 64 KB of bytecode and HotSpot
+   never JIT-compiles methods bigger than HugeMethodLimit (8000 bytes).  When
+   the estimated bytecode size of a structured function exceeds
+   MIR2J_METHOD_SIZE_LIMIT, dominator subtrees (single entry regions) are
+   outlined into helper methods <func>_part<N>, the biggest ones first.
+
+   Registers used by a region are passed through the mir_iregs (long[]) and
+   mir_fregs (double[]) arrays allocated at function entry.  The helper
+   returns an exit code: 0 for a function return (the result is in the
+   arrays), N for a jump to the N-th exit target of the region.  The caller
+   reloads the registers and dispatches the exit code with a switch.
+
+   Long runs of straight-line code are first cut by new labels into blocks
+   of half the limit, which the outlining can then move into helpers like
+   any other dominator subtree.  A method which still goes over the JVM
+   limit (a function with setjmp or irreducible control flow, which can't
+   be split) is reported as an error instead of producing a class javac or
+   the JVM rejects.  */
+
+#ifndef MIR2J_METHOD_SIZE_LIMIT
+#define MIR2J_METHOD_SIZE_LIMIT 6000
+#endif
+#define JVM_METHOD_SIZE_LIMIT 65535
+
+static int op_bytecode_size (MIR_op_t op) {
+  switch (op.mode) {
+  case MIR_OP_REG: return 2;
+  case MIR_OP_INT:
+  case MIR_OP_UINT:
+  case MIR_OP_FLOAT:
+  case MIR_OP_DOUBLE:
+  case MIR_OP_LDOUBLE: return 3;
+  case MIR_OP_REF:
+  case MIR_OP_STR: return 4;
+  case MIR_OP_MEM: return 14; /* address arithmetic and accessor call */
+  default: return 0;
+  }
+}
+
+static int insn_bytecode_size (MIR_insn_t insn) {
+  int size = 4; /* conversions and result store */
+
+  if (insn->code == MIR_LABEL) return 0;
+  for (size_t i = 0; i < insn->nops; i++) size += op_bytecode_size (insn->ops[i]);
+  if (MIR_call_code_p (insn->code)) {
+    size += 2 * insn->nops + 4;
+    if (insn->ops[0].u.ref->u.proto->vararg_p) size += 8 * insn->nops + 12; /* arg spills */
+  }
+  if (insn->code == MIR_SWITCH) size += 8 * insn->nops;
+  if (insn->code == MIR_VA_ARG || insn->code == MIR_VA_BLOCK_ARG) size += 20;
+  return size;
+}
+
+/* Exit with an error if the estimated bytecode size of a method of the
+   current function is over the JVM limit */
+static void check_method_size (int size) {
+  if (size <= JVM_METHOD_SIZE_LIMIT) return;
+  fprintf (stderr, "m2j: function %s can not be split under the JVM method size limit"
+           " (about %d bytes of bytecode, the limit is %d)\n",
+           curr_func->name, size, JVM_METHOD_SIZE_LIMIT);
+  exit (1);
+}
+
+/* Cut straight-line runs longer than half the method size limit with new
+   labels, so that split_func can outline them.  Return the number of new
+   labels.  */
+static int split_long_blocks (MIR_context_t ctx, MIR_item_t func_item) {
+  MIR_insn_t insn, prev = NULL;
+  int size = 0, total_size = 0, nlabels = 0;
+
+  for (insn = DLIST_HEAD (MIR_insn_t, curr_func->insns); insn != NULL;
+       insn = DLIST_NEXT (MIR_insn_t, insn))
+    total_size += insn_bytecode_size (insn);
+  if (total_size <= MIR2J_METHOD_SIZE_LIMIT) return 0;
+  for (insn = DLIST_HEAD (MIR_insn_t, curr_func->insns); insn != NULL;
+       prev = insn, insn = DLIST_NEXT (MIR_insn_t, insn)) {
+    if (insn->code == MIR_LABEL || (prev != NULL && bb_terminator_p (prev))) {
+      size = 0;
+    } else if (size + insn_bytecode_size (insn) > MIR2J_METHOD_SIZE_LIMIT / 2 && size != 0) {
+      MIR_insert_insn_before (ctx, func_item, insn, MIR_new_label (ctx));
+      nlabels++;
+      size = 0;
+    }
+    size += insn_bytecode_size (insn);
+  }
+  return nlabels;
+}
+
+/* Add regs of op to use unless they are in def */
+static void add_op_uses (bitmap_t use, bitmap_t def, MIR_op_t op) {
+  if (op.mode == MIR_OP_REG) {
+    if (!bitmap_bit_p (def, op.u.reg - 1)) bitmap_set_bit_p (use, op.u.reg - 1);
+  } else if (op.mode == MIR_OP_MEM) {
+    if (op.u.mem.base != 0 && !bitmap_bit_p (def, op.u.mem.base - 1))
+      bitmap_set_bit_p (use, op.u.mem.base - 1);
+    if (op.u.mem.index != 0 && !bitmap_bit_p (def, op.u.mem.index - 1))
+      bitmap_set_bit_p (use, op.u.mem.index - 1);
+  }
+}
+
+/* Set up use, def and regs of the block */
+static void find_bb_regs (MIR_context_t ctx, bb_t *bb, size_t nvars) {
+  MIR_insn_t insn;
+  size_t i;
+  int out_p;
+
+  bb->use = bitmap_create2 (nvars);
+  bb->def = bitmap_create2 (nvars);
+  bb->live_in = bitmap_create2 (nvars);
+  bb->live_out = bitmap_create2 (nvars);
+  bb->regs = bitmap_create2 (nvars);
+  bb->defs = bitmap_create2 (nvars);
+  for (insn = bb->first;; insn = DLIST_NEXT (MIR_insn_t, insn)) {
+    for (i = 0; i < insn->nops; i++) {
+      MIR_insn_op_mode (ctx, insn, i, &out_p);
+      if (!out_p || insn->ops[i].mode == MIR_OP_MEM) add_op_uses (bb->use, bb->def, insn->ops[i]);
+    }
+    for (i = 0; i < insn->nops; i++) {
+      MIR_insn_op_mode (ctx, insn, i, &out_p);
+      if (out_p && insn->ops[i].mode == MIR_OP_REG) bitmap_set_bit_p (bb->def, insn->ops[i].u.reg - 1);
+    }
+    if (insn == bb->last) break;
+  }
+  bitmap_ior (bb->regs, bb->use, bb->def);
+  bitmap_copy (bb->defs, bb->def);
+}
+
+/* Classic backward liveness over reachable blocks */
+static void calculate_liveness (void) {
+  bb_t *bb_addr = VARR_ADDR (bb_t, bbs);
+  size_t i, j, n = VARR_LENGTH (int, bb_order);
+  int changed_p = TRUE;
+
+  while (changed_p) {
+    changed_p = FALSE;
+    for (i = n; i-- > 0;) {
+      bb_t *bb = &bb_addr[VARR_GET (int, bb_order, i)];
+
+      for (j = 0; j < bb->succ_num; j++)
+        bitmap_ior (bb->live_out, bb->live_out,
+                    bb_addr[VARR_GET (int, bb_succs, bb->succ_start + j)].live_in);
+      if (bitmap_ior_and_compl (bb->live_in, bb->use, bb->live_out, bb->def)) changed_p = TRUE;
+    }
+  }
+}
+
+static int dom_child_cmp (const void *a1, const void *a2) {
+  bb_t *bb_addr = VARR_ADDR (bb_t, bbs);
+  const bb_t *bb1 = &bb_addr[*(const int *) a1], *bb2 = &bb_addr[*(const int *) a2];
+
+  if (bb1->idom != bb2->idom) return bb1->idom < bb2->idom ? -1 : 1;
+  return bb1->rpo - bb2->rpo;
+}
+
+static void number_dom_tree (int b) {
+  bb_t *bb_addr = VARR_ADDR (bb_t, bbs);
+
+  bb_addr[b].dom_pre = (int) VARR_LENGTH (int, bb_dom_order);
+  VARR_PUSH (int, bb_dom_order, b);
+  for (size_t i = 0; i < bb_addr[b].child_num; i++)
+    number_dom_tree (VARR_GET (int, bb_children, bb_addr[b].child_start + i));
+  bb_addr[b].dom_last = (int) VARR_LENGTH (int, bb_dom_order) - 1;
+}
+
+/* Estimated size of passing registers to and from an outlined subtree */
+static int region_call_size (bb_t *bb) {
+  return 40 + 32 * (int) bitmap_bit_count (bb->in_regs);
+}
+
+/* Collect exit targets of the outlined subtree with root b */
+static void find_region_exits (int b) {
+  bb_t *bb_addr = VARR_ADDR (bb_t, bbs), *region = &bb_addr[b];
+  int i, s;
+  size_t j, k;
+
+  region->exit_start = VARR_LENGTH (int, bb_exits);
+  region->exit_num = 0;
+  region->ret_exit_p = FALSE;
+  for (i = region->dom_pre; i <= region->dom_last; i++) {
+    bb_t *bb = &bb_addr[VARR_GET (int, bb_dom_order, i)];
+
+    if (bb->last->code == MIR_RET || (bb->succ_num == 0 && bb->last->code != MIR_SWITCH))
+      region->ret_exit_p = TRUE;
+    for (j = 0; j < bb->succ_num; j++) {
+      s = VARR_GET (int, bb_succs, bb->succ_start + j);
+      if (bb_in_subtree_p (b, s)) continue;
+      bitmap_ior_and (region->out_regs, region->out_regs, bb_addr[s].live_in, region->defs);
+      for (k = 0; k < region->exit_num; k++)
+        if (VARR_GET (int, bb_exits, region->exit_start + k) == s) break;
+      if (k < region->exit_num) continue;
+      VARR_PUSH (int, bb_exits, s);
+      region->exit_num++;
+    }
+  }
+}
+
+/* Set own_regs of the method emitted for the subtree with root b: the vars of
+   its blocks outside outlined subtrees.  Others stay in the register arrays
+   while the method runs.  */
+static void find_own_regs (int b, size_t nvars) {
+  bb_t *bb_addr = VARR_ADDR (bb_t, bbs), *region = &bb_addr[b];
+  int i;
+
+  region->own_regs = bitmap_create2 (nvars);
+  for (i = region->dom_pre; i <= region->dom_last; i++) {
+    bb_t *bb = &bb_addr[VARR_GET (int, bb_dom_order, i)];
+
+    if (bb != region && bb->outlined_p) {
+      i = bb->dom_last;
+      continue;
+    }
+    bitmap_ior (region->own_regs, region->own_regs, bb->use);
+    bitmap_ior (region->own_regs, region->own_regs, bb->def);
+  }
+}
+
+/* Choose dominator subtrees to outline.  Return TRUE if there are any.  */
+static int split_func (MIR_context_t ctx) {
+  bb_t *bb_addr = VARR_ADDR (bb_t, bbs);
+  size_t i, j, n = VARR_LENGTH (int, bb_order), nvars = VARR_LENGTH (MIR_var_t, curr_func->vars);
+  int b, total_size = 0, outlined_p = FALSE;
+  MIR_insn_t insn;
+
+  for (i = 0; i < n; i++) {
+    bb_t *bb = &bb_addr[VARR_GET (int, bb_order, i)];
+
+    bb->size = 4;
+    for (insn = bb->first;; insn = DLIST_NEXT (MIR_insn_t, insn)) {
+      bb->size += insn_bytecode_size (insn);
+      if (insn == bb->last) break;
+    }
+    total_size += bb->size;
+  }
+  if (total_size <= MIR2J_METHOD_SIZE_LIMIT) return FALSE;
+  /* Build the dominator tree */
+  VARR_TRUNC (int, bb_children, 0);
+  for (i = 1; i < n; i++) VARR_PUSH (int, bb_children, VARR_GET (int, bb_order, i));
+  qsort (VARR_ADDR (int, bb_children), VARR_LENGTH (int, bb_children), sizeof (int), dom_child_cmp);
+  for (i = 0; i < VARR_LENGTH (bb_t, bbs); i++) bb_addr[i].child_start = bb_addr[i].child_num = 0;
+  for (i = 0; i < VARR_LENGTH (int, bb_children); i++) {
+    bb_t *dom = &bb_addr[bb_addr[VARR_GET (int, bb_children, i)].idom];
+    if (dom->child_num++ == 0) dom->child_start = i;
+  }
+  VARR_TRUNC (int, bb_dom_order, 0);
+  number_dom_tree (0);
+  for (i = 0; i < n; i++) find_bb_regs (ctx, &bb_addr[VARR_GET (int, bb_order, i)], nvars);
+  calculate_liveness ();
+  /* Bottom-up: outline the biggest children while the residual subtree is too big */
+  for (i = n; i-- > 0;) {
+    bb_t *bb = &bb_addr[b = VARR_GET (int, bb_order, i)];
+
+    bb->residual_size = bb->size;
+    for (j = 0; j < bb->child_num; j++) {
+      bb_t *child = &bb_addr[VARR_GET (int, bb_children, bb->child_start + j)];
+      bitmap_ior (bb->regs, bb->regs, child->regs);
+      bitmap_ior (bb->defs, bb->defs, child->defs);
+      bb->residual_size += child->residual_size;
+    }
+    bb->in_regs = bitmap_create2 (nvars);
+    bb->out_regs = bitmap_create2 (nvars);
+    bitmap_and (bb->in_regs, bb->live_in, bb->regs);
+    while (bb->residual_size > MIR2J_METHOD_SIZE_LIMIT) {
+      bb_t *child, *max_child = NULL;
+
+      for (j = 0; j < bb->child_num; j++) {
+        child = &bb_addr[VARR_GET (int, bb_children, bb->child_start + j)];
+        if (child->outlined_p || child->residual_size <= region_call_size (child)) continue;
+        if (max_child == NULL || max_child->residual_size < child->residual_size) max_child = child;
+      }
+      if (max_child == NULL) break; /* a too big block can't be split further */
+      max_child->outlined_p = outlined_p = TRUE;
+      bb->residual_size += region_call_size (max_child) - max_child->residual_size;
+    }
+  }
+  for (i = 0; i < n; i++) {
+    bb_t *bb = &bb_addr[b = VARR_GET (int, bb_order, i)];
+
+    if (b != 0 && !bb->outlined_p) continue;
+    find_own_regs (b, nvars);
+    if (b == 0) /* the function args are Java locals */
+      for (j = 0; j < curr_func->nargs; j++) bitmap_set_bit_p (bb->own_regs, j);
+    /* Declarations and loads of the locals */
+    check_method_size (bb->residual_size + 8 * (int) bitmap_bit_count (bb->own_regs));
+  }
+  if (!outlined_p) return FALSE;
+  VARR_TRUNC (int, bb_exits, 0);
+  for (i = 0; i < n; i++)
+    if (bb_addr[b = VARR_GET (int, bb_order, i)].outlined_p) find_region_exits (b);
+  /* Slots of vars in the register arrays; the last two are for the result */
+  int islot = 0, fslot = 0;
+  VARR_TRUNC (int, var_slots, 0);
+  for (i = 0; i < nvars; i++) {
+    MIR_type_t type = VARR_GET (MIR_var_t, curr_func->vars, i).type;
+    VARR_PUSH (int, var_slots, type == MIR_T_F || type == MIR_T_D || type == MIR_T_LD ? fslot++ : islot++);
+  }
+  VARR_PUSH (int, var_slots, islot);
+  VARR_PUSH (int, var_slots, fslot);
+  return TRUE;
+}
+
+static void free_split_data (void) {
+  bb_t *bb_addr = VARR_ADDR (bb_t, bbs);
+
+  for (size_t i = 0; i < VARR_LENGTH (bb_t, bbs); i++) {
+    bitmap_t *bms[] = {&bb_addr[i].use,     &bb_addr[i].def,  &bb_addr[i].live_in,
+                       &bb_addr[i].live_out, &bb_addr[i].regs, &bb_addr[i].defs,
+                       &bb_addr[i].in_regs,  &bb_addr[i].out_regs, &bb_addr[i].own_regs};
+
+    for (size_t j = 0; j < sizeof (bms) / sizeof (bms[0]); j++)
+      if (*bms[j] != NULL) {
+        bitmap_destroy (*bms[j]);
+        *bms[j] = NULL;
+      }
+  }
+}
+
+/* Remove the vars defined by insn from live and add the ones it uses */
+static void update_live_vars (MIR_context_t ctx, bitmap_t live, MIR_insn_t insn) {
+  int out_p;
+
+  for (size_t i = 0; i < insn->nops; i++) {
+    MIR_insn_op_mode (ctx, insn, i, &out_p);
+    if (out_p && insn->ops[i].mode == MIR_OP_REG) bitmap_clear_bit_p (live, insn->ops[i].u.reg - 1);
+  }
+  for (size_t i = 0; i < insn->nops; i++) {
+    MIR_op_t op = insn->ops[i];
+
+    MIR_insn_op_mode (ctx, insn, i, &out_p);
+    if (op.mode == MIR_OP_REG && !out_p) {
+      bitmap_set_bit_p (live, op.u.reg - 1);
+    } else if (op.mode == MIR_OP_MEM) {
+      if (op.u.mem.base != 0) bitmap_set_bit_p (live, op.u.mem.base - 1);
+      if (op.u.mem.index != 0) bitmap_set_bit_p (live, op.u.mem.index - 1);
+    }
+  }
+}
+
+/* Set up jmp_live_vars for the setjmp calls of the current function in
+   order: the vars live after each call, without its result which is set by
+   longjmp.  Only they are saved by the call and restored by longjmp.  */
+static void find_jmp_live_vars (MIR_context_t ctx) {
+  bb_t *bb_addr;
+  size_t i, nbbs, nvars = VARR_LENGTH (MIR_var_t, curr_func->vars);
+  int num = 0, n;
+  bitmap_t live = bitmap_create2 (nvars);
+  MIR_insn_t insn;
+
+  while (VARR_LENGTH (bitmap_t, jmp_live_vars) != 0) bitmap_destroy (VARR_POP (bitmap_t, jmp_live_vars));
+  for (n = 0; n < curr_func_setjmp_calls; n++) VARR_PUSH (bitmap_t, jmp_live_vars, bitmap_create2 (nvars));
+  build_bbs ();
+  order_bbs ();
+  bb_addr = VARR_ADDR (bb_t, bbs);
+  nbbs = VARR_LENGTH (bb_t, bbs);
+  for (i = 0; i < VARR_LENGTH (int, bb_order); i++)
+    find_bb_regs (ctx, &bb_addr[VARR_GET (int, bb_order, i)], nvars);
+  calculate_liveness ();
+  /* Blocks are in insn order, and so are setjmp calls within a block */
+  for (i = 0; i < nbbs; i++) {
+    bb_t *bb = &bb_addr[i];
+
+    n = 0;
+    for (insn = bb->first;; insn = DLIST_NEXT (MIR_insn_t, insn)) {
+      if (setjmp_call_p (ctx, insn)) n++;
+      if (insn == bb->last) break;
+    }
+    num += n;
+    if (n == 0 || bb->rpo < 0) continue; /* nothing is saved in unreachable code */
+    bitmap_copy (live, bb->live_out);
+    for (insn = bb->last, n = num;; insn = DLIST_PREV (MIR_insn_t, insn)) {
+      if (setjmp_call_p (ctx, insn)) {
+        bitmap_t saved = VARR_GET (bitmap_t, jmp_live_vars, --n);
+
+        bitmap_copy (saved, live);
+        if (insn->ops[2].mode == MIR_OP_REG) bitmap_clear_bit_p (saved, insn->ops[2].u.reg - 1);
+      }
+      update_live_vars (ctx, live, insn);
+      if (insn == bb->first) break;
+    }
+  }
+  bitmap_destroy (live);
+  free_split_data ();
+}
+
+/* Emit the Java type of the local holding var nvar */
+static void out_var_decl_type (FILE *f, size_t nvar) {
+  MIR_var_t var = VARR_GET (MIR_var_t, curr_func->vars, nvar);
+
+  if (bitmap_bit_p (int_vars, nvar))
+    out_type (f, MIR_T_I32);
+  else
+    out_type (f, var.type == MIR_T_F || var.type == MIR_T_D || var.type == MIR_T_LD ? var.type : MIR_T_I64);
+}
+
+/* Copy vars of regs between the Java locals of the current method and the
+   register arrays */
+static void out_region_regs (FILE *f, bitmap_t regs, int to_array_p, int level) {
+  bitmap_t own_regs = VARR_ADDR (bb_t, bbs)[curr_region >= 0 ? curr_region : 0].own_regs;
+  bitmap_iterator_t bi;
+  size_t nvar;
+
+  FOREACH_BITMAP_BIT (bi, regs, nvar) {
+    MIR_var_t var = VARR_GET (MIR_var_t, curr_func->vars, nvar);
+
+    if (!bitmap_bit_p (own_regs, nvar)) continue;
+
+    out_indent (f, level);
+    if (to_array_p) {
+      out_regs_array (f, (int) nvar);
+      fprintf (f, " = %s;\n", var.name);
+    } else {
+      fprintf (f, "%s = (", var.name);
+      out_var_decl_type (f, nvar);
+      fprintf (f, ") ");
+      out_regs_array (f, (int) nvar);
+      fprintf (f, ";\n");
+    }
+  }
+}
+
+static void out_region_args (FILE *f, int decl_p) {
+  fprintf (f, decl_p ? "long[] mir_iregs, double[] mir_fregs" : "mir_iregs, mir_fregs");
+  if (curr_func->vararg_p) fprintf (f, decl_p ? ", long mir_va_area" : ", mir_va_area");
+  if (curr_func_has_stack_allocation)
+    fprintf (f, decl_p ? ", int mir_saved_stack_position" : ", mir_saved_stack_position");
+}
+
+static void out_region_call (MIR_context_t ctx, FILE *f, int b, int level) {
+  bb_t *bb = &VARR_ADDR (bb_t, bbs)[b];
+  size_t i, ncases = bb->exit_num + (bb->ret_exit_p ? 1 : 0);
+
+  out_region_regs (f, bb->in_regs, TRUE, level);
+  out_indent (f, level);
+  fprintf (f, "mir_exit = %s_part%d(", get_mangled_symbol_name (curr_func->name), b);
+  out_region_args (f, FALSE);
+  fprintf (f, ");\n");
+  out_region_regs (f, bb->out_regs, FALSE, level);
+  if (ncases == 0) { /* the region never exits */
+    out_indent (f, level);
+    fprintf (f, "throw new IllegalStateException();\n");
+    return;
+  }
+  out_indent (f, level);
+  fprintf (f, "switch (mir_exit) {\n");
+  for (i = bb->ret_exit_p ? 0 : 1; i <= bb->exit_num; i++) {
+    out_indent (f, level);
+    fprintf (f, i == bb->exit_num ? "case %d: default: " : "case %d: ", (int) i);
+    if (i != 0) {
+      out_bb_jump (f, b, VARR_GET (int, bb_exits, bb->exit_start + i - 1));
+    } else if (curr_region >= 0) {
+      fprintf (f, "break mir_region;");
+    } else {
+      if (curr_func_has_stack_allocation)
+        fprintf (f, "mir_set_stack_position(mir_saved_stack_position); ");
+      fprintf (f, "return");
+      if (curr_func->nres != 0) {
+        fprintf (f, " (");
+        out_type (f, curr_func->res_types[0]);
+        fprintf (f, ") ");
+        out_result_slot (f);
+      }
+      fprintf (f, ";");
+    }
+    fprintf (f, "\n");
+  }
+  out_indent (f, level);
+  fprintf (f, "} // End of switch(mir_exit)\n");
+}
+
+/* Emit helper methods for all outlined subtrees of the current function */
+/* Copy the memory array into a local: C2 keeps the array base in a register
+   instead of reloading the field after each store or runtime call */
+static void out_memory_local (FILE *f) {
+  if (legacy_memory_p) return;
+  fprintf (f, paged_memory_p ? "  byte[][] pages = this.pages;\n" : "  byte[] memory = this.memory;\n");
+}
+
+static void out_region_methods (MIR_context_t ctx, FILE *f) {
+  bb_t *bb_addr = VARR_ADDR (bb_t, bbs);
+  int b;
+
+  for (size_t i = 0; i < VARR_LENGTH (int, bb_order); i++) {
+    if (!bb_addr[b = VARR_GET (int, bb_order, i)].outlined_p) continue;
+    bb_t *bb = &bb_addr[b];
+    bitmap_iterator_t bi;
+    size_t nvar;
+
+    fprintf (f, "private int %s_part%d (", get_mangled_symbol_name (curr_func->name), b);
+    out_region_args (f, TRUE);
+    fprintf (f, ") {\n");
+    FOREACH_BITMAP_BIT (bi, bb->own_regs, nvar) {
+      MIR_var_t var = VARR_GET (MIR_var_t, curr_func->vars, nvar);
+
+      fprintf (f, "  ");
+      out_var_decl_type (f, nvar);
+      if (!bitmap_bit_p (bb->in_regs, nvar)) {
+        fprintf (f, " %s = 0;\n", var.name);
+        continue;
+      }
+      fprintf (f, " %s = (", var.name);
+      out_var_decl_type (f, nvar);
+      fprintf (f, ") ");
+      out_regs_array (f, (int) nvar);
+      fprintf (f, ";\n");
+    }
+    fprintf (f, "  int mir_exit = 0;\n");
+    out_memory_local (f);
+    curr_region = b;
+    if (bb->exit_num == 0 && !bb->ret_exit_p) {
+      out_bb_code (ctx, f, b, 1);
+    } else {
+      fprintf (f, "  mir_region: {\n");
+      out_bb_code (ctx, f, b, 2);
+      fprintf (f, "  } // End of mir_region\n");
+      out_region_regs (f, bb->out_regs, TRUE, 1);
+      fprintf (f, "  return mir_exit;\n");
+    }
+    curr_region = -1;
+    fprintf (f, "} // End of function %s_part%d\n\n", get_mangled_symbol_name (curr_func->name), b);
+  }
+}
+
+/* ----------------------------- Peephole pass -----------------------------
+   c2mir output is naive and translating it insn by insn gives bloated Java:
+   copy chains through temporaries, `(a < b) ? 1 : 0' values only tested by
+   a branch, constant expressions...  Before emission, adjacent insns of each
+   function are rewritten until nothing changes.  A temporary is a local var
+   whose def and use counts over the function show it is local to the
+   rewritten insns:
+     - extensions and integer ops of constants are folded, and ops with a
+       neutral operand (x + 0, x * 1...) become moves,
+     - `mov t, c' followed by a use of t: the use takes c,
+     - `mov t, x' followed by a use of t: the use reads x,
+     - `op t, ...; mov x, t': op writes x,
+     - `mov t, x; op t, t, y; mov x, t' (c2mir's x++ or x += y): op x, x, y,
+     - `cmp t, a, b; bt/bf L, t': the compare and branch insn,
+     - `ext32 t, x; bt/bf L, t': bts/bfs L, x,
+     - `add t, b, i' or `mul t, i, s' followed by a memory operand using t:
+       the operand computes the address.
+   m2j -O0 disables the pass.  */
+
+static VARR (int) * var_defs, *var_uses; /* indexed by reg - 1 */
+
+static void count_var_refs (MIR_context_t ctx) {
+  size_t nvars = VARR_LENGTH (MIR_var_t, curr_func->vars);
+  int out_p;
+
+  VARR_TRUNC (int, var_defs, 0);
+  VARR_TRUNC (int, var_uses, 0);
+  while (VARR_LENGTH (int, var_defs) < nvars) {
+    VARR_PUSH (int, var_defs, 0);
+    VARR_PUSH (int, var_uses, 0);
+  }
+  for (MIR_insn_t insn = DLIST_HEAD (MIR_insn_t, curr_func->insns); insn != NULL;
+       insn = DLIST_NEXT (MIR_insn_t, insn)) {
+    if (insn->code == MIR_LABEL) continue;
+    for (size_t i = 0; i < insn->nops; i++) {
+      MIR_op_t op = insn->ops[i];
+
+      if (op.mode == MIR_OP_MEM) {
+        if (op.u.mem.base != 0) VARR_ADDR (int, var_uses)[op.u.mem.base - 1]++;
+        if (op.u.mem.index != 0) VARR_ADDR (int, var_uses)[op.u.mem.index - 1]++;
+      } else if (op.mode == MIR_OP_REG) {
+        MIR_insn_op_mode (ctx, insn, i, &out_p);
+        VARR_ADDR (int, out_p ? var_defs : var_uses)[op.u.reg - 1]++;
+      }
+    }
+  }
+}
+
+static int var_referenced_p (size_t nvar) {
+  return VARR_GET (int, var_defs, nvar) != 0 || VARR_GET (int, var_uses, nvar) != 0;
+}
+
+static int temp_op_p (MIR_op_t op, int ndefs, int nuses) {
+  return (op.mode == MIR_OP_REG && op.u.reg > curr_func->nargs
+          && VARR_GET (int, var_defs, op.u.reg - 1) == ndefs
+          && VARR_GET (int, var_uses, op.u.reg - 1) == nuses);
+}
+
+static int move_code_p (MIR_insn_code_t code) {
+  return code == MIR_MOV || code == MIR_FMOV || code == MIR_DMOV || code == MIR_LDMOV;
+}
+
+/* Insns computing ops[0] from their other operands */
+static int value_code_p (MIR_insn_code_t code) { return code >= MIR_MOV && code <= MIR_LDGE; }
+
+static int cond_branch_code_p (MIR_insn_code_t code) {
+  return code == MIR_BT || code == MIR_BTS || code == MIR_BF || code == MIR_BFS;
+}
+
+static int int_const_op_p (MIR_op_t op, int64_t *v) {
+  if (op.mode != MIR_OP_INT && op.mode != MIR_OP_UINT) return FALSE;
+  *v = op.u.i;
+  return TRUE;
+}
+
+static int const_op_p (MIR_op_t op) {
+  return (op.mode == MIR_OP_INT || op.mode == MIR_OP_UINT || op.mode == MIR_OP_FLOAT
+          || op.mode == MIR_OP_DOUBLE || op.mode == MIR_OP_LDOUBLE);
+}
+
+/* Return the number of times insn reads reg, setting *mem_p if it is in a
+   memory address, and set *out_p if insn writes reg */
+static int reg_reads (MIR_context_t ctx, MIR_insn_t insn, MIR_reg_t reg, int *mem_p, int *out_p) {
+  int op_out_p, n = 0;
+
+  *mem_p = *out_p = FALSE;
+  for (size_t i = 0; i < insn->nops; i++) {
+    MIR_op_t op = insn->ops[i];
+
+    if (op.mode == MIR_OP_MEM) {
+      if (op.u.mem.base == reg || op.u.mem.index == reg) *mem_p = TRUE;
+      n += (op.u.mem.base == reg) + (op.u.mem.index == reg);
+    } else if (op.mode == MIR_OP_REG && op.u.reg == reg) {
+      MIR_insn_op_mode (ctx, insn, i, &op_out_p);
+      if (op_out_p)
+        *out_p = TRUE;
+      else
+        n++;
+    }
+  }
+  return n;
+}
+
+/* Replace the reads of reg in insn by op, which is a reg if the reads
+   include memory addresses */
+static void subst_reg_reads (MIR_context_t ctx, MIR_insn_t insn, MIR_reg_t reg, MIR_op_t op) {
+  int out_p;
+
+  for (size_t i = 0; i < insn->nops; i++) {
+    MIR_op_t *op_ref = &insn->ops[i];
+
+    if (op_ref->mode == MIR_OP_MEM) {
+      if (op_ref->u.mem.base == reg) op_ref->u.mem.base = op.u.reg;
+      if (op_ref->u.mem.index == reg) op_ref->u.mem.index = op.u.reg;
+    } else if (op_ref->mode == MIR_OP_REG && op_ref->u.reg == reg) {
+      MIR_insn_op_mode (ctx, insn, i, &out_p);
+      if (!out_p) *op_ref = op;
+    }
+  }
+}
+
+static void replace_insn (MIR_context_t ctx, MIR_item_t func_item, MIR_insn_t insn,
+                          MIR_insn_t new_insn) {
+  MIR_insert_insn_before (ctx, func_item, insn, new_insn);
+  MIR_remove_insn (ctx, func_item, insn);
+}
+
+/* Fold a constant extension or integer op or an op with a neutral operand
+   into a move */
+static int fold_insn (MIR_context_t ctx, MIR_item_t func_item, MIR_insn_t insn) {
+  int64_t a, b, r;
+  int a_p, b_p;
+  MIR_insn_code_t code = insn->code;
+  MIR_op_t res;
+
+  if (code >= MIR_EXT8 && code <= MIR_UEXT32) {
+    if (insn->ops[0].mode != MIR_OP_REG || !int_const_op_p (insn->ops[1], &a)) return FALSE;
+    switch (code) {
+    case MIR_EXT8: r = (int8_t) a; break;
+    case MIR_EXT16: r = (int16_t) a; break;
+    case MIR_EXT32: r = (int32_t) a; break;
+    case MIR_UEXT8: r = (uint8_t) a; break;
+    case MIR_UEXT16: r = (uint16_t) a; break;
+    default: r = (uint32_t) a; break;
+    }
+    replace_insn (ctx, func_item, insn, MIR_new_insn (ctx, MIR_MOV, insn->ops[0], MIR_new_int_op (ctx, r)));
+    return TRUE;
+  }
+  if (code < MIR_ADD || code > MIR_URSHS || insn->ops[0].mode != MIR_OP_REG) return FALSE;
+  a_p = int_const_op_p (insn->ops[1], &a);
+  b_p = int_const_op_p (insn->ops[2], &b);
+  if (a_p && b_p) {
+    switch (code) {
+    case MIR_ADD: case MIR_ADDS: r = (int64_t) ((uint64_t) a + (uint64_t) b); break;
+    case MIR_SUB: case MIR_SUBS: r = (int64_t) ((uint64_t) a - (uint64_t) b); break;
+    case MIR_MUL: case MIR_MULS: r = (int64_t) ((uint64_t) a * (uint64_t) b); break;
+    case MIR_AND: case MIR_ANDS: r = a & b; break;
+    case MIR_OR: case MIR_ORS: r = a | b; break;
+    case MIR_XOR: case MIR_XORS: r = a ^ b; break;
+    default: return FALSE;
+    }
+    if (code == MIR_ADDS || code == MIR_SUBS || code == MIR_MULS || code == MIR_ANDS
+        || code == MIR_ORS || code == MIR_XORS)
+      r = (int32_t) r;
+    res = MIR_new_int_op (ctx, r);
+  } else if (b_p && b == 0
+             && (code == MIR_ADD || code == MIR_ADDS || code == MIR_SUB || code == MIR_SUBS
+                 || code == MIR_OR || code == MIR_ORS || code == MIR_XOR || code == MIR_XORS
+                 || (code >= MIR_LSH && code <= MIR_URSHS))) {
+    res = insn->ops[1];
+  } else if (a_p && a == 0
+             && (code == MIR_ADD || code == MIR_ADDS || code == MIR_OR || code == MIR_ORS
+                 || code == MIR_XOR || code == MIR_XORS)) {
+    res = insn->ops[2];
+  } else if (b_p && b == 1
+             && (code == MIR_MUL || code == MIR_MULS || code == MIR_DIV || code == MIR_DIVS
+                 || code == MIR_UDIV || code == MIR_UDIVS)) {
+    res = insn->ops[1];
+  } else if (a_p && a == 1 && (code == MIR_MUL || code == MIR_MULS)) {
+    res = insn->ops[2];
+  } else {
+    return FALSE;
+  }
+  if (res.mode == MIR_OP_MEM) return FALSE;
+  replace_insn (ctx, func_item, insn, MIR_new_insn (ctx, MIR_MOV, insn->ops[0], res));
+  return TRUE;
+}
+
+/* Fold the address computation def_insn of t into the memory operand of insn
+   using t.  MIR_gen_optimize splits the addresses into such insns.  */
+static int fold_addr (MIR_insn_t insn, MIR_reg_t t, MIR_insn_t def_insn) {
+  int64_t v;
+
+  for (size_t i = 0; i < insn->nops; i++) {
+    MIR_op_t *op_ref = &insn->ops[i];
+
+    /* the displacement of a block operand is its size */
+    if (op_ref->mode != MIR_OP_MEM || MIR_all_blk_type_p (op_ref->u.mem.type)) continue;
+    if (def_insn->code == MIR_ADD && op_ref->u.mem.base == t && op_ref->u.mem.index == 0) {
+      if (int_const_op_p (def_insn->ops[2], &v)) {
+        op_ref->u.mem.disp += v;
+      } else if (def_insn->ops[2].mode == MIR_OP_REG) {
+        op_ref->u.mem.index = def_insn->ops[2].u.reg;
+        op_ref->u.mem.scale = 1;
+      } else {
+        return FALSE;
+      }
+      op_ref->u.mem.base = def_insn->ops[1].u.reg;
+      return TRUE;
+    }
+    if (def_insn->code == MIR_MUL && op_ref->u.mem.index == t && op_ref->u.mem.scale == 1
+        && int_const_op_p (def_insn->ops[2], &v) && v > 0 && v <= MIR_MAX_SCALE) {
+      op_ref->u.mem.index = def_insn->ops[1].u.reg;
+      op_ref->u.mem.scale = (MIR_scale_t) v;
+      return TRUE;
+    }
+  }
+  return FALSE;
+}
+
+/* Rewrite insn with the insns after it, return TRUE if something changed */
+static int peephole_insn (MIR_context_t ctx, MIR_item_t func_item, MIR_insn_t insn) {
+  MIR_insn_t next = DLIST_NEXT (MIR_insn_t, insn), next2;
+  MIR_insn_code_t code;
+  MIR_reg_t t;
+  int mem_p, out_p;
+
+  if (next == NULL || insn->code == MIR_LABEL || insn->nops == 0 || insn->ops[0].mode != MIR_OP_REG)
+    return FALSE;
+  t = insn->ops[0].u.reg;
+  if (move_code_p (insn->code) && (next2 = DLIST_NEXT (MIR_insn_t, next)) != NULL
+      && insn->ops[1].mode == MIR_OP_REG && insn->ops[1].u.reg != t && temp_op_p (insn->ops[0], 2, 2)
+      && value_code_p (next->code) && next->ops[0].mode == MIR_OP_REG && next->ops[0].u.reg == t
+      && reg_reads (ctx, next, t, &mem_p, &out_p) == 1 && next2->code == insn->code
+      && next2->ops[0].mode == MIR_OP_REG && next2->ops[0].u.reg == insn->ops[1].u.reg
+      && next2->ops[1].mode == MIR_OP_REG && next2->ops[1].u.reg == t) {
+    /* mov t, x; op t, t, y; mov x, t => op x, x, y */
+    next->ops[0] = insn->ops[1];
+    subst_reg_reads (ctx, next, t, insn->ops[1]);
+    MIR_remove_insn (ctx, func_item, insn);
+    MIR_remove_insn (ctx, func_item, next2);
+    return TRUE;
+  }
+  if (!temp_op_p (insn->ops[0], 1, 1)) return FALSE;
+  if (move_code_p (insn->code) && insn->ops[1].mode == MIR_OP_REG && insn->ops[1].u.reg != t
+      && next->code != MIR_LABEL && reg_reads (ctx, next, t, &mem_p, &out_p) == 1) {
+    /* mov t, x; use t => use x */
+    subst_reg_reads (ctx, next, t, insn->ops[1]);
+    MIR_remove_insn (ctx, func_item, insn);
+    return TRUE;
+  }
+  if (move_code_p (insn->code) && const_op_p (insn->ops[1])
+      && (value_code_p (next->code) || cond_branch_code_p (next->code)
+          || (next->code >= MIR_BEQ && next->code <= MIR_LDBGE) || next->code == MIR_RET)
+      && reg_reads (ctx, next, t, &mem_p, &out_p) == 1 && !mem_p) {
+    /* mov t, c; use t => use c */
+    subst_reg_reads (ctx, next, t, insn->ops[1]);
+    MIR_remove_insn (ctx, func_item, insn);
+    return TRUE;
+  }
+  if ((insn->code == MIR_ADD || insn->code == MIR_MUL) && insn->ops[1].mode == MIR_OP_REG
+      && next->code != MIR_LABEL && reg_reads (ctx, next, t, &mem_p, &out_p) == 1 && mem_p
+      && fold_addr (next, t, insn)) {
+    /* add t, b, i; use (t) => use (b, i) and mul t, i, s; use (b, t) => use (b, i, s) */
+    MIR_remove_insn (ctx, func_item, insn);
+    return TRUE;
+  }
+  if (value_code_p (insn->code) && move_code_p (next->code) && next->ops[0].mode == MIR_OP_REG
+      && next->ops[0].u.reg != t && next->ops[1].mode == MIR_OP_REG && next->ops[1].u.reg == t) {
+    /* op t, ...; mov x, t => op x, ... */
+    insn->ops[0] = next->ops[0];
+    MIR_remove_insn (ctx, func_item, next);
+    return TRUE;
+  }
+  if (!cond_branch_code_p (next->code) || next->ops[1].mode != MIR_OP_REG || next->ops[1].u.reg != t)
+    return FALSE;
+  if (insn->code >= MIR_EQ && insn->code <= MIR_LDGE) {
+    /* cmp t, a, b; bt/bf L, t => bcmp L, a, b */
+    code = MIR_BEQ + (insn->code - MIR_EQ);
+    if (next->code == MIR_BF || next->code == MIR_BFS) code = MIR_reverse_branch_code (code);
+    if (code == MIR_INSN_BOUND) return FALSE; /* no reverse for fp compares because of NaN */
+    replace_insn (ctx, func_item, next,
+                  MIR_new_insn (ctx, code, next->ops[0], insn->ops[1], insn->ops[2]));
+  } else if (insn->code == MIR_EXT32 || insn->code == MIR_UEXT32) {
+    /* ext32 t, x; bt/bf L, t => bts/bfs L, x */
+    code = next->code == MIR_BT || next->code == MIR_BTS ? MIR_BTS : MIR_BFS;
+    replace_insn (ctx, func_item, next, MIR_new_insn (ctx, code, next->ops[0], insn->ops[1]));
+  } else {
+    return FALSE;
+  }
+  MIR_remove_insn (ctx, func_item, insn);
+  return TRUE;
+}
+
+static void optimize_func (MIR_context_t ctx, MIR_item_t func_item) {
+  MIR_insn_t insn, prev, next;
+  int changed_p = TRUE;
+
+  /* The counts of the regs of rewritten insns are only updated by the next
+     iteration but the temporaries they remove are not referenced anymore */
+  while (changed_p) {
+    changed_p = FALSE;
+    count_var_refs (ctx);
+    for (insn = DLIST_HEAD (MIR_insn_t, curr_func->insns); insn != NULL; insn = next) {
+      prev = DLIST_PREV (MIR_insn_t, insn);
+      next = DLIST_NEXT (MIR_insn_t, insn);
+      if (fold_insn (ctx, func_item, insn)) {
+        changed_p = TRUE;
+      } else if (peephole_insn (ctx, func_item, insn)) {
+        changed_p = TRUE;
+        /* Look again at the rewritten insns */
+        next = prev == NULL ? DLIST_HEAD (MIR_insn_t, curr_func->insns) : DLIST_NEXT (MIR_insn_t, prev);
+      }
+    }
+  }
+}
+
+/* Declare func in MainBase for the calls from the classes before its own */
+static void out_abstract_decl (FILE *f, MIR_item_t item, const char *name) {
+  MIR_func_t func = item->u.func;
+
+  fprintf (f, item->export_p ? "public abstract " : "protected abstract ");
+  if (func->nres == 0)
+    fprintf (f, "void");
+  else
+    out_type (f, func->res_types[0]);
+  fprintf (f, " %s (", name);
+  for (size_t i = 0; i < func->nargs; i++) {
+    if (i != 0) fprintf (f, ", ");
+    out_type (f, VARR_GET (MIR_var_t, func->vars, i).type);
+    fprintf (f, " a%d", (int) i);
+  }
+  if (func->vararg_p) fprintf (f, func->nargs == 0 ? "long mir_va_area" : ", long mir_va_area");
+  fprintf (f, ");\n");
+}
+
+static symbol_t prepare_func (MIR_context_t ctx, MIR_item_t item);
+static void out_func (MIR_context_t ctx, FILE *f, MIR_item_t item, symbol_t func_symbol);
+
+void out_item (MIR_context_t ctx, FILE *f, MIR_item_t item) {
+
+  if (item->item_type == MIR_export_item) {
+	/*
+    MIR_item_t exported_item = item->ref_def;
+    if (exported_item->item_type == MIR_data_item) {
+      out_type(f, exported_item->u.data->el_type);
+      fprintf(f, " %s = %d;\n", exported_item->u.data->name, exported_item->u.data->u.els[0]);
+    }
+    */
+    MIR_item_t exported_item = item->ref_def;
+    add_symbol(MIR_item_name(ctx, exported_item), TRUE);
+    return;
+  }
+  if (item->item_type == MIR_import_item) {
+    //fprintf (f, "extern char %s[];\n", item->u.import_id);
+    MIR_item_t imported_item = item->ref_def;
+    add_symbol(item->u.import_id, TRUE);
+    return;
+  }
+  if (item->item_type == MIR_forward_item) {  // ???
+    MIR_item_t forwarded_item = item->ref_def;
+    add_symbol(MIR_item_name(ctx, forwarded_item), FALSE);
+    return;
+  }
+  if (item->item_type == MIR_proto_item) {
+    /*
+    MIR_proto_t proto = item->u.proto;
+
+    fprintf (f, "typedef ");
+    if (proto->nres == 0)
+      fprintf (f, "void");
+    else if (proto->nres == 1)
+      out_type (f, proto->res_types[0]);
+    else
+      (*MIR_get_error_func (ctx)) (MIR_func_error,
+                                   "Multiple result functions can not be called in C");
+    fprintf (f, " (*%s) (", proto->name);
+    for (i = 0; i < VARR_LENGTH (MIR_var_t, proto->args); i++) {
+      var = VARR_GET (MIR_var_t, proto->args, i);
+      if (i != 0) fprintf (f, ", ");
+      out_type (f, var.type);
+      if (var.name != NULL) fprintf (f, " %s", var.name);
+    }
+    if (i == 0) fprintf (f, "void");
+    fprintf (f, ");\n");
+    */
+    return;
+  }
+  if (data_item_p (item)) {
+    // Data lives in the image built by build_data_image: only its address is emitted
+    const char *name = MIR_item_name (ctx, item);
+    FILE *df = base_f != NULL ? base_f : f;
+    if (name != NULL) {
+      fprintf(df, "static final long %s = ", get_mangled_symbol_name(name));
+      fprintf_long_hex(df, data_addr(item));
+      fprintf(df, ";\n");
+    }
+    return;
+  }
+
+  symbol_t func_symbol = prepare_func (ctx, item);
+  out_func (ctx, f, item, func_symbol);
+}
+
+/* Analyze and optimize func item, and declare it.  Return its symbol.  */
+static symbol_t prepare_func (MIR_context_t ctx, MIR_item_t item) {
+  curr_func = item->u.func;
+  char* func_name = (char*) curr_func->name;
+  //printf("[MIR2J_DEBUG] function name:%s\n", func_name);
+
+  /*------------------------------------
+    First pass to analyze the function
+  ------------------------------------- */
+  curr_func_number_of_labels = 0;
+  curr_func_has_stack_allocation = FALSE;
+  curr_func_setjmp_calls = setjmp_call_num = 0;
+  for (MIR_insn_t insn = DLIST_HEAD (MIR_insn_t, curr_func->insns); insn != NULL;
+       insn = DLIST_NEXT (MIR_insn_t, insn)) {
+    if (insn->code == MIR_LABEL) {
+      curr_func_number_of_labels++; 
+    } else if (insn->code == MIR_ALLOCA) {
+      curr_func_has_stack_allocation = TRUE;	
+    } else if (setjmp_call_p (ctx, insn)) {
+      curr_func_setjmp_calls++;
+    }
+  }
+  //printf("n of labels=%d\n", curr_func_number_of_labels);
+  if (!no_opt_p) optimize_func (ctx, item);
+  if (curr_func_setjmp_calls == 0) curr_func_number_of_labels += split_long_blocks (ctx, item);
+  count_var_refs (ctx);
+  find_int_vars (ctx);
+
+  symbol_t func_symbol = add_symbol(curr_func->name, item->export_p);
+  int fn_index = fn_addr_index (item);
+  if (fn_index >= 0) VARR_SET (char_ptr_t, fn_table_names, fn_index, func_symbol.mangled_name);
+  if (base_f != NULL) out_abstract_decl (base_f, item, func_symbol.mangled_name);
+  return func_symbol;
+}
+
+/* Declare func item, dropped for the Runtime method of the same name */
+static void declare_runtime_intrinsic (MIR_item_t item) {
+  symbol_t func_symbol = add_symbol (item->u.func->name, TRUE);
+  int fn_index = fn_addr_index (item);
+
+  if (fn_index >= 0) VARR_SET (char_ptr_t, fn_table_names, fn_index, func_symbol.mangled_name);
+}
+
+/* Emit func item prepared by prepare_func as a Java method */
+static void out_func (MIR_context_t ctx, FILE *f, MIR_item_t item, symbol_t func_symbol) {
+  MIR_var_t var;
+  size_t i, nlocals;
+
+  /*-----------------------------------------------
+    Second pass where the code is actually emitted
+  ------------------------------------------------ */
+  fprintf (f, item->export_p ? "public " : "protected "); // static
+  if (curr_func->nres == 0)
+    fprintf (f, "void");
+  else if (curr_func->nres == 1)
     out_type (f, curr_func->res_types[0]);
   else {
     fprintf(stderr, "\nError in function %s\n", curr_func->name);
@@ -1191,18 +3545,31 @@ void out_item (MIR_context_t ctx, FILE *f, MIR_item_t item) {
     var = VARR_GET (MIR_var_t, curr_func->vars, i);
     out_type (f, var.type);
     fprintf (f,
-             var.type == MIR_T_I64 || var.type == MIR_T_F || var.type == MIR_T_D
-                 || var.type == MIR_T_LD
+             (var.type == MIR_T_I64 || var.type == MIR_T_F || var.type == MIR_T_D
+              || var.type == MIR_T_LD)
+                 && !bitmap_bit_p (int_vars, i)
                ? " %s"
                : " _%s",
              var.name);
   }
   if (curr_func->vararg_p) {
-    fprintf (f, ", Object... mir_var_args");
+    fprintf (f, curr_func->nargs == 0 ? "long mir_va_area" : ", long mir_va_area");
   }
   fprintf (f, ") {\n");
   for (i = 0; i < curr_func->nargs; i++) {
     var = VARR_GET (MIR_var_t, curr_func->vars, i);
+    if (bitmap_bit_p (int_vars, i)) {
+      // Only the low 32 bits of the param are used
+      if (var.type == MIR_T_U8)
+        fprintf (f, "  int %s = ((int) _%s) & 0xFF;\n", var.name, var.name);
+      else if (var.type == MIR_T_U16)
+        fprintf (f, "  int %s = _%s & 0xFFFF;\n", var.name, var.name);
+      else if (var.type == MIR_T_I32 || var.type == MIR_T_I16 || var.type == MIR_T_I8)
+        fprintf (f, "  int %s = _%s;\n", var.name, var.name);
+      else
+        fprintf (f, "  int %s = (int) _%s;\n", var.name, var.name);
+      continue;
+    }
     if (var.type == MIR_T_I64 || var.type == MIR_T_F || var.type == MIR_T_D || var.type == MIR_T_LD)
       continue;
   
@@ -1221,40 +3588,181 @@ void out_item (MIR_context_t ctx, FILE *f, MIR_item_t item) {
       fprintf (f, "  long %s = _%s;\n", var.name, var.name);
     }
   }
+  /* With split methods, the function only declares the locals of its own blocks */
+  int structured_p = curr_func_number_of_labels > 0 && curr_func_setjmp_calls == 0 && analyze_structure ();
+  int split_p = structured_p && split_func (ctx);
+  if (curr_func_setjmp_calls > 0) find_jmp_live_vars (ctx);
   nlocals = VARR_LENGTH (MIR_var_t, curr_func->vars) - curr_func->nargs;
   for (i = 0; i < nlocals; i++) {
     var = VARR_GET (MIR_var_t, curr_func->vars, i + curr_func->nargs);
+    if (!var_referenced_p (i + curr_func->nargs)) continue;
+    if (split_p && !bitmap_bit_p (VARR_ADDR (bb_t, bbs)[0].own_regs, i + curr_func->nargs)) continue;
     fprintf (f, "  ");
-    out_type (f, var.type);
+    out_var_decl_type (f, i + curr_func->nargs);
     fprintf (f, " %s = 0;\n", var.name);
   }
   if (curr_func_has_stack_allocation) {
   	fprintf (f, "  int mir_saved_stack_position =  mir_get_stack_position();\n");
   }
-  if (curr_func_number_of_labels > 0) {
-    fprintf (f, "  int mir_label = -1;\n");
-    fprintf (f, "while (true) {\n");
-    fprintf (f, "switch (mir_label) {\n");
-    fprintf (f, "case -1:\n");
-  }
-  for (MIR_insn_t insn = DLIST_HEAD (MIR_insn_t, curr_func->insns); insn != NULL;
-       insn = DLIST_NEXT (MIR_insn_t, insn)) {
-    out_insn (ctx, f, insn);
-  }
-  if (curr_func_number_of_labels > 0) {
-    fprintf (f, "} // End of switch\n"); 
-    fprintf (f, "} // End of while\n");
+  out_memory_local (f);
+  if (structured_p) {
+    if (split_p) {
+      fprintf (f, "  long[] mir_iregs = new long[%d];\n",
+               VARR_GET (int, var_slots, VARR_LENGTH (MIR_var_t, curr_func->vars)) + 1);
+      fprintf (f, "  double[] mir_fregs = new double[%d];\n",
+               VARR_GET (int, var_slots, VARR_LENGTH (MIR_var_t, curr_func->vars) + 1) + 1);
+      fprintf (f, "  int mir_exit = 0;\n");
+    }
+    out_bb_code (ctx, f, 0, 1);
+    fprintf (f, "} // End of function %s\n\n", curr_func->name);
+    if (split_p) out_region_methods (ctx, f);
+    free_split_data ();
+    is_in_dead_code = FALSE;
+    return;
+  } else {
+    int size = 0, n;
+
+    for (MIR_insn_t insn = DLIST_HEAD (MIR_insn_t, curr_func->insns); insn != NULL;
+         insn = DLIST_NEXT (MIR_insn_t, insn))
+      size += insn_bytecode_size (insn);
+    check_method_size (size);
+    if (curr_func_number_of_labels > 0 || curr_func_setjmp_calls > 0) {
+      fprintf (f, "  int mir_label = -1;\n");
+      for (i = 0; i < curr_func_setjmp_calls; i++) {
+        fprintf (f, "  long mir_jmp_token%d = 0;\n", (int) i);
+        if ((n = jmp_saved_vars_num (i, FALSE)) != 0)
+          fprintf (f, "  long[] mir_jmp_iregs%d = new long[%d];\n", (int) i, n);
+        if ((n = jmp_saved_vars_num (i, TRUE)) != 0)
+          fprintf (f, "  double[] mir_jmp_fregs%d = new double[%d];\n", (int) i, n);
+      }
+      if (curr_func_setjmp_calls > 0) fprintf (f, "  int mir_jmp_value = 0;\n");
+      fprintf (f, "while (true) {\n");
+      if (curr_func_setjmp_calls > 0) fprintf (f, "try {\n");
+      fprintf (f, "switch (mir_label) {\n");
+      fprintf (f, "case -1:\n");
+    }
+    for (MIR_insn_t insn = DLIST_HEAD (MIR_insn_t, curr_func->insns); insn != NULL;
+         insn = DLIST_NEXT (MIR_insn_t, insn)) {
+      out_insn (ctx, f, insn);
+      out_memory_reload (f, insn, 0);
+    }
+    if (curr_func_number_of_labels > 0 || curr_func_setjmp_calls > 0) {
+      fprintf (f, "} // End of switch\n"); 
+      if (curr_func_setjmp_calls > 0) out_setjmp_catch (f);
+      fprintf (f, "} // End of while\n");
+    }
   }
   fprintf (f, "} // End of function %s\n\n", curr_func->name);
   is_in_dead_code = FALSE;
 }
 
-static void MIR_all_modules2j (MIR_context_t ctx, FILE *f) {
-  create_symbol_table();
+static void out_imports (FILE *f) {
+  fprintf (f, "import mir2j.Runtime;\n");
+  fprintf (f, "import mir2j.JmpException;\n");
+  if (!legacy_memory_p) fprintf (f, paged_memory_p ? "import mir2j.PagedMemory;\n" : "import mir2j.Memory;\n");
+  fprintf (f, "\n");
+}
 
-  fprintf(f, "import mir2j.Runtime;\n\n");
-  fprintf(f, "public class Main extends Runtime {\n\n");
+/* Open output_dir/<class_name>.java */
+static FILE *open_class_file (const char *class_name) {
+  char *path = malloc (strlen (output_dir) + strlen (class_name) + 7);
+  FILE *f;
+
+  sprintf (path, "%s/%s.java", output_dir, class_name);
+  if ((f = fopen (path, "w")) == NULL) {
+    fprintf (stderr, "m2j: cannot open file %s\n", path);
+    exit (1);
+  }
+  free (path);
+  out_imports (f);
+  return f;
+}
+
+static FILE *open_part_class (int part) {
+  char class_name[32];
+  FILE *f;
+
+  sprintf (class_name, "MainPart%d", part);
+  f = open_class_file (class_name);
+  if (part == 1)
+    fprintf (f, "abstract class MainPart1 extends MainBase {\n\n");
+  else
+    fprintf (f, "abstract class MainPart%d extends MainPart%d {\n\n", part, part - 1);
+  return f;
+}
 
+static void close_part_class (FILE *f, int part) {
+  fprintf (f, "} // End of class MainPart%d\n", part);
+  fclose (f);
+}
+
+#include "mir2j-class.c"
+
+/* Emit func item into the current part class, a Java source one if part_f
+   is not NULL, or into a new one if *new_part_p.  With -bytecode, the
+   class switches between class file and Java source output as the function
+   can be emitted as bytecode or not.  */
+static void out_part_func (MIR_context_t ctx, MIR_item_t item, FILE **part_f, int *part,
+                           int *new_part_p) {
+  symbol_t func_symbol;
+
+  if (*new_part_p) {
+    if (*part_f != NULL) close_part_class (*part_f, *part);
+    if (class_part != 0) class_finish ();
+    *part_f = NULL;
+    ++*part;
+    *new_part_p = FALSE;
+    if (!bytecode_p) *part_f = open_part_class (*part);
+  }
+  if (!bytecode_p) {
+    out_item (ctx, *part_f, item);
+    return;
+  }
+  func_symbol = prepare_func (ctx, item);
+  if (class_part == 0) class_start (*part_f == NULL ? *part : *part + 1);
+  if (gen_class_method (ctx, item, func_symbol.mangled_name)) {
+    if (*part_f != NULL) { /* the method starts the next part */
+      close_part_class (*part_f, *part);
+      *part_f = NULL;
+      ++*part;
+    }
+    return;
+  }
+  if (*part_f == NULL && class_nmethods > 1) { /* the class has methods */
+    class_finish ();
+    ++*part;
+  }
+  class_part = 0;
+  if (*part_f == NULL) *part_f = open_part_class (*part);
+  out_func (ctx, *part_f, item, func_symbol);
+}
+
+/* Translate all modules into class Main written to f or, with -d, into
+   the class files of output_dir */
+static void MIR_all_modules2j (MIR_context_t ctx, FILE *f) {
+  FILE *part_f = NULL, *main_f;
+  int part = 0, part_module = 0, part_funcs = 0, new_part_p = FALSE;
+
+  create_symbol_table();
+  create_bb_data();
+  int_vars = bitmap_create ();
+  VARR_CREATE (bitmap_t, jmp_live_vars, 0);
+  VARR_CREATE (int, var_defs, 0);
+  VARR_CREATE (int, var_uses, 0);
+  VARR_CREATE (char_ptr_t, handle_types, 0);
+  build_export_tab (ctx);
+  find_libc_module (ctx);
+  build_fn_table (ctx);
+  build_data_image (ctx);
+  create_class_data ();
+
+  if (output_dir == NULL) {
+    out_imports (f);
+    fprintf(f, "public class Main extends Runtime {\n\n");
+  } else if ((base_f = tmpfile ()) == NULL) {
+    fprintf (stderr, "m2j: cannot create temporary file\n");
+    exit (1);
+  }
   for (MIR_module_t m = DLIST_HEAD (MIR_module_t, *MIR_get_module_list (ctx));
        m != NULL;
        m = DLIST_NEXT (MIR_module_t, m)) {
@@ -1262,11 +3770,87 @@ static void MIR_all_modules2j (MIR_context_t ctx, FILE *f) {
     for (MIR_item_t it = DLIST_HEAD (MIR_item_t, m->items);
          it != NULL;
          it = DLIST_NEXT (MIR_item_t, it)) {
-      out_item (ctx, f, it);
+      if (runtime_intrinsic_p (it)) {
+        declare_runtime_intrinsic (it);
+        continue;
+      }
+      if (output_dir == NULL) {
+        out_item (ctx, f, it);
+        continue;
+      }
+      if (it->item_type != MIR_func_item) {
+        out_item (ctx, base_f, it);
+        continue;
+      }
+      /* Start a new class for each module and each class_func_limit funcs */
+      if (part == 0 || part_module != module_serial
+          || (class_func_limit != 0 && part_funcs == class_func_limit) || class_full_p ()) {
+        new_part_p = TRUE;
+        part_module = module_serial;
+        part_funcs = 0;
+      }
+      out_part_func (ctx, it, &part_f, &part, &new_part_p);
+      part_funcs++;
     }
   }
 
-  fprintf(f, "} // End of class Main\n");
+  if (output_dir == NULL) {
+    main_f = f;
+  } else {
+    if (part_f != NULL) close_part_class (part_f, part);
+    if (class_part != 0) class_finish ();
+    f = open_class_file ("MainBase");
+    fprintf (f, "abstract class MainBase extends Runtime {\n\n");
+    rewind (base_f);
+    for (int c; (c = getc (base_f)) != EOF;) putc (c, f);
+    fclose (base_f);
+    base_f = NULL;
+    fprintf (f, "\n} // End of class MainBase\n");
+    fclose (f);
+    main_f = open_class_file ("Main");
+    if (part == 0)
+      fprintf (main_f, "public class Main extends MainBase {\n\n");
+    else
+      fprintf (main_f, "public class Main extends MainPart%d {\n\n", part);
+  }
+  out_data_init (ctx, main_f);
+  fprintf(main_f, "@Override\n");
+  fprintf(main_f, "protected String[] mir_function_names() {\n");
+  fprintf(main_f, "  return MainFunctions.NAMES;\n");
+  fprintf(main_f, "}\n\n");
+  fprintf(main_f, "@Override\n");
+  fprintf(main_f, "protected int mir_data_size() {\n");
+  fprintf(main_f, "  return %lu;\n", (unsigned long) data_size);
+  fprintf(main_f, "}\n\n");
+  if (paged_memory_p) {
+    fprintf(main_f, "@Override\n");
+    fprintf(main_f, "protected boolean mir_paged_memory() {\n");
+    fprintf(main_f, "  return true;\n");
+    fprintf(main_f, "}\n\n");
+  }
+  fprintf(main_f, "} // End of class Main\n");
+  if (output_dir != NULL) {
+    fclose (main_f);
+    f = open_class_file ("MainFunctions");
+  }
+  out_function_dispatchers (ctx, f);
+  if (output_dir != NULL) {
+    fclose (f);
+    f = open_class_file ("MainData");
+  }
+  out_data_image (f);
+  if (output_dir != NULL) fclose (f);
+  destroy_bb_data();
+  bitmap_destroy (int_vars);
+  while (VARR_LENGTH (bitmap_t, jmp_live_vars) != 0) bitmap_destroy (VARR_POP (bitmap_t, jmp_live_vars));
+  VARR_DESTROY (bitmap_t, jmp_live_vars);
+  VARR_DESTROY (int, var_defs);
+  VARR_DESTROY (int, var_uses);
+  VARR_DESTROY (char_ptr_t, handle_types);
+  destroy_data_image ();
+  destroy_class_data ();
+  destroy_fn_table ();
+  destroy_export_tab ();
   destroy_symbol_table();
 }
 
@@ -1305,8 +3889,21 @@ int main (int argc, const char *argv[]) {
 }
 #elif defined(MIR2J)
 
+#include "mir-gen.h"
+
 DEF_VARR (char);
 
+/* Apply the machine-independent optimizations of the generator to all functions in place.  */
+static void gen_optimize_modules (MIR_context_t ctx) {
+  MIR_gen_init (ctx, 1);
+  for (MIR_module_t m = DLIST_HEAD (MIR_module_t, *MIR_get_module_list (ctx)); m != NULL;
+       m = DLIST_NEXT (MIR_module_t, m))
+    for (MIR_item_t item = DLIST_HEAD (MIR_item_t, m->items); item != NULL;
+         item = DLIST_NEXT (MIR_item_t, item))
+      if (item->item_type == MIR_func_item) MIR_gen_optimize (ctx, 0, item);
+  MIR_gen_finish (ctx);
+}
+
 int main (int argc, const char *argv[]) {
   int c;
   FILE *f;
@@ -1314,6 +3911,36 @@ int main (int argc, const char *argv[]) {
   MIR_module_t m;
   MIR_context_t ctx = MIR_init ();
 
+  while (argc > 1 && argv[1][0] == '-') {
+    int nopts = 1;
+
+    if (strcmp (argv[1], "-legacy-memory") == 0) {
+      legacy_memory_p = TRUE;
+    } else if (strcmp (argv[1], "-paged-memory") == 0) {
+      paged_memory_p = TRUE;
+    } else if (strcmp (argv[1], "-O0") == 0) {
+      no_opt_p = TRUE;
+      gen_opt_p = FALSE;
+    } else if (strcmp (argv[1], "-O2") == 0) {
+      no_opt_p = FALSE;
+      gen_opt_p = TRUE;
+    } else if (strcmp (argv[1], "-d") == 0 && argc > 2) {
+      output_dir = argv[2];
+      nopts = 2;
+    } else if (strcmp (argv[1], "-bytecode") == 0) {
+      bytecode_p = TRUE;
+    } else if (strcmp (argv[1], "-class-functions") == 0 && argc > 2 && atoi (argv[2]) > 0) {
+      class_func_limit = atoi (argv[2]);
+      nopts = 2;
+    } else {
+      argc = 0; /* print usage */
+      break;
+    }
+    argv[nopts] = argv[0];
+    argc -= nopts;
+    argv += nopts;
+  }
+  if (bytecode_p && output_dir == NULL) argc = 0; /* print usage */
   if (argc == 1)
     f = stdin;
   else if (argc == 2) {
@@ -1322,7 +3949,17 @@ int main (int argc, const char *argv[]) {
       exit (1);
     }
   } else {
-    fprintf (stderr, "usage: %s < file or %s mir-file\n", argv[0], argv[0]);
+    fprintf (stderr,
+             "usage: %s [options] < file or %s [options] mir-file\n"
+             "options:\n"
+             "  -legacy-memory        access memory through the byte-wise Runtime accessors\n"
+             "  -paged-memory         use a paged memory, which can exceed 2 GB\n"
+             "  -O0                   do not optimize MIR before the translation\n"
+             "  -O2                   also run the generator SSA optimizations (GVN, CCP...)\n"
+             "  -d dir                write one class per module into dir instead of stdout\n"
+             "  -class-functions n    with -d, put at most n functions in a class\n"
+             "  -bytecode             with -d, write the function classes as .class files\n",
+             argv[0], argv[0]);
     exit (1);
   }
   
@@ -1335,7 +3972,7 @@ int main (int argc, const char *argv[]) {
   }
   fclose (f);
   MIR_scan_string (ctx, VARR_ADDR (char, input));
-  
+  if (gen_opt_p) gen_optimize_modules (ctx);
   //MIR_read (ctx, f);
   MIR_all_modules2j (ctx, stdout);
   MIR_finish (ctx);
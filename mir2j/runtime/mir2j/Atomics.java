@@ -0,0 +1,243 @@
+/*
+MIT License
+
+Copyright (c) 2025 Guillaume Legris
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+package mir2j;
+
+import java.lang.invoke.MethodHandles;
+import java.lang.invoke.VarHandle;
+import java.nio.ByteOrder;
+
+/**
+ * Atomic accesses of the emulated memory behind the mir_atomic_* functions of
+ * Runtime, which pass the byte[] (the memory or a page) and the offset of the
+ * object. Objects of 4 and 8 bytes use VarHandle atomic accesses and must be
+ * aligned, objects of 1 and 2 bytes are updated with a compare-and-set loop on
+ * their aligned int. Loads and stores follow the C memory order, read-modify-write
+ * operations are always sequentially consistent. Values are returned zero-extended.
+ * Like Memory, this class needs Java 9+.
+ */
+final class Atomics {
+
+    private static final VarHandle INT = MethodHandles.byteArrayViewVarHandle(int[].class, ByteOrder.LITTLE_ENDIAN);
+    private static final VarHandle LONG = MethodHandles.byteArrayViewVarHandle(long[].class, ByteOrder.LITTLE_ENDIAN);
+
+    /* C11 memory_order values */
+    static final int RELAXED = 0;
+    static final int CONSUME = 1;
+    static final int ACQUIRE = 2;
+    static final int RELEASE = 3;
+    static final int ACQ_REL = 4;
+    static final int SEQ_CST = 5;
+
+    /* Operations of fetchOp, see mir_atomic_fetch_op */
+    static final int ADD = 0;
+    static final int SUB = 1;
+    static final int OR = 2;
+    static final int XOR = 3;
+    static final int AND = 4;
+    static final int SET = 5;
+
+    private Atomics() {
+    }
+
+    private static long mask(int size) {
+        return size == 8 ? -1L : (1L << (size * 8)) - 1;
+    }
+
+    private static long loadInt(byte[] m, int offset, int order) {
+        int v;
+        switch (order) {
+        case RELAXED:
+            v = (int) INT.getOpaque(m, offset);
+            break;
+        case CONSUME:
+        case ACQUIRE:
+            v = (int) INT.getAcquire(m, offset);
+            break;
+        default:
+            v = (int) INT.getVolatile(m, offset);
+        }
+        return v & 0xFFFFFFFFL;
+    }
+
+    static long load(byte[] m, int offset, int size, int order) {
+        if (size == 8) {
+            switch (order) {
+            case RELAXED:
+                return (long) LONG.getOpaque(m, offset);
+            case CONSUME:
+            case ACQUIRE:
+                return (long) LONG.getAcquire(m, offset);
+            default:
+                return (long) LONG.getVolatile(m, offset);
+            }
+        }
+        int shift = (offset & 3) * 8;
+        return (loadInt(m, offset & ~3, order) >>> shift) & mask(size);
+    }
+
+    static void store(byte[] m, int offset, long v, int size, int order) {
+        if (size == 8) {
+            switch (order) {
+            case RELAXED:
+                LONG.setOpaque(m, offset, v);
+                break;
+            case RELEASE:
+                LONG.setRelease(m, offset, v);
+                break;
+            default:
+                LONG.setVolatile(m, offset, v);
+            }
+        } else if (size == 4) {
+            switch (order) {
+            case RELAXED:
+                INT.setOpaque(m, offset, (int) v);
+                break;
+            case RELEASE:
+                INT.setRelease(m, offset, (int) v);
+                break;
+            default:
+                INT.setVolatile(m, offset, (int) v);
+            }
+        } else {
+            fetchOp(m, offset, v, size, SET);
+        }
+    }
+
+    /* Applies op with v to the object and returns its old value */
+    static long fetchOp(byte[] m, int offset, long v, int size, int op) {
+        if (size == 8) {
+            switch (op) {
+            case ADD:
+                return (long) LONG.getAndAdd(m, offset, v);
+            case SUB:
+                return (long) LONG.getAndAdd(m, offset, -v);
+            case OR:
+                return (long) LONG.getAndBitwiseOr(m, offset, v);
+            case XOR:
+                return (long) LONG.getAndBitwiseXor(m, offset, v);
+            case AND:
+                return (long) LONG.getAndBitwiseAnd(m, offset, v);
+            default:
+                return (long) LONG.getAndSet(m, offset, v);
+            }
+        }
+        if (size == 4) {
+            int i = (int) v;
+            int old;
+            switch (op) {
+            case ADD:
+                old = (int) INT.getAndAdd(m, offset, i);
+                break;
+            case SUB:
+                old = (int) INT.getAndAdd(m, offset, -i);
+                break;
+            case OR:
+                old = (int) INT.getAndBitwiseOr(m, offset, i);
+                break;
+            case XOR:
+                old = (int) INT.getAndBitwiseXor(m, offset, i);
+                break;
+            case AND:
+                old = (int) INT.getAndBitwiseAnd(m, offset, i);
+                break;
+            default:
+                old = (int) INT.getAndSet(m, offset, i);
+            }
+            return old & 0xFFFFFFFFL;
+        }
+        int base = offset & ~3;
+        int shift = (offset & 3) * 8;
+        long mask = mask(size);
+        for (;;) {
+            int word = (int) INT.getVolatile(m, base);
+            long old = (word >>> shift) & mask;
+            long value;
+            switch (op) {
+            case ADD:
+                value = old + v;
+                break;
+            case SUB:
+                value = old - v;
+                break;
+            case OR:
+                value = old | v;
+                break;
+            case XOR:
+                value = old ^ v;
+                break;
+            case AND:
+                value = old & v;
+                break;
+            default:
+                value = v;
+            }
+            int newWord = (word & ~(int) (mask << shift)) | (int) ((value & mask) << shift);
+            if (INT.weakCompareAndSet(m, base, word, newWord)) {
+                return old;
+            }
+        }
+    }
+
+    /* Stores desired if the object is equal to expected and returns the old value */
+    static long compareAndExchange(byte[] m, int offset, long expected, long desired, int size) {
+        if (size == 8) {
+            return (long) LONG.compareAndExchange(m, offset, expected, desired);
+        }
+        if (size == 4) {
+            return ((int) INT.compareAndExchange(m, offset, (int) expected, (int) desired)) & 0xFFFFFFFFL;
+        }
+        int base = offset & ~3;
+        int shift = (offset & 3) * 8;
+        long mask = mask(size);
+        expected &= mask;
+        for (;;) {
+            int word = (int) INT.getVolatile(m, base);
+            long old = (word >>> shift) & mask;
+            if (old != expected) {
+                return old;
+            }
+            int newWord = (word & ~(int) (mask << shift)) | (int) ((desired & mask) << shift);
+            if (INT.weakCompareAndSet(m, base, word, newWord)) {
+                return old;
+            }
+        }
+    }
+
+    static void fence(int order) {
+        switch (order) {
+        case RELAXED:
+            break;
+        case CONSUME:
+        case ACQUIRE:
+            VarHandle.acquireFence();
+            break;
+        case RELEASE:
+            VarHandle.releaseFence();
+            break;
+        default:
+            VarHandle.fullFence();
+        }
+    }
+
+}
@@ -0,0 +1,127 @@
+/*
+MIT License
+
+Copyright (c) 2025 Guillaume Legris
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+package mir2j;
+
+import java.lang.invoke.MethodHandles;
+import java.lang.invoke.VarHandle;
+import java.nio.ByteOrder;
+import java.util.Arrays;
+
+/**
+ * Scans and comparisons of a byte[] behind the string and memory functions of
+ * Runtime (memchr, memcmp, strlen, strcmp...), which pass the memory or a page
+ * and offsets within it. Searches load 8 bytes at a time and test them all at
+ * once with the usual SWAR zero byte test, comparisons use Arrays.mismatch,
+ * which the JIT vectorizes. Like Memory and Atomics, this class needs Java 9+.
+ */
+final class BulkMemory {
+
+    private static final VarHandle LONG = MethodHandles.byteArrayViewVarHandle(long[].class, ByteOrder.LITTLE_ENDIAN);
+
+    private static final long ONES = 0x0101010101010101L;
+    private static final long HIGHS = 0x8080808080808080L;
+
+    private BulkMemory() {
+    }
+
+    /*
+     * Returns a word where the high bit of the first zero byte of x is set, or 0
+     * if x has no zero byte. Bytes after the first zero byte may also be marked.
+     */
+    private static long zeroBytes(long x) {
+        return (x - ONES) & ~x & HIGHS;
+    }
+
+    /* Returns the index in a little-endian word of the first byte marked in z */
+    private static int firstByte(long z) {
+        return Long.numberOfTrailingZeros(z) >>> 3;
+    }
+
+    /* Returns the index of the first byte v of a[from, to), or -1 */
+    static int indexOf(byte[] a, int from, int to, byte v) {
+        long pattern = (v & 0xFFL) * ONES;
+        int i = from;
+        for (; i <= to - 8; i += 8) {
+            long z = zeroBytes((long) LONG.get(a, i) ^ pattern);
+            if (z != 0) {
+                return i + firstByte(z);
+            }
+        }
+        for (; i < to; i++) {
+            if (a[i] == v) {
+                return i;
+            }
+        }
+        return -1;
+    }
+
+    /* Returns the index of the first byte v or 0 of a[from, to), or -1 */
+    static int indexOfOrZero(byte[] a, int from, int to, byte v) {
+        long pattern = (v & 0xFFL) * ONES;
+        int i = from;
+        for (; i <= to - 8; i += 8) {
+            long x = (long) LONG.get(a, i);
+            long z = zeroBytes(x ^ pattern) | zeroBytes(x);
+            if (z != 0) {
+                return i + firstByte(z);
+            }
+        }
+        for (; i < to; i++) {
+            if (a[i] == v || a[i] == 0) {
+                return i;
+            }
+        }
+        return -1;
+    }
+
+    /* Returns the index of the first difference of the len bytes at a[aFrom] and b[bFrom], or -1 */
+    static int mismatch(byte[] a, int aFrom, byte[] b, int bFrom, int len) {
+        return Arrays.mismatch(a, aFrom, aFrom + len, b, bFrom, bFrom + len);
+    }
+
+    /*
+     * Returns the index of the first difference or common 0 of the len bytes at
+     * a[aFrom] and b[bFrom], or -1: where strcmp stops.
+     */
+    static int stringMismatch(byte[] a, int aFrom, byte[] b, int bFrom, int len) {
+        int i = 0;
+        for (; i <= len - 8; i += 8) {
+            long x = (long) LONG.get(a, aFrom + i);
+            long diff = x ^ (long) LONG.get(b, bFrom + i);
+            long z = zeroBytes(x);
+            if ((diff | z) != 0) {
+                int d = diff != 0 ? firstByte(diff) : 8;
+                return i + (z != 0 ? Math.min(d, firstByte(z)) : d);
+            }
+        }
+        for (; i < len; i++) {
+            byte c = a[aFrom + i];
+            if (c != b[bFrom + i] || c == 0) {
+                return i;
+            }
+        }
+        return -1;
+    }
+
+}
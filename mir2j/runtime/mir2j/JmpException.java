@@ -0,0 +1,51 @@
+/*
+MIT License
+
+Copyright (c) 2025 Guillaume Legris
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+package mir2j;
+
+/**
+ * Thrown by longjmp and caught by the function which called setjmp on the
+ * same jmp_buf, see Runtime.mir_setjmp.
+ *
+ * Each Runtime throws a single preallocated instance without stack trace, so
+ * a longjmp costs no allocation and no stack walk.
+ */
+public final class JmpException extends RuntimeException {
+
+    private static final long serialVersionUID = 1L;
+
+    /* The token stored in the jmp_buf by the matching setjmp */
+    public long token;
+    /* The value returned by setjmp, never 0 */
+    public int value;
+
+    JmpException() {
+        super("longjmp without a matching setjmp");
+    }
+
+    @Override
+    public synchronized Throwable fillInStackTrace() {
+        return this;
+    }
+
+}
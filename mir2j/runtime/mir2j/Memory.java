@@ -0,0 +1,148 @@
+/*
+MIT License
+
+Copyright (c) 2025 Guillaume Legris
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+package mir2j;
+
+import java.lang.invoke.MethodHandles;
+import java.lang.invoke.VarHandle;
+import java.nio.ByteOrder;
+
+/**
+ * Little-endian accessors over the emulated memory used by the generated code.
+ *
+ * Each access is a single bounds-checked load or store through a static final
+ * VarHandle view of the byte[] heap, which C2 inlines and compiles to a plain
+ * (possibly unaligned) memory access. The methods mirror the mir_read_* /
+ * mir_write_* accessors of Runtime, whose heap allocator also uses them for its
+ * chunk headers. This class needs Java 9+. Code translated with
+ * "m2j -legacy-memory" calls the byte-wise Runtime accessors instead.
+ */
+public final class Memory {
+
+    private static final VarHandle SHORT = MethodHandles.byteArrayViewVarHandle(short[].class, ByteOrder.LITTLE_ENDIAN);
+    private static final VarHandle INT = MethodHandles.byteArrayViewVarHandle(int[].class, ByteOrder.LITTLE_ENDIAN);
+    private static final VarHandle LONG = MethodHandles.byteArrayViewVarHandle(long[].class, ByteOrder.LITTLE_ENDIAN);
+    private static final VarHandle FLOAT = MethodHandles.byteArrayViewVarHandle(float[].class, ByteOrder.LITTLE_ENDIAN);
+    private static final VarHandle DOUBLE = MethodHandles.byteArrayViewVarHandle(double[].class, ByteOrder.LITTLE_ENDIAN);
+
+    private Memory() {
+    }
+
+    public static byte read_byte(byte[] memory, long addr) {
+        return memory[(int) addr];
+    }
+
+    public static void write_byte(byte[] memory, long addr, long b) {
+        memory[(int) addr] = (byte) b;
+    }
+
+    public static int read_ubyte(byte[] memory, long addr) {
+        return memory[(int) addr] & 0xFF;
+    }
+
+    public static void write_ubyte(byte[] memory, long addr, long b) {
+        memory[(int) addr] = (byte) b;
+    }
+
+    public static short read_short(byte[] memory, long addr) {
+        return (short) SHORT.get(memory, (int) addr);
+    }
+
+    public static void write_short(byte[] memory, long addr, long v) {
+        SHORT.set(memory, (int) addr, (short) v);
+    }
+
+    public static int read_ushort(byte[] memory, long addr) {
+        return ((short) SHORT.get(memory, (int) addr)) & 0xFFFF;
+    }
+
+    public static void write_ushort(byte[] memory, long addr, long v) {
+        SHORT.set(memory, (int) addr, (short) v);
+    }
+
+    public static int read_int(byte[] memory, long addr) {
+        return (int) INT.get(memory, (int) addr);
+    }
+
+    public static void write_int(byte[] memory, long addr, long v) {
+        INT.set(memory, (int) addr, (int) v);
+    }
+
+    public static long read_uint(byte[] memory, long addr) {
+        return ((int) INT.get(memory, (int) addr)) & 0xFFFFFFFFL;
+    }
+
+    public static void write_uint(byte[] memory, long addr, long v) {
+        INT.set(memory, (int) addr, (int) v);
+    }
+
+    public static long read_long(byte[] memory, long addr) {
+        return (long) LONG.get(memory, (int) addr);
+    }
+
+    public static void write_long(byte[] memory, long addr, long l) {
+        LONG.set(memory, (int) addr, l);
+    }
+
+    public static long read_ulong(byte[] memory, long addr) {
+        return (long) LONG.get(memory, (int) addr);
+    }
+
+    public static void write_ulong(byte[] memory, long addr, long l) {
+        LONG.set(memory, (int) addr, l);
+    }
+
+    public static long read_pointer(byte[] memory, long addr) {
+        return (long) LONG.get(memory, (int) addr);
+    }
+
+    public static void write_pointer(byte[] memory, long addr, long v) {
+        LONG.set(memory, (int) addr, v);
+    }
+
+    public static float read_float(byte[] memory, long addr) {
+        return (float) FLOAT.get(memory, (int) addr);
+    }
+
+    public static void write_float(byte[] memory, long addr, float f) {
+        FLOAT.set(memory, (int) addr, f);
+    }
+
+    public static double read_double(byte[] memory, long addr) {
+        return (double) DOUBLE.get(memory, (int) addr);
+    }
+
+    public static void write_double(byte[] memory, long addr, double d) {
+        DOUBLE.set(memory, (int) addr, d);
+    }
+
+    /* long double is mapped to a Java double */
+    public static double read_long_double(byte[] memory, long addr) {
+        return (double) DOUBLE.get(memory, (int) addr);
+    }
+
+    public static void write_long_double(byte[] memory, long addr, double d) {
+        DOUBLE.set(memory, (int) addr, d);
+    }
+
+}
@@ -0,0 +1,181 @@
+/*
+MIT License
+
+Copyright (c) 2025 Guillaume Legris
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+package mir2j;
+
+import java.lang.invoke.MethodHandles;
+import java.lang.invoke.VarHandle;
+import java.nio.ByteOrder;
+
+/**
+ * Little-endian accessors over the paged memory used by the code translated
+ * with "m2j -paged-memory" (see Runtime.pages), which can exceed 2 GB.
+ *
+ * An access inside a page is a single VarHandle load or store like in Memory;
+ * only an access straddling two pages is split into smaller ones. Java 9+.
+ */
+public final class PagedMemory {
+
+    private static final VarHandle SHORT = MethodHandles.byteArrayViewVarHandle(short[].class, ByteOrder.LITTLE_ENDIAN);
+    private static final VarHandle INT = MethodHandles.byteArrayViewVarHandle(int[].class, ByteOrder.LITTLE_ENDIAN);
+    private static final VarHandle LONG = MethodHandles.byteArrayViewVarHandle(long[].class, ByteOrder.LITTLE_ENDIAN);
+
+    private static final int SHIFT = Runtime.PAGE_SHIFT;
+    private static final int SIZE = Runtime.PAGE_SIZE;
+    private static final int MASK = Runtime.PAGE_MASK;
+
+    private PagedMemory() {
+    }
+
+    private static byte[] page(byte[][] pages, long addr) {
+        return pages[(int) (addr >>> SHIFT)];
+    }
+
+    public static byte read_byte(byte[][] pages, long addr) {
+        return page(pages, addr)[(int) addr & MASK];
+    }
+
+    public static void write_byte(byte[][] pages, long addr, long b) {
+        page(pages, addr)[(int) addr & MASK] = (byte) b;
+    }
+
+    public static int read_ubyte(byte[][] pages, long addr) {
+        return read_byte(pages, addr) & 0xFF;
+    }
+
+    public static void write_ubyte(byte[][] pages, long addr, long b) {
+        write_byte(pages, addr, b);
+    }
+
+    public static short read_short(byte[][] pages, long addr) {
+        int offset = (int) addr & MASK;
+        if (offset <= SIZE - 2) {
+            return (short) SHORT.get(page(pages, addr), offset);
+        }
+        return (short) (read_ubyte(pages, addr) | read_ubyte(pages, addr + 1) << 8);
+    }
+
+    public static void write_short(byte[][] pages, long addr, long v) {
+        int offset = (int) addr & MASK;
+        if (offset <= SIZE - 2) {
+            SHORT.set(page(pages, addr), offset, (short) v);
+        } else {
+            write_byte(pages, addr, v);
+            write_byte(pages, addr + 1, v >> 8);
+        }
+    }
+
+    public static int read_ushort(byte[][] pages, long addr) {
+        return read_short(pages, addr) & 0xFFFF;
+    }
+
+    public static void write_ushort(byte[][] pages, long addr, long v) {
+        write_short(pages, addr, v);
+    }
+
+    public static int read_int(byte[][] pages, long addr) {
+        int offset = (int) addr & MASK;
+        if (offset <= SIZE - 4) {
+            return (int) INT.get(page(pages, addr), offset);
+        }
+        return read_ushort(pages, addr) | read_ushort(pages, addr + 2) << 16;
+    }
+
+    public static void write_int(byte[][] pages, long addr, long v) {
+        int offset = (int) addr & MASK;
+        if (offset <= SIZE - 4) {
+            INT.set(page(pages, addr), offset, (int) v);
+        } else {
+            write_short(pages, addr, v);
+            write_short(pages, addr + 2, v >> 16);
+        }
+    }
+
+    public static long read_uint(byte[][] pages, long addr) {
+        return read_int(pages, addr) & 0xFFFFFFFFL;
+    }
+
+    public static void write_uint(byte[][] pages, long addr, long v) {
+        write_int(pages, addr, v);
+    }
+
+    public static long read_long(byte[][] pages, long addr) {
+        int offset = (int) addr & MASK;
+        if (offset <= SIZE - 8) {
+            return (long) LONG.get(page(pages, addr), offset);
+        }
+        return read_uint(pages, addr) | (long) read_int(pages, addr + 4) << 32;
+    }
+
+    public static void write_long(byte[][] pages, long addr, long l) {
+        int offset = (int) addr & MASK;
+        if (offset <= SIZE - 8) {
+            LONG.set(page(pages, addr), offset, l);
+        } else {
+            write_int(pages, addr, l);
+            write_int(pages, addr + 4, l >> 32);
+        }
+    }
+
+    public static long read_ulong(byte[][] pages, long addr) {
+        return read_long(pages, addr);
+    }
+
+    public static void write_ulong(byte[][] pages, long addr, long l) {
+        write_long(pages, addr, l);
+    }
+
+    public static long read_pointer(byte[][] pages, long addr) {
+        return read_long(pages, addr);
+    }
+
+    public static void write_pointer(byte[][] pages, long addr, long v) {
+        write_long(pages, addr, v);
+    }
+
+    public static float read_float(byte[][] pages, long addr) {
+        return Float.intBitsToFloat(read_int(pages, addr));
+    }
+
+    public static void write_float(byte[][] pages, long addr, float f) {
+        write_int(pages, addr, Float.floatToRawIntBits(f));
+    }
+
+    public static double read_double(byte[][] pages, long addr) {
+        return Double.longBitsToDouble(read_long(pages, addr));
+    }
+
+    public static void write_double(byte[][] pages, long addr, double d) {
+        write_long(pages, addr, Double.doubleToRawLongBits(d));
+    }
+
+    /* long double is mapped to a Java double */
+    public static double read_long_double(byte[][] pages, long addr) {
+        return read_double(pages, addr);
+    }
+
+    public static void write_long_double(byte[][] pages, long addr, double d) {
+        write_double(pages, addr, d);
+    }
+
+}
@@ -23,221 +23,683 @@ SOFTWARE.
 */
 package mir2j;
 
+import java.io.InputStream;
+import java.io.PrintStream;
+import java.lang.invoke.MethodHandles;
+import java.lang.invoke.MethodType;
+import java.lang.reflect.InvocationTargetException;
 import java.lang.reflect.Method;
+import java.math.BigInteger;
+import java.util.ArrayList;
+import java.util.Arrays;
 import java.util.HashMap;
 import java.util.IllegalFormatException;
-import java.util.Iterator;
+import java.util.List;
+import java.util.Locale;
 import java.util.Map;
-import java.util.TreeMap;
-
-public class Runtime {
+import java.util.Set;
+import java.util.concurrent.ConcurrentHashMap;
+import java.util.concurrent.CopyOnWriteArrayList;
+import java.util.concurrent.TimeUnit;
+import java.util.concurrent.locks.ReentrantLock;
+
+/**
+ * The state of one translated C program: its memory, stack, heap, function
+ * table and standard streams. The generated Main class extends Runtime, so each
+ * Main instance is an independent program and several instances, each driven by
+ * its own thread, can run concurrently while sharing the loaded and JIT-compiled
+ * code. An instance itself is not thread-safe: the C11 threads of a program,
+ * see thrd_create, run in clones of it sharing its memory.
+ */
+public class Runtime implements Cloneable {
 
     private static final boolean LOG_WARNING = true;
 
     private static final int PTR_SIZE = 8;
-    private static final int VA_ARG_BUFFER_SIZE = 8;
-
-    private byte[] memory;
-
-    private int stackPosition = 8; // Do not start at 0 to avoid weird bugs caused by comparisons with 0
-    private final int maxStackSize;
-    private final int varArgsBufferAddress;
-    private final int functionSpaceStartAddress;
-    private final int functionSpaceSize;
-    private int nextfunctionPointer;
-    private final int heapStartAddress;
-    private TreeMap<Integer, MemoryBlock> memoryBlockMap = new TreeMap<>();
-    private TreeMap<Integer, VarArgs> varArgsMap = new TreeMap<>();
-    private HashMap<String, Integer> stringMap = new HashMap<>();
+
+    /*
+     * Memory is either one flat byte[], limited to 2 GB, or, if
+     * mir_paged_memory() is true, pages of PAGE_SIZE bytes indexed by
+     * addr >>> PAGE_SHIFT, allocated once used and never copied.
+     */
+    protected byte[] memory;
+    protected byte[][] pages;
+    public static final int PAGE_SHIFT = 20;
+    public static final int PAGE_SIZE = 1 << PAGE_SHIFT;
+    public static final int PAGE_MASK = PAGE_SIZE - 1;
+    private static final int MAX_ARRAY_SIZE = Integer.MAX_VALUE - 8;
+    private long memorySize;
+
+    /**
+     * Address of the data image laid out by m2j, at the bottom of memory.
+     * Do not start at 0 to avoid weird bugs caused by comparisons with 0.
+     */
+    public static final int DATA_ADDRESS = 8;
+
+    /**
+     * Unused gap between the data and the stack and between the stack and the
+     * heap, so that a small overflow does not corrupt the neighbouring region.
+     */
+    public static final int GUARD_SIZE = 4096;
+
+    public static final long DEFAULT_STACK_SIZE = 8 << 20;
+    public static final long DEFAULT_HEAP_SIZE = 16 << 20;
+    public static final long DEFAULT_THREAD_STACK_SIZE = 1 << 20;
+    private static final long MAX_STACK_SIZE = 1 << 30;
+    private static final int STACK_ALIGN = 16;
+
+    private final int dataSize;
+    /* The stack grows down from stackTop to stackLimit */
+    private int stackLimit;
+    private int stackTop;
+    private int stackPosition;
+    /* Lowest stack address usable without a check, see mir_allocate */
+    private long stackCommitted;
+    /* Heap chunks and free lists, see malloc */
+    private final long heapBase;
+    private long heapLimit;
+    private long heapTop;
+    private final long[] binHeads = new long[NBINS];
+    private long smallBinMap;
+    private long largeBinMap;
+    private final HashMap<String, Long> stringMap = new HashMap<>();
     private FunctionMap functionMap = new FunctionMap();
+    private MethodHandle[] functionHandles; // Indexed by address - FUNCTION_ADDRESS_BASE
+    private int functionCount;
+    /* Standard streams of the program, see mir_set_std_streams */
+    protected InputStream mir_stdin = System.in;
+    protected PrintStream mir_stdout = System.out;
+    protected PrintStream mir_stderr = System.err;
+    /* setjmp/longjmp state, see mir_setjmp */
+    private long jmpTokenCount;
+    private JmpException jmpException = new JmpException();
+    /*
+     * C11 threads state, see thrd_create. The contexts of the threads are clones
+     * of root sharing its memory and its heap, which is locked once threaded.
+     */
+    private Runtime root = this;
+    private boolean threaded;
+    private long threadId = 1;
+    private long lastThreadId = 1;
+    private final Map<Long, Runtime> threads = new ConcurrentHashMap<>();
+    private final Set<Runtime> runningThreads = ConcurrentHashMap.newKeySet();
+    private final List<Object> threadObjects = new CopyOnWriteArrayList<>(); // Mutexes, conditions and tss keys
+    private final Object onceLock = new Object();
+    private Thread thread;
+    private long threadStack;
+    private int threadResult;
+    private boolean threadFinished;
+    private boolean threadDetached;
+    /* exit in any thread ends the program, see exitProgram */
+    private Thread mainThread;
+    private volatile boolean exiting;
+    private int exitStatus;
 
     public static final int EOF = -1;
-    
+
+    /**
+     * Function pointers are not memory addresses: function i of the table has the
+     * address FUNCTION_ADDRESS_BASE + i, above any memory address.
+     */
+    public static final long FUNCTION_ADDRESS_BASE = 0x1000000000000L;
+
+    /**
+     * Uses the sizes given by the system properties mir2j.stackSize,
+     * mir2j.heapSize and mir2j.maxHeapSize, in bytes with an optional k, m or g
+     * suffix (for instance -Dmir2j.stackSize=64m).
+     */
     public Runtime() {
-        this(20000000);
+        this(sizeProperty("mir2j.stackSize", DEFAULT_STACK_SIZE), sizeProperty("mir2j.heapSize", DEFAULT_HEAP_SIZE),
+                sizeProperty("mir2j.maxHeapSize", Long.MAX_VALUE));
     }
-    
-    public Runtime(int memorySize) {
-        // Define memory sections
-        memory = new byte[memorySize];
-        maxStackSize = memorySize / 5;
-        varArgsBufferAddress = maxStackSize;
-        functionSpaceStartAddress = varArgsBufferAddress + VA_ARG_BUFFER_SIZE;
-        functionSpaceSize = 1000;
-        nextfunctionPointer = functionSpaceStartAddress;
-        heapStartAddress = functionSpaceStartAddress + functionSpaceSize;
-    }
-
-    public int growMemory(int minSize) {
-        int newSize = memory.length * 2;
+
+    /**
+     * Lays out memory: the data image at DATA_ADDRESS, sized exactly by
+     * mir_data_size(), then the stack of stackSize bytes (at most 1 GB), growing
+     * down, then the heap, which malloc grows from heapSize bytes up to
+     * maxHeapSize. A paged memory only allocates its stack and heap pages once
+     * used, heapSize just sizes its page table.
+     */
+    public Runtime(long stackSize, long heapSize, long maxHeapSize) {
+        if (stackSize <= 0 || stackSize > MAX_STACK_SIZE || heapSize < 0 || maxHeapSize < heapSize) {
+            throw new IllegalArgumentException("Bad memory sizes: stack " + stackSize + ", heap " + heapSize + ", max heap "
+                    + maxHeapSize);
+        }
+        dataSize = mir_data_size();
+        long dataEnd = DATA_ADDRESS + dataSize;
+        long limit = (dataEnd + GUARD_SIZE + STACK_ALIGN - 1) & -STACK_ALIGN;
+        long top = limit + ((stackSize + STACK_ALIGN - 1) & -STACK_ALIGN);
+        if (top > Integer.MAX_VALUE - GUARD_SIZE - PAGE_SIZE) {
+            throw new IllegalArgumentException("Data and stack must fit in 2 GB");
+        }
+        stackLimit = (int) limit;
+        stackTop = (int) top;
+        stackPosition = stackTop;
+        if (mir_paged_memory()) {
+            heapBase = (top + GUARD_SIZE + PAGE_MASK) & -PAGE_SIZE;
+            heapLimit = maxHeapSize < FUNCTION_ADDRESS_BASE - heapBase ? heapBase + maxHeapSize
+                    : FUNCTION_ADDRESS_BASE - CHUNK_OVERHEAD;
+            pages = new byte[(int) Math.max(64, (Math.min(heapBase + heapSize, heapLimit) >>> PAGE_SHIFT) + 1)][];
+            allocatePages(0, dataEnd);
+            stackCommitted = top;
+            memorySize = heapBase;
+            growMemory(heapBase + CHUNK_OVERHEAD);
+        } else {
+            heapBase = (top + GUARD_SIZE + CHUNK_ALIGN - 1) & -CHUNK_ALIGN;
+            long size = heapBase + CHUNK_OVERHEAD + heapSize;
+            if (size > MAX_ARRAY_SIZE) {
+                throw new IllegalArgumentException("Flat memory is limited to 2 GB: translate with m2j -paged-memory");
+            }
+            heapLimit = heapBase + Math.min(maxHeapSize, MAX_ARRAY_SIZE - CHUNK_OVERHEAD - heapBase);
+            memory = new byte[(int) size];
+            memorySize = size;
+            stackCommitted = limit;
+        }
+        heapTop = heapBase;
+    }
+
+    /* Reads a size in bytes with an optional k, m or g suffix from a system property */
+    private static long sizeProperty(String name, long defaultValue) {
+        String value = System.getProperty(name);
+        if (value == null || value.isEmpty()) {
+            return defaultValue;
+        }
+        int shift;
+        switch (Character.toLowerCase(value.charAt(value.length() - 1))) {
+        case 'k':
+            shift = 10;
+            break;
+        case 'm':
+            shift = 20;
+            break;
+        case 'g':
+            shift = 30;
+            break;
+        default:
+            return Long.parseLong(value);
+        }
+        return Long.parseLong(value.substring(0, value.length() - 1)) << shift;
+    }
+
+    /**
+     * Returns true if the memory is paged. Overridden by the code translated
+     * with "m2j -paged-memory", which accesses the pages through PagedMemory.
+     */
+    protected boolean mir_paged_memory() {
+        return false;
+    }
+
+    /**
+     * Returns the size of the data image, see mir_load_data. Overridden by the
+     * translated code.
+     */
+    protected int mir_data_size() {
+        return 0;
+    }
+
+    /**
+     * Makes the addresses below minSize usable and returns the new memory size.
+     * A flat memory is copied into an array twice as big, a paged memory just
+     * gets new pages.
+     */
+    public long growMemory(long minSize) {
+        if (pages != null) {
+            long end = ((minSize + PAGE_MASK) & -PAGE_SIZE);
+            if ((end >>> PAGE_SHIFT) > pages.length) {
+                pages = Arrays.copyOf(pages, (int) Math.max(end >>> PAGE_SHIFT, 2 * pages.length));
+            }
+            allocatePages(memorySize, end);
+            memorySize = Math.max(memorySize, end);
+            return memorySize;
+        }
+        if (minSize > MAX_ARRAY_SIZE) {
+            throw new OutOfMemoryError("Flat memory is limited to 2 GB: translate with m2j -paged-memory");
+        }
+        long newSize = Math.min(2L * memory.length, MAX_ARRAY_SIZE);
         while (newSize < minSize) {
-            newSize *= 2;
+            newSize = Math.min(2 * newSize, MAX_ARRAY_SIZE);
         }
-        byte[] newMemory = new byte[newSize];
+        byte[] newMemory = new byte[(int) newSize];
         System.arraycopy(memory, 0, newMemory, 0, memory.length);
         memory = newMemory;
+        memorySize = newSize;
         return newSize;
     }
 
-    public int mir_get_stack_position() {
+    /* Allocates the missing pages of a paged memory between addresses start and end */
+    private void allocatePages(long start, long end) {
+        for (long addr = start & -PAGE_SIZE; addr < end; addr += PAGE_SIZE) {
+            if (page(addr) == null) {
+                pages[(int) (addr >>> PAGE_SHIFT)] = new byte[PAGE_SIZE];
+            }
+        }
+    }
+
+    private byte[] page(long addr) {
+        return pages[(int) (addr >>> PAGE_SHIFT)];
+    }
+
+    /* Copies n bytes from src to dst, which may overlap */
+    public final void mir_copy_memory(long src, long dst, long n) {
+        if (pages == null) {
+            System.arraycopy(memory, (int) src, memory, (int) dst, (int) n);
+        } else if (dst <= src || dst >= src + n) {
+            while (n > 0) {
+                int len = (int) Math.min(n, PAGE_SIZE - Math.max((int) src & PAGE_MASK, (int) dst & PAGE_MASK));
+                System.arraycopy(page(src), (int) src & PAGE_MASK, page(dst), (int) dst & PAGE_MASK, len);
+                src += len;
+                dst += len;
+                n -= len;
+            }
+        } else {
+            // Overlapping with dst above src: copy the pieces from the end
+            src += n;
+            dst += n;
+            while (n > 0) {
+                int len = (int) Math.min(n, Math.min((int) (src - 1) & PAGE_MASK, (int) (dst - 1) & PAGE_MASK) + 1);
+                src -= len;
+                dst -= len;
+                n -= len;
+                System.arraycopy(page(src), (int) src & PAGE_MASK, page(dst), (int) dst & PAGE_MASK, len);
+            }
+        }
+    }
+
+    public final void mir_fill_memory(long addr, long n, byte v) {
+        if (pages == null) {
+            Arrays.fill(memory, (int) addr, (int) (addr + n), v);
+            return;
+        }
+        while (n > 0) {
+            int offset = (int) addr & PAGE_MASK;
+            int len = (int) Math.min(n, PAGE_SIZE - offset);
+            Arrays.fill(page(addr), offset, offset + len, v);
+            addr += len;
+            n -= len;
+        }
+    }
+
+    public final int mir_get_stack_position() {
         return stackPosition;
     }
 
-    public void mir_set_stack_position(int position) {
+    public final void mir_set_stack_position(int position) {
         stackPosition = position;
     }
 
-    public long mir_allocate(long sizeInBytes) {
-        int oldStackPosition = stackPosition;
-        if ((oldStackPosition + sizeInBytes) > maxStackSize) {
-            throw new RuntimeException("Stack overflow");
-        }
-        stackPosition += sizeInBytes;
-        return oldStackPosition;
-    }
-
-    private MemoryBlock addBlock(int address, int size, boolean free) {
-        if ((address + size) > memory.length) {
-            // TODO Try to merge free blocks before growing memory
-            growMemory(address + size);
-        }
-        MemoryBlock block = new MemoryBlock(address, size, free);
-        memoryBlockMap.put(address, block);
-        // System.out.println(block);
-        return block;
-    }
-
-    public long malloc(long longSize) {
-        int size = (int) longSize;
-        // Try to find a free block
-        if (!memoryBlockMap.isEmpty()) {
-            Iterator<MemoryBlock> i = memoryBlockMap.values().iterator();
-            while (i.hasNext()) {
-                MemoryBlock block = i.next();
-                if (block.getSize() >= size && block.isFree()) {
-                    block.setFree(false);
-                    // Split block if possible
-                    int newBlockSize = block.getSize() - size;
-                    if (newBlockSize > 0) {
-                        // Resize the current block before creating a new one
-                        block.setSize(size);
-                        int newBlockAddress = block.getStartAddress() + size;
-                        addBlock(newBlockAddress, newBlockSize, true);
-                    }
-                    return block.getStartAddress();
+    /* Allocates sizeInBytes on the stack, which grows down */
+    public final long mir_allocate(long sizeInBytes) {
+        long addr = (stackPosition - sizeInBytes) & -STACK_ALIGN;
+        if (addr < stackCommitted) {
+            growStack(addr);
+        }
+        stackPosition = (int) addr;
+        return addr;
+    }
+
+    /* Checks for a stack overflow and allocates the stack pages of a paged memory down to addr */
+    private void growStack(long addr) {
+        if (addr < stackLimit) {
+            throw new RuntimeException("Stack overflow: increase " + (threadStack != 0 ? "mir2j.threadStackSize" : "mir2j.stackSize")
+                    + " (" + (stackTop - stackLimit) + " bytes)");
+        }
+        long start = Math.max(addr & -PAGE_SIZE, stackLimit);
+        allocatePages(start, stackCommitted);
+        stackCommitted = start;
+    }
+
+    /*
+     * Heap allocator working inside memory, with no Java object per block.
+     *
+     * A chunk at address c (c % 16 == 0) has a header of two longs: at c the
+     * size of the previous chunk, valid only when that chunk is free, and at
+     * c + 8 its own size (a multiple of 16, header included) with the CINUSE and
+     * PINUSE flags. The payload starts at c + 16. Free chunks are doubly linked
+     * through their payload (next at c + 16, prev at c + 24) in bins: exact
+     * sizes below 1024 bytes, then one bin per power of two. Bitmaps of the
+     * non-empty bins find a fitting bin in O(1). Free chunks are coalesced with
+     * their neighbours and with the top of the heap, so there are never two
+     * adjacent free chunks and the chunk below heapTop is in use.
+     */
+    private static final int CHUNK_ALIGN = 16;
+    private static final int CHUNK_OVERHEAD = 16;
+    private static final int MIN_CHUNK_SIZE = 32;
+    private static final int CINUSE = 1;
+    private static final int PINUSE = 2;
+    private static final int FLAGS = CINUSE | PINUSE;
+    private static final int NSMALLBINS = 64;
+    private static final int LARGE_BIN_SHIFT = 10; // log2(NSMALLBINS * CHUNK_ALIGN)
+    private static final int NBINS = NSMALLBINS + 64 - LARGE_BIN_SHIFT;
+
+    /*
+     * Headers and free-list links are aligned longs, so they never cross a page:
+     * each is a single VarHandle access, as in the generated code.
+     */
+    private long readHeader(long addr) {
+        return pages == null ? Memory.read_long(memory, addr) : Memory.read_long(page(addr), addr & PAGE_MASK);
+    }
+
+    private void writeHeader(long addr, long v) {
+        if (pages == null) {
+            Memory.write_long(memory, addr, v);
+        } else {
+            Memory.write_long(page(addr), addr & PAGE_MASK, v);
+        }
+    }
+
+    private long chunkSize(long c) {
+        return readHeader(c + 8) & ~FLAGS;
+    }
+
+    private static int binIndex(long size) {
+        if (size < NSMALLBINS * CHUNK_ALIGN) {
+            return (int) size / CHUNK_ALIGN;
+        }
+        return NSMALLBINS + (63 - Long.numberOfLeadingZeros(size)) - LARGE_BIN_SHIFT;
+    }
+
+    /* Returns the chunk size for a request, or -1 when it is too big */
+    private static long requestToSize(long n) {
+        if (n < 0 || n > Long.MAX_VALUE / 4) {
+            return -1;
+        }
+        long size = (n + CHUNK_OVERHEAD + CHUNK_ALIGN - 1) & -CHUNK_ALIGN;
+        return size < MIN_CHUNK_SIZE ? MIN_CHUNK_SIZE : size;
+    }
+
+    private void insertFreeChunk(long c, long size) {
+        long next = c + size;
+        writeHeader(c + 8, size | PINUSE); // The previous chunk is never free
+        writeHeader(next, size);
+        writeHeader(next + 8, readHeader(next + 8) & ~PINUSE);
+        int bin = binIndex(size);
+        long head = binHeads[bin];
+        writeHeader(c + 16, head);
+        writeHeader(c + 24, 0);
+        if (head != 0) {
+            writeHeader(head + 24, c);
+        }
+        binHeads[bin] = c;
+        if (bin < 64) {
+            smallBinMap |= 1L << bin;
+        } else {
+            largeBinMap |= 1L << (bin - 64);
+        }
+    }
+
+    private void unlinkFreeChunk(long c, long size) {
+        long next = readHeader(c + 16);
+        long prev = readHeader(c + 24);
+        if (prev != 0) {
+            writeHeader(prev + 16, next);
+        } else {
+            int bin = binIndex(size);
+            binHeads[bin] = next;
+            if (next == 0) {
+                if (bin < 64) {
+                    smallBinMap &= ~(1L << bin);
+                } else {
+                    largeBinMap &= ~(1L << (bin - 64));
                 }
             }
         }
-        // No block was found. Let's create a new one.
-        int newAddress;
-        if (memoryBlockMap.isEmpty()) {
-            newAddress = heapStartAddress;
+        if (next != 0) {
+            writeHeader(next + 24, prev);
+        }
+    }
+
+    /* Returns the first non-empty bin >= bin, or -1 */
+    private int findBin(int bin) {
+        if (bin < 64) {
+            long bits = smallBinMap & (-1L << bin);
+            if (bits != 0) {
+                return Long.numberOfTrailingZeros(bits);
+            }
+            bin = 64;
+        }
+        long bits = largeBinMap & (-1L << (bin - 64));
+        return bits != 0 ? 64 + Long.numberOfTrailingZeros(bits) : -1;
+    }
+
+    /* Marks the size bytes of chunk c in use, freeing the rest of it if big enough */
+    private void useChunk(long c, long chunkSize, long size) {
+        long pinuse = readHeader(c + 8) & PINUSE;
+        if (chunkSize - size >= MIN_CHUNK_SIZE) {
+            writeHeader(c + 8, size | pinuse | CINUSE);
+            freeChunk(c + size, chunkSize - size);
         } else {
-            MemoryBlock lastBlock = memoryBlockMap.lastEntry().getValue();
-            newAddress = lastBlock.getStartAddress() + lastBlock.getSize();
+            writeHeader(c + 8, chunkSize | pinuse | CINUSE);
+            long next = c + chunkSize;
+            if (next < heapTop) {
+                writeHeader(next + 8, readHeader(next + 8) | PINUSE);
+            }
+        }
+    }
+
+    /* Returns a chunk of the given size from the top of the heap, or -1 beyond heapLimit */
+    private long allocateTop(long size) {
+        long c = heapTop;
+        if (size > heapLimit - c) {
+            return -1;
+        }
+        if (c + size + CHUNK_OVERHEAD > memorySize) {
+            growMemory(c + size + CHUNK_OVERHEAD);
+        }
+        heapTop = c + size;
+        writeHeader(c + 8, size | PINUSE | CINUSE);
+        return c;
+    }
+
+    /* Frees chunk c of the given size whose previous chunk is in use */
+    private void freeChunk(long c, long size) {
+        long next = c + size;
+        if (next == heapTop) {
+            heapTop = c;
+            return;
+        }
+        long nextHead = readHeader(next + 8);
+        if ((nextHead & CINUSE) == 0) {
+            long nextSize = nextHead & ~FLAGS;
+            unlinkFreeChunk(next, nextSize);
+            size += nextSize;
+            if (c + size == heapTop) {
+                heapTop = c;
+                return;
+            }
         }
-        addBlock(newAddress, size, false);
-        return newAddress;
+        insertFreeChunk(c, size);
+    }
+
+    /*
+     * Once the program has threads, the heap functions run on the heap of root
+     * under its lock. The memory does not grow anymore then, see startThreads.
+     */
+    public long malloc(long size) {
+        if (!threaded) {
+            return heapMalloc(size);
+        }
+        synchronized (root) {
+            return root.heapMalloc(size);
+        }
+    }
+
+    private long heapMalloc(long longSize) {
+        long size = requestToSize(longSize);
+        if (size < 0) {
+            return 0;
+        }
+        int bin = binIndex(size);
+        if (bin >= NSMALLBINS) {
+            // First fit in the bin of the size, whose chunks may be too small
+            for (long c = binHeads[bin]; c != 0; c = readHeader(c + 16)) {
+                long chunkSize = chunkSize(c);
+                if (chunkSize >= size) {
+                    unlinkFreeChunk(c, chunkSize);
+                    useChunk(c, chunkSize, size);
+                    return c + CHUNK_OVERHEAD;
+                }
+            }
+            bin++;
+        }
+        // Any chunk of the next non-empty bin fits
+        bin = bin < NBINS ? findBin(bin) : -1;
+        if (bin < 0) {
+            long c = allocateTop(size);
+            return c < 0 ? 0 : c + CHUNK_OVERHEAD;
+        }
+        long c = binHeads[bin];
+        long chunkSize = chunkSize(c);
+        unlinkFreeChunk(c, chunkSize);
+        useChunk(c, chunkSize, size);
+        return c + CHUNK_OVERHEAD;
     }
 
     public long calloc(long elementCount, long elementSize) {
-        int totalSize = (int) (elementCount * elementSize);
-        int addr = (int) malloc(totalSize);
-        if (addr == 0) {
+        long totalSize = elementCount * elementSize;
+        if (elementCount < 0 || elementSize < 0 || (elementSize != 0 && totalSize / elementSize != elementCount)) {
             return 0;
         }
-        for (int i = 0; i < totalSize; i++) {
-            memory[addr + i] = 0;
+        long addr = malloc(totalSize);
+        if (addr == 0) {
+            return 0;
         }
+        mir_fill_memory(addr, totalSize, (byte) 0);
         return addr;
     }
 
+    private long checkedChunk(long addr, String function) {
+        long c = addr - CHUNK_OVERHEAD;
+        if (addr < heapBase + CHUNK_OVERHEAD || addr >= heapTop || (readHeader(c + 8) & CINUSE) == 0) {
+            throw new RuntimeException(function + ": bad heap address " + addr);
+        }
+        return c;
+    }
+
     public long realloc(long blockAddr, long newSize) {
-        MemoryBlock block = memoryBlockMap.get((int) blockAddr);
-        if (block == null) {
-            throw new RuntimeException("Can't find memory block at address " + blockAddr);
-        }
-        // TODO Try to not copy:
-        // if newSize > oldSize: merging old block with next blocks
-        // if newSize < oldSize: reducing the current bloc size and create a (free) new one
-        int newBlockAddr = (int) malloc(newSize);
-        int length = Math.min(block.getSize(), (int) newSize);
-        System.arraycopy(memory, block.getStartAddress(), memory, newBlockAddr, length);
+        if (!threaded) {
+            return heapRealloc(blockAddr, newSize);
+        }
+        synchronized (root) {
+            return root.heapRealloc(blockAddr, newSize);
+        }
+    }
+
+    private long heapRealloc(long blockAddr, long newSize) {
+        if (blockAddr == 0) {
+            return heapMalloc(newSize);
+        }
+        long c = checkedChunk(blockAddr, "realloc");
+        long size = requestToSize(newSize);
+        if (size < 0) {
+            return 0;
+        }
+        long chunkSize = chunkSize(c);
+        long next = c + chunkSize;
+        if (chunkSize >= size) {
+            // Shrink in place
+            useChunk(c, chunkSize, size);
+            return blockAddr;
+        }
+        if (next == heapTop) {
+            if (size <= heapLimit - c) {
+                // Grow in place into the top of the heap
+                if (c + size + CHUNK_OVERHEAD > memorySize) {
+                    growMemory(c + size + CHUNK_OVERHEAD);
+                }
+                heapTop = c + size;
+                writeHeader(c + 8, size | (readHeader(c + 8) & FLAGS));
+                return blockAddr;
+            }
+        } else {
+            long nextHead = readHeader(next + 8);
+            long nextSize = nextHead & ~FLAGS;
+            if ((nextHead & CINUSE) == 0 && chunkSize + nextSize >= size) {
+                // Grow in place over the next free chunk
+                unlinkFreeChunk(next, nextSize);
+                useChunk(c, chunkSize + nextSize, size);
+                return blockAddr;
+            }
+        }
+        long newBlockAddr = heapMalloc(newSize);
+        if (newBlockAddr == 0) {
+            return 0;
+        }
+        mir_copy_memory(blockAddr, newBlockAddr, chunkSize - CHUNK_OVERHEAD);
+        heapFree(blockAddr);
         return newBlockAddr;
     }
 
-    public void free(long longAddr) {
-        MemoryBlock block = memoryBlockMap.get((int) longAddr);
-        if (block == null) {
-            throw new RuntimeException("Can't free memory block at address " + longAddr);
+    public void free(long addr) {
+        if (!threaded) {
+            heapFree(addr);
+            return;
+        }
+        synchronized (root) {
+            root.heapFree(addr);
+        }
+    }
+
+    private void heapFree(long longAddr) {
+        if (longAddr == 0) {
+            return;
+        }
+        long c = checkedChunk(longAddr, "free");
+        long head = readHeader(c + 8);
+        long size = head & ~FLAGS;
+        if ((head & PINUSE) == 0) {
+            // Coalesce with the previous free chunk
+            long prevSize = readHeader(c);
+            c -= prevSize;
+            unlinkFreeChunk(c, prevSize);
+            size += prevSize;
         }
-        block.setFree(true);
+        freeChunk(c, size);
     }
 
     public byte mir_read_byte(long addr) {
-        long b = memory[(int) addr];
-        // System.out.println("readbyte(" + addr + "): " + b);
-        return (byte) b;
+        return pages == null ? memory[(int) addr] : page(addr)[(int) addr & PAGE_MASK];
     }
 
     public void mir_write_byte(long addr, long b) {
-        // System.out.println("writebyte(" + addr + "," + b + ")");
-        memory[(int) addr] = (byte) (b & 0xFF);
+        if (pages == null) {
+            memory[(int) addr] = (byte) b;
+        } else {
+            page(addr)[(int) addr & PAGE_MASK] = (byte) b;
+        }
     }
 
     public int mir_read_ubyte(long addr) {
-        int v = ((int) memory[(int) addr]) & 0xFF;
-        return v;
+        return mir_read_byte(addr) & 0xFF;
     }
 
     public void mir_write_ubyte(long addr, long b) {
-        // System.out.println("writebyte(" + addr + "," + b + ")");
-        memory[(int) addr] = (byte) (b & 0xFF);
+        mir_write_byte(addr, b);
     }
 
-    public short mir_read_short(long longAddr) {
-        int addr = (int) longAddr;
-        int b1 = memory[addr] & 0xFF;
-        int b2 = memory[addr + 1] & 0xFF;
-        return (short) ((b2 << 8) | b1);
+    public short mir_read_short(long addr) {
+        return (short) mir_read_ushort(addr);
     }
 
-    public void mir_write_short(long longAddr, long v) {
-        int addr = (int) longAddr;
-        memory[addr]     = (byte) (v & 0xFF);
-        memory[addr + 1] = (byte) ((v >> 8) & 0xFF);
+    public void mir_write_short(long addr, long v) {
+        mir_write_byte(addr, v);
+        mir_write_byte(addr + 1, v >> 8);
     }
     
-    public int mir_read_ushort(long longAddr) {
-        int addr = (int) longAddr;
-        int b1 = memory[addr] & 0xFF;
-        int b2 = memory[addr + 1] & 0xFF;
-        return (b2 << 8) | b1;
+    public int mir_read_ushort(long addr) {
+        return mir_read_ubyte(addr) | mir_read_ubyte(addr + 1) << 8;
     }
 
-    public void mir_write_ushort(long longAddr, long v) {
-        int addr = (int) longAddr;
-        int val = (int) (v & 0xFFFFL);
-        memory[addr]     = (byte) (val & 0xFF);
-        memory[addr + 1] = (byte) ((val >> 8) & 0xFF);
+    public void mir_write_ushort(long addr, long v) {
+        mir_write_short(addr, v);
     }
 
-    public void mir_write_int(long longAddr, long v) {
-        int addr = (int) longAddr;
-        int i = (int) v;
-        memory[addr]     = (byte) (i & 0xFF);
-        memory[addr + 1] = (byte) ((i >> 8) & 0xFF);
-        memory[addr + 2] = (byte) ((i >> 16) & 0xFF);
-        memory[addr + 3] = (byte) ((i >> 24) & 0xFF);
+    public void mir_write_int(long addr, long v) {
+        mir_write_short(addr, v);
+        mir_write_short(addr + 2, v >> 16);
     }
 
-    public int mir_read_int(long longAddr) {
-        int addr = (int) longAddr;
-        int b1 = memory[addr] & 0xFF;
-        int b2 = memory[addr + 1] & 0xFF;
-        int b3 = memory[addr + 2] & 0xFF;
-        int b4 = memory[addr + 3] & 0xFF;
-        return (b4 << 24) | (b3 << 16) |  (b2 << 8) | b1;
+    public int mir_read_int(long addr) {
+        return mir_read_ushort(addr) | mir_read_ushort(addr + 2) << 16;
     }
 
     public void mir_write_uint(long longAddr, long v) {
@@ -249,29 +711,13 @@ public class Runtime {
         return v;
     }
 
-    public void mir_write_long(long longAddr, long l) {
-        int addr = (int) longAddr;
-        memory[addr]     = (byte) (l & 0xFF);
-        memory[addr + 1] = (byte) ((l >> 8) & 0xFF);
-        memory[addr + 2] = (byte) ((l >> 16) & 0xFF);
-        memory[addr + 3] = (byte) ((l >> 24) & 0xFF);
-        memory[addr + 4] = (byte) ((l >> 32) & 0xFF);
-        memory[addr + 5] = (byte) ((l >> 40) & 0xFF);
-        memory[addr + 6] = (byte) ((l >> 48) & 0xFF);
-        memory[addr + 7] = (byte) ((l >> 56) & 0xFF);
+    public void mir_write_long(long addr, long l) {
+        mir_write_int(addr, l);
+        mir_write_int(addr + 4, l >> 32);
     }
 
-    public long mir_read_long(long longAddr) {
-        int addr = (int) longAddr;
-        long b1 =  (long) (memory[addr]     & 0xFF);
-        long b2 = ((long) (memory[addr + 1] & 0xFF)) << 8;
-        long b3 = ((long) (memory[addr + 2] & 0xFF)) << 16;
-        long b4 = ((long) (memory[addr + 3] & 0xFF)) << 24;
-        long b5 = ((long) (memory[addr + 4] & 0xFF)) << 32;
-        long b6 = ((long) (memory[addr + 5] & 0xFF)) << 40;
-        long b7 = ((long) (memory[addr + 6] & 0xFF)) << 48;
-        long b8 = ((long) (memory[addr + 7] & 0xFF)) << 56;
-        return b1 | b2 | b3 | b4 | b5 | b6 | b7 | b8;
+    public long mir_read_long(long addr) {
+        return mir_read_uint(addr) | (long) mir_read_int(addr + 4) << 32;
     }
 
     public void mir_write_ulong(long longAddr, long l) {
@@ -312,6 +758,33 @@ public class Runtime {
         mir_write_long(addr, v);
     }
 
+    /**
+     * Loads the data image of the translated program: size bytes at DATA_ADDRESS,
+     * the chunks being the Latin-1 encoded start of the image (the rest is zero).
+     */
+    @SuppressWarnings("deprecation")
+    protected final void mir_load_data(String[] chunks, int size) {
+        if (size > dataSize) {
+            throw new RuntimeException("The data image is bigger than mir_data_size()");
+        }
+        long addr = DATA_ADDRESS;
+        for (int i = 0; i < chunks.length; i++) {
+            String chunk = chunks[i];
+            // Copies the low byte of each char, page by page in a paged memory
+            for (int start = 0; start < chunk.length();) {
+                int end = pages == null ? chunk.length()
+                        : (int) Math.min(chunk.length(), start + PAGE_SIZE - ((int) addr & PAGE_MASK));
+                if (pages == null) {
+                    chunk.getBytes(start, end, memory, (int) addr);
+                } else {
+                    chunk.getBytes(start, end, page(addr), (int) addr & PAGE_MASK);
+                }
+                addr += end - start;
+                start = end;
+            }
+        }
+    }
+
     public long mir_set_data_bytes(byte[] s) {
         long addr = mir_allocate(s.length);
         for (int i = 0; i < s.length; i++) {
@@ -420,116 +893,147 @@ public class Runtime {
         return addr;
     }
 
-    public void mir_va_start(long vaListAddr, Object[] mir_var_args) {
-        VarArgs varArgs = varArgsMap.get((int) vaListAddr);
-        if (varArgs == null) {
-            varArgs = new VarArgs(vaListAddr, mir_var_args);
-            varArgsMap.put((int) vaListAddr, varArgs);
-        } else {
-            varArgs.reset(mir_var_args);
-        }
-    }
-
     /*
-     * FIXME: va_end is not emitted by c2mir ! TODO: Temporary fix to call mir_va_end when the last arg is requested
+     * Variadic args are spilled by the caller to an area of the stack, one
+     * VA_SLOT_SIZE slot per arg (floats in the low half, blocks by value rounded
+     * up to slots), whose address follows the named args. A va_list holds the
+     * address of the next slot.
      */
-    public void mir_va_end(long vaListAddr) {
-        varArgsMap.remove((int) vaListAddr);
-    }
-
-    public VarArgs mir_va_get_wrapper(long vaListAddr) {
-        VarArgs varArgs = varArgsMap.get((int) vaListAddr);
-        return varArgs;
-    }
-
-    public class VarArgs {
-        private int vaListAddr;
-        private Object[] args;
-        private int index;
-
-        public VarArgs(long vaListAddr, Object[] args) {
-            this.vaListAddr = (int) vaListAddr;
-            reset(args);
-        }
+    public static final int VA_SLOT_SIZE = 8;
 
-        private Object nextArg() {
-            Object arg = args[index++];
-            return arg;
-        }
-
-        /* FIXME: Temporary fix until va_end is emitted: clean context when the last arg is requested */
-        private void cleanIfTerminated() {
-            if (index == args.length) {
-                varArgsMap.remove(vaListAddr);
-            } else if (index > args.length) {
-                throw new IllegalStateException();
+    /**
+     * Formats the variadic args at vaArea with the printf format at formatAddr,
+     * whose conversions give the types of the slots.
+     */
+    protected String mir_va_format(long formatAddr, long vaArea) {
+        String format = getStringFromMemory(formatAddr);
+        StringBuilder javaFormat = new StringBuilder();
+        ArrayList<Object> args = new ArrayList<>();
+        long slot = vaArea;
+        int i = 0;
+        int n = format.length();
+        while (i < n) {
+            char c = format.charAt(i++);
+            int start = javaFormat.length();
+            javaFormat.append(c);
+            if (c != '%') {
+                continue;
             }
+            while (i < n && "-+ #0".indexOf(format.charAt(i)) >= 0) {
+                javaFormat.append(format.charAt(i++));
+            }
+            if (i < n && format.charAt(i) == '*') {
+                int width = mir_read_int(slot);
+                slot += VA_SLOT_SIZE;
+                i++;
+                javaFormat.append(width < 0 ? "-" + -width : Integer.toString(width));
+            }
+            while (i < n && Character.isDigit(format.charAt(i))) {
+                javaFormat.append(format.charAt(i++));
+            }
+            if (i < n && format.charAt(i) == '.') {
+                i++;
+                int precision = 0;
+                if (i < n && format.charAt(i) == '*') {
+                    precision = mir_read_int(slot);
+                    slot += VA_SLOT_SIZE;
+                    i++;
+                } else {
+                    while (i < n && Character.isDigit(format.charAt(i))) {
+                        precision = 10 * precision + format.charAt(i++) - '0';
+                    }
+                }
+                if (precision >= 0) {
+                    javaFormat.append('.').append(precision);
+                }
+            }
+            boolean wide = false;
+            while (i < n && "hlLqjzt".indexOf(format.charAt(i)) >= 0) {
+                wide |= format.charAt(i++) != 'h';
+            }
+            if (i == n) {
+                break;
+            }
+            char conversion = format.charAt(i++);
+            switch (conversion) {
+            case '%':
+                javaFormat.append('%');
+                continue;
+            case 'd':
+            case 'i':
+                javaFormat.append('d');
+                args.add(wide ? mir_read_long(slot) : (long) mir_read_int(slot));
+                break;
+            case 'u':
+                javaFormat.append('d');
+                if (wide && mir_read_long(slot) < 0) {
+                    args.add(new BigInteger(Long.toUnsignedString(mir_read_long(slot))));
+                } else {
+                    args.add(wide ? mir_read_long(slot) : mir_read_uint(slot));
+                }
+                break;
+            case 'x':
+            case 'X':
+            case 'o':
+                javaFormat.append(conversion);
+                args.add(wide ? mir_read_long(slot) : mir_read_uint(slot));
+                break;
+            case 'p':
+                javaFormat.insert(start, "0x").append('x');
+                args.add(mir_read_long(slot));
+                break;
+            case 'c':
+                javaFormat.append('c');
+                args.add((char) (mir_read_int(slot) & 0xFF));
+                break;
+            case 's':
+                javaFormat.append('s');
+                args.add(getStringFromMemory(mir_read_long(slot)));
+                break;
+            case 'F':
+                javaFormat.append('f');
+                args.add(mir_read_double(slot));
+                break;
+            case 'n':
+                javaFormat.setLength(start);
+                break;
+            default: // e, E, f, g, G, a, A
+                javaFormat.append(conversion);
+                args.add(mir_read_double(slot));
+            }
+            slot += VA_SLOT_SIZE;
         }
-
-        public long nextLong() {
-            Object arg = nextArg();
-            long l = ((Number) arg).longValue();
-            cleanIfTerminated();
-            return l;
-        }
-
-        public double nextDouble() {
-            Object arg = nextArg();
-            double d = ((Number) arg).doubleValue();
-            cleanIfTerminated();
-            return d;
-        }
-
-        public Object[] getAllArgs() {
-            index = args.length;
-            cleanIfTerminated();
-            return args;
-        }
-
-        public long getArgDataAddr() {
-            return varArgsBufferAddress;
-        }
-
-        public void reset(Object[] args) {
-            this.args = args;
-            this.index = 0;
-        }
-
+        return String.format(Locale.ROOT, javaFormat.toString(), args.toArray());
     }
 
     public long mir_get_string_ptr(String s) {
-        if (stringMap.containsKey(s)) {
-            return stringMap.get(s);
+        synchronized (stringMap) {
+            Long ptr = stringMap.get(s);
+            if (ptr != null) {
+                return ptr;
+            }
+            byte[] bytes = s.getBytes();
+            long addr = malloc(bytes.length + 1); // Add one byte to add end string char
+            writeCStringInMemoryFromJavaString(addr, bytes);
+            stringMap.put(s, addr);
+            return addr;
         }
-        byte[] bytes = s.getBytes();
-        int addr = (int) malloc(bytes.length + 1); // Add one byte to add end string char
-        writeCStringInMemoryFromJavaString(addr, bytes);
-        stringMap.put(s, addr);
-        return addr;
     }
 
     public void writeCStringInMemoryFromJavaString(long longAddr, byte[] javaStringBytes) {
         int size = javaStringBytes.length;
-        int addr = (int) longAddr;
         for (int i = 0; i < size; i++) {
-            mir_write_byte(addr + i, javaStringBytes[i]);
+            mir_write_byte(longAddr + i, javaStringBytes[i]);
         }
-        mir_write_byte(addr + size, '\0');
+        mir_write_byte(longAddr + size, '\0');
     }
 
     public String getStringFromMemory(long addr) {
         // TODO Try to get String from the string map
-        int endCharIndex = 0;
-        while (true) {
-            char c = (char) memory[(int) addr + endCharIndex];
-            if (c == '\0') {
-                break;
-            }
-            endCharIndex++;
-        }
+        int endCharIndex = (int) stringLength(addr);
         byte[] bytes = new byte[endCharIndex];
         for (int i = 0; i < endCharIndex; i++) {
-            bytes[i] = memory[(int) addr + i];
+            bytes[i] = mir_read_byte(addr + i);
         }
         String s = new String(bytes);
         return s;
@@ -556,59 +1060,74 @@ public class Runtime {
         return null;
     }
 
+    /**
+     * Returns the names of the functions whose address is taken by the translated
+     * code, in address order. m2j overrides it with its compile-time table.
+     */
+    protected String[] mir_function_names() {
+        return new String[0];
+    }
+
+    private void initFunctionTable() {
+        String[] names = mir_function_names();
+        functionHandles = new MethodHandle[Math.max(16, 2 * names.length)];
+        for (int i = 0; i < names.length; i++) {
+            MethodHandle methodHandle = new MethodHandle(FUNCTION_ADDRESS_BASE + i, names[i]);
+            functionHandles[i] = methodHandle;
+            functionMap.put(names[i], methodHandle);
+        }
+        functionCount = names.length;
+    }
+
+    private MethodHandle getFunction(long functionAddr) {
+        if (functionHandles == null) {
+            initFunctionTable();
+        }
+        long index = functionAddr - FUNCTION_ADDRESS_BASE;
+        if (index < 0 || index >= functionCount)
+            throw new RuntimeException("Bad function address: " + functionAddr);
+        return functionHandles[(int) index];
+    }
+
+    /* Functions not in the compile-time table are registered after it */
     public long mir_get_function_ptr(String functionName) {
-        int functionAddress = 0;
+        if (functionHandles == null) {
+            initFunctionTable();
+        }
         // Check if we have already registered the given function
         MethodHandle methodHandle = functionMap.getMethodHandleByName(functionName);
         // If unknown, link then register the function
         if (methodHandle == null) {
-            Method method = getDeclaredMethodRecursive(getClass(), functionName);
-            if (method == null) {
-                throw new RuntimeException("Function '" + functionName + "' was not found.");
+            methodHandle = new MethodHandle(FUNCTION_ADDRESS_BASE + functionCount, functionName);
+            methodHandle.getMethod(this);
+            if (functionCount == functionHandles.length) {
+                MethodHandle[] newHandles = new MethodHandle[2 * functionCount];
+                System.arraycopy(functionHandles, 0, newHandles, 0, functionCount);
+                functionHandles = newHandles;
             }
-            if (nextfunctionPointer > functionSpaceStartAddress + functionSpaceSize) {
-                throw new RuntimeException("Can't allocate more function pointer");
-            }
-            functionAddress = nextfunctionPointer;
-            // Allow reflective access to private methods
-            method.setAccessible(true);
-            methodHandle = new MethodHandle(functionAddress, method);
             functionMap.put(functionName, methodHandle);
-            nextfunctionPointer++;
+            functionHandles[functionCount++] = methodHandle;
         }
-        functionAddress = methodHandle.getAddress();
-        return functionAddress;
-    }
-
-    /* Call-through wrappers preserving floating return types */
-    private Object invoke(long functionAddr, Object... args) {
-        if (functionAddr < functionSpaceStartAddress || functionAddr > functionSpaceStartAddress + functionSpaceSize)
-            throw new RuntimeException("Bad function address: " + functionAddr);
-        MethodHandle methodHandle = functionMap.getMethodByAddress((int) functionAddr);
-        if (methodHandle == null)
-            throw new RuntimeException("Function at addr=" + functionAddr + " is not mapped.");
-        try {
-            Method m = methodHandle.getMethod();
-            return m.invoke(this, args);
-        } catch (Exception e) {
-            throw new RuntimeException("Error while calling function '" + methodHandle.getMethod().getName() + "' (addr=" + functionAddr + ")", e);
-        }
-    }
-
-    public void mir_call_function_ret_void(long addr, Object... args) {
-        invoke(addr, args);
-    }
-
-    public long mir_call_function_ret_long(long addr, Object... args) {
-        return ((Number) invoke(addr, args)).longValue();
+        return methodHandle.getAddress();
     }
 
-    public double mir_call_function_ret_double(long addr, Object... args) {
-        return ((Number) invoke(addr, args)).doubleValue();
+    /**
+     * Returns the function at functionAddr as a handle of the given call site type,
+     * so that generated code calls it with invokeExact: no boxing nor reflection.
+     */
+    public final java.lang.invoke.MethodHandle mir_get_function_handle(long functionAddr, MethodType type) {
+        return getFunction(functionAddr).getTypedHandle(this, type);
     }
 
-    public float mir_call_function_ret_float(long addr, Object... args) {
-        return ((Number) invoke(addr, args)).floatValue();
+    /* Used by generated code to rethrow what a function handle throws */
+    public static RuntimeException mir_rethrow(Throwable t) {
+        if (t instanceof RuntimeException) {
+            throw (RuntimeException) t;
+        }
+        if (t instanceof Error) {
+            throw (Error) t;
+        }
+        throw new RuntimeException(t);
     }
 
     private static void logWarning(String message) {
@@ -642,55 +1161,147 @@ public class Runtime {
         return argvAddr;
     }
 
-    public long memcpy(long destAddr, long srcAddr, long size) {
-        System.arraycopy(memory, (int) srcAddr, memory, (int) destAddr, (int) size);
-        return destAddr;
+    /*
+     * The string and memory functions below replace the byte loops of a C libc:
+     * m2j drops the definitions of these names in the translated program. They
+     * work on the runs of bytes lying in one array, the whole flat memory or a
+     * page, with BulkMemory scans and System.arraycopy / Arrays.fill.
+     */
+
+    /* The array holding addr: the memory or its page, also used by StdlibRuntime I/O */
+    byte[] block(long addr) {
+        return pages == null ? memory : page(addr);
     }
 
-    public long memset(long addr, int value, long count) {
-        int intCount = (int) count;
-        byte v = (byte) (value & 0xFF);
-        int intAddr = (int) addr;
-        for (int i = 0; i < intCount; i++) {
-            memory[intAddr + i] = v;
-        }
-        return addr;
+    int blockOffset(long addr) {
+        return pages == null ? (int) addr : (int) addr & PAGE_MASK;
     }
 
-    public long strlen(long longAddr) {
-        int addr = (int) longAddr;
-        int endCharIndex = 0;
-        while (true) {
-            char c = (char) memory[addr + endCharIndex];
-            if (c == '\0') {
-                break;
-            }
-            endCharIndex++;
+    /* Returns the number of the n bytes at addr which lie in block(addr) */
+    int blockRun(long addr, long n) {
+        long run = pages == null ? memory.length - addr : PAGE_SIZE - ((int) addr & PAGE_MASK);
+        if (run <= 0 || addr < 0) {
+            throw new ArrayIndexOutOfBoundsException("Address out of memory: " + addr);
         }
-        return endCharIndex;
+        return (int) Math.min(n, run);
+    }
+
+    public long memcpy(long destAddr, long srcAddr, long size) {
+        mir_copy_memory(srcAddr, destAddr, size);
+        return destAddr;
+    }
+
+    public long memmove(long destAddr, long srcAddr, long size) {
+        mir_copy_memory(srcAddr, destAddr, size);
+        return destAddr;
+    }
+
+    public long memset(long addr, int value, long count) {
+        mir_fill_memory(addr, count, (byte) value);
+        return addr;
+    }
+
+    public long memchr(long addr, int c, long n) {
+        while (n > 0) {
+            int offset = blockOffset(addr);
+            int len = blockRun(addr, n);
+            int i = BulkMemory.indexOf(block(addr), offset, offset + len, (byte) c);
+            if (i >= 0) {
+                return addr + (i - offset);
+            }
+            addr += len;
+            n -= len;
+        }
+        return 0;
+    }
+
+    public int memcmp(long addr1, long addr2, long n) {
+        while (n > 0) {
+            int len = Math.min(blockRun(addr1, n), blockRun(addr2, n));
+            byte[] a = block(addr1);
+            byte[] b = block(addr2);
+            int offset1 = blockOffset(addr1);
+            int offset2 = blockOffset(addr2);
+            int i = BulkMemory.mismatch(a, offset1, b, offset2, len);
+            if (i >= 0) {
+                return (a[offset1 + i] & 0xFF) - (b[offset2 + i] & 0xFF);
+            }
+            addr1 += len;
+            addr2 += len;
+            n -= len;
+        }
+        return 0;
+    }
+
+    public long strlen(long addr) {
+        return stringLength(addr);
+    }
+
+    private long stringLength(long addr) {
+        long start = addr;
+        while (true) {
+            int offset = blockOffset(addr);
+            int len = blockRun(addr, Long.MAX_VALUE);
+            int i = BulkMemory.indexOf(block(addr), offset, offset + len, (byte) 0);
+            if (i >= 0) {
+                return addr + (i - offset) - start;
+            }
+            addr += len;
+        }
+    }
+
+    public long strchr(long addr, int c) {
+        while (true) {
+            int offset = blockOffset(addr);
+            int len = blockRun(addr, Long.MAX_VALUE);
+            byte[] a = block(addr);
+            int i = BulkMemory.indexOfOrZero(a, offset, offset + len, (byte) c);
+            if (i >= 0) {
+                return a[i] == (byte) c ? addr + (i - offset) : 0;
+            }
+            addr += len;
+        }
+    }
+
+    public int strcmp(long addr1, long addr2) {
+        return strncmp(addr1, addr2, Long.MAX_VALUE);
+    }
+
+    public int strncmp(long addr1, long addr2, long n) {
+        while (n > 0) {
+            int len = Math.min(blockRun(addr1, n), blockRun(addr2, n));
+            byte[] a = block(addr1);
+            byte[] b = block(addr2);
+            int offset1 = blockOffset(addr1);
+            int offset2 = blockOffset(addr2);
+            int i = BulkMemory.stringMismatch(a, offset1, b, offset2, len);
+            if (i >= 0) {
+                return (a[offset1 + i] & 0xFF) - (b[offset2 + i] & 0xFF);
+            }
+            addr1 += len;
+            addr2 += len;
+            n -= len;
+        }
+        return 0;
     }
 
     public long strcpy(long destAddr, long srcAddr) {
-        int dAddr = (int) destAddr;
-        int sAddr = (int) srcAddr;
-        int i = 0;
-        byte v;
-        do {
-            v = memory[sAddr + i];
-            memory[dAddr + i] = v;
-            i++;
-        } while (v != '\0');
-        return dAddr;
+        mir_copy_memory(srcAddr, destAddr, stringLength(srcAddr) + 1);
+        return destAddr;
+    }
+
+    public long strcat(long destAddr, long srcAddr) {
+        strcpy(destAddr + stringLength(destAddr), srcAddr);
+        return destAddr;
     }
 
-    public int printf(long addr, Object... args) {
-        String s = getStringFromMemory(addr);
-        String convertedFormat = convertPrintfFormat(s);
-        System.out.printf(convertedFormat, args);
-        return 1;
+    public int printf(long formatAddr, long vaArea) {
+        String s = mir_va_format(formatAddr, vaArea);
+        mir_stdout.print(s);
+        return s.length();
     }
 
-    public long fprintf(long id, Object... args) {
+    public int fprintf(long stream, long formatAddr, long vaArea) {
         logWarning("fprintf: not implemented yet");
         // TODO Auto-generated method stub
         return 0;
@@ -732,16 +1343,9 @@ public class Runtime {
         return 0;
     }
 
-    private String convertPrintfFormat(String format) {
-        format = format.replaceAll("%i", "%d");
-        return format;
-    }
-
-    public int sprintf(long bufferAddr, long stringAddr, Object... args) {
-        String inputString = getStringFromMemory(stringAddr);
+    public int sprintf(long bufferAddr, long formatAddr, long vaArea) {
         try {
-            String convertedFormat = convertPrintfFormat(inputString);
-            String outputString = String.format(convertedFormat, args);
+            String outputString = mir_va_format(formatAddr, vaArea);
             writeCStringInMemoryFromJavaString(bufferAddr, outputString.getBytes());
             return outputString.length();
         } catch (IllegalFormatException e) {
@@ -751,13 +1355,9 @@ public class Runtime {
         }
     }
 
-    public int vsprintf(long bufferAddr, long stringAddr, long va_listAddress) {
-        // System.out.println("[WARNING] vsprintf: not implemented yet");
-        String inputString = getStringFromMemory(stringAddr);
+    public int vsprintf(long bufferAddr, long formatAddr, long va_listAddress) {
         try {
-            String convertedFormat = convertPrintfFormat(inputString);
-            VarArgs varArgs = mir_va_get_wrapper(va_listAddress);
-            String outputString = String.format(convertedFormat, varArgs.getAllArgs());
+            String outputString = mir_va_format(formatAddr, mir_read_long(va_listAddress));
             writeCStringInMemoryFromJavaString(bufferAddr, outputString.getBytes());
             return outputString.length();
         } catch (IllegalFormatException e) {
@@ -767,9 +1367,21 @@ public class Runtime {
         }
     }
 
+    /**
+     * Called by the translated code for setjmp: stores a new token and the stack
+     * position in the jmp_buf and returns the token. The caller keeps the token
+     * and catches the JmpException of a longjmp on it to resume after the setjmp.
+     */
+    public final long mir_setjmp(long jumpBufferAddress) {
+        long token = ++jmpTokenCount;
+        mir_write_long(jumpBufferAddress, token);
+        mir_write_long(jumpBufferAddress + 8, stackPosition);
+        return token;
+    }
+
+    /* Only reached through a function pointer: the caller can not resume after it */
     public long _setjmp(long jumpBufferAddress) {
-        logWarning("_setjmp: not implemented yet");
-        // TODO Auto-generated method stub
+        mir_setjmp(jumpBufferAddress);
         return 0;
     }
 
@@ -777,22 +1389,619 @@ public class Runtime {
         return _setjmp(jumpBufferAddress);
     }
 
+    /* Unwinds to the function which called setjmp on jumpBufferAddress */
     public void _longjmp(long jumpBufferAddress, int val) {
-        logWarning("_longjmp: not implemented yet");
-        // TODO Auto-generated method stub
+        jmpException.token = mir_read_long(jumpBufferAddress);
+        jmpException.value = val == 0 ? 1 : val;
+        stackPosition = (int) mir_read_long(jumpBufferAddress + 8);
+        throw jmpException;
     }
 
     public void longjmp(long jumpBufferAddress, int val) {
         _longjmp(jumpBufferAddress, val);
     }
 
+    /* Atomic operations of stdatomic.h on the object of size bytes at addr */
+    public long mir_atomic_load(long addr, int size, int order) {
+        if (pages == null) {
+            return Atomics.load(memory, (int) addr, size, order);
+        }
+        return Atomics.load(page(addr), (int) addr & PAGE_MASK, size, order);
+    }
+
+    public void mir_atomic_store(long addr, long v, int size, int order) {
+        if (pages == null) {
+            Atomics.store(memory, (int) addr, v, size, order);
+        } else {
+            Atomics.store(page(addr), (int) addr & PAGE_MASK, v, size, order);
+        }
+    }
+
+    public long mir_atomic_exchange(long addr, long v, int size, int order) {
+        return mir_atomic_fetch_op(addr, v, size, Atomics.SET, order);
+    }
+
+    /* op is 0 for add, 1 sub, 2 or, 3 xor and 4 and */
+    public long mir_atomic_fetch_op(long addr, long v, int size, int op, int order) {
+        if (pages == null) {
+            return Atomics.fetchOp(memory, (int) addr, v, size, op);
+        }
+        return Atomics.fetchOp(page(addr), (int) addr & PAGE_MASK, v, size, op);
+    }
+
+    /* Returns 1 if the object was equal to *expectedAddr, else stores the object in it and returns 0 */
+    public int mir_atomic_compare_exchange(long addr, long expectedAddr, long desired, int size, int success,
+            int failure) {
+        long expected;
+        switch (size) {
+        case 1:
+            expected = mir_read_ubyte(expectedAddr);
+            break;
+        case 2:
+            expected = mir_read_ushort(expectedAddr);
+            break;
+        case 4:
+            expected = mir_read_uint(expectedAddr);
+            break;
+        default:
+            expected = mir_read_long(expectedAddr);
+        }
+        long old = pages == null ? Atomics.compareAndExchange(memory, (int) addr, expected, desired, size)
+                : Atomics.compareAndExchange(page(addr), (int) addr & PAGE_MASK, expected, desired, size);
+        if (old == expected) {
+            return 1;
+        }
+        switch (size) {
+        case 1:
+            mir_write_byte(expectedAddr, old);
+            break;
+        case 2:
+            mir_write_short(expectedAddr, old);
+            break;
+        case 4:
+            mir_write_int(expectedAddr, old);
+            break;
+        default:
+            mir_write_long(expectedAddr, old);
+        }
+        return 0;
+    }
+
+    public void atomic_thread_fence(int order) {
+        Atomics.fence(order);
+    }
+
+    /* Java has no signal handlers running in the thread */
+    public void atomic_signal_fence(int order) {
+    }
+
+    /*
+     * C11 threads. A thread runs the C function in a clone of this Runtime with
+     * its own stack of mir2j.threadStackSize bytes allocated from the heap, so it
+     * can only be created while the heap has room for it. Mutexes, conditions and
+     * tss keys are Java objects of threadObjects: the C objects only store their
+     * index + 1.
+     */
+    private static final int THRD_SUCCESS = 0;
+    private static final int THRD_BUSY = 1;
+    private static final int THRD_ERROR = 2;
+    private static final int THRD_NOMEM = 3;
+    private static final int THRD_TIMEDOUT = 4;
+    private static final int TSS_DTOR_ITERATIONS = 4;
+    private static final MethodType THREAD_START_TYPE = MethodType.methodType(int.class, long.class);
+    private static final MethodType ONCE_FUNCTION_TYPE = MethodType.methodType(void.class);
+    private static final MethodType TSS_DTOR_TYPE = MethodType.methodType(void.class, long.class);
+
+    private static final class TssKey {
+        final ThreadLocal<Long> value = new ThreadLocal<>();
+        final long dtor;
+
+        TssKey(long dtor) {
+            this.dtor = dtor;
+        }
+    }
+
+    /*
+     * Called under the lock of root before the first thread: from now the arrays
+     * of the memory are shared by the contexts, so they are never replaced.
+     */
+    private void startThreads() {
+        if (pages == null) {
+            heapLimit = Math.min(heapLimit, memorySize - CHUNK_OVERHEAD);
+        } else {
+            heapLimit = Math.min(heapLimit, ((long) pages.length << PAGE_SHIFT) - CHUNK_OVERHEAD);
+        }
+        if (functionHandles == null) {
+            initFunctionTable();
+        }
+        threaded = true;
+    }
+
+    /* Returns a context running on the stack of size bytes at addr, or null */
+    private Runtime newThreadContext(long addr, long size) {
+        Runtime context;
+        try {
+            context = (Runtime) clone();
+        } catch (CloneNotSupportedException e) {
+            throw new RuntimeException(e);
+        }
+        context.threadStack = addr;
+        context.stackLimit = (int) ((addr + STACK_ALIGN - 1) & -STACK_ALIGN);
+        context.stackTop = (int) ((addr + size) & -STACK_ALIGN);
+        context.stackPosition = context.stackTop;
+        context.stackCommitted = context.stackLimit;
+        context.jmpException = new JmpException();
+        context.jmpTokenCount = 0;
+        // Function handles are bound to their context
+        context.functionMap = new FunctionMap();
+        context.functionHandles = new MethodHandle[functionHandles.length];
+        for (int i = 0; i < functionCount; i++) {
+            MethodHandle methodHandle = new MethodHandle(functionHandles[i].getAddress(), functionHandles[i].getName());
+            context.functionHandles[i] = methodHandle;
+            context.functionMap.put(methodHandle.getName(), methodHandle);
+        }
+        return context;
+    }
+
+    public int thrd_create(long thrAddr, long func, long arg) {
+        long stackSize = (sizeProperty("mir2j.threadStackSize", DEFAULT_THREAD_STACK_SIZE) + STACK_ALIGN - 1) & -STACK_ALIGN;
+        Runtime context;
+        checkProgramExit();
+        synchronized (root) {
+            if (!threaded) {
+                startThreads();
+            }
+            long stack = root.heapMalloc(stackSize);
+            if (stack == 0) {
+                return THRD_NOMEM;
+            }
+            if (stack + stackSize > Integer.MAX_VALUE) {
+                // Stack positions are ints
+                root.heapFree(stack);
+                return THRD_NOMEM;
+            }
+            context = newThreadContext(stack, stackSize);
+            context.threadId = ++root.lastThreadId;
+        }
+        final Runtime c = context;
+        context.thread = new Thread(() -> c.runThread(func, arg), "mir2j-thread-" + context.threadId);
+        threads.put(context.threadId, context);
+        runningThreads.add(context);
+        mir_write_long(thrAddr, context.threadId);
+        context.thread.start();
+        return THRD_SUCCESS;
+    }
+
+    private void runThread(long func, long arg) {
+        try {
+            threadResult = (int) mir_get_function_handle(func, THREAD_START_TYPE).invokeExact(arg);
+        } catch (ThreadExit e) {
+            threadResult = e.result;
+        } catch (ExitException e) {
+            threadResult = e.status;
+            exitProgram(e.status);
+        } catch (Throwable t) {
+            throw mir_rethrow(t);
+        } finally {
+            try {
+                runTssDestructors();
+            } finally {
+                mir_stdout.flush();
+                synchronized (this) {
+                    threadFinished = true;
+                    if (threadDetached) {
+                        free(threadStack);
+                    }
+                }
+                runningThreads.remove(this);
+            }
+        }
+    }
+
+    /*
+     * Called by exit in any thread: as in C, it ends the whole program. The first
+     * status is kept for mir_main, and the other threads are interrupted, so that
+     * they end with an ExitException in their next blocking call (thrd_join,
+     * mtx_lock, cnd_wait, thrd_sleep...), see checkProgramExit.
+     */
+    private void exitProgram(int status) {
+        synchronized (root) {
+            if (root.exiting) {
+                return;
+            }
+            root.exitStatus = status;
+            root.exiting = true;
+        }
+        Thread current = Thread.currentThread();
+        for (Runtime context : runningThreads) {
+            if (context.thread != current) {
+                context.thread.interrupt();
+            }
+        }
+        if (root.mainThread != null && root.mainThread != current) {
+            root.mainThread.interrupt();
+        }
+    }
+
+    /* Ends the calling thread once another thread called exit */
+    private void checkProgramExit() {
+        if (root.exiting) {
+            throw new ExitException(root.exitStatus);
+        }
+    }
+
+    /* Called by mir_main at the exit of main: waits for the other threads and returns the program status */
+    private int endProgram(int status) {
+        if (!threaded) {
+            return status;
+        }
+        exitProgram(status);
+        boolean interrupted = Thread.interrupted();
+        for (Runtime context : runningThreads) {
+            while (true) {
+                try {
+                    context.thread.join();
+                    break;
+                } catch (InterruptedException e) {
+                    interrupted = true;
+                }
+            }
+        }
+        if (interrupted) {
+            Thread.currentThread().interrupt();
+        }
+        return exitStatus;
+    }
+
+    private void runTssDestructors() {
+        for (int i = 0; i < TSS_DTOR_ITERATIONS; i++) {
+            boolean called = false;
+            for (Object object : threadObjects) {
+                if (object instanceof TssKey && ((TssKey) object).dtor != 0) {
+                    TssKey key = (TssKey) object;
+                    Long value = key.value.get();
+                    if (value != null && value != 0) {
+                        key.value.remove();
+                        try {
+                            mir_get_function_handle(key.dtor, TSS_DTOR_TYPE).invokeExact((long) value);
+                        } catch (Throwable t) {
+                            throw mir_rethrow(t);
+                        }
+                        called = true;
+                    }
+                }
+            }
+            if (!called) {
+                break;
+            }
+        }
+    }
+
+    public long thrd_current() {
+        return threadId;
+    }
+
+    public int thrd_equal(long thr0, long thr1) {
+        return thr0 == thr1 ? 1 : 0;
+    }
+
+    public int thrd_join(long thr, long resAddr) {
+        Runtime context = threads.remove(thr);
+        if (context == null) {
+            return THRD_ERROR;
+        }
+        try {
+            context.thread.join();
+        } catch (InterruptedException e) {
+            threads.put(thr, context);
+            checkProgramExit();
+            Thread.currentThread().interrupt();
+            return THRD_ERROR;
+        }
+        checkProgramExit();
+        if (resAddr != 0) {
+            mir_write_int(resAddr, context.threadResult);
+        }
+        free(context.threadStack);
+        return THRD_SUCCESS;
+    }
+
+    public int thrd_detach(long thr) {
+        Runtime context = threads.remove(thr);
+        if (context == null) {
+            return THRD_ERROR;
+        }
+        synchronized (context) {
+            context.threadDetached = true;
+            if (context.threadFinished) {
+                free(context.threadStack);
+            }
+        }
+        return THRD_SUCCESS;
+    }
+
+    public void thrd_exit(int res) {
+        throw new ThreadExit(res);
+    }
+
+    public void thrd_yield() {
+        Thread.yield();
+    }
+
+    public int thrd_sleep(long durationAddr, long remainingAddr) {
+        long nanos = mir_read_long(durationAddr) * 1000000000L + mir_read_long(durationAddr + 8);
+        long end = System.nanoTime() + nanos;
+        try {
+            if (nanos > 0) {
+                Thread.sleep(nanos / 1000000, (int) (nanos % 1000000));
+            }
+            return 0;
+        } catch (InterruptedException e) {
+            checkProgramExit();
+            Thread.currentThread().interrupt();
+            if (remainingAddr != 0) {
+                long remaining = Math.max(0, end - System.nanoTime());
+                mir_write_long(remainingAddr, remaining / 1000000000L);
+                mir_write_long(remainingAddr + 8, remaining % 1000000000L);
+            }
+            return -1;
+        }
+    }
+
+    public void call_once(long flagAddr, long func) {
+        if (mir_atomic_load(flagAddr, 4, Atomics.ACQUIRE) != 0) {
+            return;
+        }
+        synchronized (onceLock) {
+            if (mir_read_int(flagAddr) == 0) {
+                try {
+                    mir_get_function_handle(func, ONCE_FUNCTION_TYPE).invokeExact();
+                } catch (Throwable t) {
+                    throw mir_rethrow(t);
+                }
+                mir_atomic_store(flagAddr, 1, 4, Atomics.RELEASE);
+            }
+        }
+    }
+
+    /* Stores a new handle of object in the int at addr */
+    private void newThreadObject(long addr, Object object) {
+        int handle;
+        synchronized (threadObjects) {
+            threadObjects.add(object);
+            handle = threadObjects.size();
+        }
+        mir_write_int(addr, handle);
+    }
+
+    private Object getThreadObject(long handle) {
+        return handle <= 0 || handle > threadObjects.size() ? null : threadObjects.get((int) handle - 1);
+    }
+
+    private void deleteThreadObject(long handle) {
+        if (handle > 0 && handle <= threadObjects.size()) {
+            threadObjects.set((int) handle - 1, null);
+        }
+    }
+
+    /* Returns the nanoseconds from now to the TIME_UTC time in the timespec at addr */
+    private long nanosUntil(long timespecAddr) {
+        long deadline = mir_read_long(timespecAddr) * 1000000000L + mir_read_long(timespecAddr + 8);
+        return deadline - System.currentTimeMillis() * 1000000L;
+    }
+
+    /* All mutexes are recursive */
+    public int mtx_init(long mtxAddr, int type) {
+        newThreadObject(mtxAddr, new ReentrantLock());
+        return THRD_SUCCESS;
+    }
+
+    public void mtx_destroy(long mtxAddr) {
+        deleteThreadObject(mir_read_int(mtxAddr));
+    }
+
+    private ReentrantLock getMutex(long mtxAddr) {
+        Object object = getThreadObject(mir_read_int(mtxAddr));
+        return object instanceof ReentrantLock ? (ReentrantLock) object : null;
+    }
+
+    public int mtx_lock(long mtxAddr) {
+        ReentrantLock lock = getMutex(mtxAddr);
+        if (lock == null) {
+            return THRD_ERROR;
+        }
+        try {
+            lock.lockInterruptibly();
+        } catch (InterruptedException e) {
+            checkProgramExit();
+            Thread.currentThread().interrupt();
+            lock.lock();
+        }
+        return THRD_SUCCESS;
+    }
+
+    public int mtx_trylock(long mtxAddr) {
+        ReentrantLock lock = getMutex(mtxAddr);
+        if (lock == null) {
+            return THRD_ERROR;
+        }
+        return lock.tryLock() ? THRD_SUCCESS : THRD_BUSY;
+    }
+
+    public int mtx_timedlock(long mtxAddr, long timespecAddr) {
+        ReentrantLock lock = getMutex(mtxAddr);
+        if (lock == null) {
+            return THRD_ERROR;
+        }
+        try {
+            return lock.tryLock(nanosUntil(timespecAddr), TimeUnit.NANOSECONDS) ? THRD_SUCCESS : THRD_TIMEDOUT;
+        } catch (InterruptedException e) {
+            checkProgramExit();
+            Thread.currentThread().interrupt();
+            return THRD_ERROR;
+        }
+    }
+
+    public int mtx_unlock(long mtxAddr) {
+        ReentrantLock lock = getMutex(mtxAddr);
+        if (lock == null || !lock.isHeldByCurrentThread()) {
+            return THRD_ERROR;
+        }
+        lock.unlock();
+        return THRD_SUCCESS;
+    }
+
+    /*
+     * A condition is a Java monitor: the mutex is released while holding it, so
+     * a signal can not be lost before the wait, and taken again after it.
+     */
+    private static final class Condition {
+    }
+
+    public int cnd_init(long cndAddr) {
+        newThreadObject(cndAddr, new Condition());
+        return THRD_SUCCESS;
+    }
+
+    public void cnd_destroy(long cndAddr) {
+        deleteThreadObject(mir_read_int(cndAddr));
+    }
+
+    private Condition getCondition(long cndAddr) {
+        Object object = getThreadObject(mir_read_int(cndAddr));
+        return object instanceof Condition ? (Condition) object : null;
+    }
+
+    public int cnd_signal(long cndAddr) {
+        Condition condition = getCondition(cndAddr);
+        if (condition == null) {
+            return THRD_ERROR;
+        }
+        synchronized (condition) {
+            condition.notify();
+        }
+        return THRD_SUCCESS;
+    }
+
+    public int cnd_broadcast(long cndAddr) {
+        Condition condition = getCondition(cndAddr);
+        if (condition == null) {
+            return THRD_ERROR;
+        }
+        synchronized (condition) {
+            condition.notifyAll();
+        }
+        return THRD_SUCCESS;
+    }
+
+    public int cnd_wait(long cndAddr, long mtxAddr) {
+        return waitCondition(cndAddr, mtxAddr, -1);
+    }
+
+    public int cnd_timedwait(long cndAddr, long mtxAddr, long timespecAddr) {
+        return waitCondition(cndAddr, mtxAddr, Math.max(1, nanosUntil(timespecAddr)));
+    }
+
+    /* Waits at most nanos if nanos >= 0 */
+    private int waitCondition(long cndAddr, long mtxAddr, long nanos) {
+        Condition condition = getCondition(cndAddr);
+        ReentrantLock lock = getMutex(mtxAddr);
+        if (condition == null || lock == null || !lock.isHeldByCurrentThread()) {
+            return THRD_ERROR;
+        }
+        long end = System.nanoTime() + nanos;
+        int result = THRD_SUCCESS;
+        try {
+            synchronized (condition) {
+                lock.unlock();
+                if (nanos < 0) {
+                    condition.wait();
+                } else {
+                    condition.wait(nanos / 1000000, (int) (nanos % 1000000));
+                }
+            }
+        } catch (InterruptedException e) {
+            checkProgramExit();
+            Thread.currentThread().interrupt();
+            result = THRD_ERROR;
+        } finally {
+            lock.lock();
+        }
+        if (result == THRD_SUCCESS && nanos >= 0 && System.nanoTime() - end >= 0) {
+            result = THRD_TIMEDOUT;
+        }
+        return result;
+    }
+
+    public int tss_create(long keyAddr, long dtor) {
+        newThreadObject(keyAddr, new TssKey(dtor));
+        return THRD_SUCCESS;
+    }
+
+    public void tss_delete(long key) {
+        deleteThreadObject(key);
+    }
+
+    public long tss_get(long key) {
+        Object object = getThreadObject(key);
+        Long value = object instanceof TssKey ? ((TssKey) object).value.get() : null;
+        return value == null ? 0 : value;
+    }
+
+    public int tss_set(long key, long value) {
+        Object object = getThreadObject(key);
+        if (!(object instanceof TssKey)) {
+            return THRD_ERROR;
+        }
+        ((TssKey) object).value.set(value);
+        return THRD_SUCCESS;
+    }
+
+    /* Redirects the standard streams of this program, System ones by default */
+    public final void mir_set_std_streams(InputStream in, PrintStream out, PrintStream err) {
+        mir_stdin = in;
+        mir_stdout = out;
+        mir_stderr = err;
+    }
+
+    /**
+     * Runs the C main with argv = {progName, args...} and returns its result or
+     * the status given to exit.
+     */
+    public final int mir_main(String progName, String[] args) {
+        Method main = getDeclaredMethodRecursive(getClass(), "main");
+        if (main == null) {
+            throw new RuntimeException("Function 'main' was not found.");
+        }
+        main.setAccessible(true);
+        mainThread = Thread.currentThread();
+        try {
+            Object result = main.getParameterTypes().length == 0 ? main.invoke(this)
+                    : main.invoke(this, args.length + 1, makeArgv(progName, args));
+            int status = result instanceof Integer ? (Integer) result : 0;
+            exit(status); // As in C, returning from main calls exit, which flushes the libc.c streams
+            return status;
+        } catch (ExitException e) {
+            mir_stdout.flush();
+            return endProgram(e.status);
+        } catch (InvocationTargetException e) {
+            mir_stdout.flush();
+            if (e.getCause() instanceof ExitException) {
+                return endProgram(((ExitException) e.getCause()).status);
+            }
+            throw mir_rethrow(e.getCause());
+        } catch (IllegalAccessException e) {
+            throw new RuntimeException("Can't access function 'main'", e);
+        }
+    }
+
     public void abort() {
-        System.out.println("aborting...");
-        System.exit(1);
+        mir_stderr.println("aborting...");
+        throw new ExitException(1);
     }
 
     public void exit(int v) {
-        System.exit(v);
+        throw new ExitException(v);
     }
 
     public float ceilf(float value) {
@@ -807,110 +2016,101 @@ public class Runtime {
 
 }
 
+/* Thrown by thrd_exit to end the current thread with its result */
+class ThreadExit extends RuntimeException {
+
+    private static final long serialVersionUID = 1L;
+
+    final int result;
+
+    ThreadExit(int result) {
+        this.result = result;
+    }
+
+    @Override
+    public synchronized Throwable fillInStackTrace() {
+        return this;
+    }
+
+}
+
 class FunctionMap {
 
-    private Map<Object, MethodHandle> map = new HashMap<Object, MethodHandle>();
+    private Map<String, MethodHandle> map = new HashMap<String, MethodHandle>();
 
     public void put(String functionName, MethodHandle methodHandle) {
         map.put(functionName, methodHandle);
-        map.put(methodHandle.getAddress(), methodHandle);
     }
 
     public MethodHandle getMethodHandleByName(String functionName) {
         return map.get(functionName);
     }
 
-    public MethodHandle getMethodByAddress(int address) {
-        return map.get(address);
-    }
-
 }
 
 class MethodHandle {
 
-    private int address;
+    private long address;
+    private String name;
     private Method method;
+    private java.lang.invoke.MethodHandle boundHandle;
+    private java.lang.invoke.MethodHandle typedHandle;
 
-    public MethodHandle(int address, Method method) {
+    public MethodHandle(long address, String name) {
         this.address = address;
-        this.method = method;
+        this.name = name;
     }
 
     /**
      * @return the address
      */
-    public int getAddress() {
+    public long getAddress() {
         return address;
     }
 
     /**
-     * @return the method
-     */
-    public Method getMethod() {
-        return method;
-    }
-
-}
-
-class MemoryBlock {
-
-    int startAddress;
-    int endAddress;
-    int size;
-    boolean free;
-
-    public MemoryBlock(int startAddress, int size, boolean free) {
-        this.startAddress = startAddress;
-        this.size = size;
-        this.free = free;
-        endAddress = startAddress + size - 1;
-    }
-
-    /**
-     * @return the free
+     * @return the function name
      */
-    public boolean isFree() {
-        return free;
+    public String getName() {
+        return name;
     }
 
     /**
-     * @param free the free to set
+     * @return the method, looked up in the class of runtime on first use
      */
-    public void setFree(boolean free) {
-        this.free = free;
-    }
-
-    /**
-     * @return the startAddress
-     */
-    public int getStartAddress() {
-        return startAddress;
-    }
-
-    /**
-     * @return the endAddress
-     */
-    public int getEndAddress() {
-        return endAddress;
-    }
-
-    /**
-     * @return the size
-     */
-    public int getSize() {
-        return size;
+    public Method getMethod(Runtime runtime) {
+        if (method == null) {
+            Method m = Runtime.getDeclaredMethodRecursive(runtime.getClass(), name);
+            if (m == null) {
+                throw new RuntimeException("Function '" + name + "' was not found.");
+            }
+            // Allow reflective access to private methods
+            m.setAccessible(true);
+            method = m;
+        }
+        return method;
     }
 
     /**
-     * @param size the size to set
+     * @return a handle of the method bound to runtime, with its arguments and result
+     *         converted to type like C casts. The last adapted handle is cached.
      */
-    public void setSize(int size) {
-        this.size = size;
-    }
-
-    @Override
-    public String toString() {
-        return "MemoryBlock [startAddress=" + startAddress + ", endAddress=" + endAddress + ", size=" + size + ", free=" + free + "]";
+    public java.lang.invoke.MethodHandle getTypedHandle(Runtime runtime, MethodType type) {
+        java.lang.invoke.MethodHandle handle = typedHandle;
+        if (handle != null && handle.type().equals(type)) {
+            return handle;
+        }
+        if (boundHandle == null) {
+            try {
+                boundHandle = MethodHandles.lookup().unreflect(getMethod(runtime)).bindTo(runtime);
+            } catch (IllegalAccessException e) {
+                throw new RuntimeException("Can't access function '" + name + "'", e);
+            }
+        }
+        handle = MethodHandles.explicitCastArguments(boundHandle, type);
+        typedHandle = handle;
+        return handle;
     }
 
 }
+
@@ -23,6 +23,13 @@ SOFTWARE.
 */
 package mir2j;
 
+import java.io.ByteArrayInputStream;
+import java.io.ByteArrayOutputStream;
+import java.io.File;
+import java.io.IOException;
+import java.io.PrintStream;
+import java.nio.file.Files;
+
 public class RuntimeTest extends Runtime {
 
     public static final int SIEVE_SIZE = 819000;
@@ -31,8 +38,12 @@ public class RuntimeTest extends Runtime {
 //	public static final int SieveSize = 8190;
 //	public static final int Expected = 1027;
 
-    public RuntimeTest(int size) {
-       super(size);
+    public RuntimeTest(long stackSize, long heapSize) {
+       super(stackSize, heapSize, Long.MAX_VALUE);
+    }
+
+    public RuntimeTest(long stackSize, long heapSize, long maxHeapSize) {
+       super(stackSize, heapSize, maxHeapSize);
     }
 
     public void check(String testName, boolean success) {
@@ -220,6 +231,243 @@ public class RuntimeTest extends Runtime {
         check("double +Inf", Double.isInfinite(mir_read_double(addr + 24)) && mir_read_double(addr + 24) > 0);
     }
 
+    public void testMemoryAccessors() {
+        long addr = 512;
+
+        // Memory (VarHandle views) and the byte-wise accessors must agree (LE, unaligned)
+        Memory.write_int(memory, addr + 1, 0xA1B2C3D4);
+        check("Memory: int vs read_int", mir_read_int(addr + 1) == 0xA1B2C3D4);
+        check("Memory: uint", Memory.read_uint(memory, addr + 1) == 0xA1B2C3D4L);
+        mir_write_long(addr + 9, 0x0102030405060708L);
+        check("Memory: long vs write_long", Memory.read_long(memory, addr + 9) == 0x0102030405060708L);
+        Memory.write_short(memory, addr + 17, 0xABCD);
+        check("Memory: short vs read_short", mir_read_short(addr + 17) == (short) 0xABCD);
+        check("Memory: ushort", Memory.read_ushort(memory, addr + 17) == 0xABCD);
+        Memory.write_ubyte(memory, addr + 19, 0xFF);
+        check("Memory: byte", Memory.read_byte(memory, addr + 19) == -1);
+        check("Memory: ubyte", Memory.read_ubyte(memory, addr + 19) == 0xFF);
+        Memory.write_float(memory, addr + 21, 145.678f);
+        check("Memory: float vs read_float", mir_read_float(addr + 21) == 145.678f);
+        mir_write_double(addr + 25, Math.PI);
+        check("Memory: double vs write_double", Memory.read_double(memory, addr + 25) == Math.PI);
+    }
+
+    public void testLoadData() {
+        RuntimeTest r = new RuntimeTest(1 << 12, 1 << 16) {
+            @Override
+            protected int mir_data_size() {
+                return 16;
+            }
+        };
+        r.mir_load_data(new String[] { "A\u00ff", "\0\u0080" }, 16);
+        check("Data image: chunks", r.mir_read_ubyte(DATA_ADDRESS) == 'A' && r.mir_read_ubyte(DATA_ADDRESS + 1) == 0xFF
+                && r.mir_read_ubyte(DATA_ADDRESS + 2) == 0 && r.mir_read_ubyte(DATA_ADDRESS + 3) == 0x80);
+        check("Data image: zero tail", r.mir_read_long(DATA_ADDRESS + 8) == 0);
+        long sp = r.mir_allocate(1);
+        check("Data image: stack above", sp >= DATA_ADDRESS + 16 + GUARD_SIZE && sp < r.malloc(1));
+    }
+
+    public void testStack() {
+        RuntimeTest r = new RuntimeTest(4096, 1 << 12);
+        int top = r.mir_get_stack_position();
+        check("Stack: grows down aligned", r.mir_allocate(10) == top - 16);
+        check("Stack: full", r.mir_allocate(4096 - 16) == top - 4096);
+        boolean overflow = false;
+        try {
+            r.mir_allocate(1);
+        } catch (RuntimeException e) {
+            overflow = true;
+        }
+        check("Stack: overflow", overflow && r.mir_get_stack_position() == top - 4096);
+        r.mir_set_stack_position(top);
+        check("Stack: released", r.mir_allocate(16) == top - 16);
+
+        RuntimeTest p = new RuntimeTest(64 << 20, 0) {
+            @Override
+            protected boolean mir_paged_memory() {
+                return true;
+            }
+        };
+        top = p.mir_get_stack_position();
+        check("Paged stack: not allocated", p.pages[(top - 1) >>> PAGE_SHIFT] == null);
+        long a = p.mir_allocate(3 * PAGE_SIZE);
+        p.mir_write_byte(top - 1, 1);
+        p.mir_write_long(a, 42);
+        check("Paged stack: allocated once used", p.mir_read_long(a) == 42
+                && p.pages[(int) ((a - PAGE_SIZE) >>> PAGE_SHIFT)] == null);
+    }
+
+    private void jumpBack(long jumpBuffer, int v) {
+        longjmp(jumpBuffer, v);
+    }
+
+    public void testSetjmp() {
+        long jumpBuffer = malloc(16);
+        int top = mir_get_stack_position();
+        long token = mir_setjmp(jumpBuffer);
+        mir_allocate(64);
+        int v = 0;
+        try {
+            jumpBack(jumpBuffer, 0);
+        } catch (JmpException e) {
+            check("Setjmp: token", e.token == token);
+            v = e.value;
+        }
+        check("Setjmp: longjmp(0) returns 1", v == 1);
+        check("Setjmp: stack restored", mir_get_stack_position() == top);
+        check("Setjmp: new token", mir_setjmp(jumpBuffer) != token);
+        free(jumpBuffer);
+    }
+
+    public void testInstances() throws InterruptedException {
+        final RuntimeTest[] programs = { new RuntimeTest(1 << 16, 1 << 16), new RuntimeTest(1 << 16, 1 << 16) };
+        final long[] blocks = new long[2];
+        final ByteArrayOutputStream[] outs = new ByteArrayOutputStream[2];
+        final int[] status = new int[2];
+        Thread[] threads = new Thread[2];
+        for (int i = 0; i < 2; i++) {
+            final int n = i;
+            outs[n] = new ByteArrayOutputStream();
+            programs[n].mir_set_std_streams(System.in, new PrintStream(outs[n]), System.err);
+            threads[n] = new Thread() {
+                public void run() {
+                    RuntimeTest p = programs[n];
+                    blocks[n] = p.malloc(8);
+                    p.mir_write_long(blocks[n], 0);
+                    for (int k = 0; k < 100000; k++) {
+                        p.mir_write_long(blocks[n], p.mir_read_long(blocks[n]) + n + 1);
+                    }
+                    p.printf(p.mir_get_string_ptr("program " + n), 0);
+                    try {
+                        p.exit(n + 3);
+                    } catch (ExitException e) {
+                        status[n] = e.status;
+                    }
+                }
+            };
+            threads[n].start();
+        }
+        for (int i = 0; i < 2; i++) {
+            threads[i].join();
+        }
+        check("Instances: same address, separate memory", blocks[0] == blocks[1]
+                && programs[0].mir_read_long(blocks[0]) == 100000 && programs[1].mir_read_long(blocks[1]) == 200000);
+        check("Instances: separate stdout", outs[0].toString().equals("program 0") && outs[1].toString().equals("program 1"));
+        check("Instances: exit status", status[0] == 3 && status[1] == 4);
+    }
+
+    public void testAtomics() {
+        long a = malloc(16);
+        mir_write_long(a, 0);
+        mir_write_long(a + 8, 0);
+        mir_atomic_store(a, 0x1234, 8, 5);
+        check("Atomics: load/store", mir_atomic_load(a, 8, 2) == 0x1234 && mir_read_long(a) == 0x1234);
+        check("Atomics: fetch add", mir_atomic_fetch_op(a, 6, 8, 0, 5) == 0x1234 && mir_read_long(a) == 0x123a);
+        check("Atomics: exchange int", mir_atomic_exchange(a + 8, -1, 4, 5) == 0 && mir_read_int(a + 8) == -1);
+        // Sub-word objects do not change their neighbours
+        mir_write_int(a + 8, 0);
+        check("Atomics: fetch sub byte", mir_atomic_fetch_op(a + 9, 1, 1, 1, 5) == 0 && mir_read_int(a + 8) == 0xff00);
+        check("Atomics: fetch or short", mir_atomic_fetch_op(a + 10, 0x8001, 2, 2, 0) == 0
+                && mir_read_int(a + 8) == 0x8001ff00 && mir_atomic_load(a + 10, 2, 0) == 0x8001);
+        long expected = malloc(8);
+        mir_write_long(expected, 5);
+        check("Atomics: failed compare exchange", mir_atomic_compare_exchange(a, expected, 9, 8, 5, 5) == 0
+                && mir_read_long(expected) == 0x123a && mir_read_long(a) == 0x123a);
+        check("Atomics: compare exchange", mir_atomic_compare_exchange(a, expected, 9, 8, 5, 5) == 1
+                && mir_read_long(a) == 9);
+        mir_write_byte(expected, 0xff);
+        check("Atomics: compare exchange byte", mir_atomic_compare_exchange(a + 9, expected, 3, 1, 5, 5) == 1
+                && mir_read_int(a + 8) == 0x80010300);
+        atomic_thread_fence(5);
+        free(expected);
+        free(a);
+    }
+
+    private static final int THREAD_ITERATIONS = 10000;
+
+    /* Thread function of testThreads: arg points to a counter, a mutex and an atomic counter */
+    public int countThread(long arg) {
+        long local = mir_allocate(16);
+        for (int i = 0; i < THREAD_ITERATIONS; i++) {
+            mtx_lock(arg + 8);
+            mir_write_long(arg, mir_read_long(arg) + 1);
+            mtx_unlock(arg + 8);
+            mir_atomic_fetch_op(arg + 16, 1, 2, 0, 5);
+        }
+        mir_write_long(local, thrd_current());
+        return (int) mir_read_long(local);
+    }
+
+    public void testThreads() {
+        RuntimeTest p = new RuntimeTest(1 << 16, 1 << 22);
+        long func = p.mir_get_function_ptr("countThread");
+        long arg = p.malloc(24);
+        p.mir_write_long(arg, 0);
+        p.mir_write_long(arg + 16, 0);
+        p.mtx_init(arg + 8, 0);
+        long thr = p.malloc(4 * 8);
+        boolean created = true;
+        for (int i = 0; i < 4; i++) {
+            created &= p.thrd_create(thr + 8 * i, func, arg) == 0;
+        }
+        check("Threads: create", created);
+        long res = p.malloc(4);
+        boolean joined = true;
+        for (int i = 0; i < 4; i++) {
+            long id = p.mir_read_long(thr + 8 * i);
+            joined &= p.thrd_join(id, res) == 0 && p.mir_read_int(res) == id && id != p.thrd_current();
+        }
+        check("Threads: join", joined && p.thrd_join(p.mir_read_long(thr), 0) != 0);
+        check("Threads: mutex", p.mir_read_long(arg) == 4 * THREAD_ITERATIONS);
+        check("Threads: atomic", p.mir_atomic_load(arg + 16, 2, 5) == 4 * THREAD_ITERATIONS);
+        long key = p.malloc(4);
+        p.tss_create(key, 0);
+        p.tss_set(p.mir_read_uint(key), 42);
+        check("Threads: tss", p.tss_get(p.mir_read_uint(key)) == 42);
+        check("Threads: malloc after threads", p.malloc(1 << 16) != 0 && p.malloc(1 << 23) == 0);
+    }
+
+    /* Thread function of testThreadExit */
+    public int exitThread(long arg) {
+        exit(3);
+        return 0;
+    }
+
+    public void testThreadExit() {
+        RuntimeTest p = new RuntimeTest(1 << 16, 1 << 22) {
+            public int main() {
+                long thr = malloc(8);
+                if (thrd_create(thr, mir_get_function_ptr("exitThread"), 0) != 0) {
+                    return 1;
+                }
+                thrd_join(mir_read_long(thr), 0);
+                return 2; // Not reached, exit in the thread ends the program
+            }
+        };
+        check("Threads: exit in a thread", p.mir_main("exit", new String[0]) == 3);
+    }
+
+    public int twice(int v) {
+        return 2 * v;
+    }
+
+    public void testFunctionHandles() {
+        long twicePtr = mir_get_function_ptr("twice");
+        check("Function ptr: same address", mir_get_function_ptr("twice") == twicePtr);
+        check("Function ptr: outside data memory", twicePtr >= FUNCTION_ADDRESS_BASE);
+        try {
+            // int twice(int) called through an i64 (i64) call site
+            long r = (long) mir_get_function_handle(twicePtr,
+                    java.lang.invoke.MethodType.methodType(long.class, long.class)).invokeExact(21L);
+            check("Function handle: typed call", r == 42);
+            // Result ignored by a void call site
+            mir_get_function_handle(twicePtr, java.lang.invoke.MethodType.methodType(void.class, long.class)).invokeExact(1L);
+            check("Function handle: void call", true);
+        } catch (Throwable t) {
+            check("Function handle: " + t, false);
+        }
+    }
+
     public void testSetDataFamily() {
         // mir_set_data_longs
         long a = mir_set_data_longs(new long[] { 0, 12, 0, 46 });
@@ -255,6 +503,194 @@ public class RuntimeTest extends Runtime {
         check("C-string content", getStringFromMemory(p3).equals("world"));
     }
 
+    public void testMalloc() {
+        RuntimeTest r = new RuntimeTest(1 << 12, 1 << 16);
+        long a = r.malloc(100);
+        long b = r.malloc(100);
+        long c = r.malloc(3000);
+        check("malloc: aligned", a % 16 == 0 && b % 16 == 0 && c % 16 == 0);
+        check("malloc: distinct", b >= a + 100 && c >= b + 100);
+        r.free(b);
+        check("malloc: reuse freed chunk", r.malloc(90) == b);
+        r.free(a);
+        r.free(b);
+        // a and b are coalesced into one chunk
+        check("malloc: coalesce", r.malloc(150) == a);
+        long d = r.malloc(16);
+        r.mir_write_byte(d + 15, 42);
+        check("realloc: grow in place over free chunk", r.realloc(d, 32) == d);
+        check("realloc: shrink in place", r.realloc(c, 10) == c);
+        long e = r.malloc(4096); // Bigger than the free chunks: at the top
+        check("realloc: grow in place at top", r.realloc(e, 1 << 17) == e);
+        check("malloc: grows memory", r.memory.length > (1 << 17));
+        r.mir_write_byte(d + 15, 42);
+        long f = r.realloc(d, 5000);
+        check("realloc: move keeps content", f != d && r.mir_read_byte(f + 15) == 42);
+        long[] blocks = new long[1000];
+        for (int i = 0; i < blocks.length; i++) {
+            blocks[i] = r.malloc(i % 64 + 1);
+        }
+        for (int i = 0; i < blocks.length; i += 2) {
+            r.free(blocks[i]);
+        }
+        for (int i = 1; i < blocks.length; i += 2) {
+            r.free(blocks[i]);
+        }
+        r.free(r.realloc(e, 8));
+        r.free(f);
+        r.free(c);
+        r.free(a);
+        // Everything was coalesced into the top of the heap
+        check("malloc: all free", r.malloc(16) == a);
+        check("calloc: zeroed", r.mir_read_byte(r.calloc(4, 4) + 15) == 0);
+        r = new RuntimeTest(1 << 12, 1 << 12, 1 << 16);
+        check("malloc: max heap", r.malloc(1 << 15) != 0 && r.malloc(1 << 15) == 0);
+        long g = r.malloc(16);
+        check("realloc: max heap", r.realloc(g, 1 << 15) == 0 && r.realloc(g, 64) == g);
+    }
+
+    public void testSysio() {
+        StdlibRuntime r = new StdlibRuntime() {
+            @Override
+            protected boolean mir_paged_memory() {
+                return true;
+            }
+        };
+        ByteArrayOutputStream out = new ByteArrayOutputStream();
+        r.mir_set_std_streams(new ByteArrayInputStream("input".getBytes()), new PrintStream(out), System.err);
+        long a = r.malloc(2 * PAGE_SIZE);
+        long addr = (((a >>> PAGE_SHIFT) + 1) << PAGE_SHIFT) - 3; // Straddles two pages
+        for (int i = 0; i < 6; i++) {
+            r.mir_write_byte(addr + i, 'a' + i);
+        }
+        check("sysio: write across pages", r.mir_sysio_write(StdlibRuntime.FD_STDOUT, addr, 6) == 6
+                && out.toString().equals("abcdef"));
+        check("sysio: read up to the page end", r.mir_sysio_read(StdlibRuntime.FD_STDIN, addr, 5) == 3
+                && r.mir_read_byte(addr) == 'i' && r.mir_read_byte(addr + 2) == 'p' && r.mir_read_byte(addr + 3) == 'd');
+        check("sysio: read the rest", r.mir_sysio_read(StdlibRuntime.FD_STDIN, addr + 3, 5) == 2
+                && r.mir_read_byte(addr + 4) == 't' && r.mir_sysio_read(StdlibRuntime.FD_STDIN, addr, 5) == 0);
+        check("sysio: bad fd", r.mir_sysio_write(StdlibRuntime.FD_STDIN, addr, 1) < 0 && r.mir_sysio_read(42, addr, 1) < 0);
+        try {
+            r.mir_sys_exit(7);
+            check("sysio: exit", false);
+        } catch (ExitException e) {
+            check("sysio: exit", e.status == 7);
+        }
+    }
+
+    public void testMmap() throws IOException {
+        StdlibRuntime r = new StdlibRuntime() {
+            @Override
+            protected boolean mir_paged_memory() {
+                return true;
+            }
+        };
+        File file = File.createTempFile("mir2j", ".bin");
+        file.deleteOnExit();
+        byte[] content = new byte[PAGE_SIZE + 100];
+        for (int i = 0; i < content.length; i++) {
+            content[i] = (byte) (i * 7);
+        }
+        Files.write(file.toPath(), content);
+        int fd = r.mir_sysio_open(r.mir_get_string_ptr(file.getPath()), r.mir_get_string_ptr("r+"));
+        long length = 2L * PAGE_SIZE;
+        long addr = r.mir_sysio_mmap(length, 3, 0x01, fd, 0); // PROT_READ | PROT_WRITE, MAP_SHARED
+        check("mmap: file content", addr > 0 && r.mir_read_byte(addr + 3) == 21
+                && r.mir_read_byte(addr + PAGE_SIZE + 99) == content[PAGE_SIZE + 99]);
+        check("mmap: zeroed past end of file", r.mir_read_long(addr + content.length) == 0
+                && r.mir_read_byte(addr + length - 1) == 0);
+        long ro = r.mir_sysio_mmap(10, 1, 0x02, fd, PAGE_SIZE); // PROT_READ, MAP_PRIVATE at an offset
+        check("mmap: offset", ro > 0 && r.mir_read_byte(ro + 5) == content[PAGE_SIZE + 5]);
+        r.mir_write_byte(addr + PAGE_SIZE + 1, 'm');
+        check("mmap: msync", r.mir_sysio_msync(addr + PAGE_SIZE, 16, 4) == 0
+                && Files.readAllBytes(file.toPath())[PAGE_SIZE + 1] == 'm');
+        r.mir_write_byte(addr + 2, 'u');
+        r.mir_sysio_close_fd(fd);
+        check("mmap: munmap after close", r.mir_sysio_munmap(addr, length) == 0 && r.mir_sysio_munmap(ro, 10) == 0
+                && Files.readAllBytes(file.toPath())[2] == 'u' && file.length() == content.length);
+        check("mmap: unmapped", r.mir_sysio_munmap(addr, length) < 0 && r.mir_sysio_msync(addr, 1, 4) < 0);
+        long anonymous = r.mir_sysio_mmap(64, 3, 0x22, -1, 0); // MAP_PRIVATE | MAP_ANONYMOUS
+        check("mmap: anonymous", anonymous > 0 && r.mir_read_long(anonymous + 56) == 0
+                && r.mir_sysio_munmap(anonymous, 64) == 0);
+        check("mmap: bad fd", r.mir_sysio_mmap(64, 1, 0x02, 42, 0) < 0);
+    }
+
+    public void testSockets() {
+        StdlibRuntime r = new StdlibRuntime();
+        long sockaddr = r.malloc(16);
+        long length = r.malloc(4);
+        long buffer = r.malloc(64);
+        r.memset(sockaddr, 0, 16);
+        r.mir_write_short(sockaddr, 2); // AF_INET, 127.0.0.1:0
+        r.mir_write_int(sockaddr + 4, 0x0100007F);
+        int server = r.mir_sysio_socket(2, 1, 0); // AF_INET, SOCK_STREAM
+        check("sockets: bind/listen", r.mir_sysio_bind(server, sockaddr, 16) == 0 && r.mir_sysio_listen(server, 5) == 0);
+        r.mir_write_int(length, 16);
+        check("sockets: getsockname", r.mir_sysio_getsockname(server, sockaddr, length, 0) == 0
+                && r.mir_read_int(length) == 16 && r.mir_read_ushort(sockaddr + 2) != 0
+                && r.mir_read_int(sockaddr + 4) == 0x0100007F);
+        int client = r.mir_sysio_socket(2, 1, 0);
+        check("sockets: connect", r.mir_sysio_connect(client, sockaddr, 16) == 0);
+        r.mir_write_int(length, 16);
+        int connection = r.mir_sysio_accept(server, sockaddr, length);
+        check("sockets: accept", connection > 0 && r.mir_read_int(sockaddr + 4) == 0x0100007F);
+        long fds = r.malloc(8);
+        r.mir_write_int(fds, connection);
+        r.mir_write_short(fds + 4, 1); // POLLIN
+        check("sockets: poll timeout", r.mir_sysio_poll(fds, 1, 10) == 0 && r.mir_read_short(fds + 6) == 0);
+        r.mir_write_long(buffer, 0x6F6C6C6568L); // "hello"
+        check("sockets: write", r.mir_sysio_write(client, buffer, 5) == 5);
+        check("sockets: poll", r.mir_sysio_poll(fds, 1, -1) == 1 && r.mir_read_short(fds + 6) == 1);
+        check("sockets: read", r.mir_sysio_read(connection, buffer + 8, 64 - 8) == 5
+                && r.mir_read_long(buffer + 8) == 0x6F6C6C6568L);
+        check("sockets: non-blocking read", r.mir_sysio_fcntl(connection, 4, 04000) == 0 // F_SETFL, O_NONBLOCK
+                && r.mir_sysio_read(connection, buffer, 8) == -11); // EAGAIN
+        check("sockets: shutdown", r.mir_sysio_shutdown(client, 1) == 0 && r.mir_sysio_read(connection, buffer, 8) == 0);
+        check("sockets: close", r.mir_sysio_close_fd(connection) == 0 && r.mir_sysio_close_fd(client) == 0
+                && r.mir_sysio_close_fd(server) == 0 && r.mir_sysio_read(server, buffer, 8) < 0);
+        check("sockets: not a socket", r.mir_sysio_listen(StdlibRuntime.FD_STDOUT, 5) == -88 // ENOTSOCK
+                && r.mir_sysio_socket(10, 1, 0) < 0);
+        check("pipe", r.mir_sysio_pipe(fds) == 0 && r.mir_sysio_write(r.mir_read_int(fds + 4), buffer + 8, 5) == 5
+                && r.mir_sysio_read(r.mir_read_int(fds), buffer + 16, 8) == 5 && r.mir_read_byte(buffer + 20) == 'o');
+        check("pipe: close", r.mir_sysio_close_fd(r.mir_read_int(fds + 4)) == 0
+                && r.mir_sysio_read(r.mir_read_int(fds), buffer, 8) == 0 && r.mir_sysio_close_fd(r.mir_read_int(fds)) == 0);
+    }
+
+    public void testPagedMemory() {
+        RuntimeTest r = new RuntimeTest(1 << 12, 0) {
+            @Override
+            protected boolean mir_paged_memory() {
+                return true;
+            }
+        };
+        long a = r.malloc(3 * PAGE_SIZE);
+        long b = r.malloc(16);
+        check("paged: heap grows without copy", r.memory == null && b > a + 3 * PAGE_SIZE);
+        long addr = (((a >>> PAGE_SHIFT) + 1) << PAGE_SHIFT) - 3; // Straddles two pages
+        PagedMemory.write_long(r.pages, addr, 0x0102030405060708L);
+        check("paged: cross-page long", PagedMemory.read_long(r.pages, addr) == 0x0102030405060708L
+                && r.mir_read_byte(addr + 3) == 0x05 && PagedMemory.read_int(r.pages, addr + 2) == 0x03040506);
+        PagedMemory.write_double(r.pages, addr + 4, 1.5);
+        check("paged: cross-page double", r.mir_read_double(addr + 4) == 1.5);
+        r.memset(a, 'x', 2 * PAGE_SIZE + 10);
+        r.mir_write_byte(a + 2 * PAGE_SIZE + 10, 0);
+        check("paged: memset/strlen across pages", r.strlen(a) == 2 * PAGE_SIZE + 10);
+        r.mir_write_byte(a + PAGE_SIZE + 2, 'y');
+        check("paged: memchr/strchr across pages", r.memchr(a + 5, 'y', 2 * PAGE_SIZE) == a + PAGE_SIZE + 2
+                && r.strchr(a + PAGE_SIZE - 3, 'y') == a + PAGE_SIZE + 2);
+        r.memset(b, 'x', 16);
+        r.mir_write_byte(b + 15, 0);
+        check("paged: strcmp/memcmp across pages", r.strcmp(a + PAGE_SIZE - 7, b) == 'y' - 'x'
+                && r.memcmp(a + 2 * PAGE_SIZE - 7, b, 15) == 0);
+        r.mir_write_long(a + PAGE_SIZE - 4, 42);
+        r.mir_copy_memory(a + PAGE_SIZE - 4, a + 2 * PAGE_SIZE - 4, PAGE_SIZE);
+        check("paged: copy", r.mir_read_long(a + 2 * PAGE_SIZE - 4) == 42);
+        r.mir_copy_memory(a + PAGE_SIZE - 4, a + PAGE_SIZE, PAGE_SIZE);
+        check("paged: overlapping copy", r.mir_read_long(a + PAGE_SIZE + 4) == 42);
+        r.free(a);
+        check("paged: free", r.malloc(PAGE_SIZE) == a);
+    }
+
     public void testStdlibBasics() {
         long addr = malloc(60);
         mir_write_byte(addr + 25, 89);
@@ -287,24 +723,61 @@ public class RuntimeTest extends Runtime {
         check("stdlib: memcpy C-string", getStringFromMemory(dst).equals("abcd"));
     }
 
+    public void testStringIntrinsics() {
+        long s = mir_get_string_ptr("the quick brown fox jumps over the lazy dog");
+        check("intrinsics: strlen", strlen(s) == 43 && strlen(s + 40) == 3);
+        check("intrinsics: memchr", memchr(s, 'z', 43) == s + 37 && memchr(s, 'z', 37) == 0);
+        check("intrinsics: strchr", strchr(s, 'j') == s + 20 && strchr(s, 'Q') == 0 && strchr(s, 0) == s + 43);
+        long t = mir_get_string_ptr("the quick brown fox jumps over the lazy cat");
+        check("intrinsics: strcmp", strcmp(s, s) == 0 && strcmp(s, t) == 'd' - 'c' && strcmp(t, s) < 0);
+        check("intrinsics: strncmp", strncmp(s, t, 40) == 0 && strncmp(s, t, 41) > 0);
+        long u = mir_get_string_ptr("the");
+        check("intrinsics: strcmp prefix", strcmp(u, s) < 0 && strcmp(s, u) == ' ');
+        long buf = malloc(64);
+        memset(buf, 0x80, 64);
+        mir_write_byte(buf + 63, 0x7F);
+        long buf2 = malloc(64);
+        memcpy(buf2, buf, 64);
+        check("intrinsics: memcmp", memcmp(buf, buf2, 64) == 0);
+        mir_write_byte(buf2 + 50, 0xFF);
+        check("intrinsics: memcmp unsigned", memcmp(buf, buf2, 64) == 0x80 - 0xFF && memcmp(buf, buf2, 50) == 0);
+        strcpy(buf, u);
+        strcat(buf, mir_get_string_ptr(" end"));
+        check("intrinsics: strcpy/strcat", getStringFromMemory(buf).equals("the end"));
+        memmove(buf + 1, buf, 7);
+        check("intrinsics: memmove", getStringFromMemory(buf).equals("tthe end"));
+        free(buf);
+        free(buf2);
+    }
+
     public void testSprintfVariants() {
         // sprintf
         long buf = malloc(64);
-        long fmt = mir_get_string_ptr("x=%d y=%u z=%X");
-        int n = sprintf(buf, fmt, -3, 300L, 0xABCD);
+        long fmt = mir_get_string_ptr("x=%d y=%u z=%X s=%s f=%.2f");
+        int saved = mir_get_stack_position();
+        long area = mir_allocate(5 * VA_SLOT_SIZE);
+        mir_write_long(area, -3);
+        mir_write_long(area + 8, 300);
+        mir_write_long(area + 16, 0xABCD);
+        mir_write_long(area + 24, mir_get_string_ptr("str"));
+        mir_write_double(area + 32, 1.5);
+        int n = sprintf(buf, fmt, area);
         check("sprintf length>0", n > 0);
         String out = getStringFromMemory(buf);
-        check("sprintf content", out.equals(String.format("x=%d y=%d z=%X", -3, 300, 0xABCD)));
+        check("sprintf content", out.equals("x=-3 y=300 z=ABCD s=str f=1.50"));
 
-        // vsprintf using our VarArgs wrapper
+        // vsprintf with a va_list pointing to the variadic args
         long vbuf = malloc(64);
-        long vfmt = mir_get_string_ptr("p=%d q=%d");
-        long va = 0x1234; // any non-zero "address" for the wrapper map
-        mir_va_start(va, new Object[] { 5, 7 });
+        long vfmt = mir_get_string_ptr("p=%d q=%lu");
+        mir_write_long(area, 5);
+        mir_write_long(area + 8, -1);
+        long va = mir_allocate(8);
+        mir_write_long(va, area);
         int vn = vsprintf(vbuf, vfmt, va);
+        mir_set_stack_position(saved);
         check("vsprintf length>0", vn > 0);
         String vout = getStringFromMemory(vbuf);
-        check("vsprintf content", vout.equals("p=5 q=7"));
+        check("vsprintf content", vout.equals("p=5 q=18446744073709551615"));
     }
 
     public void testWriteRead() {
@@ -880,10 +1353,33 @@ public class RuntimeTest extends Runtime {
         testEndianAndPrimitives();
         testUnsigned32();
         testFloatDouble();
+        testMemoryAccessors();
+        testLoadData();
+        testStack();
+        testSetjmp();
+        try {
+            testInstances();
+        } catch (InterruptedException e) {
+            check("Instances: interrupted", false);
+        }
+        testFunctionHandles();
+        testAtomics();
+        testThreads();
+        testThreadExit();
         testSetDataFamily();
         testCStringAndInterning();
         testStdlibBasics();
-        //testSprintfVariants();
+        testStringIntrinsics();
+        testMalloc();
+        testPagedMemory();
+        testSysio();
+        try {
+            testMmap();
+        } catch (IOException e) {
+            check("mmap: temporary file", false);
+        }
+        testSockets();
+        testSprintfVariants();
         testWriteRead();
 
         long startTime = System.currentTimeMillis();
@@ -939,7 +1435,7 @@ public class RuntimeTest extends Runtime {
     }
 
     public static void main(String[] args) {
-        RuntimeTest test = new RuntimeTest(5000000);
+        RuntimeTest test = new RuntimeTest(1 << 20, 4 << 20);
         test.testAll();
 
     }
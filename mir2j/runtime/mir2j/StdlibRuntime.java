@@ -1,11 +1,36 @@
 package mir2j;
 
+import java.io.Closeable;
 import java.io.FileNotFoundException;
 import java.io.IOException;
 import java.io.OutputStream;
 import java.io.RandomAccessFile;
+import java.net.BindException;
+import java.net.ConnectException;
+import java.net.Inet4Address;
+import java.net.InetAddress;
+import java.net.InetSocketAddress;
+import java.net.SocketAddress;
+import java.net.StandardSocketOptions;
+import java.nio.ByteBuffer;
+import java.nio.MappedByteBuffer;
+import java.nio.channels.ClosedChannelException;
+import java.nio.channels.FileChannel;
+import java.nio.channels.NetworkChannel;
+import java.nio.channels.NonWritableChannelException;
+import java.nio.channels.Pipe;
+import java.nio.channels.ReadableByteChannel;
+import java.nio.channels.SelectableChannel;
+import java.nio.channels.SelectionKey;
+import java.nio.channels.Selector;
+import java.nio.channels.ServerSocketChannel;
+import java.nio.channels.SocketChannel;
+import java.nio.channels.WritableByteChannel;
+import java.util.Collections;
 import java.util.HashMap;
 import java.util.Map;
+import java.util.NavigableMap;
+import java.util.TreeMap;
 
 public class StdlibRuntime extends Runtime {
     
@@ -13,10 +38,9 @@ public class StdlibRuntime extends Runtime {
      * File and time 
      * =========================================================================*/
 
-    /* ===== File-descriptor table for stdio back-end ===== */
-    private final Map<Integer, RandomAccessFile> fdTable = new HashMap<>();
-    private final Map<Integer, Boolean> fdEof = new HashMap<>();
-    private int nextFd = 3; // 0,1,2 reserved (stdin, stdout, stderr)
+    /* ===== File-descriptor table for stdio back-end, shared by the threads: RandomAccessFiles and ChannelFds ===== */
+    private final Map<Integer, Closeable> fdTable = Collections.synchronizedMap(new HashMap<>());
+    private final Map<Integer, Boolean> fdEof = Collections.synchronizedMap(new HashMap<>());
 
     public static final int FD_STDIN = 0;
     public static final int FD_STDOUT = 1;
@@ -27,21 +51,63 @@ public class StdlibRuntime extends Runtime {
     private static final int EBADF = 9;
     private static final int EINVAL = 22;
     private static final int EIO = 5;
+    private static final int ENOMEM = 12;
+    private static final int EACCES = 13;
+    private static final int EAGAIN = 11;
+    private static final int EPIPE = 32;
+    private static final int ENOTSOCK = 88;
+    private static final int ENOPROTOOPT = 92;
+    private static final int EPROTONOSUPPORT = 93;
+    private static final int EAFNOSUPPORT = 97;
+    private static final int EADDRINUSE = 98;
+    private static final int ECONNRESET = 104;
+    private static final int EISCONN = 106;
+    private static final int ENOTCONN = 107;
+    private static final int ECONNREFUSED = 111;
+    private static final int EALREADY = 114;
+    private static final int EINPROGRESS = 115;
 
     /* Helpers */
     private static boolean isStdStream(int fd) {
         return fd == FD_STDIN || fd == FD_STDOUT || fd == FD_STDERR;
     }
 
-    private int allocFd(RandomAccessFile raf) {
-        int fd = nextFd++;
-        fdTable.put(fd, raf);
-        fdEof.put(fd, Boolean.FALSE);
-        return fd;
+    /* Returns the lowest free fd, 0,1,2 are reserved (stdin, stdout, stderr) */
+    private int allocFd(Closeable file) {
+        synchronized (fdTable) {
+            int fd = 3;
+            while (fdTable.containsKey(fd))
+                fd++;
+            fdTable.put(fd, file);
+            fdEof.put(fd, Boolean.FALSE);
+            return fd;
+        }
     }
 
     private RandomAccessFile rafOrNull(int fd) {
-        return fdTable.get(fd);
+        Closeable file = fdTable.get(fd);
+        return file instanceof RandomAccessFile ? (RandomAccessFile) file : null;
+    }
+
+    /* Returns the errno matching an I/O exception */
+    private static int errnoOf(IOException e) {
+        if (e instanceof BindException)
+            return EADDRINUSE;
+        if (e instanceof ConnectException)
+            return ECONNREFUSED;
+        if (e instanceof ClosedChannelException)
+            return EBADF;
+        String message = String.valueOf(e.getMessage());
+        if (message.contains("Broken pipe"))
+            return EPIPE;
+        if (message.contains("reset"))
+            return ECONNRESET;
+        return EIO;
+    }
+
+    /** noreturn void mir_sys_exit(int status); ends the program once libc.c exit flushed its streams. */
+    public void mir_sys_exit(int status) {
+        throw new ExitException(status);
     }
 
     /* Read a C string from emulated memory (you already have getStringFromMemory) */
@@ -94,13 +160,13 @@ public class StdlibRuntime extends Runtime {
     public int mir_sysio_close_fd(int fd) {
         if (isStdStream(fd))
             return 0; // nothing to close for std streams
-        RandomAccessFile raf = rafOrNull(fd);
-        if (raf == null)
+        Closeable file = fdTable.get(fd);
+        if (file == null)
             return -EBADF;
         try {
             fdTable.remove(fd);
             fdEof.remove(fd);
-            raf.close();
+            file.close();
             return 0;
         } catch (IOException e) {
             return -EIO;
@@ -109,6 +175,8 @@ public class StdlibRuntime extends Runtime {
 
     /**
      * long mir_sysio_read(int fd, void* buffer, unsigned long count); returns bytes read >=0, 0 on EOF, or negative errno on error.
+     * Reads straight into the memory, at most up to the end of the page holding buffer. Also reads sockets and pipes, see
+     * readChannel.
      */
     public long mir_sysio_read(int fd, long bufferAddr, long count) {
         //System.out.println("mir_sysio_read fd=" + fd + " bufferAddr=0x" + Long.toHexString(bufferAddr) + " count=" + count);
@@ -117,31 +185,28 @@ public class StdlibRuntime extends Runtime {
         if (fd == FD_STDOUT || fd == FD_STDERR)
             return -EBADF; // not readable
         try {
-            if (count > Integer.MAX_VALUE)
-                count = Integer.MAX_VALUE;
-            byte[] tmp = new byte[(int) count];
+            byte[] block = block(bufferAddr);
+            int offset = blockOffset(bufferAddr);
+            int len = blockRun(bufferAddr, count);
 
+            int n;
             if (fd == FD_STDIN) {
-                // Simple stdin stub: read nothing (EOF). Improve if needed.
-                fdEof.put(fd, Boolean.TRUE);
-                return 0;
+                n = mir_stdin.read(block, offset, len);
+            } else {
+                Closeable file = fdTable.get(fd);
+                if (file instanceof ChannelFd)
+                    return readChannel((ChannelFd) file, block, offset, len);
+                if (!(file instanceof RandomAccessFile))
+                    return -EBADF;
+                n = ((RandomAccessFile) file).read(block, offset, len);
             }
-
-            RandomAccessFile raf = rafOrNull(fd);
-            if (raf == null)
-                return -EBADF;
-
-            int n = raf.read(tmp);
             if (n <= 0) { // EOF
                 fdEof.put(fd, Boolean.TRUE);
                 return 0;
             }
-            // write to emulated memory
-            for (int i = 0; i < n; i++)
-                mir_write_byte((int) (bufferAddr + i), tmp[i]); // memory[(int) (bufferAddr + i)] = tmp[i];
             return n;
         } catch (IOException e) {
-            return -EIO;
+            return -errnoOf(e);
         } catch (Throwable t) {
             return -EIO;
         }
@@ -149,33 +214,53 @@ public class StdlibRuntime extends Runtime {
 
     /**
      * long mir_sysio_write(int fd, const void* buffer, unsigned long count); returns bytes written >=0, or negative errno on error.
+     * Writes straight from the memory. The stdio buffers of libc.c call it when they flush (on newline for stdout, when full, or
+     * on fflush or exit), so stdout and stderr are flushed after each call. A non-blocking socket or pipe may take only a part
+     * of the bytes.
      */
     public long mir_sysio_write(int fd, long bufferAddr, long count) {
         if (count <= 0)
             return 0;
+        if (fd == FD_STDIN)
+            return -EBADF;
         try {
-            if (count > Integer.MAX_VALUE)
-                count = Integer.MAX_VALUE;
-            byte[] tmp = new byte[(int) count];
-            for (int i = 0; i < (int) count; i++)
-                tmp[i] = mir_read_byte((int) (bufferAddr + i)); // memory[(int) (bufferAddr + i)];
-
+            OutputStream os = null;
+            RandomAccessFile raf = null;
+            WritableByteChannel channel = null;
             if (fd == FD_STDOUT || fd == FD_STDERR) {
-                OutputStream os = (fd == FD_STDOUT) ? System.out : System.err;
-                os.write(tmp);
-                os.flush();
-                return count;
+                os = (fd == FD_STDOUT) ? mir_stdout : mir_stderr;
+            } else {
+                Closeable file = fdTable.get(fd);
+                if (file instanceof ChannelFd) {
+                    ChannelFd channelFd = (ChannelFd) file;
+                    if (!channelFd.connected() || !(channelFd.channel instanceof WritableByteChannel))
+                        return channelFd.socket ? -ENOTCONN : -EBADF;
+                    channel = (WritableByteChannel) channelFd.channel;
+                } else if (file instanceof RandomAccessFile) {
+                    raf = (RandomAccessFile) file;
+                } else {
+                    return -EBADF;
+                }
             }
-            if (fd == FD_STDIN)
-                return -EBADF;
-
-            RandomAccessFile raf = rafOrNull(fd);
-            if (raf == null)
-                return -EBADF;
-            raf.write(tmp);
+            for (long done = 0; done < count;) {
+                long addr = bufferAddr + done;
+                int len = blockRun(addr, count - done);
+                if (os != null) {
+                    os.write(block(addr), blockOffset(addr), len);
+                } else if (raf != null) {
+                    raf.write(block(addr), blockOffset(addr), len);
+                } else {
+                    int n = channel.write(ByteBuffer.wrap(block(addr), blockOffset(addr), len));
+                    if (n < len) // A non-blocking channel is full
+                        return done + n > 0 ? done + n : -EAGAIN;
+                }
+                done += len;
+            }
+            if (os != null)
+                os.flush();
             return count;
         } catch (IOException e) {
-            return -EIO;
+            return -errnoOf(e);
         } catch (Throwable t) {
             return -EIO;
         }
@@ -241,6 +326,642 @@ public class StdlibRuntime extends Runtime {
         }
     }
 
+    /* ===== Memory mapped files, see mir_sysio_mmap ===== */
+
+    private static final int PROT_WRITE = 2;
+    private static final int MAP_SHARED = 0x01;
+    private static final int MAP_ANONYMOUS = 0x20;
+    private static final int MS_SYNC = 4;
+    private static final int MAP_CHUNK_SIZE = 1 << 30;
+
+    /* A mapping of length bytes, with the mapped file chunks it is written back to (or null) */
+    private static final class Mapping {
+        final long length;
+        final MappedByteBuffer[] file;
+
+        Mapping(long length, MappedByteBuffer[] file) {
+            this.length = length;
+            this.file = file;
+        }
+    }
+
+    /* Mappings by address, shared by the threads */
+    private final NavigableMap<Long, Mapping> mappings = Collections.synchronizedNavigableMap(new TreeMap<>());
+
+    /**
+     * long mir_sysio_mmap(unsigned long length, int prot, int flags, int fd, long offset); returns the address of the mapping, or
+     * negative errno on error.
+     * The memory is made of Java arrays, which can't alias a MappedByteBuffer, and its accesses have no page fault to load
+     * pages lazily: the file region mapped by FileChannel.map is copied from the page cache into a heap block with bulk gets.
+     * Bytes past the end of the file read as 0. A MAP_SHARED and PROT_WRITE mapping keeps its MappedByteBuffers, which stay
+     * valid once the file is closed, to write the block back in msync and munmap.
+     */
+    public long mir_sysio_mmap(long length, int prot, int flags, int fd, long offset) {
+        if (length <= 0 || offset < 0)
+            return -EINVAL;
+        RandomAccessFile raf = null;
+        if ((flags & MAP_ANONYMOUS) == 0) {
+            raf = rafOrNull(fd);
+            if (raf == null)
+                return -EBADF;
+        }
+        long addr = malloc(length);
+        if (addr == 0)
+            return -ENOMEM;
+        try {
+            MappedByteBuffer[] file = new MappedByteBuffer[0];
+            long fileLength = 0;
+            boolean writeBack = false;
+            if (raf != null) {
+                FileChannel channel = raf.getChannel();
+                fileLength = Math.max(0, Math.min(length, channel.size() - offset));
+                writeBack = (flags & MAP_SHARED) != 0 && (prot & PROT_WRITE) != 0;
+                file = new MappedByteBuffer[(int) ((fileLength + MAP_CHUNK_SIZE - 1) / MAP_CHUNK_SIZE)];
+                for (int i = 0; i < file.length; i++) {
+                    long position = (long) i * MAP_CHUNK_SIZE;
+                    file[i] = channel.map(writeBack ? FileChannel.MapMode.READ_WRITE : FileChannel.MapMode.READ_ONLY,
+                            offset + position, Math.min(MAP_CHUNK_SIZE, fileLength - position));
+                    transfer(file[i], addr + position, true);
+                }
+            }
+            mir_fill_memory(addr + fileLength, length - fileLength, (byte) 0);
+            mappings.put(addr, new Mapping(length, writeBack ? file : null));
+            return addr;
+        } catch (NonWritableChannelException e) {
+            free(addr);
+            return -EACCES;
+        } catch (IOException e) {
+            free(addr);
+            return -EIO;
+        }
+    }
+
+    /* Copies a mapped file chunk to the memory at addr, or the memory back to the chunk */
+    private void transfer(MappedByteBuffer chunk, long addr, boolean load) {
+        ByteBuffer buffer = chunk.duplicate();
+        for (int done = 0; done < buffer.capacity();) {
+            int len = blockRun(addr + done, buffer.capacity() - done);
+            buffer.position(done);
+            if (load)
+                buffer.get(block(addr + done), blockOffset(addr + done), len);
+            else
+                buffer.put(block(addr + done), blockOffset(addr + done), len);
+            done += len;
+        }
+    }
+
+    /* Writes a shared writable mapping back to its file */
+    private void writeBack(long addr, Mapping mapping, boolean force) {
+        if (mapping.file == null)
+            return;
+        for (int i = 0; i < mapping.file.length; i++) {
+            transfer(mapping.file[i], addr + (long) i * MAP_CHUNK_SIZE, false);
+            if (force)
+                mapping.file[i].force();
+        }
+    }
+
+    /** int mir_sysio_munmap(void *addr, unsigned long length); returns 0 on success, negative errno on error. */
+    public int mir_sysio_munmap(long addr, long length) {
+        Mapping mapping = mappings.remove(addr);
+        if (mapping == null)
+            return -EINVAL; // Only whole mappings are unmapped
+        try {
+            writeBack(addr, mapping, false);
+            return 0;
+        } catch (Throwable t) {
+            return -EIO;
+        } finally {
+            free(addr);
+        }
+    }
+
+    /**
+     * int mir_sysio_msync(void *addr, unsigned long length, int flags); returns 0 on success, negative errno on error.
+     * Writes back the whole mapping holding addr.
+     */
+    public int mir_sysio_msync(long addr, long length, int flags) {
+        Map.Entry<Long, Mapping> entry = mappings.floorEntry(addr);
+        if (entry == null || addr + length > entry.getKey() + entry.getValue().length)
+            return -ENOMEM;
+        try {
+            writeBack(entry.getKey(), entry.getValue(), (flags & MS_SYNC) != 0);
+            return 0;
+        } catch (Throwable t) {
+            return -EIO;
+        }
+    }
+
+    /* ===== Sockets, pipes and poll ===== */
+
+    private static final int AF_INET = 2;
+    private static final int SOCK_STREAM = 1;
+    private static final int SOCK_NONBLOCK = 04000;
+    private static final int SOL_SOCKET = 1;
+    private static final int SO_REUSEADDR = 2;
+    private static final int SO_TYPE = 3;
+    private static final int SO_ERROR = 4;
+    private static final int SO_KEEPALIVE = 9;
+    private static final int SOMAXCONN = 128;
+    private static final int IPPROTO_TCP = 6;
+    private static final int TCP_NODELAY = 1;
+    private static final int SHUT_RD = 0;
+    private static final int SHUT_WR = 1;
+    private static final int SHUT_RDWR = 2;
+    private static final int SOCKADDR_IN_SIZE = 16;
+    private static final int O_RDWR = 2;
+    private static final int O_NONBLOCK = 04000;
+    private static final int F_GETFD = 1;
+    private static final int F_SETFD = 2;
+    private static final int F_GETFL = 3;
+    private static final int F_SETFL = 4;
+    private static final int POLLIN = 0x001;
+    private static final int POLLOUT = 0x004;
+    private static final int POLLERR = 0x008;
+    private static final int POLLHUP = 0x010;
+    private static final int POLLNVAL = 0x020;
+    private static final int STDIN_POLL_MILLIS = 10;
+
+    /*
+     * An fd backed by a NIO channel: one end of a pipe, or a TCP socket, whose
+     * channel is null until bind (a ServerSocketChannel, bound and listening) or
+     * connect (a SocketChannel). Reads and writes wrap the memory arrays in
+     * ByteBuffers, poll registers the channels with a Selector.
+     */
+    private static final class ChannelFd implements Closeable {
+        final boolean socket;
+        SelectableChannel channel;
+        boolean nonBlocking;
+        boolean reuseAddress;
+        boolean keepAlive;
+        boolean noDelay;
+        int error; // SO_ERROR, set when a non-blocking connect fails
+
+        ChannelFd(boolean socket, SelectableChannel channel) {
+            this.socket = socket;
+            this.channel = channel;
+        }
+
+        /* Sets the channel of a socket, with its blocking mode and options */
+        void setChannel(SelectableChannel channel) throws IOException {
+            this.channel = channel;
+            channel.configureBlocking(!nonBlocking);
+            applyOptions();
+        }
+
+        void applyOptions() throws IOException {
+            if (channel instanceof ServerSocketChannel) {
+                ((ServerSocketChannel) channel).setOption(StandardSocketOptions.SO_REUSEADDR, reuseAddress);
+            } else if (channel instanceof SocketChannel) {
+                SocketChannel socketChannel = (SocketChannel) channel;
+                socketChannel.setOption(StandardSocketOptions.SO_REUSEADDR, reuseAddress);
+                socketChannel.setOption(StandardSocketOptions.SO_KEEPALIVE, keepAlive);
+                socketChannel.setOption(StandardSocketOptions.TCP_NODELAY, noDelay);
+            }
+        }
+
+        /* Whether data can flow: a pipe, or a connected socket */
+        boolean connected() {
+            return channel instanceof SocketChannel ? ((SocketChannel) channel).isConnected() : !socket;
+        }
+
+        @Override
+        public void close() throws IOException {
+            if (channel != null)
+                channel.close();
+        }
+    }
+
+    private ChannelFd socketOrNull(int fd) {
+        Closeable file = fdTable.get(fd);
+        return file instanceof ChannelFd && ((ChannelFd) file).socket ? (ChannelFd) file : null;
+    }
+
+    /* The errno of a socket function given an fd which isn't a socket */
+    private int notSocketError(int fd) {
+        return isStdStream(fd) || fdTable.containsKey(fd) ? ENOTSOCK : EBADF;
+    }
+
+    /* Reads into block[offset, offset + len) from a channel, returns -EAGAIN when a non-blocking one has no data */
+    private static long readChannel(ChannelFd file, byte[] block, int offset, int len) throws IOException {
+        if (!file.connected() || !(file.channel instanceof ReadableByteChannel))
+            return file.socket ? -ENOTCONN : -EBADF;
+        int n = ((ReadableByteChannel) file.channel).read(ByteBuffer.wrap(block, offset, len));
+        return n < 0 ? 0 : n == 0 ? -EAGAIN : n;
+    }
+
+    /* Reads a struct sockaddr_in, or returns null if it isn't one */
+    private InetSocketAddress readSockaddr(long addr, long length) throws IOException {
+        if (addr == 0 || length < SOCKADDR_IN_SIZE || mir_read_ushort(addr) != AF_INET)
+            return null;
+        int port = (mir_read_ubyte(addr + 2) << 8) | mir_read_ubyte(addr + 3);
+        byte[] ip = new byte[4];
+        for (int i = 0; i < 4; i++)
+            ip[i] = mir_read_byte(addr + 4 + i);
+        return new InetSocketAddress(InetAddress.getByAddress(ip), port);
+    }
+
+    /* Writes a struct sockaddr_in at addr, truncated to the length at lengthAddr, which gets its size */
+    private void writeSockaddr(long addr, long lengthAddr, SocketAddress address) {
+        byte[] sockaddr = new byte[SOCKADDR_IN_SIZE];
+        sockaddr[0] = AF_INET;
+        if (address instanceof InetSocketAddress) {
+            InetSocketAddress inet = (InetSocketAddress) address;
+            sockaddr[2] = (byte) (inet.getPort() >>> 8);
+            sockaddr[3] = (byte) inet.getPort();
+            if (inet.getAddress() instanceof Inet4Address) // Else the IPv6 wildcard of a dual-stack channel: INADDR_ANY
+                System.arraycopy(inet.getAddress().getAddress(), 0, sockaddr, 4, 4);
+        }
+        int length = (int) Math.min(mir_read_int(lengthAddr) & 0xFFFFFFFFL, SOCKADDR_IN_SIZE);
+        for (int i = 0; i < length; i++)
+            mir_write_byte(addr + i, sockaddr[i]);
+        mir_write_int(lengthAddr, SOCKADDR_IN_SIZE);
+    }
+
+    /** int mir_sysio_socket(int domain, int type, int protocol); returns fd >= 0 on success, or negative errno on error. */
+    public int mir_sysio_socket(int domain, int type, int protocol) {
+        if (domain != AF_INET)
+            return -EAFNOSUPPORT;
+        if ((type & ~SOCK_NONBLOCK) != SOCK_STREAM || (protocol != 0 && protocol != IPPROTO_TCP))
+            return -EPROTONOSUPPORT;
+        ChannelFd socket = new ChannelFd(true, null);
+        socket.nonBlocking = (type & SOCK_NONBLOCK) != 0;
+        return allocFd(socket);
+    }
+
+    /**
+     * int mir_sysio_bind(int fd, const struct sockaddr *addr, socklen_t addrlen); returns 0 on success, or negative errno on error.
+     * Binds a listening ServerSocketChannel, so that errors show here and getsockname gives the port, connect replaces it.
+     */
+    public int mir_sysio_bind(int fd, long addr, long addrLength) {
+        ChannelFd socket = socketOrNull(fd);
+        if (socket == null)
+            return -notSocketError(fd);
+        if (socket.channel != null)
+            return -EINVAL;
+        try {
+            InetSocketAddress address = readSockaddr(addr, addrLength);
+            if (address == null)
+                return -EINVAL;
+            ServerSocketChannel server = ServerSocketChannel.open();
+            try {
+                socket.setChannel(server);
+                server.bind(address, SOMAXCONN);
+            } catch (IOException e) {
+                socket.channel = null;
+                server.close();
+                throw e;
+            }
+            return 0;
+        } catch (IOException e) {
+            return -errnoOf(e);
+        } catch (Throwable t) {
+            return -EIO;
+        }
+    }
+
+    /** int mir_sysio_listen(int fd, int backlog); returns 0 on success, or negative errno on error. The backlog is SOMAXCONN. */
+    public int mir_sysio_listen(int fd, int backlog) {
+        ChannelFd socket = socketOrNull(fd);
+        if (socket == null)
+            return -notSocketError(fd);
+        if (socket.channel == null) { // Bind to an ephemeral port
+            try {
+                ServerSocketChannel server = ServerSocketChannel.open();
+                socket.setChannel(server);
+                server.bind(new InetSocketAddress(0), SOMAXCONN);
+            } catch (IOException e) {
+                return -errnoOf(e);
+            }
+        }
+        return socket.channel instanceof ServerSocketChannel ? 0 : -EINVAL;
+    }
+
+    /**
+     * int mir_sysio_accept(int fd, struct sockaddr *addr, socklen_t *addrlen); returns the fd of the connection, or negative errno
+     * on error.
+     */
+    public int mir_sysio_accept(int fd, long addr, long addrLengthAddr) {
+        ChannelFd socket = socketOrNull(fd);
+        if (socket == null)
+            return -notSocketError(fd);
+        if (!(socket.channel instanceof ServerSocketChannel))
+            return -EINVAL;
+        try {
+            SocketChannel channel = ((ServerSocketChannel) socket.channel).accept();
+            if (channel == null)
+                return -EAGAIN;
+            ChannelFd connection = new ChannelFd(true, null);
+            connection.setChannel(channel);
+            if (addr != 0)
+                writeSockaddr(addr, addrLengthAddr, channel.getRemoteAddress());
+            return allocFd(connection);
+        } catch (IOException e) {
+            return -errnoOf(e);
+        } catch (Throwable t) {
+            return -EIO;
+        }
+    }
+
+    /**
+     * int mir_sysio_connect(int fd, const struct sockaddr *addr, socklen_t addrlen); returns 0 on success, or negative errno on
+     * error, -EINPROGRESS for a non-blocking socket (poll for POLLOUT then read SO_ERROR).
+     */
+    public int mir_sysio_connect(int fd, long addr, long addrLength) {
+        ChannelFd socket = socketOrNull(fd);
+        if (socket == null)
+            return -notSocketError(fd);
+        if (socket.channel instanceof SocketChannel)
+            return ((SocketChannel) socket.channel).isConnected() ? -EISCONN : -EALREADY;
+        try {
+            InetSocketAddress address = readSockaddr(addr, addrLength);
+            if (address == null)
+                return -EINVAL;
+            SocketAddress local = null;
+            if (socket.channel != null) { // Bound: connect from the address of the server channel
+                local = ((NetworkChannel) socket.channel).getLocalAddress();
+                socket.channel.close();
+                socket.channel = null;
+            }
+            SocketChannel channel = SocketChannel.open();
+            try {
+                socket.setChannel(channel);
+                if (local != null)
+                    channel.bind(local);
+                return channel.connect(address) ? 0 : -EINPROGRESS;
+            } catch (IOException e) {
+                socket.channel = null;
+                channel.close();
+                throw e;
+            }
+        } catch (IOException e) {
+            return -errnoOf(e);
+        } catch (Throwable t) {
+            return -EIO;
+        }
+    }
+
+    /**
+     * int mir_sysio_getsockname(int fd, struct sockaddr *addr, socklen_t *addrlen, int peer); returns 0 on success, or negative
+     * errno on error. Gives the local address, or the remote one if peer (getpeername).
+     */
+    public int mir_sysio_getsockname(int fd, long addr, long addrLengthAddr, int peer) {
+        ChannelFd socket = socketOrNull(fd);
+        if (socket == null)
+            return -notSocketError(fd);
+        try {
+            SocketAddress address;
+            if (peer != 0) {
+                if (!socket.connected())
+                    return -ENOTCONN;
+                address = ((SocketChannel) socket.channel).getRemoteAddress();
+            } else {
+                address = socket.channel != null ? ((NetworkChannel) socket.channel).getLocalAddress() : null;
+            }
+            writeSockaddr(addr, addrLengthAddr, address);
+            return 0;
+        } catch (IOException e) {
+            return -errnoOf(e);
+        }
+    }
+
+    /**
+     * int mir_sysio_setsockopt(int fd, int level, int name, const void *value, socklen_t length); returns 0 on success, or negative
+     * errno on error. SO_REUSEADDR, SO_KEEPALIVE and TCP_NODELAY are applied, other options are accepted and ignored.
+     */
+    public int mir_sysio_setsockopt(int fd, int level, int name, long valueAddr, long length) {
+        ChannelFd socket = socketOrNull(fd);
+        if (socket == null)
+            return -notSocketError(fd);
+        boolean value = length >= 4 && mir_read_int(valueAddr) != 0;
+        if (level == SOL_SOCKET && name == SO_REUSEADDR)
+            socket.reuseAddress = value;
+        else if (level == SOL_SOCKET && name == SO_KEEPALIVE)
+            socket.keepAlive = value;
+        else if (level == IPPROTO_TCP && name == TCP_NODELAY)
+            socket.noDelay = value;
+        else
+            return 0;
+        try {
+            if (socket.channel != null && socket.channel.isOpen())
+                socket.applyOptions();
+            return 0;
+        } catch (IOException e) {
+            return -errnoOf(e);
+        }
+    }
+
+    /**
+     * int mir_sysio_getsockopt(int fd, int level, int name, void *value, socklen_t *length); returns 0 on success, or negative
+     * errno on error.
+     */
+    public int mir_sysio_getsockopt(int fd, int level, int name, long valueAddr, long lengthAddr) {
+        ChannelFd socket = socketOrNull(fd);
+        if (socket == null)
+            return -notSocketError(fd);
+        int value;
+        if (level == SOL_SOCKET && name == SO_ERROR) {
+            value = socket.error;
+            socket.error = 0;
+        } else if (level == SOL_SOCKET && name == SO_TYPE) {
+            value = SOCK_STREAM;
+        } else if (level == SOL_SOCKET && name == SO_REUSEADDR) {
+            value = socket.reuseAddress ? 1 : 0;
+        } else if (level == SOL_SOCKET && name == SO_KEEPALIVE) {
+            value = socket.keepAlive ? 1 : 0;
+        } else if (level == IPPROTO_TCP && name == TCP_NODELAY) {
+            value = socket.noDelay ? 1 : 0;
+        } else {
+            return -ENOPROTOOPT;
+        }
+        if ((mir_read_int(lengthAddr) & 0xFFFFFFFFL) < 4)
+            return -EINVAL;
+        mir_write_int(valueAddr, value);
+        mir_write_int(lengthAddr, 4);
+        return 0;
+    }
+
+    /** int mir_sysio_shutdown(int fd, int how); returns 0 on success, or negative errno on error. */
+    public int mir_sysio_shutdown(int fd, int how) {
+        ChannelFd socket = socketOrNull(fd);
+        if (socket == null)
+            return -notSocketError(fd);
+        if (how != SHUT_RD && how != SHUT_WR && how != SHUT_RDWR)
+            return -EINVAL;
+        if (!socket.connected())
+            return -ENOTCONN;
+        try {
+            SocketChannel channel = (SocketChannel) socket.channel;
+            if (how != SHUT_WR)
+                channel.shutdownInput();
+            if (how != SHUT_RD)
+                channel.shutdownOutput();
+            return 0;
+        } catch (IOException e) {
+            return -errnoOf(e);
+        }
+    }
+
+    /** int mir_sysio_pipe(int *fds); returns 0 on success, or negative errno on error. fds gets the read and write ends. */
+    public int mir_sysio_pipe(long fdsAddr) {
+        try {
+            Pipe pipe = Pipe.open();
+            mir_write_int(fdsAddr, allocFd(new ChannelFd(false, pipe.source())));
+            mir_write_int(fdsAddr + 4, allocFd(new ChannelFd(false, pipe.sink())));
+            return 0;
+        } catch (IOException e) {
+            return -errnoOf(e);
+        }
+    }
+
+    /**
+     * int mir_sysio_fcntl(int fd, int cmd, int arg); returns the result of cmd, or negative errno on error. Only O_NONBLOCK of
+     * sockets and pipes can be changed.
+     */
+    public int mir_sysio_fcntl(int fd, int cmd, int arg) {
+        Closeable file = fdTable.get(fd);
+        if (file == null && !isStdStream(fd))
+            return -EBADF;
+        ChannelFd channelFd = file instanceof ChannelFd ? (ChannelFd) file : null;
+        if (cmd == F_GETFD || cmd == F_SETFD)
+            return 0;
+        if (cmd == F_GETFL)
+            return channelFd != null && channelFd.nonBlocking ? O_RDWR | O_NONBLOCK : O_RDWR;
+        if (cmd != F_SETFL)
+            return -EINVAL;
+        if (channelFd != null) {
+            channelFd.nonBlocking = (arg & O_NONBLOCK) != 0;
+            try {
+                if (channelFd.channel != null && channelFd.channel.isOpen())
+                    channelFd.channel.configureBlocking(!channelFd.nonBlocking);
+            } catch (IOException e) {
+                return -errnoOf(e);
+            }
+        }
+        return 0;
+    }
+
+    /**
+     * int mir_sysio_poll(struct pollfd *fds, unsigned long nfds, int timeout); returns the number of fds with events, or negative
+     * errno on error.
+     * The channels of sockets and pipes are registered with a Selector, in non-blocking mode while it waits. Files are always
+     * ready and stdin is ready when it has input available, which a Selector can't wait for: with stdin, the Selector waits at
+     * most STDIN_POLL_MILLIS at a time.
+     */
+    public int mir_sysio_poll(long fdsAddr, long nfds, int timeout) {
+        if (nfds < 0 || nfds > Integer.MAX_VALUE / 8)
+            return -EINVAL;
+        ChannelFd[] channels = new ChannelFd[(int) nfds];
+        long deadline = System.nanoTime() + timeout * 1000000L;
+        try {
+            // Closing the selector deregisters the channels, whose blocking mode can then be restored
+            try (Selector selector = Selector.open()) {
+                boolean stdin = false;
+                for (int i = 0; i < channels.length; i++) {
+                    long p = fdsAddr + 8L * i;
+                    int fd = mir_read_int(p);
+                    int events = mir_read_ushort(p + 4);
+                    Closeable file = fdTable.get(fd);
+                    if (fd == FD_STDIN && (events & POLLIN) != 0)
+                        stdin = true;
+                    if (file instanceof ChannelFd && ((ChannelFd) file).channel != null) {
+                        ChannelFd channelFd = (ChannelFd) file;
+                        channels[i] = channelFd;
+                        register(selector, channelFd.channel, events);
+                    }
+                }
+                selector.selectNow();
+                while (true) {
+                    int count = 0;
+                    for (int i = 0; i < channels.length; i++) {
+                        long p = fdsAddr + 8L * i;
+                        int revents = pollEvents(mir_read_int(p), mir_read_ushort(p + 4), channels[i], selector);
+                        mir_write_short(p + 6, revents);
+                        if (revents != 0)
+                            count++;
+                    }
+                    long remaining = (deadline - System.nanoTime()) / 1000000L;
+                    if (count > 0 || timeout == 0 || (timeout > 0 && remaining <= 0))
+                        return count;
+                    long wait = timeout < 0 ? 0 : remaining; // 0 waits until a channel is ready
+                    if (stdin)
+                        wait = wait == 0 ? STDIN_POLL_MILLIS : Math.min(wait, STDIN_POLL_MILLIS);
+                    selector.selectedKeys().clear();
+                    if (wait == 0)
+                        selector.select();
+                    else
+                        selector.select(wait);
+                }
+            } finally {
+                for (ChannelFd channelFd : channels) {
+                    if (channelFd != null && !channelFd.nonBlocking && channelFd.channel.isOpen())
+                        channelFd.channel.configureBlocking(true);
+                }
+            }
+        } catch (IOException e) {
+            return -errnoOf(e);
+        } catch (Throwable t) {
+            return -EIO;
+        }
+    }
+
+    /* Registers channel with selector for the operations matching poll events */
+    private static void register(Selector selector, SelectableChannel channel, int events) throws IOException {
+        int ops = 0;
+        if ((events & POLLIN) != 0)
+            ops |= SelectionKey.OP_READ | SelectionKey.OP_ACCEPT;
+        if ((events & POLLOUT) != 0)
+            ops |= channel instanceof SocketChannel && ((SocketChannel) channel).isConnectionPending() ? SelectionKey.OP_CONNECT
+                    : SelectionKey.OP_WRITE;
+        ops &= channel.validOps();
+        if (ops == 0 || !channel.isOpen())
+            return;
+        channel.configureBlocking(false);
+        SelectionKey key = channel.keyFor(selector);
+        if (key == null)
+            channel.register(selector, ops);
+        else
+            key.interestOps(key.interestOps() | ops);
+    }
+
+    /* Returns the revents of fd for events, a ready pending connection is completed here */
+    private int pollEvents(int fd, int events, ChannelFd channelFd, Selector selector) throws IOException {
+        if (fd < 0)
+            return 0;
+        Closeable file = fdTable.get(fd);
+        int revents;
+        if (channelFd != null) {
+            revents = channelFd.error != 0 ? POLLERR : channelFd.channel.isOpen() ? 0 : POLLHUP;
+            SelectionKey key = channelFd.channel.keyFor(selector);
+            if (key != null && key.isValid() && selector.selectedKeys().contains(key)) {
+                int ready = key.readyOps();
+                if ((ready & SelectionKey.OP_CONNECT) != 0) {
+                    try {
+                        ((SocketChannel) channelFd.channel).finishConnect();
+                    } catch (IOException e) {
+                        channelFd.error = errnoOf(e);
+                        revents |= POLLERR;
+                    }
+                }
+                if ((ready & (SelectionKey.OP_READ | SelectionKey.OP_ACCEPT)) != 0)
+                    revents |= POLLIN;
+                if ((ready & (SelectionKey.OP_WRITE | SelectionKey.OP_CONNECT)) != 0)
+                    revents |= POLLOUT;
+            }
+        } else if (file instanceof ChannelFd) { // A socket neither bound nor connected
+            revents = POLLOUT | POLLHUP;
+        } else if (fd == FD_STDIN) {
+            revents = mir_stdin.available() > 0 ? POLLIN : 0;
+        } else if (fd == FD_STDOUT || fd == FD_STDERR) {
+            revents = POLLOUT;
+        } else if (file != null) {
+            revents = POLLIN | POLLOUT;
+        } else {
+            return POLLNVAL;
+        }
+        return revents & (events | POLLERR | POLLHUP);
+    }
+
     /* clock_gettime backend: writes struct timespec { time_t sec; long nsec; } */
     public int mir_sysclock_gettime(int clk, long tsAddr) {
         // CLOCK_REALTIME approximated via currentTimeMillis. TODO: MONOTONIC via nanoTime